@@ -31,7 +31,15 @@ benchmark_refresh_quotes(BENCHMARK_H benchmark_handle,
 int
 benchmark_refresh_quotes2(BENCHMARK_H benchmark_handle, 
                           const char *symbolP, 
-                          float newValue);
+                          float newValue,
+                          QUOTE *quote_ret);
+
+int
+benchmark_refresh_quotes_list(BENCHMARK_H benchmark_handle, 
+                              int num_symbols,
+                              const char **symbol_list_P, 
+                              float newValue,
+                              QUOTE *quote_list_ret);
 
 int
 benchmark_view_stock(BENCHMARK_H benchmark_handle, 
@@ -42,6 +50,12 @@ benchmark_view_stock2(int num_symbols,
                       const char **symbol_list_P, 
                       BENCHMARK_H benchmark_handle);
 
+int
+benchmark_quote_list_get(BENCHMARK_H benchmark_handle, 
+                         int num_symbols,
+                         const char **symbol_list_P, 
+                         QUOTE *quote_list_ret);
+
 int
 benchmark_portfolios_stats_get(BENCHMARK_DBS *benchmarkP);
 
@@ -84,5 +98,21 @@ benchmark_stock_list_get(BENCHMARK_H benchmark_handle,
                          char ***stocks_list, 
                          int *num_stocks);
 
+int
+benchmark_xact_timeout_set(unsigned int timeout_us);
+
+int
+benchmark_snapshot_xacts_set(int xact_classes);
+
+int
+benchmark_xact_nosync_set(int nosync);
+
+int
+benchmark_log_flush(BENCHMARK_H benchmark_handle);
+
+int
+benchmark_mvcc_stats_get(BENCHMARK_H benchmark_handle,
+                         benchmark_mvcc_stats_t *stats_ret);
+
 
 #endif
@@ -48,6 +48,13 @@
 
 #define MAXLINE   1024
 
+/* How many quotes a cursor steps over with DB_NEXT to reach the next 
+ * requested one, before looking it up from the root instead */
+#define BENCHMARK_QUOTES_MAX_SKIP   (8)
+
+/* Portfolios re-keyed per txn by migrate_portfolio_database() */
+#define BENCHMARK_MIGRATE_CHUNK     (1000)
+
 #define PRIMARY_DB	0
 #define SECONDARY_DB	1
 
@@ -61,7 +68,7 @@
 #define QUOTESDB          "Quotes"
 #define QUOTES_HISTDB     "Quotes_Hist"
 #define PORTFOLIOSDB      "Portfolios"
-#define PORTFOLIOSSECDB   "PortfoliosSec"
+#define PORTFOLIOSSECDB   "PortfoliosSec"   /* Old layout only. See migrate_portfolio_database() */
 #define ACCOUNTSDB        "Accounts"
 #define CURRENCIESDB      "Currencies"
 #define PERSONALDB        "Personal"
@@ -90,6 +97,24 @@
 #define IS_PORTFOLIOS(_v)   (((_v) & PORTFOLIOS_FLAG) == PORTFOLIOS_FLAG)
 #define IS_ACCOUNTS(_v)     (((_v) & ACCOUNTS_FLAG) == ACCOUNTS_FLAG)
 
+/* Read-only xact classes that can run on a snapshot (MVCC) */
+#define BENCHMARK_SNAPSHOT_VIEW_STOCK      (0x1)
+#define BENCHMARK_SNAPSHOT_VIEW_PORTFOLIO  (0x2)
+#define BENCHMARK_SNAPSHOT_ALL             (BENCHMARK_SNAPSHOT_VIEW_STOCK | BENCHMARK_SNAPSHOT_VIEW_PORTFOLIO)
+
+/* What snapshots cost: versions of pages kept in the cache */
+typedef struct benchmark_mvcc_stats_t {
+  unsigned int num_snapshots;    /* Running snapshot xacts */
+  unsigned int max_snapshots;
+  unsigned int num_frozen;       /* Versions written out to make room */
+  unsigned int num_thawed;       /* Frozen versions read back */
+  unsigned int num_freed;        /* Versions no snapshot needs anymore */
+  unsigned int num_reused;       /* Obsolete versions reused for new ones */
+  unsigned int num_pages;        /* Pages in the cache */
+  unsigned int num_dirty_pages;
+  unsigned int num_evictions;
+} benchmark_mvcc_stats_t;
+
 typedef struct benchmark_xact_data_t {
   char      accountId[ID_SZ];
   int       symbolId;
@@ -119,9 +144,6 @@ typedef struct benchmark_dbs {
   DB  *currencies_dbp;
   DB  *personal_dbp;
 
-  /* secondary databases */
-  DB  *portfolios_sdbp;
-
   /* Some other useful information */
   const char *db_home_dir;
   const char *datafilesdir;
@@ -135,9 +157,6 @@ typedef struct benchmark_dbs {
   char *currencies_db_name;
   char *personal_db_name;
 
-  /* secondary databases */
-  char *portfolios_sdb_name;
-
   /* How many stores do we have in the system */
   int   number_stocks;
   char **stocks;
@@ -198,6 +217,14 @@ typedef struct portfolios {
   int       price_buy;
 } PORTFOLIOS;
 
+/* Portfolios are keyed on (account_id, symbol). The fields are 
+ * zero padded, so the holdings of an account are contiguous and
+ * sorted by symbol */
+typedef struct portfolios_key {
+  char      account_id[ID_SZ];
+  char      symbol[ID_SZ];
+} PORTFOLIOS_KEY;
+
 typedef struct account {
   char      account_id[ID_SZ];
   char      user_name[USR_SZ];
@@ -249,11 +276,15 @@ place_order(const char *account_id,
             float price, 
             int amount, 
             int force_apply, 
+            const QUOTE *current_quoteP,
             benchmark_xact_h  xactH,
             BENCHMARK_DBS *benchmarkP);
 
 int 
-update_stock(char *symbolP, float newValue, BENCHMARK_DBS *benchmarkP);
+update_stock(char *symbolP, float newValue, QUOTE *quote_ret, BENCHMARK_DBS *benchmarkP);
+
+int
+update_stock_xact(const char *symbolP, float newValue, benchmark_xact_h xactH, QUOTE *quote_ret, BENCHMARK_DBS *benchmarkP);
 
 int 
 sell_stocks(const char *account_id, 
@@ -261,6 +292,7 @@ sell_stocks(const char *account_id,
             float price, 
             int amount, 
             int force_apply, 
+            const QUOTE *current_quoteP,
             benchmark_xact_h  xactH,
             BENCHMARK_DBS *benchmarkP);
 
@@ -268,7 +300,10 @@ int
 show_stocks_records(char *symbolId, BENCHMARK_DBS *benchmarkP);
 
 int
-show_quote(char *symbolP, benchmark_xact_h xactH, BENCHMARK_DBS *benchmarkP);
+show_quote(char *symbolP, benchmark_xact_h xactH, QUOTE *quote_ret, BENCHMARK_DBS *benchmarkP);
+
+int
+get_quotes(int num_symbols, const char **symbol_list_P, QUOTE *quote_list_ret, DB_TXN *txnP, BENCHMARK_DBS *benchmarkP);
 
 int 
 show_currencies_records(BENCHMARK_DBS *my_benchmarkP);
@@ -276,6 +311,12 @@ show_currencies_records(BENCHMARK_DBS *my_benchmarkP);
 int
 show_one_portfolio(char *account_id, DB_TXN  *txn_inP, BENCHMARK_DBS *benchmarkP);
 
+void
+set_portfolio_key(PORTFOLIOS_KEY *keyP, const char *account_id, const char *symbol);
+
+int
+migrate_portfolio_database(BENCHMARK_DBS *benchmarkP);
+
 int
 show_personal_item(void *vBuf);
 
@@ -285,6 +326,9 @@ show_portfolio_item(void *vBuf, char **symbolIdPP);
 int 
 start_xact(benchmark_xact_h *xact_ret, const char *txn_name, BENCHMARK_DBS *benchmarkP);
 
+int 
+start_read_xact(benchmark_xact_h *xact_ret, const char *txn_name, int xact_class, BENCHMARK_DBS *benchmarkP);
+
 int 
 abort_xact(benchmark_xact_h xactH, BENCHMARK_DBS *benchmarkP);
 
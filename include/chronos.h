@@ -143,6 +143,10 @@ typedef struct timespec chronos_time_t;
 #define CHRONOS_TIME_ZERO(_time)		\
   ((_time).tv_sec == 0 && (_time).tv_nsec == 0)
 
+/* Whether _t1 is later than _t2 */
+#define CHRONOS_TIME_AFTER(_t1, _t2)		\
+  ((_t1).tv_sec > (_t2).tv_sec || ((_t1).tv_sec == (_t2).tv_sec && (_t1).tv_nsec > (_t2).tv_nsec))
+
 #define CHRONOS_TIME_NEGATIVE(_time)		\
   ((_time).tv_sec < 0 && (_time).tv_nsec < 0)
 
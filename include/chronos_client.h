@@ -12,6 +12,10 @@ typedef enum {
 
 typedef void *chronosConnHandle;
 
+/* Returned by chronosClientResponsePoll() when a
+ * complete response has not arrived yet */
+#define CHRONOS_CLIENT_NO_RESPONSE  2
+
 chronosEnv
 chronosClientEnvGet(chronosConnHandle connH);
 
@@ -30,13 +34,45 @@ chronosClientConnect(const char *serverAddress,
 int
 chronosClientDisconnect(chronosConnHandle connH);
 
+int
+chronosClientSocketGet(chronosConnHandle connH);
+
+int
+chronosClientWindowSet(int window, chronosConnHandle connH);
+
+int
+chronosClientWindowAvailable(chronosConnHandle connH);
+
 int
 chronosClientSendRequest(chronosRequest    requestH,
                          chronosConnHandle connH);
 
+int
+chronosClientSendBatch(chronosRequest    *requestsArr,
+                       int                numRequests,
+                       chronosConnHandle  connH);
+
 int
 chronosClientReceiveResponse(int *txn_rc_ret, 
                              chronosConnHandle connH, 
                              int (*isTimeToDieFp) (void));
 
+int
+chronosClientReceiveResponseId(int *txn_rc_ret, 
+                               unsigned int *request_id_ret,
+                               chronosConnHandle connH, 
+                               int (*isTimeToDieFp) (void));
+
+int
+chronosClientReceiveBatchResponse(int *txn_rc_arr, 
+                                  int *num_txns_ret,
+                                  unsigned int *request_id_ret,
+                                  chronosConnHandle connH, 
+                                  int (*isTimeToDieFp) (void));
+
+int
+chronosClientResponsePoll(int *txn_rc_ret, 
+                          unsigned int *request_id_ret,
+                          chronosConnHandle connH);
+
 #endif
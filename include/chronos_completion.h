@@ -0,0 +1,136 @@
+#ifndef _CHRONOS_COMPLETION_H_
+#define _CHRONOS_COMPLETION_H_
+
+#include <pthread.h>
+
+/*
+ * One-shot event through which a processing thread tells the 
+ * submitter of a txn that the txn is done, along with its rc. 
+ * The submitter either blocks in chronosCompletionWait(), or has
+ * notify_arg written to notify_fd (e.g. by a network thread).
+ */
+typedef struct chronosCompletion_t {
+  /* CHRONOS_COMPLETION_* bits. It is also the futex word */
+  volatile int  state;
+  int           rc;
+
+  int           notify_fd;
+  void         *notify_arg;
+} chronosCompletion_t;
+
+/*
+ * Multi-shot event for threads that sleep until some condition
+ * may have changed. A waiter calls chronosEventWaitPrepare(), checks
+ * its condition, and then either cancels or waits with the returned
+ * sequence number. A signal in between makes the wait return at once.
+ */
+typedef struct chronosEvent_t {
+  /* Bumped by every signal. It is also the futex word */
+  volatile int  seq;
+  volatile int  numWaiters;
+} chronosEvent_t;
+
+/*
+ * Admission gate. While closed, new txns wait until debt txns
+ * finish. Blocked submitters are let in in the order they arrived, 
+ * and newcomers queue behind them, so no submitter is starved.
+ * Entering and finishing txns are a single load while it is open.
+ */
+typedef struct chronosAdmissionWaiter_t {
+  /* Set once let in. It is also the futex word */
+  volatile int                     admitted;
+  struct chronosAdmissionWaiter_t *nextP;
+} chronosAdmissionWaiter_t;
+
+/*
+ * Threads that cannot block on the gate (e.g. network threads) ask
+ * to have notify_arg written to notify_fd the next time it opens
+ */
+typedef struct chronosAdmissionWatcher_t {
+  int                               notify_fd;
+  void                             *notify_arg;
+  int                               queued;
+  struct chronosAdmissionWatcher_t *nextP;
+} chronosAdmissionWatcher_t;
+
+typedef struct chronosAdmissionGate_t {
+  /* Txns that have to finish before new ones are let in */
+  volatile int              debt;
+  volatile int              numWaiters;
+  volatile int              numWatchers;
+
+  /* Protects the FIFO of waiters and the watchers */
+  pthread_mutex_t           mutex;
+  chronosAdmissionWaiter_t *headP;
+  chronosAdmissionWaiter_t *tailP;
+  chronosAdmissionWatcher_t *watchersP;
+} chronosAdmissionGate_t;
+
+int
+chronosCompletionInit(chronosCompletion_t *completionP, 
+                      int notify_fd, 
+                      void *notify_arg);
+
+int
+chronosCompletionSignal(chronosCompletion_t *completionP, 
+                        int rc);
+
+int
+chronosCompletionWait(chronosCompletion_t *completionP, 
+                      int *rc_ret);
+
+int
+chronosCompletionResultGet(const chronosCompletion_t *completionP);
+
+int
+chronosEventInit(chronosEvent_t *eventP);
+
+int
+chronosEventWaitPrepare(chronosEvent_t *eventP);
+
+int
+chronosEventWaitCancel(chronosEvent_t *eventP);
+
+int
+chronosEventWait(chronosEvent_t *eventP, 
+                 int seq, 
+                 int timeout_ms);
+
+int
+chronosEventSignal(chronosEvent_t *eventP, 
+                   int numWakeups);
+
+int
+chronosAdmissionGateInit(chronosAdmissionGate_t *gateP);
+
+int
+chronosAdmissionGateDestroy(chronosAdmissionGate_t *gateP);
+
+int
+chronosAdmissionGateSet(chronosAdmissionGate_t *gateP, 
+                        int debt);
+
+int
+chronosAdmissionGateTxnDone(chronosAdmissionGate_t *gateP);
+
+int
+chronosAdmissionGateEnter(chronosAdmissionGate_t *gateP, 
+                          int (*isTimeToDieFp) (void));
+
+int
+chronosAdmissionGateTryEnter(chronosAdmissionGate_t *gateP);
+
+int
+chronosAdmissionWatcherInit(chronosAdmissionWatcher_t *watcherP, 
+                            int notify_fd, 
+                            void *notify_arg);
+
+int
+chronosAdmissionGateWatch(chronosAdmissionGate_t *gateP, 
+                          chronosAdmissionWatcher_t *watcherP);
+
+int
+chronosAdmissionGateUnwatch(chronosAdmissionGate_t *gateP, 
+                            chronosAdmissionWatcher_t *watcherP);
+
+#endif
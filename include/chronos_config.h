@@ -44,9 +44,73 @@
  */
 #define CHRONOS_NUM_STOCK_UPDATES_PER_UPDATE_THREAD  30
 
+/* startup_server_2 schedules all the updates from a single
+ * thread, sleeping until the next one is due
+ */
+#define CHRONOS_NUM_UPDATE_SCHEDULER_THREADS    1
+
 /* Chronos server has two ready queues. The default size of them is 1024 */
 #define CHRONOS_READY_QUEUE_SIZE     (1024)
 
+/* The ready queues are protected by a mutex unless they are
+ * lock-free (-q 1, or built with -DCHRONOS_LOCK_FREE_QUEUE).
+ * A lock-free queue has no condition variables: a thread that finds
+ * it empty (or full) yields this many times and then sleeps, doubling
+ * the sleep each time up to the maximum.
+ */
+#ifdef CHRONOS_LOCK_FREE_QUEUE
+#define CHRONOS_LOCK_FREE_QUEUE_DEFAULT   1
+#else
+#define CHRONOS_LOCK_FREE_QUEUE_DEFAULT   0
+#endif
+#define CHRONOS_QUEUE_SPIN_COUNT          100
+#define CHRONOS_QUEUE_MIN_BACKOFF_US      1
+#define CHRONOS_QUEUE_MAX_BACKOFF_US      1000
+
+/* A thread waiting for its txn spins up to this many times
+ * before it sleeps. The actual count adapts to how often spinning
+ * pays off. 0 disables spinning.
+ */
+#define CHRONOS_COMPLETION_MAX_SPINS      1000
+
+/* Requests are decoded straight into buffers of this pool, and the
+ * ready queues only carry pointers to them. When the pool runs dry,
+ * buffers are allocated from the heap.
+ */
+#define CHRONOS_REQUEST_POOL_SIZE         (2 * CHRONOS_READY_QUEUE_SIZE)
+
+/* User txns go to a single ready queue by default. With more
+ * queues (-k), each core submits to its own queue and idle
+ * processing threads steal from the others. 
+ */
+#define CHRONOS_NUM_USER_QUEUES           1
+
+/* A processing thread takes up to this many queued txns of the
+ * same type at once (-B). Refreshes and VIEW_STOCK reads taken 
+ * together run under a single BDB transaction. 
+ */
+#define CHRONOS_PROCESS_BATCH_SIZE        1
+#define CHRONOS_PROCESS_BATCH_MAX         32
+
+/* How long a processing thread waits for a batch to fill
+ * once it has its first txn (-W) */
+#define CHRONOS_PROCESS_BATCH_MAX_WAIT_US 0
+
+/* An idle processing thread yields this many times 
+ * before it goes to sleep waiting for txns.
+ */
+#define CHRONOS_IDLE_SPIN_COUNT           10
+
+/* By default the user ready queue is FIFO. It can also run txns
+ * by earliest deadline or by least slack (-S 1 or -S 2).
+ */
+#define CHRONOS_QUEUE_DISCIPLINE_DEFAULT  0
+
+/* Weight of the last sample in the smoothed execution time of
+ * each txn type, which is used to compute the slack of a txn.
+ */
+#define CHRONOS_EXEC_TIME_WEIGHT          0.1
+
 /* The update period is initially set to 0.5 in Chronos
  */
 #define CHRONOS_INITIAL_VALIDITY_INTERVAL_MS  1000
@@ -92,4 +156,54 @@
 #define CHRONOS_MIN_DATA_ITEMS_PER_XACT   50
 #define CHRONOS_MAX_DATA_ITEMS_PER_XACT   100
 
+/* Each connection keeps a receive buffer of this size. It has
+ * to be able to hold at least one full request packet.
+ */
+#define CHRONOS_SOCKET_BUFFER_SIZE        (16 * 1024)
+
+/* By default every client connection gets its own handler thread.
+ * A positive number of network threads makes the server multiplex
+ * all connections over that many epoll loops instead.
+ */
+#define CHRONOS_NUM_NETWORK_THREADS       0
+
+/* Max number of requests a client connection can have in flight */
+#define CHRONOS_MAX_PIPELINE_DEPTH        32
+
+/* Max number of transactions carried by one batch request.
+ * A batch takes this many txn slots of a connection, so it cannot
+ * be larger than CHRONOS_MAX_PIPELINE_DEPTH.
+ */
+#define CHRONOS_MAX_BATCH_SIZE            16
+
+/* Max number of events a network thread handles per epoll_wait() */
+#define CHRONOS_NETWORK_MAX_EVENTS        64
+
+/* By default the client runs one thread per simulated user. A
+ * positive number of event loops drives all users from that many
+ * threads, so that thousands of users fit in one client process.
+ */
+#define CHRONOS_NUM_CLIENT_EVENT_LOOPS    0
+
+/* Size of each of the two rings of a shared memory connection.
+ * It must be a power of two.
+ */
+#define CHRONOS_SHM_RING_SIZE             (64 * 1024)
+
+/* Largest thread placement file accepted by -P @file */
+#define CHRONOS_PLACEMENT_FILE_MAX_SIZE   (4096)
+
+/* Read-only txns that run on a snapshot (-I): 1: VIEW_STOCK, 
+ * 2: VIEW_PORTFOLIO. By default they take read locks.
+ */
+#define CHRONOS_SNAPSHOT_XACTS_DEFAULT    0
+
+/* Microseconds the log flusher waits for more commits to share a 
+ * flush (-G). -1: no group commit, each update txn flushes the log.
+ */
+#define CHRONOS_GROUP_COMMIT_WINDOW_US    (-1)
+
+/* Pending commits that make the log flusher flush before the window ends (-g) */
+#define CHRONOS_GROUP_COMMIT_BATCH_SIZE   32
+
 #endif
@@ -0,0 +1,81 @@
+#ifndef _CHRONOS_GROUP_COMMIT_H_
+#define _CHRONOS_GROUP_COMMIT_H_
+
+#include <pthread.h>
+
+/*
+ * Group commit. Txns commit without flushing the log, and then wait
+ * in chronosGroupCommitWait() while a flusher thread makes the log
+ * durable for many of them at once. The flusher waits up to windowUS
+ * for batchSize commits to pile up before it flushes.
+ *
+ * Each waiter takes a ticket after its commit. A flush that started
+ * after a ticket was taken covers that commit, so the waiter is
+ * released once such a flush is done.
+ */
+typedef int (*chronosGroupCommitFlushFn)(void *argP);
+
+/* Counters since the previous chronosGroupCommitStatsGet() */
+typedef struct chronosGroupCommitStats_t {
+  int    numFlushes;
+  int    numCommits;
+  int    maxBatch;
+
+  /* Time the commits spent waiting for their flush */
+  double cumulativeWaitMS;
+  double maxWaitMS;
+} chronosGroupCommitStats_t;
+
+typedef struct chronosGroupCommit_t {
+  int                        windowUS;
+  int                        batchSize;
+
+  chronosGroupCommitFlushFn  flushFn;
+  void                      *flushArgP;
+
+  pthread_mutex_t            mutex;
+
+  /* The flusher waits here for commits, the committers for flushes */
+  pthread_cond_t             pendingCond;
+  pthread_cond_t             flushedCond;
+
+  /* Tickets taken so far, and the last one that is durable */
+  unsigned long long         commitSeq;
+  unsigned long long         flushedSeq;
+
+  int                        stop;
+  int                        flusherDone;
+
+  /* Set when a flush fails. No commit is known durable after that */
+  int                        broken;
+
+  chronosGroupCommitStats_t  stats;
+} chronosGroupCommit_t;
+
+int
+chronosGroupCommitInit(chronosGroupCommit_t *groupCommitP,
+                       int windowUS,
+                       int batchSize,
+                       chronosGroupCommitFlushFn flushFn,
+                       void *flushArgP);
+
+int
+chronosGroupCommitDestroy(chronosGroupCommit_t *groupCommitP);
+
+/* Start routine of the flusher thread. Its argument is the group commit */
+void *
+chronosGroupCommitFlusher(void *argP);
+
+/* Make the flusher flush what is pending and exit */
+int
+chronosGroupCommitStop(chronosGroupCommit_t *groupCommitP);
+
+/* Wait until the txns the caller committed so far are durable */
+int
+chronosGroupCommitWait(chronosGroupCommit_t *groupCommitP);
+
+int
+chronosGroupCommitStatsGet(chronosGroupCommit_t *groupCommitP,
+                           chronosGroupCommitStats_t *stats_ret);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _CHRONOS_HEAP_H_
+#define _CHRONOS_HEAP_H_
+
+/*
+ * Binary min-heap of (key, data) pairs. The smallest key is
+ * always at the top. Used as a timer heap (key is a time in ms)
+ * and as a priority queue. It is not thread safe.
+ */
+typedef struct chronosHeapEntry_t {
+  unsigned long long  key;
+  void               *data;
+} chronosHeapEntry_t;
+
+typedef struct chronosHeap_t {
+  int                 size;
+  int                 capacity;
+  chronosHeapEntry_t *entries;
+} chronosHeap_t;
+
+int
+chronosHeapInit(chronosHeap_t *heapP, int capacity);
+
+int
+chronosHeapDestroy(chronosHeap_t *heapP);
+
+int
+chronosHeapSize(const chronosHeap_t *heapP);
+
+int
+chronosHeapInsert(chronosHeap_t *heapP, unsigned long long key, void *data);
+
+int
+chronosHeapPeek(const chronosHeap_t *heapP, unsigned long long *key_ret, void **data_ret);
+
+int
+chronosHeapRemoveMin(chronosHeap_t *heapP, unsigned long long *key_ret, void **data_ret);
+
+#endif
@@ -8,12 +8,19 @@
 
 typedef struct chronosResponsePacket_t {
   chronosUserTransaction_t txn_type;
+
+  /* Id of the request this is the answer for */
+  unsigned int request_id;
   int rc;
 } chronosResponsePacket_t;
 
 typedef struct chronosRequestPacket_t {
   chronosUserTransaction_t txn_type;
 
+  /* Set by the client library. Responses can come back in
+   * a different order, this is how they are matched */
+  unsigned int request_id;
+
   /* A transaction can affect up to 100 symbols */
   int numItems;
   union {
@@ -25,6 +32,37 @@ typedef struct chronosRequestPacket_t {
 
 } chronosRequestPacket_t;
 
+/* Requests are not sent as a chronosRequestPacket_t. On the wire,
+ * a request is this header followed by exactly numItems entries of
+ * the struct that corresponds to txn_type.
+ */
+#define CHRONOS_PACKET_VERSION    2
+
+typedef struct chronosPacketHeader_t {
+  /* Total size of the encoded request, header included */
+  unsigned int    length;
+  unsigned short  version;
+  unsigned short  txn_type;
+  unsigned int    request_id;
+  int             numItems;
+} chronosPacketHeader_t;
+
+#define CHRONOS_REQUEST_MAX_ENCODED_SIZE \
+  (sizeof(chronosPacketHeader_t) + sizeof(((chronosRequestPacket_t *)0)->request_data))
+
+/* A batch carries several independent requests in one frame: a
+ * header with this txn_type and numItems set to the number of
+ * requests, followed by the encoded requests back to back.
+ *
+ * The answer is a chronosResponsePacket_t with the same txn_type and
+ * the number of requests in rc, followed by one int rc per request,
+ * in the order of the batch.
+ */
+#define CHRONOS_PACKET_TYPE_BATCH         0xBA7C
+
+/* A whole batch has to fit in a connection's receive buffer */
+#define CHRONOS_BATCH_MAX_ENCODED_SIZE    CHRONOS_SOCKET_BUFFER_SIZE
+
 typedef void *chronosRequest;
 typedef void *chronosResponse;
 
@@ -42,6 +80,51 @@ chronosRequestTypeGet(chronosRequest requestH);
 size_t
 chronosRequestSizeGet(chronosRequest requestH);
 
+unsigned int
+chronosRequestIdGet(chronosRequest requestH);
+
+int
+chronosRequestIdSet(unsigned int request_id, chronosRequest requestH);
+
+int
+chronosRequestEncode(chronosRequest requestH,
+                     void *bufP,
+                     size_t bufSize,
+                     size_t *encodedSizeP);
+
+int
+chronosRequestEncodedSizeFromHeader(const void *headerP);
+
+int
+chronosRequestDecode(const void *bufP,
+                     size_t bufSize,
+                     chronosRequestPacket_t *reqPacketP);
+
+int
+chronosRequestIsBatch(const void *headerP);
+
+int
+chronosRequestBatchEncode(chronosRequest *requestsArr,
+                          int numRequests,
+                          unsigned int request_id,
+                          void *bufP,
+                          size_t bufSize,
+                          size_t *encodedSizeP);
+
+int
+chronosRequestBatchDecode(const void *bufP,
+                          size_t bufSize,
+                          chronosRequestPacket_t **reqPacketsArr,
+                          int maxRequests,
+                          int *numRequestsP);
+
+int
+chronosResponseFrameSize(const chronosResponsePacket_t *responseP);
+
+int
+chronosRequestCopy(chronosRequestPacket_t *dstP,
+                   const chronosRequestPacket_t *srcP);
+
 chronosResponse
 chronosResponseAlloc();
 
@@ -56,4 +139,7 @@ chronosResponseTypeGet(chronosResponse responseH);
 
 int
 chronosResponseResultGet(chronosResponse responseH);
+
+unsigned int
+chronosResponseIdGet(chronosResponse responseH);
 #endif
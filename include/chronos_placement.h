@@ -0,0 +1,62 @@
+#ifndef _CHRONOS_PLACEMENT_H_
+#define _CHRONOS_PLACEMENT_H_
+
+#include <pthread.h>
+
+/*
+ * CPU placement of the server threads. Each class of thread can be
+ * restricted to a set of CPUs, and the processing threads can be kept
+ * on the NUMA node that holds the BDB cache.
+ *
+ * A placement spec is a list of entries separated by ';' or blanks:
+ *
+ *    listener=0;network=1-3;processing=4-31,36;update=32;sampling=32;numa
+ *
+ * "network" covers the network threads and the per-connection handler
+ * threads, and "numa" keeps the processing threads on the cache's node.
+ * A spec of the form @path is read from a file, where # starts a comment.
+ */
+typedef enum chronosPlacementClass_t {
+  CHRONOS_PLACEMENT_MIN = 0,
+  CHRONOS_PLACEMENT_LISTENER = CHRONOS_PLACEMENT_MIN,
+  CHRONOS_PLACEMENT_NETWORK,
+  CHRONOS_PLACEMENT_PROCESSING,
+  CHRONOS_PLACEMENT_UPDATE,
+  CHRONOS_PLACEMENT_SAMPLING,
+  CHRONOS_PLACEMENT_MAX
+} chronosPlacementClass_t;
+
+typedef struct chronosPlacement_t chronosPlacement_t;
+
+int
+chronosPlacementCreate(const char *spec, chronosPlacement_t **placementPP);
+
+int
+chronosPlacementDestroy(chronosPlacement_t *placementP);
+
+/* Keep the calling thread on its NUMA node while it creates the
+ * BDB cache, so that the cache is allocated there */
+int
+chronosPlacementCacheNodeBind(chronosPlacement_t *placementP);
+
+int
+chronosPlacementCacheNodeUnbind(chronosPlacement_t *placementP);
+
+int
+chronosPlacementAttrSet(const chronosPlacement_t *placementP,
+                        chronosPlacementClass_t placementClass,
+                        pthread_attr_t *attrP);
+
+/* Attributes for threads the caller does not create itself,
+ * e.g. timer threads. NULL if the class is not placed */
+pthread_attr_t *
+chronosPlacementAttrGet(chronosPlacement_t *placementP,
+                        chronosPlacementClass_t placementClass);
+
+int
+chronosPlacementReport(const chronosPlacement_t *placementP,
+                       chronosPlacementClass_t placementClass,
+                       const pthread_t *threadArr,
+                       int numThreads);
+
+#endif
@@ -3,25 +3,77 @@
 
 #include "chronos_server.h"
 
+/* Returned when a dequeue that does not wait finds no txn */
+#define CHRONOS_QUEUE_EMPTY   2
+
+int
+chronos_queue_init(int lockFree, int discipline, chronos_queue_t *txnQueueP);
+
+int
+chronos_queue_destroy(chronos_queue_t *txnQueueP);
+
+int
+chronos_queue_size(const chronos_queue_t *txnQueueP);
+
+int
+chronos_user_queues_init(int numQueues, chronosServerContext_t *contextP);
+
+int
+chronos_user_queues_destroy(chronosServerContext_t *contextP);
+
 int
-chronos_dequeue_system_transaction(void *requestP_ret, chronos_time_t *ts, chronosServerContext_t *contextP);
+chronos_user_queue_size(const chronosServerContext_t *contextP);
 
 int
-chronos_enqueue_system_transaction(void *requestP, const chronos_time_t *ts, chronosServerContext_t *contextP);
+chronos_queue_wait_for_work(chronosServerContext_t *contextP);
 
 int
-chronos_enqueue_user_transaction(void                 *requestP,
+chronos_dequeue_system_transaction(chronosRequestBuffer_t **requestBuf_ret, chronos_time_t *ts, chronosServerContext_t *contextP);
+
+int
+chronos_dequeue_system_transactions(chronosRequestBuffer_t **requestBuf_arr,
+                                    chronos_time_t          *ts_arr, 
+                                    int                      maxTxns,
+                                    int                     *numTxns_ret,
+                                    int                      maxWaitUS,
+                                    chronosServerContext_t  *contextP);
+
+int
+chronos_enqueue_system_transaction(chronosRequestBuffer_t *requestBufP, const chronos_time_t *ts, chronosServerContext_t *contextP);
+
+int
+chronos_enqueue_user_transaction(chronosRequestBuffer_t *requestBufP,
                                  const chronos_time_t *ts, 
                                  unsigned long long   *ticket_ret, 
-                                 volatile int         *txn_done,
-                                 volatile int         *txn_rc,
+                                 chronosCompletion_t  *completionP,
                                  chronosServerContext_t *contextP);
 
 int
-chronos_dequeue_user_transaction(void               *requestP_ret,
+chronos_enqueue_user_transaction_batch(chronosRequestBuffer_t **requestBufArr,
+                                       int                     numRequests,
+                                       const chronos_time_t   *ts, 
+                                       unsigned long long     *ticket_ret, 
+                                       chronosCompletion_t   **completion_arr,
+                                       chronosServerContext_t *contextP);
+
+int
+chronos_dequeue_user_transaction(chronosRequestBuffer_t **requestBuf_ret,
                                  chronos_time_t     *ts, 
+                                 chronos_time_t     *deadline_ret, 
                                  unsigned long long *ticket_ret,
-                                 volatile int       **txn_done_ret,
-                                 volatile int       **txn_rc_ret,
+                                 chronosCompletion_t **completion_ret,
+                                 int                 home_queue,
                                  chronosServerContext_t *contextP);
+
+int
+chronos_dequeue_user_transactions(chronosRequestBuffer_t **requestBuf_arr,
+                                  chronos_time_t     *ts_arr, 
+                                  chronos_time_t     *deadline_arr, 
+                                  unsigned long long *ticket_arr,
+                                  chronosCompletion_t **completion_arr,
+                                  int                 maxTxns,
+                                  int                *numTxns_ret,
+                                  int                 maxWaitUS,
+                                  int                 home_queue,
+                                  chronosServerContext_t *contextP);
 #endif
@@ -0,0 +1,48 @@
+#ifndef _CHRONOS_QUOTE_MIRROR_H_
+#define _CHRONOS_QUOTE_MIRROR_H_
+
+#include "benchmark.h"
+
+/*
+ * In-memory copy of the quotes, indexed by symbol id, so that
+ * VIEW_STOCK can be served without going to BDB. Refreshes publish
+ * the quote after their BDB commit.
+ *
+ * Each entry is guarded by a sequence counter: it is odd while the
+ * entry is being written. A reader copies the quote and retries if the
+ * counter was odd or changed meanwhile, so readers never block writers.
+ */
+typedef struct chronosQuoteMirrorEntry_t {
+  /* 0 until the entry is published for the first time */
+  volatile unsigned int seq;
+
+  QUOTE                 quote;
+} chronosQuoteMirrorEntry_t;
+
+typedef struct chronosQuoteMirror_t {
+  chronosQuoteMirrorEntry_t *entryArr;
+  int                        numEntries;
+
+  /* Number of reads that had to retry because of a writer */
+  volatile int               numReadRetries;
+} chronosQuoteMirror_t;
+
+int
+chronosQuoteMirrorInit(chronosQuoteMirror_t *mirrorP,
+                       int numEntries);
+
+int
+chronosQuoteMirrorDestroy(chronosQuoteMirror_t *mirrorP);
+
+int
+chronosQuoteMirrorPublish(chronosQuoteMirror_t *mirrorP,
+                          int index,
+                          const QUOTE *quoteP);
+
+/* Fails if the index is out of range or the entry was never published */
+int
+chronosQuoteMirrorRead(chronosQuoteMirror_t *mirrorP,
+                       int index,
+                       QUOTE *quote_ret);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _CHRONOS_REQUEST_POOL_H_
+#define _CHRONOS_REQUEST_POOL_H_
+
+#include "chronos_packets.h"
+
+struct chronosRequestPool_t;
+
+/*
+ * A request, as decoded from the wire. It is shared by reference 
+ * between the thread that received it and the processing thread 
+ * that runs it, and goes back to its pool with the last reference.
+ */
+typedef struct chronosRequestBuffer_t {
+  volatile int  refCount;
+
+  /* Position in the pool, -1 if it was allocated from the heap */
+  int           index;
+
+  /* Next free buffer in the pool, -1 for the last one */
+  int           next;
+
+  struct chronosRequestPool_t *poolP;
+
+  chronosRequestPacket_t request;
+} chronosRequestBuffer_t;
+
+typedef struct chronosRequestPool_t {
+  chronosRequestBuffer_t *bufferArr;
+  int                     numBuffers;
+
+  /* The low 32 bits are the index of the first free buffer plus one 
+   * (0 when there is none). The high bits are bumped by every change, 
+   * so that a stale head never matches the current one */
+  volatile unsigned long long freeHead;
+
+  /* Number of buffers that had to come from the heap */
+  volatile int            numOverflows;
+} chronosRequestPool_t;
+
+int
+chronosRequestPoolInit(chronosRequestPool_t *poolP,
+                       int numBuffers);
+
+int
+chronosRequestPoolDestroy(chronosRequestPool_t *poolP);
+
+chronosRequestBuffer_t *
+chronosRequestBufferAlloc(chronosRequestPool_t *poolP);
+
+int
+chronosRequestBufferRetain(chronosRequestBuffer_t *bufferP);
+
+int
+chronosRequestBufferRelease(chronosRequestBuffer_t *bufferP);
+
+#endif
@@ -8,6 +8,12 @@
 #include "chronos_config.h"
 #include "chronos_transactions.h"
 #include "chronos_packets.h"
+#include "chronos_heap.h"
+#include "chronos_completion.h"
+#include "chronos_request_pool.h"
+#include "chronos_placement.h"
+#include "chronos_quote_mirror.h"
+#include "chronos_group_commit.h"
 #include "benchmark.h"
 
 #define CHRONOS_SERVER_CTX_MAGIC      (0xBACA)
@@ -26,6 +32,11 @@
 #define IS_CHRONOS_MODE_AUP(_ctxt)    ((_ctxt)->runningMode == CHRONOS_MODE_AUP)
 #define IS_CHRONOS_MODE_FULL(_ctxt)   ((_ctxt)->runningMode == CHRONOS_MODE_FULL)
 
+/* Order in which txns leave a ready queue */
+#define CHRONOS_QUEUE_FIFO  (0)   /* First come, first served */
+#define CHRONOS_QUEUE_EDF   (1)   /* Earliest deadline first */
+#define CHRONOS_QUEUE_LSF   (2)   /* Least slack first */
+
 typedef enum chronosServerThreadState_t {
   CHRONOS_SERVER_THREAD_STATE_MIN = 0,
   CHRONOS_SERVER_THREAD_STATE_RUN = CHRONOS_SERVER_THREAD_STATE_MIN,
@@ -39,6 +50,7 @@ typedef enum chronosServerThreadType_t {
   CHRONOS_SERVER_THREAD_LISTENER = CHRONOS_SERVER_THREAD_MIN,
   CHRONOS_SERVER_THREAD_UPDATE,
   CHRONOS_SERVER_THREAD_PROCESSING,
+  CHRONOS_SERVER_THREAD_NETWORK,
   CHRONOS_SERVER_THREAD_MAX,
   CHRONOS_SERVER_THREAD_INVAL=CHRONOS_SERVER_THREAD_MAX
 } chronosServerThreadType_t;
@@ -57,6 +69,14 @@ typedef struct chronosServerStats_t
   int            num_failed_txns;
 
   int            num_timely_txns;
+
+  int            num_missed_deadlines;
+
+  /* Firm deadline mode: txns not run at all, and
+   * txns aborted once their deadline passed */
+  int            num_dropped_txns;
+
+  int            num_aborted_txns;
 } chronosServerStats_t;
 
 /* Information required for update transactions */
@@ -78,12 +98,28 @@ typedef struct
   chronos_time_t txn_start;
   chronos_time_t txn_enqueue;
   unsigned long long ticket;
-  volatile int *txn_done;
-  volatile int *txn_rc;
 
-  chronosRequestPacket_t  request;
+  /* Signaled once the txn is done. NULL for system txns */
+  chronosCompletion_t *completionP;
+
+  /* The txn should be done by this time */
+  chronos_time_t txn_deadline;
+
+  /* Unless the queue is FIFO, the txn with the
+   * lowest priority value leaves the queue first */
+  unsigned long long priority;
+
+  /* The request stays in its buffer. The queue holds
+   * one reference, which goes to whoever dequeues it */
+  chronosRequestBuffer_t *requestBufP;
+
+  /* Copy of the request's txn type, so that batched dequeues
+   * can look at a slot without touching its buffer */
+  int txn_type;
 } txn_info_t;
   
+#define CHRONOS_QUEUE_CACHE_LINE  64
+
 /* This is the structure of a ready queue in Chronos. 
  */
 typedef struct 
@@ -98,6 +134,28 @@ typedef struct
   pthread_cond_t more;
   pthread_cond_t less;
   pthread_cond_t ticketReady;
+
+  /* Unless the queue is FIFO, occupied slots are kept in
+   * a heap ordered by priority, and free slots in freeSlotArr */
+  int discipline;
+  chronosHeap_t heap;
+  int freeSlotArr[CHRONOS_READY_QUEUE_SIZE];
+  int numFreeSlots;
+
+  /* The fields below are only used by the lock-free version.
+   * Positions only grow. The slot of position p is free when its 
+   * sequence number is p, and holds a txn when it is p + 1. */
+  int lockFree;
+  volatile unsigned long long seqArr[CHRONOS_READY_QUEUE_SIZE];
+  char pad1[CHRONOS_QUEUE_CACHE_LINE];
+
+  /* Claimed by producers */
+  volatile unsigned long long enqueuePos;
+  char pad2[CHRONOS_QUEUE_CACHE_LINE - sizeof(unsigned long long)];
+
+  /* Claimed by consumers */
+  volatile unsigned long long dequeuePos;
+  char pad3[CHRONOS_QUEUE_CACHE_LINE - sizeof(unsigned long long)];
 } chronos_queue_t;
 
 
@@ -106,6 +164,9 @@ typedef struct chronosDataItem_t
   int      index;
   char    *dataItem;
 
+  /* Set while a refresh of this item is in the system queue */
+  volatile int refreshPending;
+
   unsigned long long nextUpdateTimeMS;
   volatile double accessFrequency[CHRONOS_SAMPLING_SPACE];
   volatile double updateFrequency[CHRONOS_SAMPLING_SPACE];
@@ -122,6 +183,9 @@ typedef struct chronosServerContext_t
 
   int serverPort;
 
+  /* Either an ip address or unix:/path */
+  char serverAddress[256];
+
   /* Whether an initial load is required or not */
   int initialLoad;
 
@@ -155,6 +219,56 @@ typedef struct chronosServerContext_t
    * and process them */
   int numServerThreads;
 
+  /* If > 0, client connections are served by this
+   * many epoll threads instead of one thread each */
+  int numNetworkThreads;
+
+  /* Whether each network thread gets its own
+   * listening socket through SO_REUSEPORT */
+  int reusePort;
+
+  /* Whether the ready queues are lock-free rings
+   * instead of being protected by a mutex */
+  int lockFreeQueues;
+
+  /* Order in which user txns are run: CHRONOS_QUEUE_FIFO,
+   * CHRONOS_QUEUE_EDF or CHRONOS_QUEUE_LSF. With several
+   * user queues, the order holds within each of them */
+  int queueDiscipline;
+
+  /* How many user queues to use. 0 means one per core */
+  int numUserQueuesRequested;
+
+  /* How many queued txns a processing thread takes at once,
+   * and how long it waits for them */
+  int processBatchSize;
+  int processBatchMaxWaitUS;
+
+  /* Firm deadlines: a user txn that cannot meet its deadline is 
+   * not run, and one that is still running at its deadline is aborted */
+  int firmDeadlines;
+
+  /* CPUs each class of thread runs on. NULL if not given */
+  chronosPlacement_t *placementP;
+
+  /* Serve VIEW_STOCK from an in-memory copy of the 
+   * quotes, instead of reading them from BDB */
+  int quoteMirrorEnabled;
+  chronosQuoteMirror_t quoteMirror;
+
+  /* Read-only txn classes that run on a snapshot (BENCHMARK_SNAPSHOT_*) */
+  int snapshotXacts;
+
+  /* Update txns commit without flushing the log, and a flusher 
+   * thread makes them durable in groups. Off if the window is < 0 */
+  int groupCommitWindowUS;
+  int groupCommitBatchSize;
+  chronosGroupCommit_t groupCommit;
+  pthread_t groupCommitThread;
+
+  /* Smoothed execution time of each type of user txn */
+  volatile double txnExecTimeMSArr[CHRONOS_USER_TXN_MAX];
+
   /* These two variables are used to wait till 
    * all client threads are initialized, so that
    * we can have a fair experiment*/
@@ -178,6 +292,22 @@ typedef struct chronosServerContext_t
   chronos_queue_t userTxnQueue;
   chronos_queue_t sysTxnQueue;
 
+  /* User txns are spread over these queues. With a single
+   * queue, this points to userTxnQueue */
+  chronos_queue_t *userTxnQueuesArr;
+  int             numUserTxnQueues;
+
+  /* Buffers for the requests waiting in the queues */
+  chronosRequestPool_t requestPool;
+
+  /* Signaled whenever txns are put in either queue, 
+   * so that idle processing threads can sleep */
+  chronosEvent_t  workAvailable;
+
+  /* Admission control: closed by the sampling task when the server
+   * is overloaded, opened again as txns finish */
+  chronosAdmissionGate_t admissionGate;
+
   /*============ These fields control the sampling task ==========*/
   volatile int          currentSlot;
   chronosServerStats_t  stats_matrix[CHRONOS_SAMPLING_SPACE][CHRONOS_MAX_NUM_SERVER_THREADS];
@@ -185,9 +315,12 @@ typedef struct chronosServerContext_t
   double                degree_timing_violation;
   double                smoth_degree_timing_violation;
   double                alpha;
-  volatile int          num_txn_to_wait;
+  volatile int          num_txn_to_wait;   /* startup_server_2 uses admissionGate */
   int                   total_txns_enqueued;
 
+  /* Refreshes merged into one that was already queued */
+  volatile int          numCoalescedRefreshes;
+
   chronosDataItem_t    *dataItemsArray;
   int                   szDataItemsArray;
 
@@ -211,6 +344,18 @@ typedef struct chronosUpdateThreadInfo_t {
   chronosDataItem_t    *dataItemsArray;      /* Pointer to the array that contains the stocks managed by this thread */
 } chronosUpdateThreadInfo_t;
 
+typedef struct chronosNetworkThreadInfo_t {
+  int    listen_fd;        /* Socket where this thread accepts new connections */
+  int    notify_fd;        /* Processing threads report finished txns here */
+  int    notify_read_fd;   /* The end of the pipe the network thread reads */
+
+  /* Has the admission gate write to notify_fd when it opens */
+  chronosAdmissionWatcher_t gateWatcher;
+
+  /* Connections left with queued txns when the thread exited */
+  struct chronosServerConnection_t *orphanListP;
+} chronosNetworkThreadInfo_t;
+
 typedef struct chronosServerThreadInfo_t {
   int       magic;
   pthread_t thread_id;
@@ -225,6 +370,7 @@ typedef struct chronosServerThreadInfo_t {
   /* These are fields specific to each thread type */
   union {
     chronosUpdateThreadInfo_t updateParameters;
+    chronosNetworkThreadInfo_t networkParameters;
   } parameters;
 } chronosServerThreadInfo_t;
 
@@ -0,0 +1,102 @@
+#ifndef _CHRONOS_SHM_H_
+#define _CHRONOS_SHM_H_
+
+#include "chronos_config.h"
+
+/* Returned by chronosShmRecv() when the peer closed
+ * the connection and there is nothing left to read.
+ */
+#define CHRONOS_SHM_CLOSED      2
+
+/* Returned by chronosShmAcceptTry() when the client 
+ * did not send its region yet.
+ */
+#define CHRONOS_SHM_AGAIN       3
+
+#define CHRONOS_SHM_CACHE_LINE  64
+
+/*
+ * Single producer, single consumer byte ring. The same framed
+ * packets that go over a socket are written here. head and tail
+ * only grow; they are reduced modulo the ring size on access.
+ */
+typedef struct chronosShmRing_t {
+  /* Written by the consumer */
+  volatile unsigned int head;
+
+  /* The consumer is about to wait on its event fd */
+  volatile int          consumerWaiting;
+  char                  pad1[CHRONOS_SHM_CACHE_LINE - 2 * sizeof(int)];
+
+  /* Written by the producer */
+  volatile unsigned int tail;
+
+  /* The producer will not write anymore */
+  volatile int          closed;
+  char                  pad2[CHRONOS_SHM_CACHE_LINE - 2 * sizeof(int)];
+
+  char                  data[CHRONOS_SHM_RING_SIZE];
+} chronosShmRing_t;
+
+/*
+ * The region shared by a client and the server. The client is the
+ * producer of the request ring and the server of the response ring.
+ */
+typedef struct chronosShmRegion_t {
+  unsigned int          magic;
+  char                  pad[CHRONOS_SHM_CACHE_LINE - sizeof(int)];
+  chronosShmRing_t      requestRing;
+  chronosShmRing_t      responseRing;
+} chronosShmRegion_t;
+
+/*
+ * One side's view of a shared memory connection. Each side sleeps
+ * on the event fd of the ring it reads from and kicks the event fd 
+ * of the ring it writes to.
+ */
+typedef struct chronosShmConnection_t {
+  chronosShmRegion_t   *regionP;
+  int                   mem_fd;
+
+  chronosShmRing_t     *recvRingP;
+  int                   recv_event_fd;
+
+  chronosShmRing_t     *sendRingP;
+  int                   send_event_fd;
+} chronosShmConnection_t;
+
+int
+chronosShmConnect(int socket_fd, 
+                  chronosShmConnection_t *shmP);
+
+int
+chronosShmAcceptTry(int socket_fd, 
+                    chronosShmConnection_t *shmP);
+
+int
+chronosShmAccept(int socket_fd, 
+                 chronosShmConnection_t *shmP,
+                 int (*isTimeToDieFp) (void));
+
+int
+chronosShmClose(chronosShmConnection_t *shmP);
+
+int
+chronosShmRecv(chronosShmConnection_t *shmP,
+               void *dstP,
+               int maxLen,
+               int *num_bytes_ret);
+
+int
+chronosShmSend(chronosShmConnection_t *shmP,
+               const void *bufP,
+               int len,
+               int *num_bytes_ret);
+
+int
+chronosShmSendAll(chronosShmConnection_t *shmP,
+                  const void *bufP,
+                  int len,
+                  int (*isTimeToDieFp) (void));
+
+#endif
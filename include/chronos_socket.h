@@ -0,0 +1,119 @@
+#ifndef _CHRONOS_SOCKET_H_
+#define _CHRONOS_SOCKET_H_
+
+#include <sys/socket.h>
+#include "chronos_config.h"
+#include "chronos_shm.h"
+
+/* Returned by the receive routines when the peer closed
+ * the connection. This is not necessarily an error.
+ */
+#define CHRONOS_SOCKET_CLOSED   2
+
+/* An address like "unix:/tmp/chronos.sock" names a Unix domain
+ * socket. "shm:/tmp/chronos.sock" uses the Unix domain socket only
+ * to set up a shared memory connection. Any other address is an
+ * IPv4 address.
+ */
+#define CHRONOS_SOCKET_UNIX_PREFIX  "unix:"
+#define CHRONOS_SOCKET_SHM_PREFIX   "shm:"
+
+/*
+ * Per-connection receive buffer. Bytes are pulled from the
+ * socket in bulk and frames are handed out from here, so a
+ * frame may span several reads and a read may carry several
+ * frames.
+ */
+typedef struct chronosSocketBuffer_t {
+  /* For shared memory connections, this is the event fd
+   * that tells when there is something to read */
+  int   socket_fd;
+
+  /* NULL unless this is a shared memory connection */
+  chronosShmConnection_t *shmP;
+
+  /* First byte not yet handed out */
+  int   head;
+
+  /* One past the last byte read from the socket */
+  int   tail;
+
+  char  data[CHRONOS_SOCKET_BUFFER_SIZE];
+} chronosSocketBuffer_t;
+
+int
+chronosSocketAddressIsUnix(const char *address);
+
+int
+chronosSocketAddressIsShm(const char *address);
+
+const char *
+chronosSocketAddressPathGet(const char *address);
+
+int
+chronosSocketAddressGet(const char *address,
+                        int port,
+                        struct sockaddr_storage *addrP,
+                        socklen_t *addrLenP);
+
+int
+chronosSocketBufferInit(chronosSocketBuffer_t *sockBufP, 
+                        int socket_fd);
+
+int
+chronosSocketBufferShmSet(chronosSocketBuffer_t *sockBufP,
+                          chronosShmConnection_t *shmP);
+
+int
+chronosSocketBufferFill(chronosSocketBuffer_t *sockBufP);
+
+int
+chronosSocketBufferAvailable(const chronosSocketBuffer_t *sockBufP);
+
+int
+chronosSocketBufferPeek(const chronosSocketBuffer_t *sockBufP,
+                        void *dstP,
+                        int len);
+
+int
+chronosSocketBufferConsume(chronosSocketBuffer_t *sockBufP,
+                           void *dstP,
+                           int len);
+
+const char *
+chronosSocketBufferHead(const chronosSocketBuffer_t *sockBufP);
+
+int
+chronosSocketBufferSkip(chronosSocketBuffer_t *sockBufP,
+                        int len);
+
+int
+chronosSocketBufferWait(chronosSocketBuffer_t *sockBufP,
+                        int len,
+                        int (*isTimeToDieFp) (void));
+
+int
+chronosSocketRecvFrame(chronosSocketBuffer_t *sockBufP,
+                       void *frameP,
+                       int frameSize,
+                       int (*isTimeToDieFp) (void));
+
+int
+chronosSocketSendAll(int socket_fd,
+                     const void *bufP,
+                     int len,
+                     int (*isTimeToDieFp) (void));
+
+int
+chronosSocketBufferSend(const chronosSocketBuffer_t *sockBufP,
+                        const void *bufP,
+                        int len,
+                        int *num_bytes_ret);
+
+int
+chronosSocketBufferSendAll(const chronosSocketBuffer_t *sockBufP,
+                           const void *bufP,
+                           int len,
+                           int (*isTimeToDieFp) (void));
+
+#endif
@@ -56,6 +56,11 @@ typedef enum chronosSystemTransaction_t {
   CHRONOS_SYS_TXN_INVAL=CHRONOS_SYS_TXN_MAX
 } chronosSystemTransaction_t;
 
+/* Results of user txns which, in firm deadline mode, could
+ * not meet their deadline. Any other non-zero result is a failure */
+#define CHRONOS_TXN_RC_DROPPED   2   /* Not run: it could not finish in time */
+#define CHRONOS_TXN_RC_ABORTED   3   /* Aborted once its deadline passed */
+
 extern const char *chronos_user_transaction_str[];
 extern const char *chronos_system_transaction_str[];
 
@@ -17,8 +17,21 @@
  */
 
 
+#include <errno.h>
 #include "benchmark_common.h"
 
+/* Read-only xact classes that run on a snapshot.
+ * See benchmark_snapshot_xacts_set() */
+static int snapshot_xacts = 0;
+
+/* Isolation flags of the reads of the xact this thread runs: 
+ * 0 while it runs on a snapshot */
+static __thread u_int32_t xact_read_flags = DB_READ_COMMITTED;
+
+/* Flags of the commits of update xacts. DB_TXN_NOSYNC when the caller
+ * flushes the log on its own. See benchmark_xact_nosync_set() */
+static u_int32_t xact_commit_flags = 0;
+
 static int
 symbol_exists(const char *symbol, DB_TXN *txnP, BENCHMARK_DBS *benchmarkP);
 
@@ -31,12 +44,6 @@ show_stock_item(void *);
 static int
 show_currencies_item(void *vBuf);
 
-static int
-get_account_id(DB *sdbp,          /* secondary db handle */
-              const DBT *pkey,   /* primary db record's key */
-              const DBT *pdata,  /* primary db record's data */
-              DBT *skey);         /* secondary db record's key */
-
 static int 
 create_portfolio(const char *account_id, 
                  const char *symbol, 
@@ -51,34 +58,14 @@ get_portfolio(const char *account_id,
               const char *symbol, 
               DB_TXN *txnP, 
               DBC **cursorPP, 
-              DBT *key_ret, 
               DBT *data_ret, 
+              int flags,
               BENCHMARK_DBS *benchmarkP);
 
 int
 get_stock(const char *symbol, DB_TXN *txnP, DBC **cursorPP, DBT *key_ret, DBT *data_ret, int flags, BENCHMARK_DBS *benchmarkP);
 
 /*=============== STATIC FUNCTIONS =======================*/
-static int
-get_account_id(DB *sdbp,          /* secondary db handle */
-              const DBT *pkey,   /* primary db record's key */
-              const DBT *pdata,  /* primary db record's data */
-              DBT *skey)         /* secondary db record's key */
-{
-    PORTFOLIOS *portfoliosP;
-
-    /* First, extract the structure contained in the primary's data */
-    portfoliosP = pdata->data;
-
-    /* Now set the secondary key's data to be the representative's name */
-    memset(skey, 0, sizeof(DBT));
-    skey->data = portfoliosP->account_id;
-    skey->size = strlen(portfoliosP->account_id) + 1;
-
-    /* Return 0 to indicate that the record can be created/updated. */
-    return (0);
-} 
-
 static int
 show_stock_item(void *vBuf)
 {
@@ -109,6 +96,7 @@ open_database(DB_ENV *envP,
               const char *program_name,  
               FILE *error_file_pointer,
               int is_secondary,
+              int multiversion,
               int create)
 {
   DB *dbp;
@@ -149,6 +137,10 @@ open_database(DB_ENV *envP,
     open_flags |= DB_EXCL;   /*  Error if DB exists */
   }
 
+  if (multiversion) {
+    open_flags |= DB_MULTIVERSION; /* Keep page versions for snapshot reads */
+  }
+
   /* Now open the database */
   ret = dbp->open(dbp,        /* Pointer to the database */
                   NULL,       /* Txn pointer */
@@ -342,6 +334,7 @@ databases_setup(BENCHMARK_DBS *benchmarkP,
                         benchmarkP->stocks_db_name,
                         program_name, error_fileP,
                         PRIMARY_DB,
+                        0,
                         benchmarkP->createDBs);
     if (ret != 0) {
       return (ret);
@@ -354,6 +347,7 @@ databases_setup(BENCHMARK_DBS *benchmarkP,
                         benchmarkP->quotes_db_name,
                         program_name, error_fileP,
                         PRIMARY_DB,
+                        snapshot_xacts != 0,
                         benchmarkP->createDBs);
     if (ret != 0) {
       return (ret);
@@ -366,6 +360,7 @@ databases_setup(BENCHMARK_DBS *benchmarkP,
                         benchmarkP->quotes_hist_db_name,
                         program_name, error_fileP,
                         PRIMARY_DB,
+                        0,
                         benchmarkP->createDBs);
     if (ret != 0) {
       return (ret);
@@ -378,33 +373,11 @@ databases_setup(BENCHMARK_DBS *benchmarkP,
                         benchmarkP->portfolios_db_name,
                         program_name, error_fileP,
                         PRIMARY_DB,
+                        snapshot_xacts != 0,
                         benchmarkP->createDBs);
     if (ret != 0) {
       return (ret);
     }
-
-    ret = open_database(benchmarkP->envP,
-                        &(benchmarkP->portfolios_sdbp),
-                        benchmarkP->portfolios_sdb_name,
-                        program_name, error_fileP,
-                        SECONDARY_DB,
-                        benchmarkP->createDBs);
-    if (ret != 0) {
-      return (ret);
-    }
-
-    /* Now associate the secondary to the primary */
-    ret = benchmarkP->portfolios_dbp->associate(benchmarkP->portfolios_dbp,            /* Primary database */
-                   NULL,           /* TXN id */
-                   benchmarkP->portfolios_sdbp,           /* Secondary database */
-                   get_account_id,
-                   0);
-
-    if (ret != 0) {
-      envP->err(envP, ret, "[%s:%d] [%d] Failed to associate secondary database.", __FILE__, __LINE__, getpid());
-      return (ret);
-    }
-
   }
 
   if (IS_ACCOUNTS(which_database)) {
@@ -413,6 +386,7 @@ databases_setup(BENCHMARK_DBS *benchmarkP,
                         benchmarkP->accounts_db_name,
                         program_name, error_fileP,
                         PRIMARY_DB,
+                        0,
                         benchmarkP->createDBs);
     if (ret != 0) {
       return (ret);
@@ -425,6 +399,7 @@ databases_setup(BENCHMARK_DBS *benchmarkP,
                         benchmarkP->currencies_db_name,
                         program_name, error_fileP,
                         PRIMARY_DB,
+                        0,
                         benchmarkP->createDBs);
     if (ret != 0) {
       return (ret);
@@ -437,6 +412,7 @@ databases_setup(BENCHMARK_DBS *benchmarkP,
                         benchmarkP->personal_db_name,
                         program_name, error_fileP,
                         PRIMARY_DB,
+                        0,
                         benchmarkP->createDBs);
     if (ret != 0) {
       return (ret);
@@ -560,10 +536,6 @@ set_db_filenames(BENCHMARK_DBS *benchmarkP)
   benchmarkP->portfolios_db_name = malloc(size);
   snprintf(benchmarkP->portfolios_db_name, size, "%s", PORTFOLIOSDB);
 
-  size = strlen(PORTFOLIOSSECDB) + 1;
-  benchmarkP->portfolios_sdb_name = malloc(size);
-  snprintf(benchmarkP->portfolios_sdb_name, size, "%s", PORTFOLIOSSECDB);
-
   size = strlen(ACCOUNTSDB) + 1;
   benchmarkP->accounts_db_name = malloc(size);
   snprintf(benchmarkP->accounts_db_name, size, "%s", ACCOUNTSDB);
@@ -890,7 +862,7 @@ show_portfolios(char              *account_id,
 
   /* First read the personall account */
   ret = benchmarkP->personal_dbp->cursor(benchmarkP->personal_dbp, txnP,
-                                    &personal_cursorP, DB_READ_COMMITTED);
+                                    &personal_cursorP, xact_read_flags);
   if (ret != 0) {
     envP->err(envP, ret, "[%s:%d] [%d] Failed to create cursor for Personal.", __FILE__, __LINE__, getpid());
     goto failXit;
@@ -904,7 +876,7 @@ show_portfolios(char              *account_id,
   if (account_id != NULL && account_id[0] != '\0') {
     key.data = account_id;
     key.size = (u_int32_t) strlen(account_id) + 1;
-    curRc=personal_cursorP->get(personal_cursorP, &key, &data, DB_SET | DB_READ_COMMITTED);
+    curRc=personal_cursorP->get(personal_cursorP, &key, &data, DB_SET | xact_read_flags);
     if (curRc == 0) {
 
       /* Show user's information */
@@ -924,7 +896,7 @@ show_portfolios(char              *account_id,
     }
   }
   else {
-    while ((curRc=personal_cursorP->get(personal_cursorP, &key, &data, DB_READ_COMMITTED | DB_NEXT)) == 0)
+    while ((curRc=personal_cursorP->get(personal_cursorP, &key, &data, xact_read_flags | DB_NEXT)) == 0)
     {
       /* Show user's information */
       (void) show_personal_item(data.data);   
@@ -1003,14 +975,14 @@ show_one_portfolio(char *account_id, DB_TXN  *txn_inP, BENCHMARK_DBS *benchmarkP
   DBC *portfolio_cursorP = NULL;
   DB_TXN  *txnP = NULL;
   DB_ENV  *envP = NULL;
-  DBT key;
-  DBT pkey, pdata;
+  DBT key, data;
+  PORTFOLIOS_KEY portfolio_key;
   char *symbolIdP = NULL;
   int rc = BENCHMARK_SUCCESS;
   int ret;
   int numPortfolios = 0;
 
-  if (benchmarkP == NULL || benchmarkP->portfolios_sdbp == NULL) {
+  if (account_id == NULL || benchmarkP == NULL || benchmarkP->portfolios_dbp == NULL) {
     benchmark_error("Invalid argument");
     goto failXit;
   }
@@ -1035,16 +1007,17 @@ show_one_portfolio(char *account_id, DB_TXN  *txn_inP, BENCHMARK_DBS *benchmarkP
   }
 
   memset(&key, 0, sizeof(DBT));
-  memset(&pkey, 0, sizeof(DBT));
-  memset(&pdata, 0, sizeof(DBT));
+  memset(&data, 0, sizeof(DBT));
 
-  key.data = account_id;
-  key.size = ID_SZ;
+  /* The smallest key of this account: its holdings follow it */
+  set_portfolio_key(&portfolio_key, account_id, "");
+  key.data = &portfolio_key;
+  key.size = sizeof(PORTFOLIOS_KEY);
  
   /* Create a cursor to iterate over the portfolios given the 
    * user id. */
-  ret = benchmarkP->portfolios_sdbp->cursor(benchmarkP->portfolios_sdbp, txnP, 
-                                   &portfolio_cursorP, DB_READ_COMMITTED);
+  ret = benchmarkP->portfolios_dbp->cursor(benchmarkP->portfolios_dbp, txnP, 
+                                   &portfolio_cursorP, xact_read_flags);
   if (ret != 0) {
     envP->err(envP, ret, "[%s:%d] [%d] Failed to create cursor for Portfolios.", __FILE__, __LINE__, getpid());
     goto failXit;
@@ -1052,32 +1025,23 @@ show_one_portfolio(char *account_id, DB_TXN  *txn_inP, BENCHMARK_DBS *benchmarkP
 
   benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "PID: %d, %p : searching for account id: %s", getpid(), txnP, account_id);
 
-#if 1
-  /* Iterate over all portfolios in order to find those belonging to the user_id */
-  while ((ret = portfolio_cursorP->pget(portfolio_cursorP, &key, &pkey, &pdata, DB_NEXT)) == 0)
+  for (ret = portfolio_cursorP->get(portfolio_cursorP, &key, &data, DB_SET_RANGE);
+       ret == 0 && key.size == sizeof(PORTFOLIOS_KEY)
+         && strncmp(((PORTFOLIOS_KEY *)key.data)->account_id, portfolio_key.account_id, ID_SZ) == 0;
+       ret = portfolio_cursorP->get(portfolio_cursorP, &key, &data, DB_NEXT))
   {
-    /* TODO: Is it necessary this comparison? */
-    if (strcmp(account_id, (char *)key.data) == 0) {
-      /* Finally, go ahead and display the information about this
-       * portfolio */
-      (void) show_portfolio_item(pdata.data, &symbolIdP);
+    (void) show_portfolio_item(data.data, &symbolIdP);
 
-      numPortfolios ++;
-    }
+    numPortfolios ++;
   }
 
-#else 
-
-  /* Position the cursor */
-  rc = portfolio_cursorP->pget(portfolio_cursorP, &key, &pkey, &pdata, DB_SET | DB_READ_COMMITTED);
-  if (rc != 0) {
-    envP->err(envP, rc, "[%s:%d] [%d] Failed to find record (%s) in Portfolio.", __FILE__, __LINE__, getpid(), account_id);
+  if (ret != 0 && ret != DB_NOTFOUND) {
+    envP->err(envP, ret, "[%s:%d] [%d] Failed to read Portfolios.", __FILE__, __LINE__, getpid());
     goto failXit;
   }
 
-  (void) show_portfolio_item(pdata.data, &symbolIdP);
+  benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "Account %s holds %d symbols", account_id, numPortfolios);
 
-#endif
   ret = portfolio_cursorP->close(portfolio_cursorP);
   if (ret != 0) {
     envP->err(envP, ret, "[%s:%d] [%d] Failed to close cursor.", __FILE__, __LINE__, getpid());
@@ -1271,8 +1235,155 @@ show_portfolio_item(void *vBuf, char **symbolIdPP)
   return 0;
 }
 
-int 
-start_xact(benchmark_xact_h *xact_ret, const char *txn_name, BENCHMARK_DBS *benchmarkP)
+void
+set_portfolio_key(PORTFOLIOS_KEY *keyP, const char *account_id, const char *symbol)
+{
+  memset(keyP, 0, sizeof(PORTFOLIOS_KEY));
+  strncpy(keyP->account_id, account_id, ID_SZ - 1);
+  strncpy(keyP->symbol, symbol, ID_SZ - 1);
+}
+
+/* Timeout of the xacts started by this thread. 0 means no timeout */
+static __thread unsigned int xact_timeout_us = 0;
+
+/*
+ * Xacts started by the calling thread from now on are aborted
+ * if they are still running after timeout_us. 0 disables it.
+ * Berkeley DB checks the timeout whenever the xact waits for a lock.
+ */
+int
+benchmark_xact_timeout_set(unsigned int timeout_us)
+{
+  xact_timeout_us = timeout_us;
+
+  return BENCHMARK_SUCCESS;
+}
+
+/*
+ * Run the given classes of read-only xacts (BENCHMARK_SNAPSHOT_*) on a
+ * snapshot, without read locks. It has to be set before the databases 
+ * are opened, since Quotes and Portfolios then keep page versions.
+ */
+int
+benchmark_snapshot_xacts_set(int xact_classes)
+{
+  if ((xact_classes & ~BENCHMARK_SNAPSHOT_ALL) != 0) {
+    benchmark_error("Invalid snapshot xact classes: %d", xact_classes);
+    return BENCHMARK_FAIL;
+  }
+
+  snapshot_xacts = xact_classes;
+
+  return BENCHMARK_SUCCESS;
+}
+
+/*
+ * Commit update xacts without flushing the log. The caller is then 
+ * responsible for making them durable with benchmark_log_flush().
+ */
+int
+benchmark_xact_nosync_set(int nosync)
+{
+  xact_commit_flags = nosync ? DB_TXN_NOSYNC : 0;
+
+  return BENCHMARK_SUCCESS;
+}
+
+/*
+ * Flush the whole log to disk, which makes every xact committed so 
+ * far durable
+ */
+int
+benchmark_log_flush(void *benchmark_handle)
+{
+  BENCHMARK_DBS  *benchmarkP = benchmark_handle;
+  DB_ENV         *envP = NULL;
+  int             rc;
+
+  if (benchmarkP == NULL) {
+    benchmark_error("Invalid arguments");
+    goto failXit;
+  }
+
+  BENCHMARK_CHECK_MAGIC(benchmarkP);
+  envP = benchmarkP->envP;
+  if (envP == NULL) {
+    benchmark_error("Invalid arguments");
+    goto failXit;
+  }
+
+  rc = envP->log_flush(envP, NULL);
+  if (rc != 0) {
+    envP->err(envP, rc, "[%s:%d] [%d] Failed to flush the log.", __FILE__, __LINE__, getpid());
+    goto failXit;
+  }
+
+  return BENCHMARK_SUCCESS;
+
+failXit:
+  return BENCHMARK_FAIL;
+}
+
+/*
+ * Snapshot and cache counters since the previous call
+ */
+int
+benchmark_mvcc_stats_get(void *benchmark_handle, benchmark_mvcc_stats_t *stats_ret)
+{
+  BENCHMARK_DBS  *benchmarkP = benchmark_handle;
+  DB_ENV         *envP = NULL;
+  DB_TXN_STAT    *txn_statP = NULL;
+  DB_MPOOL_STAT  *mpool_statP = NULL;
+  int             rc;
+
+  if (benchmarkP == NULL || stats_ret == NULL) {
+    benchmark_error("Invalid arguments");
+    goto failXit;
+  }
+
+  BENCHMARK_CHECK_MAGIC(benchmarkP);
+  envP = benchmarkP->envP;
+  if (envP == NULL) {
+    benchmark_error("Invalid arguments");
+    goto failXit;
+  }
+
+  rc = envP->txn_stat(envP, &txn_statP, DB_STAT_CLEAR);
+  if (rc != 0) {
+    envP->err(envP, rc, "[%s:%d] [%d] Failed to get txn stats.", __FILE__, __LINE__, getpid());
+    goto failXit;
+  }
+
+  rc = envP->memp_stat(envP, &mpool_statP, NULL, DB_STAT_CLEAR);
+  if (rc != 0) {
+    envP->err(envP, rc, "[%s:%d] [%d] Failed to get cache stats.", __FILE__, __LINE__, getpid());
+    goto failXit;
+  }
+
+  stats_ret->num_snapshots = txn_statP->st_nsnapshot;
+  stats_ret->max_snapshots = txn_statP->st_maxnsnapshot;
+  stats_ret->num_frozen = mpool_statP->st_mvcc_frozen;
+  stats_ret->num_thawed = mpool_statP->st_mvcc_thawed;
+  stats_ret->num_freed = mpool_statP->st_mvcc_freed;
+  stats_ret->num_reused = mpool_statP->st_mvcc_reused;
+  stats_ret->num_pages = mpool_statP->st_pages;
+  stats_ret->num_dirty_pages = mpool_statP->st_page_dirty;
+  stats_ret->num_evictions = mpool_statP->st_ro_evict + mpool_statP->st_rw_evict;
+
+  free(txn_statP);
+  free(mpool_statP);
+
+  return BENCHMARK_SUCCESS;
+
+failXit:
+  free(txn_statP);
+  free(mpool_statP);
+
+  return BENCHMARK_FAIL;
+}
+
+static int 
+begin_xact(benchmark_xact_h *xact_ret, const char *txn_name, u_int32_t txn_flags, BENCHMARK_DBS *benchmarkP)
 {
   int rc = BENCHMARK_SUCCESS;
   DB_TXN  *txnP = NULL;
@@ -1289,7 +1400,7 @@ start_xact(benchmark_xact_h *xact_ret, const char *txn_name, BENCHMARK_DBS *benc
     goto failXit;
   }
 
-  rc = envP->txn_begin(envP, NULL, &txnP, DB_READ_COMMITTED | DB_TXN_WAIT);
+  rc = envP->txn_begin(envP, NULL, &txnP, txn_flags);
   if (rc != 0) {
     envP->err(envP, rc, "[%s:%d] [%d] Transaction begin failed.", __FILE__, __LINE__, getpid());
     goto failXit; 
@@ -1302,6 +1413,14 @@ start_xact(benchmark_xact_h *xact_ret, const char *txn_name, BENCHMARK_DBS *benc
     goto failXit; 
   }
 
+  if (xact_timeout_us > 0) {
+    rc = txnP->set_timeout(txnP, xact_timeout_us, DB_SET_TXN_TIMEOUT);
+    if (rc != 0) {
+      envP->err(envP, rc, "[%s:%d] [%d] Transaction timeout set failed.", __FILE__, __LINE__, getpid());
+      goto failXit; 
+    }
+  }
+
   *xact_ret = txnP;
 
   goto cleanup;
@@ -1324,6 +1443,30 @@ cleanup:
   return rc;
 }
 
+int 
+start_xact(benchmark_xact_h *xact_ret, const char *txn_name, BENCHMARK_DBS *benchmarkP)
+{
+  xact_read_flags = DB_READ_COMMITTED;
+
+  return begin_xact(xact_ret, txn_name, DB_READ_COMMITTED | DB_TXN_WAIT, benchmarkP);
+}
+
+/*
+ * Start a read-only xact of the given class. It runs on a
+ * snapshot if its class was set so, and takes read locks otherwise.
+ */
+int 
+start_read_xact(benchmark_xact_h *xact_ret, const char *txn_name, int xact_class, BENCHMARK_DBS *benchmarkP)
+{
+  if ((snapshot_xacts & xact_class) == 0) {
+    return start_xact(xact_ret, txn_name, benchmarkP);
+  }
+
+  xact_read_flags = 0;
+
+  return begin_xact(xact_ret, txn_name, DB_TXN_SNAPSHOT | DB_TXN_WAIT, benchmarkP);
+}
+
 int 
 commit_xact(benchmark_xact_h xactH, BENCHMARK_DBS *benchmarkP)
 {
@@ -1345,7 +1488,7 @@ commit_xact(benchmark_xact_h xactH, BENCHMARK_DBS *benchmarkP)
   txnP = (DB_TXN *)xactH;
 
   benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "PID: %d, Committing transaction: %p", getpid(), txnP);
-  rc = txnP->commit(txnP, 0);
+  rc = txnP->commit(txnP, xact_commit_flags);
   if (rc != 0) {
     envP->err(envP, rc, "[%s:%d] [%d] Transaction commit failed. txnP: %p", __FILE__, __LINE__, getpid(), txnP);
     goto failXit; 
@@ -1367,6 +1510,7 @@ failXit:
   rc = BENCHMARK_FAIL;
 
 cleanup:
+  xact_read_flags = DB_READ_COMMITTED;
   return rc;
 }
 
@@ -1404,11 +1548,12 @@ failXit:
   rc = BENCHMARK_FAIL;
 
 cleanup:
+  xact_read_flags = DB_READ_COMMITTED;
   return rc;
 }
 
 int 
-show_quote(char *symbolP, benchmark_xact_h xactH, BENCHMARK_DBS *benchmarkP)
+show_quote(char *symbolP, benchmark_xact_h xactH, QUOTE *quote_ret, BENCHMARK_DBS *benchmarkP)
 {
   int rc = BENCHMARK_SUCCESS;
   DB_TXN  *txnP = NULL;
@@ -1450,6 +1595,9 @@ show_quote(char *symbolP, benchmark_xact_h xactH, BENCHMARK_DBS *benchmarkP)
   
   //quoteP = data.data;
   //benchmark_info("*** Value of %s is %f", quoteP->symbol, quoteP->current_price);
+  if (quote_ret != NULL) {
+    memcpy(quote_ret, data.data, sizeof(QUOTE));
+  }
 
   /* Close the record */
   if (cursorp != NULL) {
@@ -1497,17 +1645,18 @@ cleanup:
   return rc;
 }
 
-int 
-update_stock(char *symbolP, float newValue, BENCHMARK_DBS *benchmarkP)
+int
+update_stock_xact(const char *symbolP, float newValue, benchmark_xact_h xactH, QUOTE *quote_ret, BENCHMARK_DBS *benchmarkP)
 {
   int rc = BENCHMARK_SUCCESS;
-  DB_TXN  *txnP = NULL;
+  int close_rc;
+  DB_TXN  *txnP = xactH;
   DB_ENV  *envP = NULL;
   DBT      key, data;
   DBC     *cursorp = NULL; /* To iterate over the porfolios */
   QUOTE   *quoteP = NULL;
 
-  if (benchmarkP == NULL) {
+  if (benchmarkP == NULL || txnP == NULL) {
     goto failXit;
   }
 
@@ -1521,13 +1670,6 @@ update_stock(char *symbolP, float newValue, BENCHMARK_DBS *benchmarkP)
   memset(&key, 0, sizeof(DBT));
   memset(&data, 0, sizeof(DBT));
 
-  rc = envP->txn_begin(envP, NULL, &txnP, DB_READ_COMMITTED | DB_TXN_WAIT);
-  if (rc != 0) {
-    envP->err(envP, rc, "[%s:%d] [%d] Transaction begin failed.", __FILE__, __LINE__, getpid());
-    goto failXit; 
-  }
-
-  benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT,"PID: %d, Starting transaction: %p", getpid(), txnP);
   rc = get_stock(symbolP, txnP, &cursorp, &key, &data, DB_RMW, benchmarkP);
   if (rc != BENCHMARK_SUCCESS) {
     benchmark_error("Could not find record.");
@@ -1558,18 +1700,62 @@ update_stock(char *symbolP, float newValue, BENCHMARK_DBS *benchmarkP)
     goto failXit; 
   }
 
+  if (quote_ret != NULL) {
+    memcpy(quote_ret, quoteP, sizeof(QUOTE));
+  }
+
+  BENCHMARK_CHECK_MAGIC(benchmarkP);
+  goto cleanup;
+
+failXit:
+  rc = BENCHMARK_FAIL;
+
+cleanup:
   /* Close the record */
   if (cursorp != NULL) {
-    rc = cursorp->close(cursorp);
-    if (rc != 0) {
-      envP->err(envP, rc, "[%s:%d] [%d] Failed to close cursor for quote", __FILE__, __LINE__, getpid());
-      goto failXit; 
+    close_rc = cursorp->close(cursorp);
+    if (close_rc != 0) {
+      envP->err(envP, close_rc, "[%s:%d] [%d] Failed to close cursor for quote", __FILE__, __LINE__, getpid());
+      rc = BENCHMARK_FAIL;
     }
     cursorp = NULL;
   }
 
+  return rc;
+}
+
+int 
+update_stock(char *symbolP, float newValue, QUOTE *quote_ret, BENCHMARK_DBS *benchmarkP)
+{
+  int rc = BENCHMARK_SUCCESS;
+  DB_TXN  *txnP = NULL;
+  DB_ENV  *envP = NULL;
+
+  if (benchmarkP == NULL) {
+    goto failXit;
+  }
+
+  BENCHMARK_CHECK_MAGIC(benchmarkP);
+  envP = benchmarkP->envP;
+  if (envP == NULL) {
+    benchmark_error("Invalid arguments");
+    goto failXit;
+  }
+
+  rc = envP->txn_begin(envP, NULL, &txnP, DB_READ_COMMITTED | DB_TXN_WAIT);
+  if (rc != 0) {
+    envP->err(envP, rc, "[%s:%d] [%d] Transaction begin failed.", __FILE__, __LINE__, getpid());
+    goto failXit; 
+  }
+
+  benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT,"PID: %d, Starting transaction: %p", getpid(), txnP);
+  rc = update_stock_xact(symbolP, newValue, txnP, quote_ret, benchmarkP);
+  if (rc != BENCHMARK_SUCCESS) {
+    goto failXit; 
+  }
+
   benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "PID: %d, Committing transaction: %p", getpid(), txnP);
-  rc = txnP->commit(txnP, 0);
+  rc = txnP->commit(txnP, xact_commit_flags);
   if (rc != 0) {
     envP->err(envP, rc, "[%s:%d] [%d] Transaction commit failed. txnP: %p", __FILE__, __LINE__, getpid(), txnP);
     goto failXit; 
@@ -1581,14 +1767,6 @@ update_stock(char *symbolP, float newValue, BENCHMARK_DBS *benchmarkP)
 failXit:
   BENCHMARK_CHECK_MAGIC(benchmarkP);
   if (txnP != NULL) {
-    if (cursorp != NULL) {
-      rc = cursorp->close(cursorp);
-      if (rc != 0) {
-        envP->err(envP, rc, "[%s:%d] [%d] Failed to close cursor.", __FILE__, __LINE__, getpid());
-      }
-      cursorp = NULL;
-    }
-
     benchmark_warning("PID: %d About to abort transaction. txnP: %p", getpid(), txnP);
     rc = txnP->abort(txnP);
     if (rc != 0) {
@@ -1609,6 +1787,7 @@ sell_stocks(const char *account_id,
             float price, 
             int amount, 
             int force_apply, 
+            const QUOTE *current_quoteP,
             benchmark_xact_h  xactH,
             BENCHMARK_DBS *benchmarkP)
 {
@@ -1616,13 +1795,11 @@ sell_stocks(const char *account_id,
   DB_TXN  *txnP = NULL;
   DB_ENV  *envP = NULL;
   DBT      key_portfolio, data_portfolio;
-  DBT      key_quote, data_quote;
-  DBC     *cursor_portfolioP = NULL; /* To iterate over the porfolios */
-  DBC     *cursor_primary_portfolioP = NULL; /* To iterate over the porfolios */
-  DBC     *cursor_quoteP = NULL; /* To iterate over the quotes */
+  DBC     *cursor_portfolioP = NULL; /* Positioned on the portfolio */
   int      exists = 0;
   PORTFOLIOS *portfolioP = NULL;
-  QUOTE      *quoteP = NULL;
+  const QUOTE *quoteP = NULL;
+  QUOTE       quote;
 
   if (benchmarkP == NULL) {
     goto failXit;
@@ -1638,8 +1815,6 @@ sell_stocks(const char *account_id,
 
   memset(&key_portfolio, 0, sizeof(DBT));
   memset(&data_portfolio, 0, sizeof(DBT));
-  memset(&key_quote, 0, sizeof(DBT));
-  memset(&data_quote, 0, sizeof(DBT));
 
   if (xactH == NULL) {
     rc = envP->txn_begin(envP, NULL, &txnP, DB_READ_COMMITTED | DB_TXN_WAIT);
@@ -1669,7 +1844,7 @@ sell_stocks(const char *account_id,
   benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "Looking up portfolio for account: %s and symbol: %s", account_id, symbol);
 
   /* get a cursor to the portfolio */
-  rc = get_portfolio(account_id, symbol, txnP, &cursor_portfolioP, &key_portfolio, &data_portfolio, benchmarkP);
+  rc = get_portfolio(account_id, symbol, txnP, &cursor_portfolioP, &data_portfolio, DB_RMW, benchmarkP);
   if (rc != BENCHMARK_SUCCESS) {
     benchmark_error("Failed to obtain portfolio for account: %s and symbol: %s.", account_id, symbol);
     goto failXit; 
@@ -1683,30 +1858,17 @@ sell_stocks(const char *account_id,
     goto failXit; 
   }
 
-  /* Locate the porfolio in the primary database */
-  rc = benchmarkP->portfolios_dbp->cursor(benchmarkP->portfolios_dbp, txnP,
-                                    &cursor_primary_portfolioP, DB_READ_COMMITTED);
-  if (rc != 0) {
-    envP->err(envP, rc, "[%s:%d] [%d] Failed to create cursor for Portfolio.", __FILE__, __LINE__, getpid());
-    goto failXit;
-  }
-
-  rc = cursor_primary_portfolioP->get(cursor_primary_portfolioP, &key_portfolio, &data_portfolio, DB_SET);
-  if (rc != 0) {
-    envP->err(envP, rc, "[%s:%d] [%d] Failed to find record in Portfolio.", __FILE__, __LINE__, getpid());
-    goto failXit;
-  }
-
-  portfolioP = data_portfolio.data;
-
   /* Perform the sell right away */
   if (force_apply == 1) {
-    rc = get_stock(symbol, txnP, &cursor_quoteP, &key_quote, &data_quote, 0, benchmarkP);
-    if (rc != BENCHMARK_SUCCESS) {
-      benchmark_error("Could not find record.");
-      goto failXit; 
+    quoteP = current_quoteP;
+    if (quoteP == NULL) {
+      rc = get_quotes(1, &symbol, &quote, txnP, benchmarkP);
+      if (rc != BENCHMARK_SUCCESS) {
+        benchmark_error("Could not find record.");
+        goto failXit; 
+      }
+      quoteP = &quote;
     }
-    quoteP = data_quote.data;
     benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "Current price for stock: %s is %f, requested is: %f", symbol, quoteP->current_price, price);
     if (quoteP->current_price >= price) {
       benchmark_info("Selling %d stocks", amount);
@@ -1726,7 +1888,7 @@ sell_stocks(const char *account_id,
   }
 
   /* Save the record */
-  rc = cursor_primary_portfolioP->put(cursor_primary_portfolioP, &key_portfolio, &data_portfolio, DB_CURRENT);
+  rc = cursor_portfolioP->put(cursor_portfolioP, &key_portfolio, &data_portfolio, DB_CURRENT);
   if (rc != 0) {
     envP->err(envP, rc, "[%s:%d] [%d] Could not update record.", __FILE__, __LINE__, getpid());
     goto failXit; 
@@ -1743,20 +1905,9 @@ sell_stocks(const char *account_id,
     cursor_portfolioP = NULL;
   }
 
-  /* Close the record */
-  if (cursor_primary_portfolioP != NULL) {
-    rc = cursor_primary_portfolioP->close(cursor_primary_portfolioP);
-    if (rc != 0) {
-      envP->err(envP, rc, "[%s:%d] [%d] Could not close cursor.", __FILE__, __LINE__, getpid());
-      goto failXit; 
-    }
-
-    cursor_primary_portfolioP = NULL;
-  }
-
   if (xactH == NULL) {
     benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "PID: %d, Committing transaction: %p", getpid(), txnP);
-    rc = txnP->commit(txnP, 0);
+    rc = txnP->commit(txnP, xact_commit_flags);
     if (rc != 0) {
       envP->err(envP, rc, "%s:%d Transaction commit failed.", __func__, __LINE__);
       goto failXit; 
@@ -1778,16 +1929,6 @@ failXit:
       cursor_portfolioP = NULL;
     }
 
-    if (cursor_primary_portfolioP != NULL) {
-      rc = cursor_primary_portfolioP->close(cursor_primary_portfolioP);
-      if (rc != 0) {
-        envP->err(envP, rc, "[%s:%d] [%d] Could not close cursor.", __FILE__, __LINE__, getpid());
-        goto failXit; 
-      }
-
-      cursor_primary_portfolioP = NULL;
-    }
-
     benchmark_warning("PID: %d About to abort transaction. txnP: %p", getpid(), txnP);
     rc = txnP->abort(txnP);
     if (rc != 0) {
@@ -1809,21 +1950,20 @@ place_order(const char *account_id,
             float price, 
             int amount, 
             int force_apply, 
+            const QUOTE *current_quoteP,
             benchmark_xact_h  xactH,
             BENCHMARK_DBS *benchmarkP)
 {
   int rc = 0;
   int exists = 0;
   DBT      key_portfolio, data_portfolio;
-  DBT      key_quote, data_quote;
-  DBC     *cursor_portfolioP = NULL; /* To iterate over the porfolios */
-  DBC     *cursor_primary_portfolioP = NULL; /* To iterate over the porfolios */
-  DBC     *cursor_quoteP = NULL; /* To iterate over the quotes */
+  DBC     *cursor_portfolioP = NULL; /* Positioned on the portfolio */
   DB_TXN *txnP = NULL;
   DB_ENV  *envP = NULL;
   DBT key, data;
   PORTFOLIOS *portfolioP = NULL;
-  QUOTE      *quoteP = NULL;
+  const QUOTE *quoteP = NULL;
+  QUOTE       quote;
 
   envP = benchmarkP->envP;
   if (envP == NULL) {
@@ -1833,6 +1973,8 @@ place_order(const char *account_id,
 
   memset(&key, 0, sizeof(DBT));
   memset(&data, 0, sizeof(DBT));
+  memset(&key_portfolio, 0, sizeof(DBT));
+  memset(&data_portfolio, 0, sizeof(DBT));
 
   if (xactH == NULL) {
     rc = envP->txn_begin(envP, NULL, &txnP, DB_READ_COMMITTED | DB_TXN_WAIT);
@@ -1859,36 +2001,30 @@ place_order(const char *account_id,
     goto failXit; 
   }
 
+  /* The price is only checked if the order is applied right away */
+  if (force_apply == 1) {
+    quoteP = current_quoteP;
+    if (quoteP == NULL) {
+      rc = get_quotes(1, &symbol, &quote, txnP, benchmarkP);
+      if (rc != BENCHMARK_SUCCESS) {
+        benchmark_error("Could not find record.");
+        goto failXit; 
+      }
+      quoteP = &quote;
+    }
+  }
+
   benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "Looking up portfolio for account: %s and symbol: %s", account_id, symbol);
 
   /* 3) exists portfolio */
-  rc = get_portfolio(account_id, symbol, txnP, &cursor_portfolioP, &key_portfolio, &data_portfolio, benchmarkP);
+  rc = get_portfolio(account_id, symbol, txnP, &cursor_portfolioP, &data_portfolio, DB_RMW, benchmarkP);
 
   /* 3.1) if so, update */
   if (rc == BENCHMARK_SUCCESS) {
-    rc = benchmarkP->portfolios_dbp->cursor(benchmarkP->portfolios_dbp, txnP,
-                                      &cursor_primary_portfolioP, DB_READ_COMMITTED);
-    if (rc != 0) {
-      envP->err(envP, rc, "[%s:%d] [%d] Failed to create cursor for Portfolio.", __FILE__, __LINE__, getpid());
-      goto failXit;
-    }
-
-    rc = cursor_primary_portfolioP->get(cursor_primary_portfolioP, &key_portfolio, &data_portfolio, DB_SET);
-    if (rc != 0) {
-      envP->err(envP, rc, "[%s:%d] [%d] Failed to find record in Portfolio.", __FILE__, __LINE__, getpid());
-      goto failXit;
-    }
-
     portfolioP = data_portfolio.data;
 
     /* Perform the sell right away */
     if (force_apply == 1) {
-      rc = get_stock(symbol, txnP, &cursor_quoteP, &key_quote, &data_quote, 0, benchmarkP);
-      if (rc != BENCHMARK_SUCCESS) {
-        benchmark_error("Could not find record.");
-        goto failXit; 
-      }
-      quoteP = data_quote.data;
       benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "Current price for stock: %s is %f, requested is: %f", symbol, quoteP->current_price, price);
       if (quoteP->current_price <= price) {
         benchmark_info("Purchasing %d stocks", amount);
@@ -1909,7 +2045,7 @@ place_order(const char *account_id,
 
     /* Save the record */
 
-    rc = cursor_primary_portfolioP->put(cursor_primary_portfolioP, &key_portfolio, &data_portfolio, DB_CURRENT);
+    rc = cursor_portfolioP->put(cursor_portfolioP, &key_portfolio, &data_portfolio, DB_CURRENT);
     if (rc != 0) {
       envP->err(envP, rc, "[%s:%d] [%d] Could not update record.", __FILE__, __LINE__, getpid());
       goto failXit; 
@@ -1919,12 +2055,6 @@ place_order(const char *account_id,
   /* 3.2) otherwise, create a new portfolio */
   else {
     if (force_apply == 1) {
-      rc = get_stock(symbol, txnP, &cursor_quoteP, &key_quote, &data_quote, 0, benchmarkP);
-      if (rc != BENCHMARK_SUCCESS) {
-        benchmark_error("Could not find record.");
-        goto failXit; 
-      }
-      quoteP = data_quote.data;
       benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "Current price for stock: %s is %f, requested is: %f", symbol, quoteP->current_price, price);
       if (quoteP->current_price <= price) {
         benchmark_info("Purchasing %d stocks of symbol: %s at %f USD since %s wanted a price <= %f USD", 
@@ -1956,20 +2086,9 @@ place_order(const char *account_id,
     cursor_portfolioP = NULL;
   }
 
-  /* Close the record */
-  if (cursor_primary_portfolioP != NULL) {
-    rc = cursor_primary_portfolioP->close(cursor_primary_portfolioP);
-    if (rc != 0) {
-      envP->err(envP, rc, "[%s:%d] [%d] Could not close cursor.", __FILE__, __LINE__, getpid());
-      goto failXit; 
-    }
-
-    cursor_primary_portfolioP = NULL;
-  }
-
   if (xactH == NULL) {
     benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "PID: %d, Committing transaction: %p", getpid(), txnP);
-    rc = txnP->commit(txnP, 0);
+    rc = txnP->commit(txnP, xact_commit_flags);
     if (rc != 0) {
       envP->err(envP, rc, "%s:%d Transaction commit failed.", __func__, __LINE__);
       goto failXit; 
@@ -1990,16 +2109,6 @@ failXit:
       cursor_portfolioP = NULL;
     }
 
-    if (cursor_primary_portfolioP != NULL) {
-      rc = cursor_primary_portfolioP->close(cursor_primary_portfolioP);
-      if (rc != 0) {
-        envP->err(envP, rc, "[%s:%d] [%d] Could not close cursor.", __FILE__, __LINE__, getpid());
-        goto failXit; 
-      }
-
-      cursor_primary_portfolioP = NULL;
-    }
-
     benchmark_warning("PID: %d About to abort transaction. txnP: %p", getpid(), txnP);
     rc = txnP->abort(txnP);
     if (rc != 0) {
@@ -2014,26 +2123,30 @@ cleanup:
   return rc;
 }
 
+/*
+ * Position a cursor on the portfolio of account_id for symbol. The 
+ * cursor is returned so that the caller can update the record in
+ * place. flags are passed to the cursor get, e.g. DB_RMW.
+ */
 int
 get_portfolio(const char *account_id, 
               const char *symbol, 
               DB_TXN *txnP, 
               DBC **cursorPP, 
-              DBT *key_ret, 
               DBT *data_ret, 
+              int flags,
               BENCHMARK_DBS *benchmarkP) 
 {
   DBC *cursorp = NULL;
   DB  *portfoliosdbP= NULL;
-  DB  *portfoliossdbP= NULL;
   DB_ENV  *envP = NULL;
-  DBT pkey, pdata;
-  DBT key;
+  PORTFOLIOS_KEY portfolio_key;
+  DBT key, data;
   int rc = 0;
 
   if (account_id == NULL || account_id[0] == '\0' || 
       symbol == NULL || symbol[0] == '\0' || 
-      txnP == NULL || benchmarkP == NULL) 
+      txnP == NULL || cursorPP == NULL || benchmarkP == NULL) 
   {
     benchmark_error("Invalid argument");
     goto failXit;
@@ -2053,62 +2166,47 @@ get_portfolio(const char *account_id,
     goto failXit;
   }
 
-  portfoliossdbP = benchmarkP->portfolios_sdbp;
-  if (portfoliossdbP == NULL) {
-    benchmark_error("Portfolios secondary database is not open");
-    goto failXit;
-  }
-
   memset(&key, 0, sizeof(DBT));
-  memset(&pkey, 0, sizeof(DBT));
-  memset(&pdata, 0, sizeof(DBT));
+  memset(&data, 0, sizeof(DBT));
 
-  key.data = (char *)account_id;
-  key.size = ID_SZ;
+  set_portfolio_key(&portfolio_key, account_id, symbol);
+  key.data = &portfolio_key;
+  key.size = sizeof(PORTFOLIOS_KEY);
 
-  rc = portfoliossdbP->cursor(portfoliossdbP, txnP,
-                         &cursorp, 0);
+  rc = portfoliosdbP->cursor(portfoliosdbP, txnP,
+                         &cursorp, DB_READ_COMMITTED);
   if (rc != 0) {
     envP->err(envP, rc, "[%s:%d] [%d] Failed to create cursor for Portfolios.", __FILE__, __LINE__, getpid());
     goto failXit;
   }
-  
-  while ((rc=cursorp->pget(cursorp, &key, &pkey, &pdata, DB_NEXT)) == 0)
-  {
-    /* TODO: Is this comparison needed? */
-    if (strcmp(account_id, (char *)key.data) == 0) {
-      if ( symbol != NULL && symbol[0] != '\0') {
-        if (strcmp(symbol, ((PORTFOLIOS *)pdata.data)->symbol) == 0) {
-          rc = BENCHMARK_SUCCESS;
-          goto cleanup;
-        }
-      }
-    }
-  }
-
-failXit:
-  benchmark_warning("Could not find symbol %s for account_id: %s", symbol, account_id);
 
-  rc = cursorp->close(cursorp);
+  rc = cursorp->get(cursorp, &key, &data, DB_SET | flags);
   if (rc != 0) {
-    envP->err(envP, rc, "[%s:%d] [%d] Failed to close cursor for Portfolios.", __FILE__, __LINE__, getpid());
+    if (rc != DB_NOTFOUND) {
+      envP->err(envP, rc, "[%s:%d] [%d] Failed to look up Portfolios.", __FILE__, __LINE__, getpid());
+    }
+    goto failXit;
   }
-  cursorp = NULL;
-
-  rc = BENCHMARK_FAIL;
-  return rc;
 
-cleanup:
   *cursorPP = cursorp;
-  if (key_ret != NULL) {
-    *key_ret = pkey;
+  if (data_ret != NULL) {
+    *data_ret = data;
   }
 
-  if (data_ret != NULL) {
-    *data_ret = pdata;
+  return BENCHMARK_SUCCESS;
+
+failXit:
+  benchmark_warning("Could not find symbol %s for account_id: %s", symbol, account_id);
+
+  if (cursorp != NULL) {
+    rc = cursorp->close(cursorp);
+    if (rc != 0) {
+      envP->err(envP, rc, "[%s:%d] [%d] Failed to close cursor for Portfolios.", __FILE__, __LINE__, getpid());
+    }
+    cursorp = NULL;
   }
 
-  return rc;
+  return BENCHMARK_FAIL;
 }
 
 int
@@ -2194,6 +2292,157 @@ done:
   return BENCHMARK_SUCCESS;
 }
 
+/* A requested quote, and where the caller wants it */
+typedef struct quote_request_t {
+  const char *symbol;
+  int         pos;
+} quote_request_t;
+
+static int
+quote_request_compare(const void *aP, const void *bP)
+{
+  return strcmp(((const quote_request_t *) aP)->symbol, ((const quote_request_t *) bP)->symbol);
+}
+
+/*
+ * Read the quotes of several symbols with a single cursor. The symbols
+ * are visited in key order, so that consecutive lookups mostly hit the
+ * same leaf pages: the cursor walks forward with DB_NEXT when the next
+ * symbol is close, and only looks it up with DB_SET_RANGE otherwise.
+ * quote_list_ret may be NULL, to only check that the quotes exist.
+ */
+int
+get_quotes(int num_symbols, const char **symbol_list_P, QUOTE *quote_list_ret, DB_TXN *txnP, BENCHMARK_DBS *benchmarkP)
+{
+  DBC *cursorp = NULL;
+  DB  *quotesdbP= NULL;
+  DB_ENV  *envP = NULL;
+  DBT key, data;
+  quote_request_t *request_arr = NULL;
+  const char *symbol;
+  int i;
+  int skip;
+  int cmp;
+  int positioned = 0;
+  int rc = 0;
+
+  if (benchmarkP==NULL || txnP == NULL || symbol_list_P == NULL || num_symbols < 0)
+  {
+    benchmark_error("Invalid arguments");
+    goto failXit;
+  }
+
+  BENCHMARK_CHECK_MAGIC(benchmarkP);
+
+  envP = benchmarkP->envP;
+  if (envP == NULL) {
+    benchmark_error("Invalid argument");
+    goto failXit;
+  }
+
+  quotesdbP = benchmarkP->quotes_dbp;
+  if (quotesdbP == NULL) {
+    benchmark_error("Quotes database is not open");
+    goto failXit;
+  }
+
+  if (num_symbols == 0) {
+    return BENCHMARK_SUCCESS;
+  }
+
+  request_arr = malloc(num_symbols * sizeof(quote_request_t));
+  if (request_arr == NULL) {
+    benchmark_error("Could not allocate quote requests");
+    goto failXit;
+  }
+
+  for (i=0; i<num_symbols; i++) {
+    if (symbol_list_P[i] == NULL || symbol_list_P[i][0] == '\0') {
+      benchmark_error("Invalid arguments");
+      goto failXit;
+    }
+    request_arr[i].symbol = symbol_list_P[i];
+    request_arr[i].pos = i;
+  }
+
+  qsort(request_arr, num_symbols, sizeof(quote_request_t), quote_request_compare);
+
+  rc = quotesdbP->cursor(quotesdbP, txnP, &cursorp, xact_read_flags);
+  if (rc != 0) {
+    envP->err(envP, rc, "[%s:%d] [%d] Failed to create cursor for Quotes.", __FILE__, __LINE__, getpid());
+    goto failXit;
+  }
+
+  memset(&key, 0, sizeof(DBT));
+  memset(&data, 0, sizeof(DBT));
+
+  for (i=0; i<num_symbols; i++) {
+    symbol = request_arr[i].symbol;
+
+    /* Keys are NUL terminated, so they compare like strings */
+    cmp = positioned ? strcmp((const char *) key.data, symbol) : -1;
+
+    for (skip=0; positioned && cmp < 0 && skip < BENCHMARK_QUOTES_MAX_SKIP; skip++) {
+      rc = cursorp->get(cursorp, &key, &data, DB_NEXT | xact_read_flags);
+      if (rc != 0) {
+        envP->err(envP, rc, "[%s:%d] [%d] Failed to find record in Quotes: %s", __FILE__, __LINE__, getpid(), symbol);
+        goto failXit;
+      }
+      cmp = strcmp((const char *) key.data, symbol);
+    }
+
+    if (cmp < 0) {
+      memset(&key, 0, sizeof(DBT));
+      key.data = (char *)symbol;
+      key.size = (u_int32_t) strlen(symbol) + 1;
+
+      rc = cursorp->get(cursorp, &key, &data, DB_SET_RANGE | xact_read_flags);
+      if (rc != 0) {
+        envP->err(envP, rc, "[%s:%d] [%d] Failed to find record in Quotes: %s", __FILE__, __LINE__, getpid(), symbol);
+        goto failXit;
+      }
+      positioned = 1;
+      cmp = strcmp((const char *) key.data, symbol);
+    }
+
+    if (cmp != 0) {
+      benchmark_error("Failed to find record in Quotes: %s", symbol);
+      goto failXit;
+    }
+
+    benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "PID: %d, retrieved: %s $%f", getpid(), 
+                    ((QUOTE *) data.data)->symbol, ((QUOTE *) data.data)->current_price);
+    if (quote_list_ret != NULL) {
+      memcpy(&quote_list_ret[request_arr[i].pos], data.data, sizeof(QUOTE));
+    }
+  }
+
+  rc = cursorp->close(cursorp);
+  cursorp = NULL;
+  if (rc != 0) {
+    envP->err(envP, rc, "[%s:%d] [%d] Failed to close cursor for Quotes.", __FILE__, __LINE__, getpid());
+    goto failXit;
+  }
+
+  free(request_arr);
+
+  BENCHMARK_CHECK_MAGIC(benchmarkP);
+  return BENCHMARK_SUCCESS;
+
+failXit:
+  if (cursorp) {
+    rc = cursorp->close(cursorp);
+    if (rc != 0) {
+      envP->err(envP, rc, "[%s:%d] [%d] Failed to close cursor for Quotes.", __FILE__, __LINE__, getpid());
+    }
+    cursorp = NULL;
+  }
+
+  free(request_arr);
+
+  return BENCHMARK_FAIL;
+}
+
 static int
 symbol_exists(const char *symbol, DB_TXN *txnP, BENCHMARK_DBS *benchmarkP) 
 {
@@ -2319,6 +2568,7 @@ create_portfolio(const char *account_id,
 {
   int rc = 0;
   PORTFOLIOS portfolio;
+  PORTFOLIOS_KEY portfolio_key;
   DB_ENV  *envP = NULL;
   DBT key, data;
   int use_portfolio_id;
@@ -2355,19 +2605,20 @@ create_portfolio(const char *account_id,
   }
 
   /* Set up the database record's key */
-  key.data = portfolio.portfolio_id;
-  key.size = (u_int32_t)strlen(portfolio.portfolio_id) + 1;
+  set_portfolio_key(&portfolio_key, account_id, symbol);
+  key.data = &portfolio_key;
+  key.size = sizeof(PORTFOLIOS_KEY);
 
   /* Set up the database record's data */
   data.data = &portfolio;
   data.size = sizeof(PORTFOLIOS);
 
   /* Put the data into the database */
-  benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "Inserting: %s", (char *)key.data);
+  benchmark_debug(BENCHMARK_DEBUG_LEVEL_XACT, "Inserting: %s (%s, %s)", portfolio.portfolio_id, account_id, symbol);
 
   rc = benchmarkP->portfolios_dbp->put(benchmarkP->portfolios_dbp, txnP, &key, &data, DB_NOOVERWRITE);
   if (rc != 0) {
-    envP->err(envP, rc, "[%s:%d] [%d] Database put failed (id: %s).", __FILE__, __LINE__, getpid(), (char *)key.data);
+    envP->err(envP, rc, "[%s:%d] [%d] Database put failed (id: %s).", __FILE__, __LINE__, getpid(), portfolio.portfolio_id);
     goto failXit; 
   }
 
@@ -2380,3 +2631,198 @@ cleanup:
   return rc;
 }
 
+/*
+ * Portfolios used to be keyed on portfolio_id, with a secondary 
+ * database on account_id that every lookup scanned. Re-key the
+ * records still in that layout on (account_id, symbol), and drop
+ * the secondary database.
+ *
+ * The secondary database is removed last, so its absence means there
+ * is nothing left to migrate. The records are re-keyed in txns of up
+ * to BENCHMARK_MIGRATE_CHUNK, each one resuming past the last old key
+ * the previous one handled.
+ */
+int
+migrate_portfolio_database(BENCHMARK_DBS *benchmarkP)
+{
+  DBC     *cursorP = NULL;
+  DB_TXN  *txnP = NULL;
+  DB_ENV  *envP = NULL;
+  DB      *portfoliosdbP = NULL;
+  DB      *secdbP = NULL;
+  DBT      key, data;
+  DBT      new_key, new_data, old_data;
+  PORTFOLIOS      portfolio;
+  PORTFOLIOS_KEY  portfolio_key;
+  char     resume_key[sizeof(PORTFOLIOS)];
+  int      resume_size = 0;
+  int      numMigrated = 0;
+  int      numChunk;
+  int      done = 0;
+  int      ret;
+
+  if (benchmarkP == NULL || benchmarkP->envP == NULL || benchmarkP->portfolios_dbp == NULL) {
+    benchmark_error("Invalid argument");
+    goto failXit;
+  }
+
+  BENCHMARK_CHECK_MAGIC(benchmarkP);
+
+  envP = benchmarkP->envP;
+  portfoliosdbP = benchmarkP->portfolios_dbp;
+
+  /* Only databases loaded by older versions have the secondary */
+  ret = db_create(&secdbP, envP, 0);
+  if (ret != 0) {
+    envP->err(envP, ret, "[%s:%d] [%d] Failed to create DB handle.", __FILE__, __LINE__, getpid());
+    goto failXit;
+  }
+
+  ret = secdbP->open(secdbP, NULL, PORTFOLIOSSECDB, NULL, DB_UNKNOWN, DB_RDONLY, 0);
+  (void) secdbP->close(secdbP, 0);
+  secdbP = NULL;
+  if (ret == ENOENT) {
+    return BENCHMARK_SUCCESS;
+  }
+  else if (ret != 0) {
+    envP->err(envP, ret, "[%s:%d] [%d] Failed to open %s.", __FILE__, __LINE__, getpid(), PORTFOLIOSSECDB);
+    goto failXit;
+  }
+
+  memset(&new_key, 0, sizeof(DBT));
+  memset(&new_data, 0, sizeof(DBT));
+
+  while (!done) {
+    numChunk = 0;
+
+    ret = envP->txn_begin(envP, NULL, &txnP, DB_TXN_WAIT);
+    if (ret != 0) {
+      envP->err(envP, ret, "[%s:%d] [%d] Transaction begin failed.", __FILE__, __LINE__, getpid());
+      goto failXit;
+    }
+
+    ret = portfoliosdbP->cursor(portfoliosdbP, txnP, &cursorP, 0);
+    if (ret != 0) {
+      envP->err(envP, ret, "[%s:%d] [%d] Failed to create cursor for Portfolios.", __FILE__, __LINE__, getpid());
+      goto failXit;
+    }
+
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+
+    /* The last old key was deleted, so this lands on the one after it */
+    if (resume_size > 0) {
+      key.data = resume_key;
+      key.size = resume_size;
+      ret = cursorP->get(cursorP, &key, &data, DB_SET_RANGE | DB_RMW);
+    }
+    else {
+      ret = cursorP->get(cursorP, &key, &data, DB_FIRST | DB_RMW);
+    }
+
+    for (; ret == 0; ret = cursorP->get(cursorP, &key, &data, DB_NEXT | DB_RMW)) {
+      /* Already keyed on (account_id, symbol) */
+      if (key.size == sizeof(PORTFOLIOS_KEY) || data.size != sizeof(PORTFOLIOS)) {
+        continue;
+      }
+
+      if (numChunk == BENCHMARK_MIGRATE_CHUNK) {
+        break;
+      }
+
+      memcpy(&portfolio, data.data, sizeof(PORTFOLIOS));
+
+      /* An oversized key cannot be resumed from. The next chunk starts
+       * over instead, skipping what is migrated already */
+      resume_size = 0;
+      if (key.size <= sizeof(resume_key)) {
+        memcpy(resume_key, key.data, key.size);
+        resume_size = key.size;
+      }
+
+      ret = cursorP->del(cursorP, 0);
+      if (ret != 0) {
+        envP->err(envP, ret, "[%s:%d] [%d] Failed to delete portfolio %s.", __FILE__, __LINE__, getpid(), portfolio.portfolio_id);
+        goto failXit;
+      }
+
+      set_portfolio_key(&portfolio_key, portfolio.account_id, portfolio.symbol);
+      new_key.data = &portfolio_key;
+      new_key.size = sizeof(PORTFOLIOS_KEY);
+
+      /* The old layout allowed several records for the same account
+       * and symbol. Their holdings are merged */
+      memset(&old_data, 0, sizeof(DBT));
+      ret = portfoliosdbP->get(portfoliosdbP, txnP, &new_key, &old_data, DB_RMW);
+      if (ret == 0) {
+        portfolio.hold_stocks += ((PORTFOLIOS *)old_data.data)->hold_stocks;
+      }
+      else if (ret != DB_NOTFOUND) {
+        envP->err(envP, ret, "[%s:%d] [%d] Failed to look up Portfolios.", __FILE__, __LINE__, getpid());
+        goto failXit;
+      }
+
+      new_data.data = &portfolio;
+      new_data.size = sizeof(PORTFOLIOS);
+
+      ret = portfoliosdbP->put(portfoliosdbP, txnP, &new_key, &new_data, 0);
+      if (ret != 0) {
+        envP->err(envP, ret, "[%s:%d] [%d] Failed to re-key portfolio %s.", __FILE__, __LINE__, getpid(), portfolio.portfolio_id);
+        goto failXit;
+      }
+
+      numChunk ++;
+    }
+
+    if (ret == DB_NOTFOUND) {
+      done = 1;
+    }
+    else if (ret != 0) {
+      envP->err(envP, ret, "[%s:%d] [%d] Failed to read Portfolios.", __FILE__, __LINE__, getpid());
+      goto failXit;
+    }
+
+    ret = cursorP->close(cursorP);
+    cursorP = NULL;
+    if (ret != 0) {
+      envP->err(envP, ret, "[%s:%d] [%d] Failed to close cursor.", __FILE__, __LINE__, getpid());
+      goto failXit;
+    }
+
+    ret = txnP->commit(txnP, 0);
+    txnP = NULL;
+    if (ret != 0) {
+      envP->err(envP, ret, "[%s:%d] [%d] Transaction commit failed.", __FILE__, __LINE__, getpid());
+      goto failXit;
+    }
+
+    numMigrated += numChunk;
+  }
+
+  if (numMigrated > 0) {
+    benchmark_info("Re-keyed %d portfolios on (account_id, symbol)", numMigrated);
+  }
+
+  ret = envP->dbremove(envP, NULL, PORTFOLIOSSECDB, NULL, DB_AUTO_COMMIT);
+  if (ret != 0 && ret != ENOENT) {
+    envP->err(envP, ret, "[%s:%d] [%d] Failed to remove %s.", __FILE__, __LINE__, getpid(), PORTFOLIOSSECDB);
+    goto failXit;
+  }
+
+  return BENCHMARK_SUCCESS;
+
+failXit:
+  if (cursorP != NULL) {
+    (void) cursorP->close(cursorP);
+  }
+
+  if (txnP != NULL) {
+    benchmark_warning("PID: %d About to abort transaction. txnP: %p", getpid(), txnP);
+    ret = txnP->abort(txnP);
+    if (ret != 0) {
+      envP->err(envP, ret, "[%s:%d] [%d] Transaction abort failed.", __FILE__, __LINE__, getpid());
+    }
+  }
+
+  return BENCHMARK_FAIL;
+}
@@ -12,6 +12,7 @@
 #include "chronos.h"
 #include "chronos_environment.h"
 #include "chronos_client.h"
+#include "chronos_socket.h"
 
 typedef struct chronosClientConnection_t {
   char                connectionName[256];
@@ -20,8 +21,109 @@ typedef struct chronosClientConnection_t {
   int                 socket_fd;
   chronosConnState_t  state;
   chronosEnv          envH; 
+
+  /* Responses are reassembled here */
+  chronosSocketBuffer_t recvBuffer;
+
+  /* Used when connected to a shm: address */
+  chronosShmConnection_t shmConnection;
+
+  /* Up to window requests can be sent before
+   * their responses are received */
+  int                 window;
+  int                 numInFlight;
+  unsigned int        nextRequestId;
+  unsigned int        inFlightIds[CHRONOS_MAX_PIPELINE_DEPTH];
 } chronosClientConnection_t;
 
+/*
+ * Forget about a request once its response has arrived
+ */
+static int
+chronosClientInFlightRemove(unsigned int request_id,
+                            chronosClientConnection_t *connectionP)
+{
+  int i;
+
+  for (i=0; i<connectionP->numInFlight; i++) {
+    if (connectionP->inFlightIds[i] == request_id) {
+      break;
+    }
+  }
+
+  if (i == connectionP->numInFlight) {
+    chronos_error("Received response for unknown request: %u", request_id);
+    goto failXit;
+  }
+
+  connectionP->numInFlight --;
+  connectionP->inFlightIds[i] = connectionP->inFlightIds[connectionP->numInFlight];
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Bookkeeping common to all the ways of receiving a response.
+ * For a batch, txn_rc_arr already holds the per transaction rcs.
+ */
+static int
+chronosClientResponseProcess(const chronosResponsePacket_t *responseP,
+                             int frameSize,
+                             int *txn_rc_arr,
+                             int *num_txns_ret,
+                             unsigned int *request_id_ret,
+                             chronosClientConnection_t *connectionP)
+{
+  int rc;
+
+#ifdef CHRONOS_DEBUG_2
+  chronos_info("Txn: %d, rc: %d", responseP->txn_type, responseP->rc);
+#endif
+
+  if (frameSize > (int) sizeof(*responseP)) {
+    *num_txns_ret = responseP->rc;
+  }
+  else {
+    txn_rc_arr[0] = responseP->rc;
+    *num_txns_ret = 1;
+  }
+
+  rc = chronosClientInFlightRemove(responseP->request_id, connectionP);
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  if (request_id_ret != NULL) {
+    *request_id_ret = responseP->request_id;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * The result of a batch as a whole: the rc of
+ * the first transaction that failed, or 0.
+ */
+static int
+chronosClientBatchResultGet(const int *txn_rc_arr, int num_txns)
+{
+  int i;
+
+  for (i=0; i<num_txns; i++) {
+    if (txn_rc_arr[i] != 0) {
+      return txn_rc_arr[i];
+    }
+  }
+
+  return 0;
+}
+
 chronosEnv
 chronosClientEnvGet(chronosConnHandle connH)
 {
@@ -60,6 +162,10 @@ chronosClientDisconnect(chronosConnHandle connH)
   connectionP = (chronosClientConnection_t *) connH;
 
   if (connectionP->state == CHRONOS_CONNECTION_CONNECTED) {
+    if (connectionP->recvBuffer.shmP != NULL) {
+      chronosShmClose(connectionP->recvBuffer.shmP);
+      connectionP->recvBuffer.shmP = NULL;
+    }
     close(connectionP->socket_fd);
     connectionP->socket_fd = -1;
   }
@@ -82,7 +188,8 @@ chronosClientConnect(const char *serverAddress,
   int socket_fd;
   int rc = CHRONOS_SUCCESS;
   chronosClientConnection_t *connectionP = NULL;
-  struct sockaddr_in chronos_server_address;
+  struct sockaddr_storage chronos_server_address;
+  socklen_t chronos_server_address_len;
   struct pollfd fds[1];
 
   if (connH == NULL) {
@@ -90,7 +197,8 @@ chronosClientConnect(const char *serverAddress,
     goto failXit;
   }
 
-  if (serverPort == 0 || serverAddress == NULL) {
+  if (serverAddress == NULL 
+      || (serverPort == 0 && !chronosSocketAddressIsUnix(serverAddress))) {
     chronos_error("Invalid arguments");
     goto failXit;
   }
@@ -120,7 +228,15 @@ chronosClientConnect(const char *serverAddress,
              serverPort);
   }
 
-  socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+  rc = chronosSocketAddressGet(serverAddress, 
+                               serverPort,
+                               &chronos_server_address,
+                               &chronos_server_address_len);
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  socket_fd = socket(chronos_server_address.ss_family, SOCK_STREAM, 0);
   if (socket_fd == -1) {
     perror("socket() failed");
     goto failXit;
@@ -133,6 +249,19 @@ chronosClientConnect(const char *serverAddress,
     goto failXit;
   }
 
+  /* A non-blocking connect on a unix domain socket fails with
+   * EAGAIN instead of waiting when the server backlog is full,
+   * so connect those before making the socket non-blocking */
+  if (chronos_server_address.ss_family == AF_UNIX) {
+    rc = connect(socket_fd, 
+                 (struct sockaddr *)&chronos_server_address, 
+                 chronos_server_address_len);
+    if (rc < 0) {
+      perror("connect() failed");
+      goto failXit;
+    }
+  }
+
   /* Make non-blocking socket */
   rc = ioctl(socket_fd, FIONBIO, (char *)&on);
   if (rc < 0) {
@@ -143,13 +272,16 @@ chronosClientConnect(const char *serverAddress,
   fds[0].fd = socket_fd;
   fds[0].events = POLLOUT;
 
-  chronos_server_address.sin_family = AF_INET;
-  chronos_server_address.sin_addr.s_addr = inet_addr(serverAddress);
-  chronos_server_address.sin_port = htons(serverPort);
-  
-  rc = connect(socket_fd, 
-                (struct sockaddr *)&chronos_server_address, 
-                sizeof(chronos_server_address));
+  if (chronos_server_address.ss_family == AF_UNIX) {
+    /* already connected */
+    rc = 0;
+  }
+  else {
+    rc = connect(socket_fd, 
+                  (struct sockaddr *)&chronos_server_address, 
+                  chronos_server_address_len);
+  }
+
   if (rc < 0 && errno != EINPROGRESS) {
     perror("connect() failed");
     goto failXit;
@@ -192,6 +324,20 @@ chronosClientConnect(const char *serverAddress,
   }
 
   connectionP->socket_fd = socket_fd;
+  chronosSocketBufferInit(&connectionP->recvBuffer, socket_fd);
+
+  /* From now on, packets go through shared memory. The
+   * socket only stays open for the server to notice when we leave */
+  if (chronosSocketAddressIsShm(serverAddress)) {
+    rc = chronosShmConnect(socket_fd, &connectionP->shmConnection);
+    if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Could not set up shared memory connection");
+      goto failXit;
+    }
+
+    chronosSocketBufferShmSet(&connectionP->recvBuffer, &connectionP->shmConnection);
+  }
+  connectionP->numInFlight = 0;
 
   connectionP->state = CHRONOS_CONNECTION_CONNECTED;
 
@@ -226,6 +372,7 @@ chronosConnHandleAlloc(chronosEnv envH)
 
   connectionP->envH = envH;
   connectionP->state = CHRONOS_CONNECTION_DISCONNECTED;
+  connectionP->window = 1;
   goto cleanup;
 
 failXit:
@@ -274,6 +421,76 @@ cleanup:
   return rc;
 }
 
+/*
+ * Returns the socket of a connected handle, so that callers
+ * can multiplex many connections with poll/epoll
+ */
+int
+chronosClientSocketGet(chronosConnHandle connH)
+{
+  chronosClientConnection_t *connectionP = NULL;
+
+  if (connH == NULL) {
+    chronos_error("Invalid handle");
+    return -1;
+  }
+
+  connectionP = (chronosClientConnection_t *) connH;
+
+  if (connectionP->state != CHRONOS_CONNECTION_CONNECTED) {
+    return -1;
+  }
+
+  /* For shared memory connections this is the event fd
+   * that becomes readable when responses arrive */
+  return connectionP->recvBuffer.socket_fd;
+}
+
+/*
+ * Sets how many requests can be in flight on this connection
+ */
+int
+chronosClientWindowSet(int window, chronosConnHandle connH)
+{
+  chronosClientConnection_t *connectionP = NULL;
+
+  if (connH == NULL) {
+    chronos_error("Invalid handle");
+    goto failXit;
+  }
+
+  if (window < 1 || window > CHRONOS_MAX_PIPELINE_DEPTH) {
+    chronos_error("Window must be between 1 and %d", CHRONOS_MAX_PIPELINE_DEPTH);
+    goto failXit;
+  }
+
+  connectionP = (chronosClientConnection_t *) connH;
+  connectionP->window = window;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL; 
+}
+
+/*
+ * Returns how many more requests can be sent before
+ * a response has to be received
+ */
+int
+chronosClientWindowAvailable(chronosConnHandle connH)
+{
+  chronosClientConnection_t *connectionP = NULL;
+
+  if (connH == NULL) {
+    chronos_error("Invalid handle");
+    return 0;
+  }
+
+  connectionP = (chronosClientConnection_t *) connH;
+  return connectionP->window - connectionP->numInFlight;
+}
+
 /*
  * Sends a transaction request to the Chronos Server
  */
@@ -281,8 +498,10 @@ int
 chronosClientSendRequest(chronosRequest    requestH,
                          chronosConnHandle connH)
 {
-  int written, to_write;
-  char *buf = NULL;
+  int rc;
+  size_t encodedSize = 0;
+  unsigned int request_id;
+  char buf[CHRONOS_REQUEST_MAX_ENCODED_SIZE];
   chronosClientConnection_t *connectionP = NULL;
 
   if (connH == NULL) {
@@ -307,20 +526,96 @@ chronosClientSendRequest(chronosRequest    requestH,
                 chronosRequestTypeGet(requestH));
 #endif
 
-  buf = (char *)requestH;
-  to_write = chronosRequestSizeGet(requestH);
- 
-  while(to_write >0) {
-    written = write(connectionP->socket_fd, buf, to_write);
-    if (written < 0) {
-      chronos_error("Failed to write to socket");
-      goto failXit;
-    }
+  if (connectionP->numInFlight >= connectionP->window) {
+    chronos_error("Too many requests in flight");
+    goto failXit;
+  }
+
+  request_id = ++ connectionP->nextRequestId;
+  chronosRequestIdSet(request_id, requestH);
+
+  rc = chronosRequestEncode(requestH, buf, sizeof(buf), &encodedSize);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to encode request");
+    goto failXit;
+  }
+
+  rc = chronosSocketBufferSendAll(&connectionP->recvBuffer,
+                                  buf,
+                                  encodedSize,
+                                  NULL);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to write to socket");
+    goto failXit;
+  }
+
+  connectionP->inFlightIds[connectionP->numInFlight] = request_id;
+  connectionP->numInFlight ++;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL; 
+}
+
+/*
+ * Sends several transaction requests in a single packet. They are
+ * queued together on the server and answered with a single response,
+ * so the batch takes only one place in the window.
+ */
+int
+chronosClientSendBatch(chronosRequest    *requestsArr,
+                       int                numRequests,
+                       chronosConnHandle  connH)
+{
+  int rc;
+  size_t encodedSize = 0;
+  unsigned int request_id;
+  char buf[CHRONOS_BATCH_MAX_ENCODED_SIZE];
+  chronosClientConnection_t *connectionP = NULL;
+
+  if (connH == NULL) {
+    chronos_error("Invalid handle");
+    goto failXit;
+  }
+
+  if (requestsArr == NULL || numRequests < 1 || numRequests > CHRONOS_MAX_BATCH_SIZE) {
+    chronos_error("Invalid batch");
+    goto failXit;
+  }
+
+  connectionP = (chronosClientConnection_t *) connH;
+
+  if (connectionP->state != CHRONOS_CONNECTION_CONNECTED) {
+    chronos_error("Invalid connection state");
+    goto failXit;
+  }
 
-    to_write -= written;
-    buf += written;
+  if (connectionP->numInFlight >= connectionP->window) {
+    chronos_error("Too many requests in flight");
+    goto failXit;
   }
 
+  request_id = ++ connectionP->nextRequestId;
+
+  rc = chronosRequestBatchEncode(requestsArr, numRequests, request_id, buf, sizeof(buf), &encodedSize);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to encode batch");
+    goto failXit;
+  }
+
+  rc = chronosSocketBufferSendAll(&connectionP->recvBuffer,
+                                  buf,
+                                  encodedSize,
+                                  NULL);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to write to socket");
+    goto failXit;
+  }
+
+  connectionP->inFlightIds[connectionP->numInFlight] = request_id;
+  connectionP->numInFlight ++;
+
   return CHRONOS_SUCCESS;
 
 failXit:
@@ -334,14 +629,63 @@ int
 chronosClientReceiveResponse(int *txn_rc_ret, 
                              chronosConnHandle connH, 
                              int (*isTimeToDieFp) (void))
+{
+  return chronosClientReceiveResponseId(txn_rc_ret, NULL, connH, isTimeToDieFp);
+}
+
+/* 
+ * Waits for the next response from chronos server. With several
+ * requests in flight, responses may arrive in any order: 
+ * request_id_ret tells which request this response belongs to.
+ * For a batch, txn_rc_ret is 0 only if all its transactions succeeded.
+ */
+int
+chronosClientReceiveResponseId(int *txn_rc_ret, 
+                               unsigned int *request_id_ret,
+                               chronosConnHandle connH, 
+                               int (*isTimeToDieFp) (void))
+{
+  int rc;
+  int num_txns = 0;
+  int txn_rc_arr[CHRONOS_MAX_BATCH_SIZE];
+
+  if (txn_rc_ret == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  rc = chronosClientReceiveBatchResponse(txn_rc_arr, &num_txns, request_id_ret, connH, isTimeToDieFp);
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  *txn_rc_ret = chronosClientBatchResultGet(txn_rc_arr, num_txns);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL; 
+}
+
+/* 
+ * Waits for the next response from chronos server, which may be
+ * the answer to a batch. txn_rc_arr receives the rc of each transaction
+ * (just one if it was not a batch), so it must have room for 
+ * CHRONOS_MAX_BATCH_SIZE entries.
+ */
+int
+chronosClientReceiveBatchResponse(int *txn_rc_arr, 
+                                  int *num_txns_ret,
+                                  unsigned int *request_id_ret,
+                                  chronosConnHandle connH, 
+                                  int (*isTimeToDieFp) (void))
 {
   int rc;
-  int num_bytes;
-  chronosResponse responseH = NULL; 
+  int frameSize;
+  chronosResponsePacket_t response;
   chronosClientConnection_t *connectionP = NULL;
-  struct pollfd fds[1];
 
-  if (connH == NULL || txn_rc_ret == NULL) {
+  if (connH == NULL || txn_rc_arr == NULL || num_txns_ret == NULL) {
     chronos_error("Invalid handle");
     goto failXit;
   }
@@ -353,67 +697,124 @@ chronosClientReceiveResponse(int *txn_rc_ret,
     goto failXit;
   }
 
-  responseH = chronosResponseAlloc();
-  if (responseH == NULL) {
-    chronos_error("Could not create response");
+  rc = chronosSocketRecvFrame(&connectionP->recvBuffer,
+                              &response,
+                              sizeof(response),
+                              isTimeToDieFp);
+  if (rc == CHRONOS_SOCKET_CLOSED) {
+    chronos_error("socket closed");
+    goto failXit;
+  }
+  else if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to receive response");
     goto failXit;
   }
 
-  fds[0].fd = connectionP->socket_fd;
-  fds[0].events = POLLIN;
-
-  /* While we are interested in reading from this 
-   * socket 
-   */
-  while(fds[0].events) {
-    char *buf = (char *) responseH;
-    int   to_read = chronosResponseSizeGet(responseH);
+  frameSize = chronosResponseFrameSize(&response);
+  if (frameSize < 0) {
+    goto failXit;
+  }
 
-    if (isTimeToDieFp()) {
-      chronos_error("requested to die");
+  if (frameSize > (int) sizeof(response)) {
+    rc = chronosSocketRecvFrame(&connectionP->recvBuffer,
+                                txn_rc_arr,
+                                frameSize - sizeof(response),
+                                isTimeToDieFp);
+    if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Failed to receive response");
       goto failXit;
     }
+  }
 
-    rc = poll(fds, 1, 1000 /* one second */);
-    if (rc < 0) {
-      perror("poll() failed");
+  rc = chronosClientResponseProcess(&response, frameSize, txn_rc_arr, num_txns_ret, request_id_ret, connectionP);
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL; 
+}
+
+/* 
+ * Non-blocking version of chronosClientReceiveResponseId(). It reads
+ * whatever the socket has and returns CHRONOS_CLIENT_NO_RESPONSE if 
+ * a complete response has not arrived yet. Call it until it returns
+ * CHRONOS_CLIENT_NO_RESPONSE to drain all buffered responses.
+ */
+int
+chronosClientResponsePoll(int *txn_rc_ret, 
+                          unsigned int *request_id_ret,
+                          chronosConnHandle connH)
+{
+  int rc;
+  int frameSize;
+  int num_txns = 0;
+  int txn_rc_arr[CHRONOS_MAX_BATCH_SIZE];
+  chronosResponsePacket_t response;
+  chronosClientConnection_t *connectionP = NULL;
+
+  if (connH == NULL || txn_rc_ret == NULL) {
+    chronos_error("Invalid handle");
+    goto failXit;
+  }
+
+  connectionP = (chronosClientConnection_t *) connH;
+
+  if (connectionP->state != CHRONOS_CONNECTION_CONNECTED) {
+    chronos_error("Invalid connection state");
+    goto failXit;
+  }
+
+  /* Only read when what is buffered is not a whole response */
+  if (chronosSocketBufferPeek(&connectionP->recvBuffer, &response, sizeof(response)) != CHRONOS_SUCCESS
+      || chronosSocketBufferAvailable(&connectionP->recvBuffer) < chronosResponseFrameSize(&response)) {
+    rc = chronosSocketBufferFill(&connectionP->recvBuffer);
+    if (rc == CHRONOS_SOCKET_CLOSED) {
+      chronos_error("socket closed");
       goto failXit;
     }
-    else if (rc == 0) {
-      chronos_error("poll() timed out");
-      continue;
+    else if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Failed to receive response");
+      goto failXit;
     }
 
-    assert(fds[0].revents);
+    if (chronosSocketBufferPeek(&connectionP->recvBuffer, &response, sizeof(response)) != CHRONOS_SUCCESS) {
+      return CHRONOS_CLIENT_NO_RESPONSE;
+    }
+  }
 
-    while (to_read > 0) {
-      num_bytes = read(connectionP->socket_fd, buf, 1);
-      if (num_bytes < 0) {
-        perror("read() failed");
-        goto failXit;
-      }
-      else if (num_bytes == 0) {
-        chronos_error("socket closed");
-        fds[0].events = 0;
-        goto failXit;
-      }
+  frameSize = chronosResponseFrameSize(&response);
+  if (frameSize < 0) {
+    goto failXit;
+  }
+
+  if (chronosSocketBufferAvailable(&connectionP->recvBuffer) < frameSize) {
+    return CHRONOS_CLIENT_NO_RESPONSE;
+  }
+
+  rc = chronosSocketBufferConsume(&connectionP->recvBuffer, &response, sizeof(response));
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
 
-      to_read -= num_bytes;
-      buf += num_bytes;
+  if (frameSize > (int) sizeof(response)) {
+    rc = chronosSocketBufferConsume(&connectionP->recvBuffer, txn_rc_arr, frameSize - sizeof(response));
+    if (rc != CHRONOS_SUCCESS) {
+      goto failXit;
     }
+  }
 
-#ifdef CHRONOS_DEBUG_2
-    chronos_info("Txn: %d, rc: %d", 
-                  chronosResponseTypeGet(responseH),
-                  chronosResponseResultGet(responseH));
-#endif
-    *txn_rc_ret = chronosResponseResultGet(responseH);
-    break;
+  rc = chronosClientResponseProcess(&response, frameSize, txn_rc_arr, &num_txns, request_id_ret, connectionP);
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
   }
 
+  *txn_rc_ret = chronosClientBatchResultGet(txn_rc_arr, num_txns);
+
   return CHRONOS_SUCCESS;
 
 failXit:
   return CHRONOS_FAIL; 
 }
-
@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "chronos.h"
+#include "chronos_config.h"
+#include "chronos_completion.h"
+
+#define CHRONOS_COMPLETION_DONE     (0x1)
+#define CHRONOS_COMPLETION_WAITING  (0x2)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHRONOS_CPU_RELAX()   __asm__ __volatile__("pause" ::: "memory")
+#else
+#define CHRONOS_CPU_RELAX()   __asm__ __volatile__("" ::: "memory")
+#endif
+
+/* How long this thread spins before sleeping. It grows while
+ * txns finish during the spin and shrinks when they do not */
+static __thread int completionSpins = CHRONOS_COMPLETION_MAX_SPINS;
+
+static int
+futex_wait(volatile int *addrP, int val, const struct timespec *timeoutP)
+{
+  return syscall(SYS_futex, addrP, FUTEX_WAIT_PRIVATE, val, timeoutP, NULL, 0);
+}
+
+static int
+futex_wake(volatile int *addrP, int numWakeups)
+{
+  return syscall(SYS_futex, addrP, FUTEX_WAKE_PRIVATE, numWakeups, NULL, NULL, 0);
+}
+
+int
+chronosCompletionInit(chronosCompletion_t *completionP, 
+                      int notify_fd, 
+                      void *notify_arg)
+{
+  if (completionP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  completionP->state = 0;
+  completionP->rc = 0;
+  completionP->notify_fd = notify_fd;
+  completionP->notify_arg = notify_arg;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Publish the rc and wake up the submitter. The completion may
+ * be gone as soon as it is marked done, so it is not touched after.
+ */
+int
+chronosCompletionSignal(chronosCompletion_t *completionP, 
+                        int rc)
+{
+  int   old_state;
+  int   notify_fd;
+  void *notify_arg;
+
+  if (completionP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  notify_fd = completionP->notify_fd;
+  notify_arg = completionP->notify_arg;
+
+  completionP->rc = rc;
+
+  /* Full barrier: the rc is visible before the done bit */
+  old_state = __sync_fetch_and_or(&completionP->state, CHRONOS_COMPLETION_DONE);
+
+  if (old_state & CHRONOS_COMPLETION_WAITING) {
+    (void) futex_wake(&completionP->state, INT_MAX);
+  }
+
+  if (notify_fd >= 0) {
+    if (write(notify_fd, &notify_arg, sizeof(notify_arg)) != sizeof(notify_arg)) {
+      chronos_error("Failed to notify txn completion");
+      goto failXit;
+    }
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Block until the completion is signaled. Spin for a short
+ * while first, since many txns are done in a few microseconds.
+ *
+ * There is no giving up, not even when it is time to die: the
+ * processing thread writes to the completion when it is done,
+ * so it has to be there until then.
+ */
+int
+chronosCompletionWait(chronosCompletion_t *completionP, 
+                      int *rc_ret)
+{
+  int i;
+  int state;
+
+  if (completionP == NULL || rc_ret == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  for (i=0; i<completionSpins; i++) {
+    if (completionP->state & CHRONOS_COMPLETION_DONE) {
+      if (completionSpins < CHRONOS_COMPLETION_MAX_SPINS) {
+        completionSpins = 2 * completionSpins + 1;
+        if (completionSpins > CHRONOS_COMPLETION_MAX_SPINS) {
+          completionSpins = CHRONOS_COMPLETION_MAX_SPINS;
+        }
+      }
+      goto doneXit;
+    }
+    CHRONOS_CPU_RELAX();
+  }
+  if (completionSpins > 1) {
+    completionSpins /= 2;
+  }
+
+  while (1) {
+    state = completionP->state;
+    if (state & CHRONOS_COMPLETION_DONE) {
+      break;
+    }
+
+    if (!(state & CHRONOS_COMPLETION_WAITING)) {
+      if (!__sync_bool_compare_and_swap(&completionP->state, state, state | CHRONOS_COMPLETION_WAITING)) {
+        continue;
+      }
+      state |= CHRONOS_COMPLETION_WAITING;
+    }
+
+    /* Returns right away if the state changed in the meantime */
+    if (futex_wait(&completionP->state, state, NULL) != 0
+        && errno != EAGAIN && errno != EINTR) {
+      perror("futex() failed");
+      goto failXit;
+    }
+  }
+
+doneXit:
+  *rc_ret = chronosCompletionResultGet(completionP);
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * The rc of a completion which is known to be done
+ */
+int
+chronosCompletionResultGet(const chronosCompletion_t *completionP)
+{
+  /* Pairs with the barrier in chronosCompletionSignal() */
+  __sync_synchronize();
+  return completionP->rc;
+}
+
+int
+chronosEventInit(chronosEvent_t *eventP)
+{
+  if (eventP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  eventP->seq = 0;
+  eventP->numWaiters = 0;
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Announce that we are about to wait. The returned sequence 
+ * number has to be passed to chronosEventWait()
+ */
+int
+chronosEventWaitPrepare(chronosEvent_t *eventP)
+{
+  /* Full barrier: signalers that come after this see the waiter */
+  __sync_fetch_and_add(&eventP->numWaiters, 1);
+  return eventP->seq;
+}
+
+int
+chronosEventWaitCancel(chronosEvent_t *eventP)
+{
+  __sync_fetch_and_sub(&eventP->numWaiters, 1);
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Sleep until the event is signaled after seq was obtained,
+ * or until timeout_ms go by
+ */
+int
+chronosEventWait(chronosEvent_t *eventP, 
+                 int seq, 
+                 int timeout_ms)
+{
+  int rc = CHRONOS_SUCCESS;
+  struct timespec timeout;
+
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+  if (futex_wait(&eventP->seq, seq, &timeout) != 0
+      && errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+    perror("futex() failed");
+    rc = CHRONOS_FAIL;
+  }
+
+  __sync_fetch_and_sub(&eventP->numWaiters, 1);
+
+  return rc;
+}
+
+/*
+ * Wake up to numWakeups waiters. Cheap when nobody waits.
+ */
+int
+chronosEventSignal(chronosEvent_t *eventP, 
+                   int numWakeups)
+{
+  /* Full barrier: whatever the waiters check is visible before */
+  __sync_fetch_and_add(&eventP->seq, 1);
+
+  if (eventP->numWaiters > 0) {
+    (void) futex_wake(&eventP->seq, numWakeups);
+  }
+
+  return CHRONOS_SUCCESS;
+}
+
+int
+chronosAdmissionGateInit(chronosAdmissionGate_t *gateP)
+{
+  if (gateP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  gateP->debt = 0;
+  gateP->numWaiters = 0;
+  gateP->numWatchers = 0;
+  gateP->headP = NULL;
+  gateP->tailP = NULL;
+  gateP->watchersP = NULL;
+
+  if (pthread_mutex_init(&gateP->mutex, NULL) != 0) {
+    chronos_error("Failed to init mutex");
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosAdmissionGateDestroy(chronosAdmissionGate_t *gateP)
+{
+  if (gateP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  pthread_mutex_destroy(&gateP->mutex);
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Let waiters in, oldest first, for as long as the gate is open.
+ * If it is still open after that, tell the watchers.
+ */
+static void
+chronosAdmissionGateAdmit(chronosAdmissionGate_t *gateP)
+{
+  chronosAdmissionWaiter_t *waiterP = NULL;
+  chronosAdmissionWatcher_t *watcherP = NULL;
+
+  pthread_mutex_lock(&gateP->mutex);
+
+  while (gateP->headP != NULL && gateP->debt <= 0) {
+    waiterP = gateP->headP;
+    gateP->headP = waiterP->nextP;
+    if (gateP->headP == NULL) {
+      gateP->tailP = NULL;
+    }
+    __sync_fetch_and_sub(&gateP->numWaiters, 1);
+
+    /* The waiter takes the mutex before leaving, so its
+     * entry is still there when we wake it up */
+    waiterP->admitted = 1;
+    (void) futex_wake(&waiterP->admitted, 1);
+  }
+
+  while (gateP->watchersP != NULL && gateP->debt <= 0) {
+    watcherP = gateP->watchersP;
+    gateP->watchersP = watcherP->nextP;
+    watcherP->queued = 0;
+    __sync_fetch_and_sub(&gateP->numWatchers, 1);
+
+    if (write(watcherP->notify_fd, &watcherP->notify_arg, sizeof(watcherP->notify_arg)) != sizeof(watcherP->notify_arg)) {
+      chronos_error("Failed to notify that the gate opened");
+    }
+  }
+
+  pthread_mutex_unlock(&gateP->mutex);
+}
+
+/*
+ * Close the gate until debt txns finish, or open it if debt is 0
+ */
+int
+chronosAdmissionGateSet(chronosAdmissionGate_t *gateP, 
+                        int debt)
+{
+  if (gateP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  gateP->debt = debt > 0 ? debt : 0;
+  __sync_synchronize();
+
+  if (debt <= 0 && (gateP->numWaiters > 0 || gateP->numWatchers > 0)) {
+    chronosAdmissionGateAdmit(gateP);
+  }
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * One more txn finished. The gate opens when the debt is paid off
+ */
+int
+chronosAdmissionGateTxnDone(chronosAdmissionGate_t *gateP)
+{
+  int debt;
+
+  if (gateP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  do {
+    debt = gateP->debt;
+    if (debt <= 0) {
+      return CHRONOS_SUCCESS;
+    }
+  } while (!__sync_bool_compare_and_swap(&gateP->debt, debt, debt - 1));
+
+  if (debt == 1 && (gateP->numWaiters > 0 || gateP->numWatchers > 0)) {
+    chronosAdmissionGateAdmit(gateP);
+  }
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Whether a new txn can go in right now, without waiting. 
+ * If others are already waiting, it cannot.
+ */
+int
+chronosAdmissionGateTryEnter(chronosAdmissionGate_t *gateP)
+{
+  return gateP->debt <= 0 && gateP->numWaiters == 0;
+}
+
+/*
+ * Block until a new txn can go in
+ */
+int
+chronosAdmissionGateEnter(chronosAdmissionGate_t *gateP, 
+                          int (*isTimeToDieFp) (void))
+{
+  int rc = CHRONOS_SUCCESS;
+  chronosAdmissionWaiter_t  waiter;
+  chronosAdmissionWaiter_t **waiterPP = NULL;
+  struct timespec timeout = {1, 0};
+
+  if (gateP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  if (chronosAdmissionGateTryEnter(gateP)) {
+    return CHRONOS_SUCCESS;
+  }
+
+  pthread_mutex_lock(&gateP->mutex);
+
+  /* The gate may have opened meanwhile */
+  if (gateP->debt <= 0 && gateP->headP == NULL) {
+    pthread_mutex_unlock(&gateP->mutex);
+    return CHRONOS_SUCCESS;
+  }
+
+  waiter.admitted = 0;
+  waiter.nextP = NULL;
+  if (gateP->tailP != NULL) {
+    gateP->tailP->nextP = &waiter;
+  }
+  else {
+    gateP->headP = &waiter;
+  }
+  gateP->tailP = &waiter;
+  __sync_fetch_and_add(&gateP->numWaiters, 1);
+
+  pthread_mutex_unlock(&gateP->mutex);
+
+  /* The debt may have been paid off before we were queued */
+  if (gateP->debt <= 0) {
+    chronosAdmissionGateAdmit(gateP);
+  }
+
+  while (!waiter.admitted) {
+    if (futex_wait(&waiter.admitted, 0, &timeout) != 0
+        && errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+      perror("futex() failed");
+      rc = CHRONOS_FAIL;
+      break;
+    }
+
+    if (isTimeToDieFp && isTimeToDieFp()) {
+      chronos_info("Requested to die");
+      rc = CHRONOS_FAIL;
+      break;
+    }
+  }
+
+  pthread_mutex_lock(&gateP->mutex);
+
+  if (!waiter.admitted) {
+    /* Leave the queue */
+    for (waiterPP = &gateP->headP; *waiterPP != NULL; waiterPP = &((*waiterPP)->nextP)) {
+      if (*waiterPP == &waiter) {
+        *waiterPP = waiter.nextP;
+        break;
+      }
+    }
+
+    if (gateP->tailP == &waiter) {
+      gateP->tailP = NULL;
+      for (waiterPP = &gateP->headP; *waiterPP != NULL; waiterPP = &((*waiterPP)->nextP)) {
+        gateP->tailP = *waiterPP;
+      }
+    }
+    __sync_fetch_and_sub(&gateP->numWaiters, 1);
+  }
+  else {
+    rc = CHRONOS_SUCCESS;
+  }
+
+  pthread_mutex_unlock(&gateP->mutex);
+
+  return rc;
+}
+
+int
+chronosAdmissionWatcherInit(chronosAdmissionWatcher_t *watcherP, 
+                            int notify_fd, 
+                            void *notify_arg)
+{
+  if (watcherP == NULL || notify_fd < 0) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  watcherP->notify_fd = notify_fd;
+  watcherP->notify_arg = notify_arg;
+  watcherP->queued = 0;
+  watcherP->nextP = NULL;
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Have the watcher notified once the gate opens. Returns 0 without 
+ * queueing it if the gate is open already, and 1 otherwise. Queueing
+ * it again before it was notified changes nothing.
+ */
+int
+chronosAdmissionGateWatch(chronosAdmissionGate_t *gateP, 
+                          chronosAdmissionWatcher_t *watcherP)
+{
+  if (gateP == NULL || watcherP == NULL) {
+    chronos_error("Invalid argument");
+    return 0;
+  }
+
+  pthread_mutex_lock(&gateP->mutex);
+
+  /* With waiters still queued, the watcher goes after them */
+  if (gateP->debt <= 0 && gateP->headP == NULL) {
+    pthread_mutex_unlock(&gateP->mutex);
+    return 0;
+  }
+
+  if (!watcherP->queued) {
+    watcherP->queued = 1;
+    watcherP->nextP = gateP->watchersP;
+    gateP->watchersP = watcherP;
+    /* Full barrier: the last txn done either sees us or we see it */
+    __sync_fetch_and_add(&gateP->numWatchers, 1);
+  }
+
+  pthread_mutex_unlock(&gateP->mutex);
+
+  /* The debt may have been paid off before we were queued */
+  if (gateP->debt <= 0) {
+    chronosAdmissionGateAdmit(gateP);
+  }
+
+  return 1;
+}
+
+/*
+ * Take the watcher off the gate, if it is still waiting
+ */
+int
+chronosAdmissionGateUnwatch(chronosAdmissionGate_t *gateP, 
+                            chronosAdmissionWatcher_t *watcherP)
+{
+  chronosAdmissionWatcher_t **watcherPP = NULL;
+
+  if (gateP == NULL || watcherP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  pthread_mutex_lock(&gateP->mutex);
+
+  if (watcherP->queued) {
+    for (watcherPP = &gateP->watchersP; *watcherPP != NULL; watcherPP = &((*watcherPP)->nextP)) {
+      if (*watcherPP == watcherP) {
+        *watcherPP = watcherP->nextP;
+        break;
+      }
+    }
+    watcherP->queued = 0;
+    __sync_fetch_and_sub(&gateP->numWatchers, 1);
+  }
+
+  pthread_mutex_unlock(&gateP->mutex);
+
+  return CHRONOS_SUCCESS;
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "chronos.h"
+#include "chronos_group_commit.h"
+
+int
+chronosGroupCommitInit(chronosGroupCommit_t *groupCommitP,
+                       int windowUS,
+                       int batchSize,
+                       chronosGroupCommitFlushFn flushFn,
+                       void *flushArgP)
+{
+  if (groupCommitP == NULL || windowUS < 0 || batchSize < 1 || flushFn == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  memset(groupCommitP, 0, sizeof(chronosGroupCommit_t));
+  groupCommitP->windowUS = windowUS;
+  groupCommitP->batchSize = batchSize;
+  groupCommitP->flushFn = flushFn;
+  groupCommitP->flushArgP = flushArgP;
+
+  if (pthread_mutex_init(&groupCommitP->mutex, NULL) != 0) {
+    chronos_error("Failed to init mutex");
+    goto failXit;
+  }
+
+  if (pthread_cond_init(&groupCommitP->pendingCond, NULL) != 0) {
+    chronos_error("Failed to init condition variable");
+    goto failXit;
+  }
+
+  if (pthread_cond_init(&groupCommitP->flushedCond, NULL) != 0) {
+    chronos_error("Failed to init condition variable");
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosGroupCommitDestroy(chronosGroupCommit_t *groupCommitP)
+{
+  if (groupCommitP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  pthread_cond_destroy(&groupCommitP->flushedCond);
+  pthread_cond_destroy(&groupCommitP->pendingCond);
+  pthread_mutex_destroy(&groupCommitP->mutex);
+
+  return CHRONOS_SUCCESS;
+}
+
+void *
+chronosGroupCommitFlusher(void *argP)
+{
+  chronosGroupCommit_t *groupCommitP = (chronosGroupCommit_t *) argP;
+  unsigned long long    target;
+  int                   batch;
+  int                   rc;
+  struct timespec       deadline;
+
+  if (groupCommitP == NULL) {
+    chronos_error("Invalid argument");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&groupCommitP->mutex);
+
+  while (1) {
+    while (!groupCommitP->stop && groupCommitP->commitSeq == groupCommitP->flushedSeq) {
+      pthread_cond_wait(&groupCommitP->pendingCond, &groupCommitP->mutex);
+    }
+
+    if (groupCommitP->commitSeq == groupCommitP->flushedSeq) {
+      break;
+    }
+
+    /* Let the batch fill, but not for longer than the window */
+    if (groupCommitP->windowUS > 0) {
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += groupCommitP->windowUS / 1000000;
+      deadline.tv_nsec += (groupCommitP->windowUS % 1000000) * 1000;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec ++;
+        deadline.tv_nsec -= 1000000000;
+      }
+
+      while (!groupCommitP->stop
+             && groupCommitP->commitSeq - groupCommitP->flushedSeq < (unsigned long long) groupCommitP->batchSize) {
+        if (pthread_cond_timedwait(&groupCommitP->pendingCond, &groupCommitP->mutex, &deadline) == ETIMEDOUT) {
+          break;
+        }
+      }
+    }
+
+    target = groupCommitP->commitSeq;
+    pthread_mutex_unlock(&groupCommitP->mutex);
+
+    rc = groupCommitP->flushFn(groupCommitP->flushArgP);
+
+    pthread_mutex_lock(&groupCommitP->mutex);
+
+    if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Failed to flush the log. Commits are not durable anymore");
+      groupCommitP->broken = 1;
+      break;
+    }
+
+    batch = (int) (target - groupCommitP->flushedSeq);
+    groupCommitP->stats.numFlushes ++;
+    groupCommitP->stats.numCommits += batch;
+    if (batch > groupCommitP->stats.maxBatch) {
+      groupCommitP->stats.maxBatch = batch;
+    }
+
+    groupCommitP->flushedSeq = target;
+    pthread_cond_broadcast(&groupCommitP->flushedCond);
+  }
+
+  groupCommitP->flusherDone = 1;
+  pthread_cond_broadcast(&groupCommitP->flushedCond);
+  pthread_mutex_unlock(&groupCommitP->mutex);
+
+  return NULL;
+}
+
+int
+chronosGroupCommitStop(chronosGroupCommit_t *groupCommitP)
+{
+  if (groupCommitP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  pthread_mutex_lock(&groupCommitP->mutex);
+  groupCommitP->stop = 1;
+  pthread_cond_signal(&groupCommitP->pendingCond);
+  pthread_mutex_unlock(&groupCommitP->mutex);
+
+  return CHRONOS_SUCCESS;
+}
+
+int
+chronosGroupCommitWait(chronosGroupCommit_t *groupCommitP)
+{
+  int                rc = CHRONOS_SUCCESS;
+  unsigned long long ticket;
+  chronos_time_t     begin;
+  chronos_time_t     end;
+  chronos_time_t     elapsed;
+  double             wait_ms;
+
+  if (groupCommitP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  CHRONOS_TIME_GET(begin);
+
+  pthread_mutex_lock(&groupCommitP->mutex);
+
+  if (groupCommitP->broken) {
+    pthread_mutex_unlock(&groupCommitP->mutex);
+    return CHRONOS_FAIL;
+  }
+
+  /* Without a flusher, the caller flushes on its own */
+  if (groupCommitP->flusherDone) {
+    pthread_mutex_unlock(&groupCommitP->mutex);
+    return groupCommitP->flushFn(groupCommitP->flushArgP);
+  }
+
+  ticket = ++ groupCommitP->commitSeq;
+  pthread_cond_signal(&groupCommitP->pendingCond);
+
+  while (groupCommitP->flushedSeq < ticket && !groupCommitP->flusherDone) {
+    pthread_cond_wait(&groupCommitP->flushedCond, &groupCommitP->mutex);
+  }
+
+  if (groupCommitP->flushedSeq < ticket) {
+    rc = CHRONOS_FAIL;
+  }
+
+  CHRONOS_TIME_GET(end);
+  CHRONOS_TIME_NANO_OFFSET_GET(begin, end, elapsed);
+  wait_ms = elapsed.tv_sec * 1000.0 + elapsed.tv_nsec / 1000000.0;
+  groupCommitP->stats.cumulativeWaitMS += wait_ms;
+  if (wait_ms > groupCommitP->stats.maxWaitMS) {
+    groupCommitP->stats.maxWaitMS = wait_ms;
+  }
+
+  pthread_mutex_unlock(&groupCommitP->mutex);
+
+  return rc;
+}
+
+int
+chronosGroupCommitStatsGet(chronosGroupCommit_t *groupCommitP,
+                           chronosGroupCommitStats_t *stats_ret)
+{
+  if (groupCommitP == NULL || stats_ret == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  pthread_mutex_lock(&groupCommitP->mutex);
+  *stats_ret = groupCommitP->stats;
+  memset(&groupCommitP->stats, 0, sizeof(groupCommitP->stats));
+  pthread_mutex_unlock(&groupCommitP->mutex);
+
+  return CHRONOS_SUCCESS;
+}
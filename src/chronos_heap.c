@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chronos.h"
+#include "chronos_heap.h"
+
+#define HEAP_PARENT(_i)   (((_i) - 1) / 2)
+#define HEAP_LEFT(_i)     (2 * (_i) + 1)
+#define HEAP_RIGHT(_i)    (2 * (_i) + 2)
+
+static void
+chronosHeapSwap(chronosHeap_t *heapP, int i, int j)
+{
+  chronosHeapEntry_t tmp;
+
+  tmp = heapP->entries[i];
+  heapP->entries[i] = heapP->entries[j];
+  heapP->entries[j] = tmp;
+}
+
+static void
+chronosHeapSiftUp(chronosHeap_t *heapP, int i)
+{
+  while (i > 0 && heapP->entries[HEAP_PARENT(i)].key > heapP->entries[i].key) {
+    chronosHeapSwap(heapP, i, HEAP_PARENT(i));
+    i = HEAP_PARENT(i);
+  }
+}
+
+static void
+chronosHeapSiftDown(chronosHeap_t *heapP, int i)
+{
+  int smallest;
+
+  while (1) {
+    smallest = i;
+
+    if (HEAP_LEFT(i) < heapP->size 
+        && heapP->entries[HEAP_LEFT(i)].key < heapP->entries[smallest].key) {
+      smallest = HEAP_LEFT(i);
+    }
+
+    if (HEAP_RIGHT(i) < heapP->size 
+        && heapP->entries[HEAP_RIGHT(i)].key < heapP->entries[smallest].key) {
+      smallest = HEAP_RIGHT(i);
+    }
+
+    if (smallest == i) {
+      break;
+    }
+
+    chronosHeapSwap(heapP, i, smallest);
+    i = smallest;
+  }
+}
+
+int
+chronosHeapInit(chronosHeap_t *heapP, int capacity)
+{
+  if (heapP == NULL || capacity <= 0) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  heapP->entries = calloc(capacity, sizeof(chronosHeapEntry_t));
+  if (heapP->entries == NULL) {
+    chronos_error("Could not allocate heap");
+    goto failXit;
+  }
+
+  heapP->size = 0;
+  heapP->capacity = capacity;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosHeapDestroy(chronosHeap_t *heapP)
+{
+  if (heapP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  free(heapP->entries);
+  memset(heapP, 0, sizeof(*heapP));
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosHeapSize(const chronosHeap_t *heapP)
+{
+  return heapP->size;
+}
+
+/*
+ * Add an element. The heap grows as needed.
+ */
+int
+chronosHeapInsert(chronosHeap_t *heapP, unsigned long long key, void *data)
+{
+  chronosHeapEntry_t *newEntries = NULL;
+
+  if (heapP == NULL || heapP->entries == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (heapP->size == heapP->capacity) {
+    newEntries = realloc(heapP->entries, 2 * heapP->capacity * sizeof(chronosHeapEntry_t));
+    if (newEntries == NULL) {
+      chronos_error("Could not grow heap");
+      goto failXit;
+    }
+    heapP->entries = newEntries;
+    heapP->capacity *= 2;
+  }
+
+  heapP->entries[heapP->size].key = key;
+  heapP->entries[heapP->size].data = data;
+  heapP->size ++;
+
+  chronosHeapSiftUp(heapP, heapP->size - 1);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Look at the element with the smallest key, without removing it.
+ * Fails if the heap is empty.
+ */
+int
+chronosHeapPeek(const chronosHeap_t *heapP, unsigned long long *key_ret, void **data_ret)
+{
+  if (heapP == NULL || heapP->size == 0) {
+    goto failXit;
+  }
+
+  if (key_ret) {
+    *key_ret = heapP->entries[0].key;
+  }
+
+  if (data_ret) {
+    *data_ret = heapP->entries[0].data;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Remove the element with the smallest key.
+ * Fails if the heap is empty.
+ */
+int
+chronosHeapRemoveMin(chronosHeap_t *heapP, unsigned long long *key_ret, void **data_ret)
+{
+  if (chronosHeapPeek(heapP, key_ret, data_ret) != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  heapP->size --;
+  if (heapP->size > 0) {
+    heapP->entries[0] = heapP->entries[heapP->size];
+    chronosHeapSiftDown(heapP, 0);
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
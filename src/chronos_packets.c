@@ -330,6 +330,38 @@ failXit:
   return CHRONOS_USER_TXN_INVAL;
 }
 
+/*
+ * Size of a single data item for the given transaction type.
+ * System transactions (CHRONOS_USER_TXN_MAX) carry symbols.
+ */
+static size_t
+chronosRequestItemSizeGet(int txn_type)
+{
+  switch (txn_type) {
+    case CHRONOS_USER_TXN_VIEW_STOCK:
+      return sizeof(chronosSymbol_t);
+
+    case CHRONOS_USER_TXN_VIEW_PORTFOLIO:
+      return sizeof(chronosViewPortfolioInfo_t);
+
+    case CHRONOS_USER_TXN_PURCHASE:
+      return sizeof(chronosPurchaseInfo_t);
+
+    case CHRONOS_USER_TXN_SALE:
+      return sizeof(chronosSellInfo_t);
+
+    case CHRONOS_USER_TXN_MAX:
+      return sizeof(chronosSymbol_t);
+
+    default:
+      return 0;
+  }
+}
+
+/*
+ * Returns the number of bytes this request
+ * takes on the wire
+ */
 size_t
 chronosRequestSizeGet(chronosRequest requestH)
 {
@@ -341,12 +373,418 @@ chronosRequestSizeGet(chronosRequest requestH)
   }
 
   requestP = (chronosRequestPacket_t *) requestH;
-  return sizeof(*requestP);
+  return sizeof(chronosPacketHeader_t) 
+         + requestP->numItems * chronosRequestItemSizeGet(requestP->txn_type);
+
+failXit:
+  return -1;
+}
+
+unsigned int
+chronosRequestIdGet(chronosRequest requestH)
+{
+  chronosRequestPacket_t *requestP = NULL;
+
+  if (requestH == NULL) {
+    chronos_error("Invalid handle");
+    goto failXit;
+  }
+
+  requestP = (chronosRequestPacket_t *) requestH;
+  return requestP->request_id;
+
+failXit:
+  return 0;
+}
+
+int
+chronosRequestIdSet(unsigned int request_id, chronosRequest requestH)
+{
+  chronosRequestPacket_t *requestP = NULL;
+
+  if (requestH == NULL) {
+    chronos_error("Invalid handle");
+    goto failXit;
+  }
+
+  requestP = (chronosRequestPacket_t *) requestH;
+  requestP->request_id = request_id;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Serialize the request into bufP: a header followed
+ * by only the populated data items.
+ */
+int
+chronosRequestEncode(chronosRequest requestH,
+                     void *bufP,
+                     size_t bufSize,
+                     size_t *encodedSizeP)
+{
+  size_t itemSize;
+  size_t encodedSize;
+  chronosPacketHeader_t  *headerP = NULL;
+  chronosRequestPacket_t *requestP = NULL;
+
+  if (requestH == NULL || bufP == NULL || encodedSizeP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  requestP = (chronosRequestPacket_t *) requestH;
+
+  if (!CHRONOS_TXN_IS_VALID(requestP->txn_type)) {
+    chronos_error("Invalid transaction type: %d", requestP->txn_type);
+    goto failXit;
+  }
+
+  if (requestP->numItems < 0 || requestP->numItems > CHRONOS_MAX_DATA_ITEMS_PER_XACT) {
+    chronos_error("Invalid number of items: %d", requestP->numItems);
+    goto failXit;
+  }
+
+  itemSize = chronosRequestItemSizeGet(requestP->txn_type);
+  encodedSize = sizeof(chronosPacketHeader_t) + requestP->numItems * itemSize;
+  if (encodedSize > bufSize) {
+    chronos_error("Buffer too small to encode request");
+    goto failXit;
+  }
+
+  headerP = (chronosPacketHeader_t *) bufP;
+  headerP->length = encodedSize;
+  headerP->version = CHRONOS_PACKET_VERSION;
+  headerP->txn_type = requestP->txn_type;
+  headerP->request_id = requestP->request_id;
+  headerP->numItems = requestP->numItems;
+
+  memcpy((char *)bufP + sizeof(chronosPacketHeader_t), 
+         &(requestP->request_data), 
+         requestP->numItems * itemSize);
+
+  *encodedSizeP = encodedSize;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Given the header of an encoded request, returns how many
+ * bytes the whole request takes, or -1 if the header is bad.
+ */
+int
+chronosRequestEncodedSizeFromHeader(const void *headerP)
+{
+  chronosPacketHeader_t header;
+
+  if (headerP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  memcpy(&header, headerP, sizeof(header));
+
+  if (header.version != CHRONOS_PACKET_VERSION) {
+    chronos_error("Unsupported packet version: %d", header.version);
+    goto failXit;
+  }
+
+  if (header.length < sizeof(chronosPacketHeader_t) 
+      || header.length > (header.txn_type == CHRONOS_PACKET_TYPE_BATCH ? 
+                          CHRONOS_BATCH_MAX_ENCODED_SIZE : CHRONOS_REQUEST_MAX_ENCODED_SIZE)) {
+    chronos_error("Invalid packet length: %u", header.length);
+    goto failXit;
+  }
+
+  return header.length;
 
 failXit:
   return -1;
 }
 
+/*
+ * Rebuild a request packet from its wire encoding.
+ */
+int
+chronosRequestDecode(const void *bufP,
+                     size_t bufSize,
+                     chronosRequestPacket_t *reqPacketP)
+{
+  int    encodedSize;
+  size_t itemSize;
+  chronosPacketHeader_t header;
+
+  if (bufP == NULL || reqPacketP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (bufSize < sizeof(header)) {
+    chronos_error("Truncated packet");
+    goto failXit;
+  }
+
+  encodedSize = chronosRequestEncodedSizeFromHeader(bufP);
+  if (encodedSize < 0 || encodedSize > bufSize) {
+    chronos_error("Invalid packet");
+    goto failXit;
+  }
+
+  memcpy(&header, bufP, sizeof(header));
+
+  if (!CHRONOS_TXN_IS_VALID(header.txn_type)) {
+    chronos_error("Invalid transaction type: %d", header.txn_type);
+    goto failXit;
+  }
+
+  if (header.numItems < 0 || header.numItems > CHRONOS_MAX_DATA_ITEMS_PER_XACT) {
+    chronos_error("Invalid number of items: %d", header.numItems);
+    goto failXit;
+  }
+
+  itemSize = chronosRequestItemSizeGet(header.txn_type);
+  if (encodedSize != sizeof(header) + header.numItems * itemSize) {
+    chronos_error("Packet length does not match its contents");
+    goto failXit;
+  }
+
+  reqPacketP->txn_type = header.txn_type;
+  reqPacketP->request_id = header.request_id;
+  reqPacketP->numItems = header.numItems;
+  memcpy(&(reqPacketP->request_data),
+         (const char *)bufP + sizeof(header),
+         header.numItems * itemSize);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosRequestIsBatch(const void *headerP)
+{
+  chronosPacketHeader_t header;
+
+  memcpy(&header, headerP, sizeof(header));
+  return header.txn_type == CHRONOS_PACKET_TYPE_BATCH;
+}
+
+/*
+ * Serialize several requests into a single batch frame.
+ */
+int
+chronosRequestBatchEncode(chronosRequest *requestsArr,
+                          int numRequests,
+                          unsigned int request_id,
+                          void *bufP,
+                          size_t bufSize,
+                          size_t *encodedSizeP)
+{
+  int i;
+  int rc;
+  size_t encodedSize;
+  size_t memberSize;
+  chronosPacketHeader_t  *headerP = NULL;
+
+  if (requestsArr == NULL || bufP == NULL || encodedSizeP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (numRequests < 1 || numRequests > CHRONOS_MAX_BATCH_SIZE) {
+    chronos_error("Invalid number of requests in batch: %d", numRequests);
+    goto failXit;
+  }
+
+  if (bufSize > CHRONOS_BATCH_MAX_ENCODED_SIZE) {
+    bufSize = CHRONOS_BATCH_MAX_ENCODED_SIZE;
+  }
+
+  encodedSize = sizeof(chronosPacketHeader_t);
+
+  for (i=0; i<numRequests; i++) {
+    if (encodedSize >= bufSize) {
+      chronos_error("Buffer too small to encode batch");
+      goto failXit;
+    }
+
+    /* Members carry the id of the batch */
+    chronosRequestIdSet(request_id, requestsArr[i]);
+
+    rc = chronosRequestEncode(requestsArr[i], 
+                              (char *)bufP + encodedSize, 
+                              bufSize - encodedSize, 
+                              &memberSize);
+    if (rc != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+
+    encodedSize += memberSize;
+  }
+
+  headerP = (chronosPacketHeader_t *) bufP;
+  headerP->length = encodedSize;
+  headerP->version = CHRONOS_PACKET_VERSION;
+  headerP->txn_type = CHRONOS_PACKET_TYPE_BATCH;
+  headerP->request_id = request_id;
+  headerP->numItems = numRequests;
+
+  *encodedSizeP = encodedSize;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Rebuild the requests of a batch frame, each one
+ * into its own packet.
+ */
+int
+chronosRequestBatchDecode(const void *bufP,
+                          size_t bufSize,
+                          chronosRequestPacket_t **reqPacketsArr,
+                          int maxRequests,
+                          int *numRequestsP)
+{
+  int i;
+  int rc;
+  int encodedSize;
+  int memberSize;
+  size_t offset;
+  chronosPacketHeader_t header;
+
+  if (bufP == NULL || reqPacketsArr == NULL || numRequestsP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (bufSize < sizeof(header)) {
+    chronos_error("Truncated packet");
+    goto failXit;
+  }
+
+  encodedSize = chronosRequestEncodedSizeFromHeader(bufP);
+  if (encodedSize < 0 || encodedSize > bufSize) {
+    chronos_error("Invalid packet");
+    goto failXit;
+  }
+
+  memcpy(&header, bufP, sizeof(header));
+
+  if (header.txn_type != CHRONOS_PACKET_TYPE_BATCH) {
+    chronos_error("Not a batch: %d", header.txn_type);
+    goto failXit;
+  }
+
+  if (header.numItems < 1 || header.numItems > maxRequests || header.numItems > CHRONOS_MAX_BATCH_SIZE) {
+    chronos_error("Invalid number of requests in batch: %d", header.numItems);
+    goto failXit;
+  }
+
+  offset = sizeof(header);
+
+  for (i=0; i<header.numItems; i++) {
+    if (encodedSize - offset < sizeof(chronosPacketHeader_t)) {
+      chronos_error("Truncated batch");
+      goto failXit;
+    }
+
+    memberSize = chronosRequestEncodedSizeFromHeader((const char *)bufP + offset);
+    if (memberSize < 0 || memberSize > encodedSize - offset) {
+      chronos_error("Invalid request in batch");
+      goto failXit;
+    }
+
+    rc = chronosRequestDecode((const char *)bufP + offset, memberSize, reqPacketsArr[i]);
+    if (rc != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+
+    offset += memberSize;
+  }
+
+  if (offset != encodedSize) {
+    chronos_error("Packet length does not match its contents");
+    goto failXit;
+  }
+
+  *numRequestsP = header.numItems;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Returns how many bytes a response takes on the wire, given its
+ * fixed part, or -1 if it is bad. Batch responses carry the rc of
+ * each transaction after the fixed part.
+ */
+int
+chronosResponseFrameSize(const chronosResponsePacket_t *responseP)
+{
+  if (responseP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if ((int) responseP->txn_type == CHRONOS_PACKET_TYPE_BATCH) {
+    if (responseP->rc < 1 || responseP->rc > CHRONOS_MAX_BATCH_SIZE) {
+      chronos_error("Invalid number of responses in batch: %d", responseP->rc);
+      goto failXit;
+    }
+    return sizeof(*responseP) + responseP->rc * sizeof(int);
+  }
+
+  return sizeof(*responseP);
+
+failXit:
+  return -1;
+}
+
+/*
+ * Copy only the populated part of a request
+ */
+int
+chronosRequestCopy(chronosRequestPacket_t *dstP,
+                   const chronosRequestPacket_t *srcP)
+{
+  int numItems;
+
+  if (dstP == NULL || srcP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  numItems = srcP->numItems;
+  if (numItems < 0 || numItems > CHRONOS_MAX_DATA_ITEMS_PER_XACT) {
+    chronos_error("Invalid number of items: %d", numItems);
+    goto failXit;
+  }
+
+  dstP->txn_type = srcP->txn_type;
+  dstP->request_id = srcP->request_id;
+  dstP->numItems = numItems;
+  memcpy(&(dstP->request_data), 
+         &(srcP->request_data), 
+         numItems * chronosRequestItemSizeGet(srcP->txn_type));
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
 chronosResponse
 chronosResponseAlloc()
 {
@@ -442,3 +880,19 @@ failXit:
   return -1;
 }
 
+unsigned int
+chronosResponseIdGet(chronosResponse responseH)
+{
+  chronosResponsePacket_t *responseP = NULL;
+
+  if (responseH == NULL) {
+    chronos_error("Invalid handle");
+    goto failXit;
+  }
+
+  responseP = (chronosResponsePacket_t *) responseH;
+  return responseP->request_id;
+
+failXit:
+  return 0;
+}
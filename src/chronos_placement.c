@@ -0,0 +1,594 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include "chronos.h"
+#include "chronos_config.h"
+#include "chronos_placement.h"
+
+#define CHRONOS_NODE_SYSFS_DIR  "/sys/devices/system/node"
+
+struct chronosPlacement_t {
+  int             isPlaced[CHRONOS_PLACEMENT_MAX];
+  cpu_set_t       cpuSet[CHRONOS_PLACEMENT_MAX];
+
+  /* Initialized only for the placed classes */
+  pthread_attr_t  attr[CHRONOS_PLACEMENT_MAX];
+
+  /* CPUs of the classes that are not placed */
+  cpu_set_t       processCpuSet;
+
+  /* Keep the processing threads on the node of the BDB cache */
+  int             numaLocal;
+  int             cacheNode;
+  cpu_set_t       callerCpuSet;
+};
+
+static const char *chronosPlacementNames[CHRONOS_PLACEMENT_MAX] = {
+  "listener",
+  "network",
+  "processing",
+  "update",
+  "sampling"
+};
+
+/*
+ * Parse a list of CPUs such as "0-3,8,10-11"
+ */
+static int
+cpuListParse(const char *list, cpu_set_t *cpuSetP)
+{
+  long  first;
+  long  last;
+  char *endP = NULL;
+
+  CPU_ZERO(cpuSetP);
+
+  while (*list != '\0') {
+    first = strtol(list, &endP, 10);
+    if (endP == list || first < 0) {
+      goto failXit;
+    }
+    list = endP;
+
+    last = first;
+    if (*list == '-') {
+      list ++;
+      last = strtol(list, &endP, 10);
+      if (endP == list || last < first) {
+        goto failXit;
+      }
+      list = endP;
+    }
+
+    if (last >= CPU_SETSIZE) {
+      chronos_error("CPU %ld is out of range", last);
+      goto failXit;
+    }
+
+    for (; first <= last; first++) {
+      CPU_SET(first, cpuSetP);
+    }
+
+    if (*list == ',') {
+      list ++;
+    }
+    else if (*list != '\0' && *list != '\n') {
+      goto failXit;
+    }
+    else {
+      break;
+    }
+  }
+
+  if (CPU_COUNT(cpuSetP) == 0) {
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+static void
+cpuListFormat(const cpu_set_t *cpuSetP, char *buffer, size_t bufferSize)
+{
+  int    cpu;
+  int    first;
+  size_t len = 0;
+
+  buffer[0] = '\0';
+
+  for (cpu=0; cpu<CPU_SETSIZE && len < bufferSize; cpu++) {
+    if (!CPU_ISSET(cpu, cpuSetP)) {
+      continue;
+    }
+
+    first = cpu;
+    while (cpu + 1 < CPU_SETSIZE && CPU_ISSET(cpu + 1, cpuSetP)) {
+      cpu ++;
+    }
+
+    if (first == cpu) {
+      len += snprintf(buffer + len, bufferSize - len, "%s%d", len > 0 ? "," : "", cpu);
+    }
+    else {
+      len += snprintf(buffer + len, bufferSize - len, "%s%d-%d", len > 0 ? "," : "", first, cpu);
+    }
+  }
+}
+
+/*
+ * Find the NUMA node a CPU belongs to, and the CPUs of that node
+ */
+static int
+cpuNodeGet(int cpu, int *nodeP, cpu_set_t *nodeCpuSetP)
+{
+  int            node;
+  char           path[256];
+  char           list[1024];
+  DIR           *dirP = NULL;
+  FILE          *fileP = NULL;
+  struct dirent *entryP = NULL;
+
+  dirP = opendir(CHRONOS_NODE_SYSFS_DIR);
+  if (dirP == NULL) {
+    chronos_warning("NUMA topology is not available");
+    goto failXit;
+  }
+
+  while ((entryP = readdir(dirP)) != NULL) {
+    if (sscanf(entryP->d_name, "node%d", &node) != 1) {
+      continue;
+    }
+
+    snprintf(path, sizeof(path), "%s/node%d/cpulist", CHRONOS_NODE_SYSFS_DIR, node);
+    fileP = fopen(path, "r");
+    if (fileP == NULL) {
+      continue;
+    }
+
+    if (fgets(list, sizeof(list), fileP) != NULL
+        && cpuListParse(list, nodeCpuSetP) == CHRONOS_SUCCESS
+        && CPU_ISSET(cpu, nodeCpuSetP)) {
+      fclose(fileP);
+      closedir(dirP);
+      *nodeP = node;
+      return CHRONOS_SUCCESS;
+    }
+
+    fclose(fileP);
+  }
+
+  chronos_warning("Could not find the NUMA node of CPU %d", cpu);
+
+failXit:
+  if (dirP != NULL) {
+    closedir(dirP);
+  }
+  return CHRONOS_FAIL;
+}
+
+static int
+placementEntryParse(char *entry, chronosPlacement_t *placementP)
+{
+  int   i;
+  char *valueP = NULL;
+
+  if (strcmp(entry, "numa") == 0) {
+    placementP->numaLocal = 1;
+    return CHRONOS_SUCCESS;
+  }
+
+  valueP = strchr(entry, '=');
+  if (valueP == NULL) {
+    chronos_error("Invalid placement entry: %s", entry);
+    goto failXit;
+  }
+  *valueP = '\0';
+  valueP ++;
+
+  for (i=CHRONOS_PLACEMENT_MIN; i<CHRONOS_PLACEMENT_MAX; i++) {
+    if (strcmp(entry, chronosPlacementNames[i]) == 0) {
+      break;
+    }
+  }
+
+  if (i == CHRONOS_PLACEMENT_MAX) {
+    chronos_error("Unknown thread class in placement: %s", entry);
+    goto failXit;
+  }
+
+  if (cpuListParse(valueP, &placementP->cpuSet[i]) != CHRONOS_SUCCESS) {
+    chronos_error("Invalid CPU list for %s threads: %s", entry, valueP);
+    goto failXit;
+  }
+  placementP->isPlaced[i] = 1;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+static int
+placementFileRead(const char *path, char *buffer, size_t bufferSize)
+{
+  size_t  len;
+  char   *commentP = NULL;
+  char   *lineP = NULL;
+  FILE   *fileP = NULL;
+
+  fileP = fopen(path, "r");
+  if (fileP == NULL) {
+    chronos_error("Could not open placement file %s", path);
+    goto failXit;
+  }
+
+  len = fread(buffer, 1, bufferSize - 1, fileP);
+  if (!feof(fileP)) {
+    chronos_error("Placement file %s is too large", path);
+    goto failXit;
+  }
+  buffer[len] = '\0';
+  fclose(fileP);
+
+  /* Blank out the comments */
+  for (lineP = buffer; (commentP = strchr(lineP, '#')) != NULL; lineP = commentP) {
+    while (*commentP != '\0' && *commentP != '\n') {
+      *commentP++ = ' ';
+    }
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  if (fileP != NULL) {
+    fclose(fileP);
+  }
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Refresh the attributes of a class after its CPUs changed
+ */
+static int
+placementAttrUpdate(chronosPlacement_t *placementP,
+                    chronosPlacementClass_t placementClass)
+{
+  int rc;
+
+  if (!placementP->isPlaced[placementClass]) {
+    return CHRONOS_SUCCESS;
+  }
+
+  rc = pthread_attr_setaffinity_np(&placementP->attr[placementClass],
+                                   sizeof(cpu_set_t),
+                                   &placementP->cpuSet[placementClass]);
+  if (rc != 0) {
+    chronos_error("Failed to set affinity of %s threads: %s",
+                  chronosPlacementNames[placementClass], strerror(rc));
+    return CHRONOS_FAIL;
+  }
+
+  return CHRONOS_SUCCESS;
+}
+
+int
+chronosPlacementCreate(const char *spec, chronosPlacement_t **placementPP)
+{
+  int                 i;
+  char               *specCopyP = NULL;
+  char               *entryP = NULL;
+  char               *saveP = NULL;
+  chronosPlacement_t *placementP = NULL;
+
+  if (spec == NULL || placementPP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  placementP = calloc(1, sizeof(chronosPlacement_t));
+  if (placementP == NULL) {
+    chronos_error("Could not allocate placement");
+    goto failXit;
+  }
+  placementP->cacheNode = -1;
+
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &placementP->processCpuSet) != 0) {
+    perror("sched_getaffinity() failed");
+    goto failXit;
+  }
+
+  if (spec[0] == '@') {
+    specCopyP = malloc(CHRONOS_PLACEMENT_FILE_MAX_SIZE);
+    if (specCopyP == NULL) {
+      chronos_error("Could not allocate placement spec");
+      goto failXit;
+    }
+
+    if (placementFileRead(spec + 1, specCopyP, CHRONOS_PLACEMENT_FILE_MAX_SIZE) != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+  }
+  else {
+    specCopyP = strdup(spec);
+    if (specCopyP == NULL) {
+      chronos_error("Could not allocate placement spec");
+      goto failXit;
+    }
+  }
+
+  for (entryP = strtok_r(specCopyP, "; \t\r\n", &saveP);
+       entryP != NULL;
+       entryP = strtok_r(NULL, "; \t\r\n", &saveP)) {
+    if (placementEntryParse(entryP, placementP) != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+  }
+
+  for (i=CHRONOS_PLACEMENT_MIN; i<CHRONOS_PLACEMENT_MAX; i++) {
+    if (!placementP->isPlaced[i]) {
+      continue;
+    }
+
+    if (pthread_attr_init(&placementP->attr[i]) != 0) {
+      chronos_error("Failed to init thread attributes");
+      placementP->isPlaced[i] = 0;
+      goto failXit;
+    }
+
+    if (placementAttrUpdate(placementP, i) != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+  }
+
+  free(specCopyP);
+  *placementPP = placementP;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  free(specCopyP);
+  if (placementP != NULL) {
+    chronosPlacementDestroy(placementP);
+  }
+  return CHRONOS_FAIL;
+}
+
+int
+chronosPlacementDestroy(chronosPlacement_t *placementP)
+{
+  int i;
+
+  if (placementP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  for (i=CHRONOS_PLACEMENT_MIN; i<CHRONOS_PLACEMENT_MAX; i++) {
+    if (placementP->isPlaced[i]) {
+      pthread_attr_destroy(&placementP->attr[i]);
+    }
+  }
+
+  free(placementP);
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Memory is placed on the node of the thread that first touches
+ * it. The caller stays on its current node until it unbinds, and
+ * the processing threads are restricted to that node.
+ */
+int
+chronosPlacementCacheNodeBind(chronosPlacement_t *placementP)
+{
+  int       rc;
+  int       cpu;
+  int       node;
+  cpu_set_t nodeCpuSet;
+  cpu_set_t processingCpuSet;
+  char      cpuList[128];
+
+  if (placementP == NULL || !placementP->numaLocal) {
+    return CHRONOS_SUCCESS;
+  }
+
+  cpu = sched_getcpu();
+  if (cpu < 0 || cpuNodeGet(cpu, &node, &nodeCpuSet) != CHRONOS_SUCCESS) {
+    chronos_warning("Processing threads are not kept on the cache's node");
+    placementP->numaLocal = 0;
+    return CHRONOS_SUCCESS;
+  }
+
+  rc = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &placementP->callerCpuSet);
+  if (rc != 0) {
+    chronos_error("Failed to get affinity: %s", strerror(rc));
+    goto failXit;
+  }
+
+  rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &nodeCpuSet);
+  if (rc != 0) {
+    chronos_error("Failed to set affinity: %s", strerror(rc));
+    goto failXit;
+  }
+  placementP->cacheNode = node;
+
+  if (placementP->isPlaced[CHRONOS_PLACEMENT_PROCESSING]) {
+    CPU_AND(&processingCpuSet, &placementP->cpuSet[CHRONOS_PLACEMENT_PROCESSING], &nodeCpuSet);
+    if (CPU_COUNT(&processingCpuSet) == 0) {
+      chronos_warning("None of the processing CPUs are on node %d, using all of its CPUs", node);
+      processingCpuSet = nodeCpuSet;
+    }
+  }
+  else {
+    if (pthread_attr_init(&placementP->attr[CHRONOS_PLACEMENT_PROCESSING]) != 0) {
+      chronos_error("Failed to init thread attributes");
+      goto failXit;
+    }
+    placementP->isPlaced[CHRONOS_PLACEMENT_PROCESSING] = 1;
+    processingCpuSet = nodeCpuSet;
+  }
+
+  placementP->cpuSet[CHRONOS_PLACEMENT_PROCESSING] = processingCpuSet;
+  if (placementAttrUpdate(placementP, CHRONOS_PLACEMENT_PROCESSING) != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  cpuListFormat(&nodeCpuSet, cpuList, sizeof(cpuList));
+  chronos_info("BDB cache is created on NUMA node %d (CPUs %s)", node, cpuList);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosPlacementCacheNodeUnbind(chronosPlacement_t *placementP)
+{
+  int rc;
+
+  if (placementP == NULL || placementP->cacheNode < 0) {
+    return CHRONOS_SUCCESS;
+  }
+
+  rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &placementP->callerCpuSet);
+  if (rc != 0) {
+    chronos_error("Failed to set affinity: %s", strerror(rc));
+    return CHRONOS_FAIL;
+  }
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Restrict the threads created with attrP to the CPUs of their
+ * class. If the class is not placed, they may run on any CPU
+ * the process may run on.
+ */
+int
+chronosPlacementAttrSet(const chronosPlacement_t *placementP,
+                        chronosPlacementClass_t placementClass,
+                        pthread_attr_t *attrP)
+{
+  int rc;
+
+  if (attrP == NULL || placementClass < CHRONOS_PLACEMENT_MIN || placementClass >= CHRONOS_PLACEMENT_MAX) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (placementP == NULL) {
+    return CHRONOS_SUCCESS;
+  }
+
+  rc = pthread_attr_setaffinity_np(attrP, sizeof(cpu_set_t),
+                                   placementP->isPlaced[placementClass] ? &placementP->cpuSet[placementClass]
+                                                                        : &placementP->processCpuSet);
+
+  if (rc != 0) {
+    chronos_error("Failed to set affinity of %s threads: %s",
+                  chronosPlacementNames[placementClass], strerror(rc));
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+pthread_attr_t *
+chronosPlacementAttrGet(chronosPlacement_t *placementP,
+                        chronosPlacementClass_t placementClass)
+{
+  if (placementP == NULL
+      || placementClass < CHRONOS_PLACEMENT_MIN
+      || placementClass >= CHRONOS_PLACEMENT_MAX
+      || !placementP->isPlaced[placementClass]) {
+    return NULL;
+  }
+
+  return &placementP->attr[placementClass];
+}
+
+/*
+ * Print where the given threads of a class actually run. Without
+ * threads, print where the class will run.
+ */
+int
+chronosPlacementReport(const chronosPlacement_t *placementP,
+                       chronosPlacementClass_t placementClass,
+                       const pthread_t *threadArr,
+                       int numThreads)
+{
+  int       i;
+  int       rc;
+  int       numMisplaced = 0;
+  cpu_set_t threadCpuSet;
+  cpu_set_t unionCpuSet;
+  char      cpuList[128];
+
+  if (placementP == NULL) {
+    return CHRONOS_SUCCESS;
+  }
+
+  if (placementClass < CHRONOS_PLACEMENT_MIN || placementClass >= CHRONOS_PLACEMENT_MAX
+      || (numThreads > 0 && threadArr == NULL)) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (numThreads == 0) {
+    if (placementP->isPlaced[placementClass]) {
+      cpuListFormat(&placementP->cpuSet[placementClass], cpuList, sizeof(cpuList));
+      chronos_info("Placement: %s threads on CPUs %s",
+                   chronosPlacementNames[placementClass], cpuList);
+    }
+    else {
+      chronos_info("Placement: %s threads on any CPU",
+                   chronosPlacementNames[placementClass]);
+    }
+    return CHRONOS_SUCCESS;
+  }
+
+  CPU_ZERO(&unionCpuSet);
+
+  for (i=0; i<numThreads; i++) {
+    rc = pthread_getaffinity_np(threadArr[i], sizeof(cpu_set_t), &threadCpuSet);
+    if (rc != 0) {
+      chronos_error("Failed to get affinity: %s", strerror(rc));
+      goto failXit;
+    }
+
+    CPU_OR(&unionCpuSet, &unionCpuSet, &threadCpuSet);
+    if (placementP->isPlaced[placementClass]
+        && !CPU_EQUAL(&threadCpuSet, &placementP->cpuSet[placementClass])) {
+      numMisplaced ++;
+    }
+  }
+
+  cpuListFormat(&unionCpuSet, cpuList, sizeof(cpuList));
+  chronos_info("Placement: %d %s threads on CPUs %s%s",
+               numThreads,
+               chronosPlacementNames[placementClass],
+               cpuList,
+               placementClass == CHRONOS_PLACEMENT_PROCESSING && placementP->cacheNode >= 0 ? " (BDB cache node)" : "");
+
+  if (numMisplaced > 0) {
+    chronos_warning("Placement: %d %s threads are not on the requested CPUs",
+                    numMisplaced, chronosPlacementNames[placementClass]);
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
@@ -1,26 +1,598 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
 #include "chronos_queue.h"
 #include "chronos.h"
 #include "chronos_transactions.h"
+#include "chronos_packets.h"
+
+/*
+ * Set the deadline of a user txn, and its priority according
+ * to the discipline of the user queue
+ */
+static void
+chronos_txn_deadline_set(txn_info_t *txnInfoP, 
+                         chronosServerContext_t *contextP)
+{
+  int                txn_type;
+  unsigned long long deadline_ns;
+  unsigned long long exec_ns = 0;
+
+  deadline_ns = (unsigned long long) txnInfoP->txn_enqueue.tv_sec * NSEC_TO_SEC
+                + txnInfoP->txn_enqueue.tv_nsec
+                + (unsigned long long) (contextP->desiredDelayBoundMS * NSEC_TO_MSEC);
+
+  txnInfoP->txn_deadline.tv_sec = deadline_ns / NSEC_TO_SEC;
+  txnInfoP->txn_deadline.tv_nsec = deadline_ns % NSEC_TO_SEC;
+
+  switch (contextP->queueDiscipline) {
+    case CHRONOS_QUEUE_EDF:
+      txnInfoP->priority = deadline_ns;
+      break;
+
+    case CHRONOS_QUEUE_LSF:
+      /* Every queued txn has the same "now", so ordering by
+       * deadline minus expected execution time is ordering by slack */
+      txn_type = txnInfoP->requestBufP->request.txn_type;
+      if (CHRONOS_TXN_IS_VALID(txn_type)) {
+        exec_ns = contextP->txnExecTimeMSArr[txn_type] * NSEC_TO_MSEC;
+      }
+      txnInfoP->priority = deadline_ns > exec_ns ? deadline_ns - exec_ns : 0;
+      break;
+
+    default:
+      txnInfoP->priority = 0;
+      break;
+  }
+}
+
+/*
+ * Slot where the next txn of a locked queue is copied
+ */
+static txn_info_t *
+chronos_queue_slot_alloc(chronos_queue_t *txnQueueP)
+{
+  if (txnQueueP->discipline == CHRONOS_QUEUE_FIFO) {
+    return &(txnQueueP->txnInfoArr[txnQueueP->nextin]);
+  }
+
+  assert(txnQueueP->numFreeSlots > 0);
+  return &(txnQueueP->txnInfoArr[txnQueueP->freeSlotArr[txnQueueP->numFreeSlots - 1]]);
+}
+
+/*
+ * Make the slot obtained from chronos_queue_slot_alloc()
+ * visible to the consumers of a locked queue
+ */
+static void
+chronos_queue_slot_push(txn_info_t *txnInfoP, chronos_queue_t *txnQueueP)
+{
+  int rc;
+
+  if (txnQueueP->discipline == CHRONOS_QUEUE_FIFO) {
+    txnQueueP->nextin ++;
+    txnQueueP->nextin %= CHRONOS_READY_QUEUE_SIZE;
+  }
+  else {
+    txnQueueP->numFreeSlots --;
+    /* The heap can hold every slot, so it never grows here */
+    rc = chronosHeapInsert(&txnQueueP->heap, txnInfoP->priority, txnInfoP);
+    assert(rc == CHRONOS_SUCCESS);
+    (void) rc;
+  }
+
+  txnQueueP->occupied++;
+}
+
+/*
+ * The slot holding the next txn to leave a locked queue
+ */
+static txn_info_t *
+chronos_queue_slot_head(chronos_queue_t *txnQueueP)
+{
+  void *dataP = NULL;
+
+  if (txnQueueP->discipline == CHRONOS_QUEUE_FIFO) {
+    return &(txnQueueP->txnInfoArr[txnQueueP->nextout]);
+  }
+
+  (void) chronosHeapPeek(&txnQueueP->heap, NULL, &dataP);
+  return (txn_info_t *) dataP;
+}
+
+static void
+chronos_queue_slot_pop(chronos_queue_t *txnQueueP)
+{
+  void *dataP = NULL;
+
+  if (txnQueueP->discipline == CHRONOS_QUEUE_FIFO) {
+    txnQueueP->nextout++;
+    txnQueueP->nextout %= CHRONOS_READY_QUEUE_SIZE;
+  }
+  else {
+    (void) chronosHeapRemoveMin(&txnQueueP->heap, NULL, &dataP);
+    txnQueueP->freeSlotArr[txnQueueP->numFreeSlots] = (txn_info_t *) dataP - txnQueueP->txnInfoArr;
+    txnQueueP->numFreeSlots ++;
+  }
+
+  txnQueueP->occupied--;
+}
+
+int
+chronos_queue_init(int lockFree, int discipline, chronos_queue_t *txnQueueP)
+{
+  int i;
+
+  if (txnQueueP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (lockFree && discipline != CHRONOS_QUEUE_FIFO) {
+    chronos_error("Only FIFO queues can be lock-free");
+    goto failXit;
+  }
+
+  txnQueueP->discipline = discipline;
+  if (discipline != CHRONOS_QUEUE_FIFO) {
+    if (chronosHeapInit(&txnQueueP->heap, CHRONOS_READY_QUEUE_SIZE) != CHRONOS_SUCCESS) {
+      chronos_error("Failed to init queue heap");
+      goto failXit;
+    }
+
+    for (i=0; i<CHRONOS_READY_QUEUE_SIZE; i++) {
+      txnQueueP->freeSlotArr[i] = i;
+    }
+    txnQueueP->numFreeSlots = CHRONOS_READY_QUEUE_SIZE;
+  }
+
+  txnQueueP->occupied = 0;
+  txnQueueP->nextin = 0;
+  txnQueueP->nextout = 0;
+  txnQueueP->ticketReq = 0;
+  txnQueueP->ticketDone = 0;
+
+  txnQueueP->lockFree = lockFree;
+  txnQueueP->enqueuePos = 0;
+  txnQueueP->dequeuePos = 0;
+  for (i=0; i<CHRONOS_READY_QUEUE_SIZE; i++) {
+    txnQueueP->seqArr[i] = i;
+  }
+
+  if (pthread_mutex_init(&txnQueueP->mutex, NULL) != 0) {
+    chronos_error("Failed to init mutex");
+    goto failXit;
+  }
+
+  if (pthread_cond_init(&txnQueueP->more, NULL) != 0) {
+    chronos_error("Failed to init condition variable");
+    goto failXit;
+  }
+
+  if (pthread_cond_init(&txnQueueP->less, NULL) != 0) {
+    chronos_error("Failed to init condition variable");
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronos_queue_destroy(chronos_queue_t *txnQueueP)
+{
+  if (txnQueueP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  pthread_cond_destroy(&txnQueueP->more);
+  pthread_cond_destroy(&txnQueueP->less);
+  pthread_mutex_destroy(&txnQueueP->mutex);
+
+  if (txnQueueP->discipline != CHRONOS_QUEUE_FIFO) {
+    chronosHeapDestroy(&txnQueueP->heap);
+  }
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Number of txns in the queue. It is only a hint: 
+ * it may change as soon as it is read.
+ */
+int
+chronos_queue_size(const chronos_queue_t *txnQueueP)
+{
+  unsigned long long dequeuePos;
+  unsigned long long enqueuePos;
+
+  if (!txnQueueP->lockFree) {
+    return txnQueueP->occupied;
+  }
+
+  dequeuePos = txnQueueP->dequeuePos;
+  __sync_synchronize();
+  enqueuePos = txnQueueP->enqueuePos;
+
+  return enqueuePos > dequeuePos ? (int)(enqueuePos - dequeuePos) : 0;
+}
+
+/*
+ * The user queues are sharded: there is one per core, or as many as 
+ * requested. A txn goes to the queue of the core it was submitted
+ * from, and idle processing threads steal from the other queues.
+ * With a single queue, the context's own userTxnQueue is used.
+ */
+int
+chronos_user_queues_init(int numQueues, chronosServerContext_t *contextP)
+{
+  int i;
+
+  if (contextP == NULL || numQueues < 0) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (numQueues == 0) {
+    numQueues = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numQueues < 1) {
+      numQueues = 1;
+    }
+  }
+
+  if (numQueues == 1) {
+    contextP->userTxnQueuesArr = &(contextP->userTxnQueue);
+  }
+  else {
+    contextP->userTxnQueuesArr = calloc(numQueues, sizeof(chronos_queue_t));
+    if (contextP->userTxnQueuesArr == NULL) {
+      chronos_error("Could not allocate user queues");
+      goto failXit;
+    }
+  }
+  contextP->numUserTxnQueues = numQueues;
+
+  for (i=0; i<numQueues; i++) {
+    if (chronos_queue_init(contextP->lockFreeQueues, 
+                           contextP->queueDiscipline, 
+                           &(contextP->userTxnQueuesArr[i])) != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+  }
+
+  chronos_info("Using %d user queues", numQueues);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronos_user_queues_destroy(chronosServerContext_t *contextP)
+{
+  int i;
+
+  if (contextP == NULL || contextP->userTxnQueuesArr == NULL) {
+    return CHRONOS_SUCCESS;
+  }
+
+  for (i=0; i<contextP->numUserTxnQueues; i++) {
+    chronos_queue_destroy(&(contextP->userTxnQueuesArr[i]));
+  }
+
+  if (contextP->userTxnQueuesArr != &(contextP->userTxnQueue)) {
+    free(contextP->userTxnQueuesArr);
+  }
+
+  contextP->userTxnQueuesArr = NULL;
+  contextP->numUserTxnQueues = 0;
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Number of txns in all the user queues. Only a hint, like
+ * chronos_queue_size().
+ */
+int
+chronos_user_queue_size(const chronosServerContext_t *contextP)
+{
+  int i;
+  int size = 0;
+
+  for (i=0; i<contextP->numUserTxnQueues; i++) {
+    size += chronos_queue_size(&(contextP->userTxnQueuesArr[i]));
+  }
+
+  return size;
+}
+
+/*
+ * The user queue of the core we are running on
+ */
+static chronos_queue_t *
+chronos_user_queue_local(chronosServerContext_t *contextP)
+{
+  int cpu = 0;
+
+  if (contextP->numUserTxnQueues > 1) {
+    cpu = sched_getcpu();
+    if (cpu < 0) {
+      cpu = 0;
+    }
+  }
+
+  return &(contextP->userTxnQueuesArr[cpu % contextP->numUserTxnQueues]);
+}
 
 static int
-chronos_dequeue_transaction(txn_info_t *txnInfoP, 
-                            int (*timeToDieFp)(void), 
-                            chronos_queue_t *txnQueueP)
+chronos_queues_have_work(chronosServerContext_t *contextP)
+{
+  return chronos_queue_size(&contextP->sysTxnQueue) > 0
+         || chronos_user_queue_size(contextP) > 0;
+}
+
+/*
+ * Called by a processing thread which found both queues empty. 
+ * Yield for a little while, and then sleep until txns are enqueued.
+ * It may return without work, e.g. to let the caller check whether
+ * it is time to die.
+ */
+int
+chronos_queue_wait_for_work(chronosServerContext_t *contextP)
+{
+  int i;
+  int seq;
+  int rc;
+
+  if (contextP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  for (i=0; i<CHRONOS_IDLE_SPIN_COUNT; i++) {
+    if (chronos_queues_have_work(contextP)) {
+      return CHRONOS_SUCCESS;
+    }
+    sched_yield();
+  }
+
+  seq = chronosEventWaitPrepare(&contextP->workAvailable);
+
+  /* Txns enqueued from now on will wake us up */
+  if (chronos_queues_have_work(contextP)) {
+    chronosEventWaitCancel(&contextP->workAvailable);
+    return CHRONOS_SUCCESS;
+  }
+
+  rc = chronosEventWait(&contextP->workAvailable, seq, 1000 /* one second */);
+
+  return rc;
+}
+
+typedef struct {
+  int  spins;
+  long sleep_us;
+} chronos_backoff_t;
+
+/*
+ * Wait a little before trying a lock-free queue again: 
+ * yield the cpu at first, then sleep longer each time.
+ */
+static void
+chronos_backoff(chronos_backoff_t *backoffP)
+{
+  struct timespec ts;
+
+  if (backoffP->spins < CHRONOS_QUEUE_SPIN_COUNT) {
+    backoffP->spins ++;
+    sched_yield();
+    return;
+  }
+
+  ts.tv_sec = 0;
+  ts.tv_nsec = backoffP->sleep_us * 1000;
+  nanosleep(&ts, NULL);
+
+  backoffP->sleep_us *= 2;
+  if (backoffP->sleep_us > CHRONOS_QUEUE_MAX_BACKOFF_US) {
+    backoffP->sleep_us = CHRONOS_QUEUE_MAX_BACKOFF_US;
+  }
+}
+
+/*
+ * Claim numSlots consecutive free slots of a lock-free queue. Each of 
+ * them must then be filled and handed to the consumers with
+ * chronos_queue_slot_publish().
+ */
+static int
+chronos_queue_slots_claim(int numSlots,
+                          unsigned long long *pos_ret,
+                          int (*timeToDieFp)(void), 
+                          chronos_queue_t *txnQueueP)
+{
+  int                i;
+  long long          diff = 0;
+  unsigned long long pos;
+  chronos_backoff_t  backoff = {0, CHRONOS_QUEUE_MIN_BACKOFF_US};
+
+  while (1) {
+    pos = txnQueueP->enqueuePos;
+
+    for (i=0; i<numSlots; i++) {
+      diff = (long long) (txnQueueP->seqArr[(pos + i) % CHRONOS_READY_QUEUE_SIZE] - (pos + i));
+      if (diff != 0) {
+        break;
+      }
+    }
+
+    if (i == numSlots) {
+      /* The slots stay free until someone moves enqueuePos */
+      if (__sync_bool_compare_and_swap(&txnQueueP->enqueuePos, pos, pos + numSlots)) {
+        *pos_ret = pos;
+        return CHRONOS_SUCCESS;
+      }
+    }
+    else if (diff < 0) {
+      /* The queue is full */
+      if (timeToDieFp && timeToDieFp()) {
+        chronos_warning("Process asked to die");
+        return CHRONOS_FAIL;
+      }
+      chronos_backoff(&backoff);
+    }
+    /* Otherwise another producer got there first */
+  }
+}
+
+static void
+chronos_queue_slot_publish(unsigned long long pos, 
+                           chronos_queue_t *txnQueueP)
+{
+  __sync_synchronize();
+  txnQueueP->seqArr[pos % CHRONOS_READY_QUEUE_SIZE] = pos + 1;
+}
+
+/*
+ * If txn_type is not negative, only a txn of that type is taken. 
+ * Otherwise CHRONOS_QUEUE_EMPTY is returned, as if the queue was empty.
+ */
+static int
+chronos_lock_free_dequeue(txn_info_t *txnInfoP, 
+                          int txn_type,
+                          int wait,
+                          int (*timeToDieFp)(void), 
+                          chronos_queue_t *txnQueueP)
+{
+  long long          diff;
+  unsigned long long pos;
+  chronos_backoff_t  backoff = {0, CHRONOS_QUEUE_MIN_BACKOFF_US};
+
+  while (1) {
+    pos = txnQueueP->dequeuePos;
+    diff = (long long) (txnQueueP->seqArr[pos % CHRONOS_READY_QUEUE_SIZE] - (pos + 1));
+
+    if (diff == 0) {
+      /* The slot may be taken and refilled meanwhile. Then the
+       * type we read is stale, but the CAS below fails anyway */
+      if (txn_type >= 0 
+          && txnQueueP->txnInfoArr[pos % CHRONOS_READY_QUEUE_SIZE].txn_type != txn_type) {
+        return CHRONOS_QUEUE_EMPTY;
+      }
+      if (__sync_bool_compare_and_swap(&txnQueueP->dequeuePos, pos, pos + 1)) {
+        break;
+      }
+    }
+    else if (diff < 0) {
+      /* The queue is empty */
+      if (!wait) {
+        return CHRONOS_QUEUE_EMPTY;
+      }
+      if (timeToDieFp && timeToDieFp()) {
+        chronos_warning("Process asked to die");
+        return CHRONOS_FAIL;
+      }
+      chronos_backoff(&backoff);
+    }
+    /* Otherwise another consumer got there first */
+  }
+
+  *txnInfoP = txnQueueP->txnInfoArr[pos % CHRONOS_READY_QUEUE_SIZE];
+
+  /* Hand the slot back to the producers of the next round */
+  __sync_synchronize();
+  txnQueueP->seqArr[pos % CHRONOS_READY_QUEUE_SIZE] = pos + CHRONOS_READY_QUEUE_SIZE;
+
+  return CHRONOS_SUCCESS;
+}
+
+static int
+chronos_lock_free_enqueue(txn_info_t *txnInfoP, 
+                          unsigned long long *ticket_ret, 
+                          int (*timeToDieFp)(void), 
+                          chronos_queue_t *txnQueueP)
+{
+  unsigned long long pos;
+  txn_info_t        *slotP = NULL;
+
+  if (chronos_queue_slots_claim(1, &pos, timeToDieFp, txnQueueP) != CHRONOS_SUCCESS) {
+    return CHRONOS_FAIL;
+  }
+
+  slotP = &(txnQueueP->txnInfoArr[pos % CHRONOS_READY_QUEUE_SIZE]);
+  *slotP = *txnInfoP;
+
+  /* Tickets start at one, as with the locked queue */
+  slotP->ticket = pos + 1;
+  if (ticket_ret) {
+    *ticket_ret = pos + 1;
+  }
+
+  chronos_queue_slot_publish(pos, txnQueueP);
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Take up to maxTxns txns out of the queue. The first one is the head 
+ * of the queue, provided it is of txn_type when that is not negative.
+ * The rest are the txns right behind it, as long as they are of the
+ * same type, so the order of the queue is kept. If wait is not set,
+ * CHRONOS_QUEUE_EMPTY is returned instead of waiting for a txn.
+ */
+static int
+chronos_dequeue_transactions(txn_info_t *txnInfoArr, 
+                             int maxTxns,
+                             int txn_type,
+                             int *numTxns_ret,
+                             int wait,
+                             int (*timeToDieFp)(void), 
+                             chronos_queue_t *txnQueueP)
 {
   int              rc = CHRONOS_SUCCESS;
+  int              num = 0;
+  txn_info_t      *slotP = NULL;
   struct timespec  ts; /* For the timed wait */
 
-  if (txnQueueP == NULL || txnInfoP == NULL) {
+  if (txnQueueP == NULL || txnInfoArr == NULL || numTxns_ret == NULL || maxTxns < 1) {
     chronos_error("Invalid argument");
     goto failXit;
   }
 
+  *numTxns_ret = 0;
+
+  if (txnQueueP->lockFree) {
+    rc = chronos_lock_free_dequeue(&txnInfoArr[0], txn_type, wait, timeToDieFp, txnQueueP);
+    if (rc != CHRONOS_SUCCESS) {
+      return rc;
+    }
+
+    for (num=1; num<maxTxns; num++) {
+      if (chronos_lock_free_dequeue(&txnInfoArr[num], txnInfoArr[0].txn_type, 0, timeToDieFp, txnQueueP) != CHRONOS_SUCCESS) {
+        break;
+      }
+    }
+
+    *numTxns_ret = num;
+    return CHRONOS_SUCCESS;
+  }
+
   pthread_mutex_lock(&txnQueueP->mutex);
   while(txnQueueP->occupied <= 0) {
+    if (!wait) {
+      pthread_mutex_unlock(&txnQueueP->mutex);
+      return CHRONOS_QUEUE_EMPTY;
+    }
+
     clock_gettime(CLOCK_REALTIME, &ts);
     ts.tv_sec += 5;
     pthread_cond_timedwait(&txnQueueP->more, &txnQueueP->mutex, &ts);
@@ -34,19 +606,40 @@ chronos_dequeue_transaction(txn_info_t *txnInfoP,
 
   assert(txnQueueP->occupied > 0);
 
-  memcpy(txnInfoP, &(txnQueueP->txnInfoArr[txnQueueP->nextout]), sizeof(*txnInfoP));
+  while (num < maxTxns && txnQueueP->occupied > 0) {
+    slotP = chronos_queue_slot_head(txnQueueP);
+    if (txn_type >= 0 && slotP->txn_type != txn_type) {
+      break;
+    }
 
-  txnQueueP->nextout++;
-  txnQueueP->nextout %= CHRONOS_READY_QUEUE_SIZE;
-  txnQueueP->occupied--;
-  /* now: either txnQueueP->occupied > 0 and txnQueueP->nextout is the index
-       of the next occupied slot in the buffer, or
-       txnQueueP->occupied == 0 and txnQueueP->nextout is the index of the next
-       (empty) slot that will be filled by a producer (such as
-       txnQueueP->nextout == txnQueueP->nextin) */
+    txnInfoArr[num] = *slotP;
+    txn_type = slotP->txn_type;
+    num ++;
 
-  pthread_cond_signal(&txnQueueP->less);
+    chronos_queue_slot_pop(txnQueueP);
+    /* now: either txnQueueP->occupied > 0 and txnQueueP->nextout is the index
+         of the next occupied slot in the buffer, or
+         txnQueueP->occupied == 0 and txnQueueP->nextout is the index of the next
+         (empty) slot that will be filled by a producer (such as
+         txnQueueP->nextout == txnQueueP->nextin) */
+  }
+
+  if (num == 0) {
+    /* The head is of another type */
+    pthread_mutex_unlock(&txnQueueP->mutex);
+    return CHRONOS_QUEUE_EMPTY;
+  }
+
+  /* There is room for more than one producer */
+  if (num > 1) {
+    pthread_cond_broadcast(&txnQueueP->less);
+  }
+  else {
+    pthread_cond_signal(&txnQueueP->less);
+  }
   pthread_mutex_unlock(&txnQueueP->mutex);
+
+  *numTxns_ret = num;
   goto cleanup;
 
 failXit:
@@ -56,6 +649,63 @@ cleanup:
   return rc;
 }
 
+/*
+ * Once a batch has been started, keep adding txns of the same type to
+ * it from the same queue, until it is full or maxWaitUS have passed.
+ */
+static void
+chronos_dequeue_batch_fill(txn_info_t *txnInfoArr,
+                           int maxTxns,
+                           int *numTxnsP,
+                           int maxWaitUS,
+                           int (*timeToDieFp)(void), 
+                           chronos_queue_t *txnQueueP)
+{
+  int            num = 0;
+  chronos_time_t now;
+  unsigned long long deadline_ns;
+  unsigned long long now_ns;
+
+  if (maxWaitUS <= 0 || *numTxnsP >= maxTxns) {
+    return;
+  }
+
+  CHRONOS_TIME_GET(now);
+  deadline_ns = (unsigned long long) now.tv_sec * NSEC_TO_SEC + now.tv_nsec
+                + (unsigned long long) maxWaitUS * 1000;
+
+  while (*numTxnsP < maxTxns) {
+    if (timeToDieFp && timeToDieFp()) {
+      break;
+    }
+
+    CHRONOS_TIME_GET(now);
+    now_ns = (unsigned long long) now.tv_sec * NSEC_TO_SEC + now.tv_nsec;
+    if (now_ns >= deadline_ns) {
+      break;
+    }
+
+    if (chronos_queue_size(txnQueueP) == 0) {
+      sched_yield();
+      continue;
+    }
+
+    if (chronos_dequeue_transactions(&txnInfoArr[*numTxnsP], 
+                                     maxTxns - *numTxnsP, 
+                                     txnInfoArr[0].txn_type,
+                                     &num,
+                                     0,
+                                     timeToDieFp,
+                                     txnQueueP) == CHRONOS_SUCCESS) {
+      *numTxnsP += num;
+    }
+    else {
+      /* A txn of another type is next: the batch cannot grow */
+      break;
+    }
+  }
+}
+
 static int
 chronos_enqueue_transaction(txn_info_t *txnInfoP, 
                             unsigned long long *ticket_ret, 
@@ -64,12 +714,17 @@ chronos_enqueue_transaction(txn_info_t *txnInfoP,
 {
   int              rc = CHRONOS_SUCCESS;
   struct timespec  ts; /* For the timed wait */
+  txn_info_t      *slotP = NULL;
 
   if (txnQueueP == NULL || txnInfoP == NULL) {
     chronos_error("Invalid argument");
     goto failXit;
   }
 
+  if (txnQueueP->lockFree) {
+    return chronos_lock_free_enqueue(txnInfoP, ticket_ret, timeToDieFp, txnQueueP);
+  }
+
   pthread_mutex_lock(&txnQueueP->mutex);
    
   while (txnQueueP->occupied >= CHRONOS_READY_QUEUE_SIZE) {
@@ -87,17 +742,16 @@ chronos_enqueue_transaction(txn_info_t *txnInfoP,
 
   assert(txnQueueP->occupied < CHRONOS_READY_QUEUE_SIZE);
   
-  memcpy(&(txnQueueP->txnInfoArr[txnQueueP->nextin]), txnInfoP, sizeof(*txnInfoP));
+  slotP = chronos_queue_slot_alloc(txnQueueP);
+  *slotP = *txnInfoP;
 
   txnQueueP->ticketReq ++;
-  txnQueueP->txnInfoArr[txnQueueP->nextin].ticket = txnQueueP->ticketReq;
+  slotP->ticket = txnQueueP->ticketReq;
   if (ticket_ret) {
     *ticket_ret = txnQueueP->ticketReq;
   }
   
-  txnQueueP->nextin ++;
-  txnQueueP->nextin %= CHRONOS_READY_QUEUE_SIZE;
-  txnQueueP->occupied++;
+  chronos_queue_slot_push(slotP, txnQueueP);
 
   /* now: either b->occupied < CHRONOS_READY_QUEUE_SIZE and b->nextin is the index
        of the next empty slot in the buffer, or
@@ -118,30 +772,159 @@ cleanup:
   return rc;
 }
 
+/*
+ * Put several user transactions in the queue while holding the lock
+ * only once. Each request buffer passes one reference to the queue.
+ * They are enqueued back to back, so they get consecutive tickets.
+ */
 int
-chronos_dequeue_system_transaction(void *requestP_ret,
-                                   chronos_time_t *ts, 
-                                   chronosServerContext_t *contextP) 
+chronos_enqueue_user_transaction_batch(chronosRequestBuffer_t **requestBufArr,
+                                       int                     numRequests,
+                                       const chronos_time_t   *ts, 
+                                       unsigned long long     *ticket_ret, 
+                                       chronosCompletion_t   **completion_arr,
+                                       chronosServerContext_t *contextP) 
 {
+  int              i;
   int              rc = CHRONOS_SUCCESS;
-  txn_info_t       txn_info;
+  struct timespec  wait_ts; /* For the timed wait */
+  unsigned long long pos;
+  txn_info_t      *txnInfoP = NULL;
+  chronos_queue_t *userTxnQueueP = NULL;
+
+  if (contextP == NULL || requestBufArr == NULL || ts == NULL || ticket_ret == NULL 
+      || completion_arr == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (numRequests < 1 || numRequests > CHRONOS_READY_QUEUE_SIZE) {
+    chronos_error("Invalid number of requests: %d", numRequests);
+    goto failXit;
+  }
+
+  userTxnQueueP = chronos_user_queue_local(contextP);
+
+  if (userTxnQueueP->lockFree) {
+    rc = chronos_queue_slots_claim(numRequests, &pos, contextP->timeToDieFp, userTxnQueueP);
+    if (rc != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+
+    *ticket_ret = pos + 1;
+
+    for (i=0; i<numRequests; i++) {
+      txnInfoP = &(userTxnQueueP->txnInfoArr[(pos + i) % CHRONOS_READY_QUEUE_SIZE]);
+
+      memset(txnInfoP, 0, sizeof(*txnInfoP));
+      txnInfoP->requestBufP = requestBufArr[i];
+      txnInfoP->txn_type = requestBufArr[i]->request.txn_type;
+      txnInfoP->txn_enqueue = *ts;
+      txnInfoP->completionP = completion_arr[i];
+      txnInfoP->ticket = pos + i + 1;
+      chronos_txn_deadline_set(txnInfoP, contextP);
+
+      chronos_queue_slot_publish(pos + i, userTxnQueueP);
+    }
+
+    chronosEventSignal(&contextP->workAvailable, numRequests);
+    goto cleanup;
+  }
+
+  pthread_mutex_lock(&userTxnQueueP->mutex);
+   
+  while (userTxnQueueP->occupied + numRequests > CHRONOS_READY_QUEUE_SIZE) {
+    clock_gettime(CLOCK_REALTIME, &wait_ts);
+    wait_ts.tv_sec += 5;
+
+    pthread_cond_timedwait(&userTxnQueueP->less, &userTxnQueueP->mutex, &wait_ts);
+
+    if (contextP->timeToDieFp && contextP->timeToDieFp()) {
+      chronos_warning("Process asked to die");
+      pthread_mutex_unlock(&userTxnQueueP->mutex);
+      goto failXit;
+    }
+  }
+
+  *ticket_ret = userTxnQueueP->ticketReq + 1;
+
+  for (i=0; i<numRequests; i++) {
+    txnInfoP = chronos_queue_slot_alloc(userTxnQueueP);
+
+    memset(txnInfoP, 0, sizeof(*txnInfoP));
+    txnInfoP->requestBufP = requestBufArr[i];
+    txnInfoP->txn_type = requestBufArr[i]->request.txn_type;
+    txnInfoP->txn_enqueue = *ts;
+    txnInfoP->completionP = completion_arr[i];
+
+    chronos_txn_deadline_set(txnInfoP, contextP);
+
+    userTxnQueueP->ticketReq ++;
+    txnInfoP->ticket = userTxnQueueP->ticketReq;
+
+    chronos_queue_slot_push(txnInfoP, userTxnQueueP);
+  }
+
+  /* There is work for more than one processing thread */
+  if (numRequests > 1) {
+    pthread_cond_broadcast(&userTxnQueueP->more);
+  }
+  else {
+    pthread_cond_signal(&userTxnQueueP->more);
+  }
+
+  pthread_mutex_unlock(&userTxnQueueP->mutex);
+
+  chronosEventSignal(&contextP->workAvailable, numRequests);
+  goto cleanup;
+
+failXit:
+  rc = CHRONOS_FAIL;
+
+cleanup:
+  return rc;
+}
+
+/*
+ * Take up to maxTxns refreshes in a row out of the system queue, waiting
+ * up to maxWaitUS for the batch to fill once the first one is in. The
+ * caller gets the queue's reference to each request buffer.
+ */
+int
+chronos_dequeue_system_transactions(chronosRequestBuffer_t **requestBuf_arr,
+                                    chronos_time_t          *ts_arr, 
+                                    int                      maxTxns,
+                                    int                     *numTxns_ret,
+                                    int                      maxWaitUS,
+                                    chronosServerContext_t  *contextP) 
+{
+  int              i;
+  int              num = 0;
+  int              rc = CHRONOS_SUCCESS;
+  txn_info_t       txn_info_arr[CHRONOS_PROCESS_BATCH_MAX];
   chronos_queue_t *systemTxnQueueP = NULL;
 
-  if (contextP == NULL || requestP_ret == NULL || ts == NULL) {
+  if (contextP == NULL || requestBuf_arr == NULL || ts_arr == NULL || numTxns_ret == NULL
+      || maxTxns < 1 || maxTxns > CHRONOS_PROCESS_BATCH_MAX) {
     chronos_error("Invalid argument");
     goto failXit;
   }
 
   systemTxnQueueP = &(contextP->sysTxnQueue);
 
-  rc = chronos_dequeue_transaction(&txn_info, contextP->timeToDieFp, systemTxnQueueP);
+  rc = chronos_dequeue_transactions(txn_info_arr, maxTxns, -1, &num, 1, contextP->timeToDieFp, systemTxnQueueP);
   if (rc != CHRONOS_SUCCESS) {
     chronos_error("Could not dequeue update transaction");
     goto failXit;
   }
 
-  memcpy(requestP_ret, &txn_info.request, sizeof(txn_info.request));
-  *ts = txn_info.txn_enqueue;
+  chronos_dequeue_batch_fill(txn_info_arr, maxTxns, &num, maxWaitUS, contextP->timeToDieFp, systemTxnQueueP);
+
+  for (i=0; i<num; i++) {
+    requestBuf_arr[i] = txn_info_arr[i].requestBufP;
+    ts_arr[i] = txn_info_arr[i].txn_enqueue;
+  }
+  *numTxns_ret = num;
 
   goto cleanup;
 
@@ -152,8 +935,24 @@ cleanup:
   return rc;
 }
 
+/*
+ * The caller gets the queue's reference to the request buffer
+ */
 int
-chronos_enqueue_system_transaction(void *requestP, 
+chronos_dequeue_system_transaction(chronosRequestBuffer_t **requestBuf_ret,
+                                   chronos_time_t *ts, 
+                                   chronosServerContext_t *contextP) 
+{
+  int num = 0;
+
+  return chronos_dequeue_system_transactions(requestBuf_ret, ts, 1, &num, 0, contextP);
+}
+
+/*
+ * The caller passes one reference to the request buffer to the queue
+ */
+int
+chronos_enqueue_system_transaction(chronosRequestBuffer_t *requestBufP, 
                                    const chronos_time_t *ts, 
                                    chronosServerContext_t *contextP) 
 {
@@ -161,7 +960,7 @@ chronos_enqueue_system_transaction(void *requestP,
   txn_info_t       txn_info;
   chronos_queue_t *systemTxnQueueP = NULL;
 
-  if (contextP == NULL || requestP == NULL || ts == NULL) {
+  if (contextP == NULL || requestBufP == NULL || ts == NULL) {
     chronos_error("Invalid argument");
     goto failXit;
   }
@@ -170,7 +969,8 @@ chronos_enqueue_system_transaction(void *requestP,
 
   /* Set the transaction information */
   memset(&txn_info, 0, sizeof(txn_info));
-  memcpy(&txn_info.request, requestP, sizeof(txn_info.request));
+  txn_info.requestBufP = requestBufP;
+  txn_info.txn_type = requestBufP->request.txn_type;
   txn_info.txn_enqueue = *ts;
 
   rc = chronos_enqueue_transaction(&txn_info, NULL, contextP->timeToDieFp, systemTxnQueueP);
@@ -179,6 +979,8 @@ chronos_enqueue_system_transaction(void *requestP,
     goto failXit;
   }
 
+  chronosEventSignal(&contextP->workAvailable, 1);
+
   goto cleanup;
 
 failXit:
@@ -188,36 +990,69 @@ cleanup:
   return rc;
 }
 
+/*
+ * Take up to maxTxns user txns of the same type in a row out of the user 
+ * queues, waiting up to maxWaitUS for the batch to fill once the first
+ * one is in. They all come from the same queue. The caller gets the
+ * queue's reference to each request buffer.
+ */
 int
-chronos_dequeue_user_transaction(void                   *requestP_ret, 
-                                 chronos_time_t         *ts, 
-                                 unsigned long long     *ticket_ret,
-                                 volatile int           **txn_done_ret,
-                                 volatile int           **txn_rc_ret,
-                                 chronosServerContext_t *contextP) 
+chronos_dequeue_user_transactions(chronosRequestBuffer_t **requestBuf_arr, 
+                                  chronos_time_t         *ts_arr, 
+                                  chronos_time_t         *deadline_arr, 
+                                  unsigned long long     *ticket_arr,
+                                  chronosCompletion_t    **completion_arr,
+                                  int                    maxTxns,
+                                  int                    *numTxns_ret,
+                                  int                    maxWaitUS,
+                                  int                    home_queue,
+                                  chronosServerContext_t *contextP) 
 {
+  int              i;
+  int              num = 0;
   int              rc = CHRONOS_SUCCESS;
-  txn_info_t       txn_info;
+  txn_info_t       txn_info_arr[CHRONOS_PROCESS_BATCH_MAX];
   chronos_queue_t *userTxnQueueP = NULL;
 
-  if (contextP == NULL || ts == NULL) {
+  if (contextP == NULL || requestBuf_arr == NULL || ts_arr == NULL || ticket_arr == NULL
+      || completion_arr == NULL || numTxns_ret == NULL || home_queue < 0
+      || maxTxns < 1 || maxTxns > CHRONOS_PROCESS_BATCH_MAX) {
     chronos_error("Invalid argument");
     goto failXit;
   }
 
-  userTxnQueueP = &(contextP->userTxnQueue);
+  /* Start with our own queue, then steal from the others */
+  rc = CHRONOS_QUEUE_EMPTY;
+  for (i=0; i<contextP->numUserTxnQueues && rc == CHRONOS_QUEUE_EMPTY; i++) {
+    userTxnQueueP = &(contextP->userTxnQueuesArr[(home_queue + i) % contextP->numUserTxnQueues]);
 
-  rc = chronos_dequeue_transaction(&txn_info, contextP->timeToDieFp, userTxnQueueP);
-  if (rc != CHRONOS_SUCCESS) {
+    if (chronos_queue_size(userTxnQueueP) == 0) {
+      continue;
+    }
+
+    rc = chronos_dequeue_transactions(txn_info_arr, maxTxns, -1, &num, 0, contextP->timeToDieFp, userTxnQueueP);
+  }
+
+  if (rc == CHRONOS_QUEUE_EMPTY) {
+    return CHRONOS_QUEUE_EMPTY;
+  }
+  else if (rc != CHRONOS_SUCCESS) {
     chronos_error("Could not dequeue user transaction");
     goto failXit;
   }
 
-  memcpy(requestP_ret, &txn_info.request, sizeof(txn_info.request));
-  *ts = txn_info.txn_enqueue;
-  *ticket_ret = txn_info.ticket;
-  *txn_done_ret = txn_info.txn_done;
-  *txn_rc_ret = txn_info.txn_rc;
+  chronos_dequeue_batch_fill(txn_info_arr, maxTxns, &num, maxWaitUS, contextP->timeToDieFp, userTxnQueueP);
+
+  for (i=0; i<num; i++) {
+    requestBuf_arr[i] = txn_info_arr[i].requestBufP;
+    ts_arr[i] = txn_info_arr[i].txn_enqueue;
+    if (deadline_arr) {
+      deadline_arr[i] = txn_info_arr[i].txn_deadline;
+    }
+    ticket_arr[i] = txn_info_arr[i].ticket;
+    completion_arr[i] = txn_info_arr[i].completionP;
+  }
+  *numTxns_ret = num;
 
   goto cleanup;
 
@@ -228,31 +1063,52 @@ cleanup:
   return rc;
 }
 
+/*
+ * The caller gets the queue's reference to the request buffer
+ */
+int
+chronos_dequeue_user_transaction(chronosRequestBuffer_t **requestBuf_ret, 
+                                 chronos_time_t         *ts, 
+                                 chronos_time_t         *deadline_ret, 
+                                 unsigned long long     *ticket_ret,
+                                 chronosCompletion_t    **completion_ret,
+                                 int                    home_queue,
+                                 chronosServerContext_t *contextP) 
+{
+  int num = 0;
+
+  return chronos_dequeue_user_transactions(requestBuf_ret, ts, deadline_ret, ticket_ret, completion_ret,
+                                           1, &num, 0, home_queue, contextP);
+}
+
+/*
+ * The caller passes one reference to the request buffer to the queue
+ */
 int
-chronos_enqueue_user_transaction(void *requestP,
+chronos_enqueue_user_transaction(chronosRequestBuffer_t *requestBufP,
                                  const chronos_time_t *ts, 
                                  unsigned long long *ticket_ret, 
-                                 volatile int *txn_done,
-                                 volatile int *txn_rc,
+                                 chronosCompletion_t *completionP,
                                  chronosServerContext_t *contextP) 
 {
   int              rc = CHRONOS_SUCCESS;
   txn_info_t       txn_info;
   chronos_queue_t *userTxnQueueP = NULL;
 
-  if (contextP == NULL || ts == NULL || ticket_ret == NULL) {
+  if (contextP == NULL || requestBufP == NULL || ts == NULL || ticket_ret == NULL) {
     chronos_error("Invalid argument");
     goto failXit;
   }
 
-  userTxnQueueP = &(contextP->userTxnQueue);
+  userTxnQueueP = chronos_user_queue_local(contextP);
 
   /* Set the transaction information */
   memset(&txn_info, 0, sizeof(txn_info));
-  memcpy(&txn_info.request, requestP, sizeof(txn_info.request));
+  txn_info.requestBufP = requestBufP;
+  txn_info.txn_type = requestBufP->request.txn_type;
   txn_info.txn_enqueue = *ts;
-  txn_info.txn_done = txn_done;
-  txn_info.txn_rc = txn_rc;
+  txn_info.completionP = completionP;
+  chronos_txn_deadline_set(&txn_info, contextP);
 
   rc = chronos_enqueue_transaction(&txn_info, ticket_ret, contextP->timeToDieFp, userTxnQueueP);
   if (rc != CHRONOS_SUCCESS) {
@@ -260,6 +1116,8 @@ chronos_enqueue_user_transaction(void *requestP,
     goto failXit;
   }
 
+  chronosEventSignal(&contextP->workAvailable, 1);
+
   goto cleanup;
 
 failXit:
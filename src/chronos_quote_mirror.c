@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chronos.h"
+#include "chronos_quote_mirror.h"
+
+int
+chronosQuoteMirrorInit(chronosQuoteMirror_t *mirrorP,
+                       int numEntries)
+{
+  if (mirrorP == NULL || numEntries < 0) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  mirrorP->entryArr = NULL;
+  mirrorP->numEntries = numEntries;
+  mirrorP->numReadRetries = 0;
+
+  if (numEntries == 0) {
+    return CHRONOS_SUCCESS;
+  }
+
+  mirrorP->entryArr = calloc(numEntries, sizeof(chronosQuoteMirrorEntry_t));
+  if (mirrorP->entryArr == NULL) {
+    chronos_error("Could not allocate quote mirror");
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosQuoteMirrorDestroy(chronosQuoteMirror_t *mirrorP)
+{
+  if (mirrorP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  if (mirrorP->numReadRetries > 0) {
+    chronos_info("Quote mirror: %d reads were retried", mirrorP->numReadRetries);
+  }
+
+  if (mirrorP->entryArr != NULL) {
+    free(mirrorP->entryArr);
+    mirrorP->entryArr = NULL;
+  }
+  mirrorP->numEntries = 0;
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Writers of the same entry exclude each other by moving the counter
+ * from even to odd. Two refreshes of the same symbol rarely overlap,
+ * since refreshes are coalesced; if they do, the last one to publish
+ * wins until the next refresh.
+ */
+int
+chronosQuoteMirrorPublish(chronosQuoteMirror_t *mirrorP,
+                          int index,
+                          const QUOTE *quoteP)
+{
+  chronosQuoteMirrorEntry_t *entryP = NULL;
+  unsigned int seq;
+
+  if (mirrorP == NULL || quoteP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  if (index < 0 || index >= mirrorP->numEntries) {
+    chronos_error("Invalid quote index: %d", index);
+    return CHRONOS_FAIL;
+  }
+
+  entryP = &(mirrorP->entryArr[index]);
+
+  while (1) {
+    seq = entryP->seq;
+    if ((seq & 1) == 0 && __sync_bool_compare_and_swap(&entryP->seq, seq, seq + 1)) {
+      break;
+    }
+  }
+
+  memcpy(&entryP->quote, quoteP, sizeof(QUOTE));
+
+  __sync_synchronize();
+  entryP->seq = seq + 2;
+
+  return CHRONOS_SUCCESS;
+}
+
+int
+chronosQuoteMirrorRead(chronosQuoteMirror_t *mirrorP,
+                       int index,
+                       QUOTE *quote_ret)
+{
+  chronosQuoteMirrorEntry_t *entryP = NULL;
+  unsigned int seq;
+  int retried = 0;
+
+  if (mirrorP == NULL || quote_ret == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  if (index < 0 || index >= mirrorP->numEntries) {
+    return CHRONOS_FAIL;
+  }
+
+  entryP = &(mirrorP->entryArr[index]);
+
+  while (1) {
+    seq = entryP->seq;
+    if (seq == 0) {
+      return CHRONOS_FAIL;
+    }
+
+    if ((seq & 1) == 0) {
+      __sync_synchronize();
+      memcpy(quote_ret, &entryP->quote, sizeof(QUOTE));
+      __sync_synchronize();
+
+      if (entryP->seq == seq) {
+        break;
+      }
+    }
+
+    retried = 1;
+  }
+
+  if (retried) {
+    __sync_fetch_and_add(&mirrorP->numReadRetries, 1);
+  }
+
+  return CHRONOS_SUCCESS;
+}
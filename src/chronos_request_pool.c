@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "chronos.h"
+#include "chronos_request_pool.h"
+
+#define CHRONOS_POOL_INDEX_MASK   (0xFFFFFFFFULL)
+
+/* Same head with a new index and the next version */
+#define CHRONOS_POOL_HEAD_NEXT(_head, _index) \
+  (((((_head) >> 32) + 1) << 32) | (unsigned long long) ((_index) + 1))
+
+int
+chronosRequestPoolInit(chronosRequestPool_t *poolP,
+                       int numBuffers)
+{
+  int i;
+
+  if (poolP == NULL || numBuffers < 0) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  poolP->bufferArr = NULL;
+  poolP->numBuffers = numBuffers;
+  poolP->freeHead = 0;
+  poolP->numOverflows = 0;
+
+  if (numBuffers == 0) {
+    return CHRONOS_SUCCESS;
+  }
+
+  poolP->bufferArr = malloc(numBuffers * sizeof(chronosRequestBuffer_t));
+  if (poolP->bufferArr == NULL) {
+    chronos_error("Could not allocate request pool");
+    goto failXit;
+  }
+
+  for (i=0; i<numBuffers; i++) {
+    poolP->bufferArr[i].refCount = 0;
+    poolP->bufferArr[i].index = i;
+    poolP->bufferArr[i].next = i + 1 < numBuffers ? i + 1 : -1;
+    poolP->bufferArr[i].poolP = poolP;
+  }
+  poolP->freeHead = CHRONOS_POOL_HEAD_NEXT(0ULL, 0);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosRequestPoolDestroy(chronosRequestPool_t *poolP)
+{
+  if (poolP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  if (poolP->numOverflows > 0) {
+    chronos_info("%d requests did not fit in the request pool", poolP->numOverflows);
+  }
+
+  free(poolP->bufferArr);
+  poolP->bufferArr = NULL;
+  poolP->numBuffers = 0;
+  poolP->freeHead = 0;
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Take a free buffer, holding one reference. The request
+ * in it is not initialized.
+ */
+chronosRequestBuffer_t *
+chronosRequestBufferAlloc(chronosRequestPool_t *poolP)
+{
+  int                     index;
+  unsigned long long      head;
+  chronosRequestBuffer_t *bufferP = NULL;
+
+  if (poolP == NULL) {
+    chronos_error("Invalid argument");
+    return NULL;
+  }
+
+  while (1) {
+    head = poolP->freeHead;
+    index = (int) (head & CHRONOS_POOL_INDEX_MASK) - 1;
+    if (index < 0) {
+      break;
+    }
+
+    /* next may be stale if someone else took this buffer
+     * meanwhile, but then the head has changed too */
+    bufferP = &(poolP->bufferArr[index]);
+    if (__sync_bool_compare_and_swap(&poolP->freeHead,
+                                     head,
+                                     CHRONOS_POOL_HEAD_NEXT(head, bufferP->next))) {
+      bufferP->refCount = 1;
+      return bufferP;
+    }
+  }
+
+  __sync_fetch_and_add(&poolP->numOverflows, 1);
+
+  bufferP = malloc(sizeof(chronosRequestBuffer_t));
+  if (bufferP == NULL) {
+    chronos_error("Could not allocate request buffer");
+    return NULL;
+  }
+
+  bufferP->refCount = 1;
+  bufferP->index = -1;
+  bufferP->next = -1;
+  bufferP->poolP = poolP;
+
+  return bufferP;
+}
+
+int
+chronosRequestBufferRetain(chronosRequestBuffer_t *bufferP)
+{
+  if (bufferP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  __sync_fetch_and_add(&bufferP->refCount, 1);
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Drop one reference. The buffer goes back to its
+ * pool when there are no more.
+ */
+int
+chronosRequestBufferRelease(chronosRequestBuffer_t *bufferP)
+{
+  int                   refCount;
+  unsigned long long    head;
+  chronosRequestPool_t *poolP = NULL;
+
+  if (bufferP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  refCount = __sync_sub_and_fetch(&bufferP->refCount, 1);
+  if (refCount > 0) {
+    return CHRONOS_SUCCESS;
+  }
+  else if (refCount < 0) {
+    chronos_error("Request buffer released too many times");
+    goto failXit;
+  }
+
+  if (bufferP->index < 0) {
+    free(bufferP);
+    return CHRONOS_SUCCESS;
+  }
+
+  poolP = bufferP->poolP;
+
+  do {
+    head = poolP->freeHead;
+    bufferP->next = (int) (head & CHRONOS_POOL_INDEX_MASK) - 1;
+  } while (!__sync_bool_compare_and_swap(&poolP->freeHead,
+                                         head,
+                                         CHRONOS_POOL_HEAD_NEXT(head, bufferP->index)));
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
@@ -0,0 +1,531 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "chronos.h"
+#include "chronos_shm.h"
+
+#define CHRONOS_SHM_MAGIC     0x5348524E
+#define CHRONOS_SHM_NUM_FDS   3
+#define RING_OFFSET(_pos)     ((_pos) & (CHRONOS_SHM_RING_SIZE - 1))
+
+#if (CHRONOS_SHM_RING_SIZE & (CHRONOS_SHM_RING_SIZE - 1)) != 0
+#error "CHRONOS_SHM_RING_SIZE must be a power of two"
+#endif
+
+static void
+chronosShmRingCopyIn(chronosShmRing_t *ringP, unsigned int pos, const char *srcP, int len)
+{
+  int offset = RING_OFFSET(pos);
+  int first = CHRONOS_SHM_RING_SIZE - offset;
+
+  if (first > len) {
+    first = len;
+  }
+
+  memcpy(ringP->data + offset, srcP, first);
+  memcpy(ringP->data, srcP + first, len - first);
+}
+
+static void
+chronosShmRingCopyOut(const chronosShmRing_t *ringP, unsigned int pos, char *dstP, int len)
+{
+  int offset = RING_OFFSET(pos);
+  int first = CHRONOS_SHM_RING_SIZE - offset;
+
+  if (first > len) {
+    first = len;
+  }
+
+  memcpy(dstP, ringP->data + offset, first);
+  memcpy(dstP + first, ringP->data, len - first);
+}
+
+static void
+chronosShmKick(int event_fd)
+{
+  uint64_t one = 1;
+
+  (void) write(event_fd, &one, sizeof(one));
+}
+
+static void
+chronosShmReset(chronosShmConnection_t *shmP)
+{
+  memset(shmP, 0, sizeof(*shmP));
+  shmP->mem_fd = -1;
+  shmP->recv_event_fd = -1;
+  shmP->send_event_fd = -1;
+}
+
+/*
+ * Client side: create the shared region and the event fds, and 
+ * hand them to the server through the (unix domain) socket.
+ */
+int
+chronosShmConnect(int socket_fd, 
+                  chronosShmConnection_t *shmP)
+{
+  static volatile int regionCounter = 0;
+  char name[64];
+  char payload = 0;
+  int fds[CHRONOS_SHM_NUM_FDS];
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr *cmsgP = NULL;
+  int request_event_fd = -1;
+  void *addrP = NULL;
+
+  if (shmP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  chronosShmReset(shmP);
+
+  /* The name is only needed to create the region, the
+   * server gets to it through the descriptor */
+  snprintf(name, sizeof(name), "/chronos-shm-%d-%d", 
+           (int) getpid(), __sync_fetch_and_add(&regionCounter, 1));
+
+  shmP->mem_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+  if (shmP->mem_fd < 0) {
+    perror("shm_open() failed");
+    goto failXit;
+  }
+  shm_unlink(name);
+
+  if (ftruncate(shmP->mem_fd, sizeof(chronosShmRegion_t)) < 0) {
+    perror("ftruncate() failed");
+    goto failXit;
+  }
+
+  addrP = mmap(NULL, sizeof(chronosShmRegion_t), PROT_READ | PROT_WRITE, MAP_SHARED, shmP->mem_fd, 0);
+  if (addrP == MAP_FAILED) {
+    perror("mmap() failed");
+    goto failXit;
+  }
+
+  shmP->regionP = addrP;
+  shmP->regionP->magic = CHRONOS_SHM_MAGIC;
+
+  /* Nobody has read yet, so both sides start out waiting */
+  shmP->regionP->requestRing.consumerWaiting = 1;
+  shmP->regionP->responseRing.consumerWaiting = 1;
+  shmP->sendRingP = &shmP->regionP->requestRing;
+  shmP->recvRingP = &shmP->regionP->responseRing;
+
+  request_event_fd = eventfd(0, EFD_NONBLOCK);
+  shmP->recv_event_fd = eventfd(0, EFD_NONBLOCK);
+  if (request_event_fd < 0 || shmP->recv_event_fd < 0) {
+    perror("eventfd() failed");
+    goto failXit;
+  }
+  shmP->send_event_fd = request_event_fd;
+
+  fds[0] = shmP->mem_fd;
+  fds[1] = request_event_fd;
+  fds[2] = shmP->recv_event_fd;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(control, 0, sizeof(control));
+  iov.iov_base = &payload;
+  iov.iov_len = sizeof(payload);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  cmsgP = CMSG_FIRSTHDR(&msg);
+  cmsgP->cmsg_level = SOL_SOCKET;
+  cmsgP->cmsg_type = SCM_RIGHTS;
+  cmsgP->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsgP), fds, sizeof(fds));
+
+  if (sendmsg(socket_fd, &msg, MSG_NOSIGNAL) < 0) {
+    perror("sendmsg() failed");
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  if (shmP != NULL) {
+    if (request_event_fd >= 0 && shmP->send_event_fd < 0) {
+      close(request_event_fd);
+    }
+    chronosShmClose(shmP);
+  }
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Server side: receive the region and the event fds a client sends
+ * right after connecting. Returns CHRONOS_SHM_AGAIN if they did not
+ * arrive yet, so that it can be retried when the socket is readable.
+ */
+int
+chronosShmAcceptTry(int socket_fd, 
+                    chronosShmConnection_t *shmP)
+{
+  int rc;
+  char payload;
+  struct stat st;
+  int fds[CHRONOS_SHM_NUM_FDS];
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr *cmsgP = NULL;
+  void *addrP = NULL;
+
+  if (shmP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  chronosShmReset(shmP);
+
+  memset(&msg, 0, sizeof(msg));
+  memset(control, 0, sizeof(control));
+  iov.iov_base = &payload;
+  iov.iov_len = sizeof(payload);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  rc = recvmsg(socket_fd, &msg, MSG_DONTWAIT);
+  if (rc == 0) {
+    chronos_error("Client closed the connection");
+    goto failXit;
+  }
+  else if (rc < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return CHRONOS_SHM_AGAIN;
+    }
+    perror("recvmsg() failed");
+    goto failXit;
+  }
+
+  cmsgP = CMSG_FIRSTHDR(&msg);
+  if (cmsgP == NULL
+      || cmsgP->cmsg_level != SOL_SOCKET
+      || cmsgP->cmsg_type != SCM_RIGHTS
+      || cmsgP->cmsg_len != CMSG_LEN(sizeof(fds))) {
+    chronos_error("Client did not send a shared memory region");
+    goto failXit;
+  }
+  memcpy(fds, CMSG_DATA(cmsgP), sizeof(fds));
+
+  shmP->mem_fd = fds[0];
+  shmP->recv_event_fd = fds[1];
+  shmP->send_event_fd = fds[2];
+
+  /* Touching a page past the end of a short region raises SIGBUS */
+  if (fstat(shmP->mem_fd, &st) < 0) {
+    perror("fstat() failed");
+    goto failXit;
+  }
+  if (st.st_size < (off_t) sizeof(chronosShmRegion_t)) {
+    chronos_error("Shared memory region is too small: %ld bytes", (long) st.st_size);
+    goto failXit;
+  }
+
+  addrP = mmap(NULL, sizeof(chronosShmRegion_t), PROT_READ | PROT_WRITE, MAP_SHARED, shmP->mem_fd, 0);
+  if (addrP == MAP_FAILED) {
+    perror("mmap() failed");
+    goto failXit;
+  }
+  shmP->regionP = addrP;
+
+  if (shmP->regionP->magic != CHRONOS_SHM_MAGIC) {
+    chronos_error("Bad shared memory region");
+    goto failXit;
+  }
+
+  shmP->recvRingP = &shmP->regionP->requestRing;
+  shmP->sendRingP = &shmP->regionP->responseRing;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  if (shmP != NULL) {
+    chronosShmClose(shmP);
+  }
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Same as chronosShmAcceptTry(), but wait for the client
+ */
+int
+chronosShmAccept(int socket_fd, 
+                 chronosShmConnection_t *shmP,
+                 int (*isTimeToDieFp) (void))
+{
+  int rc;
+  struct pollfd pfd;
+
+  while (1) {
+    if (isTimeToDieFp && isTimeToDieFp()) {
+      chronos_info("Requested to die");
+      goto failXit;
+    }
+
+    rc = chronosShmAcceptTry(socket_fd, shmP);
+    if (rc != CHRONOS_SHM_AGAIN) {
+      return rc;
+    }
+
+    pfd.fd = socket_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 1000 /* one second */) < 0 && errno != EINTR) {
+      perror("poll() failed");
+      goto failXit;
+    }
+  }
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Tell the peer we are done and release our side of the connection
+ */
+int
+chronosShmClose(chronosShmConnection_t *shmP)
+{
+  if (shmP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (shmP->sendRingP != NULL) {
+    shmP->sendRingP->closed = 1;
+    __sync_synchronize();
+    if (shmP->send_event_fd >= 0) {
+      chronosShmKick(shmP->send_event_fd);
+    }
+  }
+
+  if (shmP->regionP != NULL) {
+    munmap(shmP->regionP, sizeof(chronosShmRegion_t));
+  }
+
+  if (shmP->mem_fd >= 0) {
+    close(shmP->mem_fd);
+  }
+
+  if (shmP->recv_event_fd >= 0) {
+    close(shmP->recv_event_fd);
+  }
+
+  if (shmP->send_event_fd >= 0) {
+    close(shmP->send_event_fd);
+  }
+
+  chronosShmReset(shmP);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Copy up to maxLen bytes out of the receive ring. Like a read on a
+ * non-blocking socket, it is not an error if there is nothing to read.
+ * Afterwards the recv event fd becomes readable when there is more.
+ */
+int
+chronosShmRecv(chronosShmConnection_t *shmP,
+               void *dstP,
+               int maxLen,
+               int *num_bytes_ret)
+{
+  uint64_t count;
+  unsigned int head;
+  unsigned int tail;
+  int num_bytes;
+  chronosShmRing_t *ringP = NULL;
+
+  if (shmP == NULL || shmP->recvRingP == NULL || dstP == NULL || num_bytes_ret == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  ringP = shmP->recvRingP;
+
+  /* The ring tells what is there, the counter is not needed */
+  (void) read(shmP->recv_event_fd, &count, sizeof(count));
+
+  tail = ringP->tail;
+  __sync_synchronize();
+  head = ringP->head;
+
+  /* The peer moves tail, so do not take it on trust */
+  if (tail - head > CHRONOS_SHM_RING_SIZE) {
+    chronos_error("Corrupt receive ring: head %u, tail %u", head, tail);
+    goto failXit;
+  }
+
+  num_bytes = tail - head;
+  if (num_bytes > maxLen) {
+    num_bytes = maxLen;
+  }
+
+  chronosShmRingCopyOut(ringP, head, dstP, num_bytes);
+  __sync_synchronize();
+  ringP->head = head + num_bytes;
+
+  /* Ask the producer to kick us when it writes again. If there is
+   * data we could not take, kick ourselves so that we come back */
+  ringP->consumerWaiting = 1;
+  __sync_synchronize();
+  if (ringP->tail != ringP->head) {
+    chronosShmKick(shmP->recv_event_fd);
+  }
+
+  if (num_bytes == 0 && ringP->closed) {
+    __sync_synchronize();
+    if (ringP->tail == ringP->head) {
+      return CHRONOS_SHM_CLOSED;
+    }
+  }
+
+  *num_bytes_ret = num_bytes;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Copy as much of the buffer as fits in the send ring. Like a write 
+ * on a non-blocking socket, it is not an error if the ring is full.
+ */
+int
+chronosShmSend(chronosShmConnection_t *shmP,
+               const void *bufP,
+               int len,
+               int *num_bytes_ret)
+{
+  unsigned int head;
+  unsigned int tail;
+  int num_bytes;
+  chronosShmRing_t *ringP = NULL;
+
+  if (shmP == NULL || shmP->sendRingP == NULL || bufP == NULL || num_bytes_ret == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  ringP = shmP->sendRingP;
+  tail = ringP->tail;
+  head = ringP->head;
+
+  /* The peer moves head, so do not take it on trust */
+  if (tail - head > CHRONOS_SHM_RING_SIZE) {
+    chronos_error("Corrupt send ring: head %u, tail %u", head, tail);
+    goto failXit;
+  }
+
+  num_bytes = CHRONOS_SHM_RING_SIZE - (int)(tail - head);
+  if (num_bytes > len) {
+    num_bytes = len;
+  }
+
+  if (num_bytes > 0) {
+    __sync_synchronize();
+    chronosShmRingCopyIn(ringP, tail, bufP, num_bytes);
+    __sync_synchronize();
+    ringP->tail = tail + num_bytes;
+    __sync_synchronize();
+
+    if (__sync_bool_compare_and_swap(&ringP->consumerWaiting, 1, 0)) {
+      chronosShmKick(shmP->send_event_fd);
+    }
+  }
+
+  *num_bytes_ret = num_bytes;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Write the whole buffer to the send ring, waiting for the
+ * consumer to make room if needed.
+ */
+int
+chronosShmSendAll(chronosShmConnection_t *shmP,
+                  const void *bufP,
+                  int len,
+                  int (*isTimeToDieFp) (void))
+{
+  unsigned int head;
+  unsigned int tail;
+  chronosShmRing_t *ringP = NULL;
+  struct timespec backoff = {0, 50000 /* 50 usecs */};
+
+  if (shmP == NULL || shmP->sendRingP == NULL || bufP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (len > CHRONOS_SHM_RING_SIZE) {
+    chronos_error("Frame of %d bytes does not fit in the ring", len);
+    goto failXit;
+  }
+
+  ringP = shmP->sendRingP;
+  tail = ringP->tail;
+
+  while (1) {
+    head = ringP->head;
+    if (tail - head > CHRONOS_SHM_RING_SIZE) {
+      chronos_error("Corrupt send ring: head %u, tail %u", head, tail);
+      goto failXit;
+    }
+
+    if (CHRONOS_SHM_RING_SIZE - (int)(tail - head) >= len) {
+      break;
+    }
+
+    if (isTimeToDieFp && isTimeToDieFp()) {
+      chronos_info("Requested to die");
+      goto failXit;
+    }
+    nanosleep(&backoff, NULL);
+  }
+
+  __sync_synchronize();
+  chronosShmRingCopyIn(ringP, tail, bufP, len);
+  __sync_synchronize();
+  ringP->tail = tail + len;
+  __sync_synchronize();
+
+  /* Only pay for the system call if the consumer may be asleep */
+  if (__sync_bool_compare_and_swap(&ringP->consumerWaiting, 1, 0)) {
+    chronosShmKick(shmP->send_event_fd);
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
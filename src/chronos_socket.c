@@ -0,0 +1,529 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include "chronos.h"
+#include "chronos_socket.h"
+
+/*
+ * Waits up to one second for the socket to become
+ * readable or writable.
+ */
+static int
+chronosSocketWait(int socket_fd, short events)
+{
+  int rc;
+  struct pollfd fds[1];
+
+  fds[0].fd = socket_fd;
+  fds[0].events = events;
+  fds[0].revents = 0;
+
+  rc = poll(fds, 1, 1000 /* one second */);
+  if (rc < 0 && errno != EINTR) {
+    perror("poll() failed");
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosSocketAddressIsShm(const char *address)
+{
+  return address != NULL
+         && strncmp(address, CHRONOS_SOCKET_SHM_PREFIX, strlen(CHRONOS_SOCKET_SHM_PREFIX)) == 0;
+}
+
+/*
+ * Both unix: and shm: addresses are reached through a unix domain socket
+ */
+int
+chronosSocketAddressIsUnix(const char *address)
+{
+  return chronosSocketAddressPathGet(address) != NULL;
+}
+
+/*
+ * Returns the socket path of a unix: or shm: address, NULL otherwise
+ */
+const char *
+chronosSocketAddressPathGet(const char *address)
+{
+  if (address == NULL) {
+    return NULL;
+  }
+
+  if (strncmp(address, CHRONOS_SOCKET_UNIX_PREFIX, strlen(CHRONOS_SOCKET_UNIX_PREFIX)) == 0) {
+    return address + strlen(CHRONOS_SOCKET_UNIX_PREFIX);
+  }
+
+  if (chronosSocketAddressIsShm(address)) {
+    return address + strlen(CHRONOS_SOCKET_SHM_PREFIX);
+  }
+
+  return NULL;
+}
+
+/*
+ * Translate a chronos address into a socket address. Unix domain
+ * addresses ignore the port. The caller creates the socket with
+ * the family found in addrP->ss_family.
+ */
+int
+chronosSocketAddressGet(const char *address,
+                        int port,
+                        struct sockaddr_storage *addrP,
+                        socklen_t *addrLenP)
+{
+  const char *path = NULL;
+  struct sockaddr_un *unixAddrP = NULL;
+  struct sockaddr_in *inetAddrP = NULL;
+
+  if (address == NULL || addrP == NULL || addrLenP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  memset(addrP, 0, sizeof(*addrP));
+
+  path = chronosSocketAddressPathGet(address);
+  if (path != NULL) {
+    unixAddrP = (struct sockaddr_un *) addrP;
+
+    if (path[0] == '\0' || strlen(path) >= sizeof(unixAddrP->sun_path)) {
+      chronos_error("Invalid unix socket path: %s", path);
+      goto failXit;
+    }
+
+    unixAddrP->sun_family = AF_UNIX;
+    strncpy(unixAddrP->sun_path, path, sizeof(unixAddrP->sun_path) - 1);
+    *addrLenP = sizeof(*unixAddrP);
+  }
+  else {
+    inetAddrP = (struct sockaddr_in *) addrP;
+
+    if (port <= 0) {
+      chronos_error("Invalid port: %d", port);
+      goto failXit;
+    }
+
+    inetAddrP->sin_family = AF_INET;
+    inetAddrP->sin_addr.s_addr = inet_addr(address);
+    inetAddrP->sin_port = htons(port);
+    *addrLenP = sizeof(*inetAddrP);
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosSocketBufferInit(chronosSocketBuffer_t *sockBufP,
+                        int socket_fd)
+{
+  if (sockBufP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  sockBufP->socket_fd = socket_fd;
+  sockBufP->shmP = NULL;
+  sockBufP->head = 0;
+  sockBufP->tail = 0;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Read from the receive ring of a shared memory connection
+ * instead of the socket
+ */
+int
+chronosSocketBufferShmSet(chronosSocketBuffer_t *sockBufP,
+                          chronosShmConnection_t *shmP)
+{
+  if (sockBufP == NULL || shmP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  sockBufP->shmP = shmP;
+  sockBufP->socket_fd = shmP->recv_event_fd;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+int
+chronosSocketBufferAvailable(const chronosSocketBuffer_t *sockBufP)
+{
+  return sockBufP->tail - sockBufP->head;
+}
+
+/*
+ * Issue a single read for as many bytes as fit in the buffer.
+ * It is not an error if there is nothing to read on a
+ * non-blocking socket.
+ */
+int
+chronosSocketBufferFill(chronosSocketBuffer_t *sockBufP)
+{
+  int rc;
+  int num_bytes;
+  int pending;
+
+  if (sockBufP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  /* Move the partial frame (if any) to the front so that
+   * we always read into a contiguous free region */
+  pending = sockBufP->tail - sockBufP->head;
+  if (sockBufP->head > 0) {
+    if (pending > 0) {
+      memmove(sockBufP->data, sockBufP->data + sockBufP->head, pending);
+    }
+    sockBufP->head = 0;
+    sockBufP->tail = pending;
+  }
+
+  if (sockBufP->tail >= (int) sizeof(sockBufP->data)) {
+    chronos_error("Receive buffer is full");
+    goto failXit;
+  }
+
+  if (sockBufP->shmP != NULL) {
+    rc = chronosShmRecv(sockBufP->shmP,
+                        sockBufP->data + sockBufP->tail,
+                        sizeof(sockBufP->data) - sockBufP->tail,
+                        &num_bytes);
+    if (rc == CHRONOS_SHM_CLOSED) {
+      return CHRONOS_SOCKET_CLOSED;
+    }
+    else if (rc != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+
+    sockBufP->tail += num_bytes;
+    return CHRONOS_SUCCESS;
+  }
+
+  num_bytes = recv(sockBufP->socket_fd,
+                   sockBufP->data + sockBufP->tail,
+                   sizeof(sockBufP->data) - sockBufP->tail,
+                   0);
+  if (num_bytes < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return CHRONOS_SUCCESS;
+    }
+    perror("recv() failed");
+    goto failXit;
+  }
+  else if (num_bytes == 0) {
+    return CHRONOS_SOCKET_CLOSED;
+  }
+
+  sockBufP->tail += num_bytes;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Copy len bytes without removing them from the buffer.
+ * Fails if the buffer does not hold that many bytes yet.
+ */
+int
+chronosSocketBufferPeek(const chronosSocketBuffer_t *sockBufP,
+                        void *dstP,
+                        int len)
+{
+  if (sockBufP == NULL || dstP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (chronosSocketBufferAvailable(sockBufP) < len) {
+    goto failXit;
+  }
+
+  memcpy(dstP, sockBufP->data + sockBufP->head, len);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * The bytes not handed out yet, so that frames can be decoded
+ * in place. They stay put until the buffer is filled or
+ * consumed again.
+ */
+const char *
+chronosSocketBufferHead(const chronosSocketBuffer_t *sockBufP)
+{
+  return sockBufP->data + sockBufP->head;
+}
+
+/*
+ * Drop len bytes from the buffer. Fails if the
+ * buffer does not hold that many bytes yet.
+ */
+int
+chronosSocketBufferSkip(chronosSocketBuffer_t *sockBufP,
+                        int len)
+{
+  if (sockBufP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (chronosSocketBufferAvailable(sockBufP) < len) {
+    chronos_error("Not enough data in buffer");
+    goto failXit;
+  }
+
+  sockBufP->head += len;
+
+  if (sockBufP->head == sockBufP->tail) {
+    sockBufP->head = 0;
+    sockBufP->tail = 0;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Copy len bytes out of the buffer. Fails if the
+ * buffer does not hold that many bytes yet.
+ */
+int
+chronosSocketBufferConsume(chronosSocketBuffer_t *sockBufP,
+                           void *dstP,
+                           int len)
+{
+  if (sockBufP == NULL || dstP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (chronosSocketBufferAvailable(sockBufP) < len) {
+    chronos_error("Not enough data in buffer");
+    goto failXit;
+  }
+
+  memcpy(dstP, sockBufP->data + sockBufP->head, len);
+
+  return chronosSocketBufferSkip(sockBufP, len);
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Read from the socket until the buffer holds at least len bytes
+ */
+int
+chronosSocketBufferWait(chronosSocketBuffer_t *sockBufP,
+                        int len,
+                        int (*isTimeToDieFp) (void))
+{
+  int rc;
+
+  if (sockBufP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (len > (int) sizeof(sockBufP->data)) {
+    chronos_error("Frame of %d bytes does not fit in receive buffer", len);
+    goto failXit;
+  }
+
+  while (chronosSocketBufferAvailable(sockBufP) < len) {
+
+    if (isTimeToDieFp && isTimeToDieFp()) {
+      chronos_info("Requested to die");
+      goto failXit;
+    }
+
+    rc = chronosSocketWait(sockBufP->socket_fd, POLLIN);
+    if (rc != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+
+    rc = chronosSocketBufferFill(sockBufP);
+    if (rc == CHRONOS_SOCKET_CLOSED) {
+      return CHRONOS_SOCKET_CLOSED;
+    }
+    else if (rc != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Obtain a complete frame of frameSize bytes, reading from
+ * the socket only when the buffer does not already hold it.
+ */
+int
+chronosSocketRecvFrame(chronosSocketBuffer_t *sockBufP,
+                       void *frameP,
+                       int frameSize,
+                       int (*isTimeToDieFp) (void))
+{
+  int rc;
+
+  if (sockBufP == NULL || frameP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  rc = chronosSocketBufferWait(sockBufP, frameSize, isTimeToDieFp);
+  if (rc != CHRONOS_SUCCESS) {
+    return rc;
+  }
+
+  return chronosSocketBufferConsume(sockBufP, frameP, frameSize);
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Write the whole buffer, waiting for the socket
+ * to drain if it is non-blocking.
+ */
+int
+chronosSocketSendAll(int socket_fd,
+                     const void *bufP,
+                     int len,
+                     int (*isTimeToDieFp) (void))
+{
+  int written;
+  const char *buf = (const char *) bufP;
+
+  if (bufP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  while (len > 0) {
+    written = send(socket_fd, buf, len, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        if (isTimeToDieFp && isTimeToDieFp()) {
+          chronos_info("Requested to die");
+          goto failXit;
+        }
+
+        if (chronosSocketWait(socket_fd, POLLOUT) != CHRONOS_SUCCESS) {
+          goto failXit;
+        }
+        continue;
+      }
+
+      perror("send() failed");
+      goto failXit;
+    }
+
+    len -= written;
+    buf += written;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Issue a single write to the peer of the connection this receive
+ * buffer belongs to. It is not an error if nothing could be written
+ * on a non-blocking socket; *num_bytes_ret tells how much went out.
+ */
+int
+chronosSocketBufferSend(const chronosSocketBuffer_t *sockBufP,
+                        const void *bufP,
+                        int len,
+                        int *num_bytes_ret)
+{
+  int written;
+
+  if (sockBufP == NULL || bufP == NULL || num_bytes_ret == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (sockBufP->shmP != NULL) {
+    return chronosShmSend(sockBufP->shmP, bufP, len, num_bytes_ret);
+  }
+
+  written = send(sockBufP->socket_fd, bufP, len, MSG_NOSIGNAL);
+  if (written < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      *num_bytes_ret = 0;
+      return CHRONOS_SUCCESS;
+    }
+    perror("send() failed");
+    goto failXit;
+  }
+
+  *num_bytes_ret = written;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Write the whole buffer to the peer of the connection
+ * this receive buffer belongs to
+ */
+int
+chronosSocketBufferSendAll(const chronosSocketBuffer_t *sockBufP,
+                           const void *bufP,
+                           int len,
+                           int (*isTimeToDieFp) (void))
+{
+  if (sockBufP == NULL) {
+    chronos_error("Invalid argument");
+    return CHRONOS_FAIL;
+  }
+
+  if (sockBufP->shmP != NULL) {
+    return chronosShmSendAll(sockBufP->shmP, bufP, len, isTimeToDieFp);
+  }
+
+  return chronosSocketSendAll(sockBufP->socket_fd, bufP, len, isTimeToDieFp);
+}
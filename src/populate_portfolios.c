@@ -38,6 +38,14 @@ benchmark_load_portfolio(void *benchmark_handle)
   }
   
   BENCHMARK_CHECK_MAGIC(benchmarkP);
+
+  /* Portfolios loaded by older versions are re-keyed first */
+  ret = migrate_portfolio_database(benchmarkP);
+  if (ret) {
+    benchmark_error("%s:%d Error migrating portfolios database.", __FILE__, __LINE__);
+    goto failXit;
+  }
+
   ret = load_portfolio_database(benchmarkP);
   if (ret) {
     benchmark_error("%s:%d Error loading personal database.", __FILE__, __LINE__);
@@ -62,6 +70,7 @@ load_portfolio_database(BENCHMARK_DBS *benchmarkP)
   DB_ENV  *envP = NULL;
 #define CHRONOS_PORTFOLIOS_NUM	100
   PORTFOLIOS portfolio;
+  PORTFOLIOS_KEY portfolio_key;
   int i;
 
   envP = benchmarkP->envP;
@@ -107,8 +116,9 @@ load_portfolio_database(BENCHMARK_DBS *benchmarkP)
     /* Now that we have our structure we can load it into the database. */
 
     /* Set up the database record's key */
-    key.data = portfolio.portfolio_id;
-    key.size = (u_int32_t)strlen(portfolio.portfolio_id) + 1;
+    set_portfolio_key(&portfolio_key, portfolio.account_id, portfolio.symbol);
+    key.data = &portfolio_key;
+    key.size = sizeof(PORTFOLIOS_KEY);
 
     /* Set up the database record's data */
     data.data = &portfolio;
@@ -133,7 +143,17 @@ load_portfolio_database(BENCHMARK_DBS *benchmarkP)
     }
 
     rc = benchmarkP->portfolios_dbp->put(benchmarkP->portfolios_dbp, txnP, &key, &data, DB_NOOVERWRITE);
-    if (rc != 0) {
+    if (rc == DB_KEYEXIST) {
+      /* This account already holds this symbol */
+      benchmark_debug(4,"Skipping: %s, account: %s already holds: %s", portfolio.portfolio_id, portfolio.account_id, portfolio.symbol);
+      rc = txnP->abort(txnP);
+      if (rc != 0) {
+        envP->err(envP, rc, "[%s:%d] [%d] Transaction abort failed.", __FILE__, __LINE__, getpid());
+        goto failXit;
+      }
+      continue;
+    }
+    else if (rc != 0) {
       envP->err(envP, rc, "Database put failed.");
       rc = txnP->abort(txnP);
       if (rc != 0) {
@@ -65,7 +65,7 @@ benchmark_purchase(int account,
   }
  
   assert("Need to set account id" == NULL);
-  ret = place_order(NULL, random_symbol, random_price, random_amount, force_apply, NULL, benchmarkP);
+  ret = place_order(NULL, random_symbol, random_price, random_amount, force_apply, NULL, NULL, benchmarkP);
   if (ret != 0) {
     fprintf(stderr, "Could not place order\n");
     goto failXit;
@@ -95,6 +95,8 @@ benchmark_purchase2(int           num_data,
   benchmark_xact_h xactH = NULL;
   int i;
   int ret;
+  const char **symbol_list = NULL;
+  QUOTE *quote_list = NULL;
 
   benchmarkP = benchmark_handle;
   if (benchmarkP == NULL) {
@@ -108,11 +110,28 @@ benchmark_purchase2(int           num_data,
     goto failXit;
   }
 
+  symbol_list = malloc(num_data * sizeof(const char *));
+  quote_list = malloc(num_data * sizeof(QUOTE));
+  if (num_data > 0 && (symbol_list == NULL || quote_list == NULL)) {
+    benchmark_error("Could not allocate quote list");
+    goto failXit;
+  }
+
+  /* Read all the prices at once */
+  for (i=0; i<num_data; i++) {
+    symbol_list[i] = data[i].symbol;
+  }
+
+  ret = get_quotes(num_data, symbol_list, quote_list, xactH, benchmarkP);
+  if (ret != BENCHMARK_SUCCESS) {
+    goto failXit;
+  }
+
   benchmark_debug(2, "Purchasing for: %d symbols", num_data);
 
   for (i=0; i<num_data; i++) {
     benchmark_debug(2, "Placing order for user: %s", data[i].accountId);
-    ret = place_order(data[i].accountId, data[i].symbol, data[i].price, data[i].amount, 1, xactH, benchmarkP);
+    ret = place_order(data[i].accountId, data[i].symbol, data[i].price, data[i].amount, 1, &quote_list[i], xactH, benchmarkP);
     if (ret != BENCHMARK_SUCCESS) {
       goto failXit;
     }
@@ -123,6 +142,9 @@ benchmark_purchase2(int           num_data,
     goto failXit;
   }
 
+  free(symbol_list);
+  free(quote_list);
+
   BENCHMARK_CHECK_MAGIC(benchmarkP);
 
   return ret;
@@ -132,5 +154,8 @@ benchmark_purchase2(int           num_data,
     abort_xact(xactH, benchmarkP);
   }
 
+  free(symbol_list);
+  free(quote_list);
+
   return BENCHMARK_FAIL;
 }
@@ -42,7 +42,7 @@ benchmark_refresh_quotes(void *benchmark_handle, int *symbolP, float newValue)
   random_symbol = benchmarkP->stocks[symbol];
 
   benchmark_debug(BENCHMARK_DEBUG_LEVEL_API, "PID: %d, Attempting to update %s to %f", getpid(), random_symbol, newValue);
-  ret = update_stock(random_symbol, newValue, benchmarkP);
+  ret = update_stock(random_symbol, newValue, NULL, benchmarkP);
   if (ret != 0) {
     benchmark_error("Could not update quote");
     goto failXit;
@@ -65,7 +65,7 @@ benchmark_refresh_quotes(void *benchmark_handle, int *symbolP, float newValue)
 }
 
 int
-benchmark_refresh_quotes2(void *benchmark_handle, const char *symbolP, float newValue)
+benchmark_refresh_quotes2(void *benchmark_handle, const char *symbolP, float newValue, QUOTE *quote_ret)
 {
   BENCHMARK_DBS *benchmarkP = NULL;
   int ret = BENCHMARK_SUCCESS;
@@ -82,7 +82,7 @@ benchmark_refresh_quotes2(void *benchmark_handle, const char *symbolP, float new
   BENCHMARK_CHECK_MAGIC(benchmarkP);
 
   benchmark_debug(BENCHMARK_DEBUG_LEVEL_API,"PID: %d, Attempting to update %s to %f", getpid(), symbolP, newValue);
-  ret = update_stock((char *)symbolP, newValue, benchmarkP);
+  ret = update_stock((char *)symbolP, newValue, quote_ret, benchmarkP);
   if (ret != 0) {
     benchmark_error("Could not update quote");
     goto failXit;
@@ -96,3 +96,57 @@ benchmark_refresh_quotes2(void *benchmark_handle, const char *symbolP, float new
   
   return BENCHMARK_FAIL;
 }
+
+/*
+ * Refresh several quotes under a single transaction. If any of them
+ * fails, none is refreshed. If quote_list_ret is given, it gets the
+ * new quotes, which are valid only if the transaction committed.
+ */
+int
+benchmark_refresh_quotes_list(void *benchmark_handle, int num_symbols, const char **symbol_list_P, float newValue, QUOTE *quote_list_ret)
+{
+  BENCHMARK_DBS *benchmarkP = NULL;
+  benchmark_xact_h xactH = NULL;
+  int i;
+  int ret;
+
+  benchmarkP = benchmark_handle;
+  if (benchmarkP == NULL || symbol_list_P == NULL || num_symbols < 1) {
+    goto failXit;
+  }
+
+  BENCHMARK_CHECK_MAGIC(benchmarkP);
+
+  ret = start_xact(&xactH, "REFRESH_QUOTES_TXN", benchmarkP);
+  if (ret != BENCHMARK_SUCCESS) {
+    goto failXit;
+  }
+
+  for (i=0; i<num_symbols; i++) {
+    benchmark_debug(BENCHMARK_DEBUG_LEVEL_API,"PID: %d, Attempting to update %s to %f", getpid(), symbol_list_P[i], newValue);
+    ret = update_stock_xact(symbol_list_P[i], newValue, xactH, 
+                            quote_list_ret != NULL ? &quote_list_ret[i] : NULL, 
+                            benchmarkP);
+    if (ret != BENCHMARK_SUCCESS) {
+      benchmark_error("Could not update quote");
+      goto failXit;
+    }
+  }
+
+  ret = commit_xact(xactH, benchmarkP);
+  xactH = NULL;
+  if (ret != BENCHMARK_SUCCESS) {
+    goto failXit;
+  }
+
+  BENCHMARK_CHECK_MAGIC(benchmarkP);
+  benchmark_debug(BENCHMARK_DEBUG_LEVEL_API, "Done refreshing price for %d symbols.", num_symbols);
+  return ret;
+
+ failXit:
+  if (xactH != NULL) {
+    abort_xact(xactH, benchmarkP);
+  }
+
+  return BENCHMARK_FAIL;
+}
@@ -67,7 +67,7 @@ benchmark_sell(int account, int symbol, float price, int amount, int force_apply
   }
  
   assert("Need to pass a valid account" == NULL);
-  ret = sell_stocks(NULL, random_symbol, random_price, random_amount, force_apply, NULL, benchmarkP);
+  ret = sell_stocks(NULL, random_symbol, random_price, random_amount, force_apply, NULL, NULL, benchmarkP);
   if (ret != 0) {
     benchmark_error("Could not place order");
     goto failXit;
@@ -97,6 +97,8 @@ benchmark_sell2(int           num_data,
   benchmark_xact_h xactH = NULL;
   int i;
   int ret;
+  const char **symbol_list = NULL;
+  QUOTE *quote_list = NULL;
 
   benchmarkP = benchmark_handle;
   if (benchmarkP == NULL) {
@@ -110,11 +112,28 @@ benchmark_sell2(int           num_data,
     goto failXit;
   }
 
+  symbol_list = malloc(num_data * sizeof(const char *));
+  quote_list = malloc(num_data * sizeof(QUOTE));
+  if (num_data > 0 && (symbol_list == NULL || quote_list == NULL)) {
+    benchmark_error("Could not allocate quote list");
+    goto failXit;
+  }
+
+  /* Read all the prices at once */
+  for (i=0; i<num_data; i++) {
+    symbol_list[i] = data[i].symbol;
+  }
+
+  ret = get_quotes(num_data, symbol_list, quote_list, xactH, benchmarkP);
+  if (ret != BENCHMARK_SUCCESS) {
+    goto failXit;
+  }
+
   benchmark_debug(2, "Sell for: %d symbols", num_data);
 
   for (i=0; i<num_data; i++) {
     benchmark_debug(2, "Placing order for user: %s", data[i].accountId);
-    ret = sell_stocks(data[i].accountId, data[i].symbol, data[i].price, data[i].amount, 1, xactH, benchmarkP);
+    ret = sell_stocks(data[i].accountId, data[i].symbol, data[i].price, data[i].amount, 1, &quote_list[i], xactH, benchmarkP);
     if (ret != BENCHMARK_SUCCESS) {
       benchmark_error("Could not place order for user: %s and symbol: %s", data[i].accountId, data[i].symbol);
       goto failXit;
@@ -126,6 +145,9 @@ benchmark_sell2(int           num_data,
     goto failXit;
   }
 
+  free(symbol_list);
+  free(quote_list);
+
   BENCHMARK_CHECK_MAGIC(benchmarkP);
   return ret;
   
@@ -134,5 +156,8 @@ benchmark_sell2(int           num_data,
     abort_xact(xactH, benchmarkP);
   }
 
+  free(symbol_list);
+  free(quote_list);
+
   return BENCHMARK_FAIL;
 }
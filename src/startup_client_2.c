@@ -10,11 +10,14 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <errno.h>
+#include <sys/epoll.h>
 #include "chronos.h"
 #include "chronos_packets.h"
 #include "chronos_config.h"
 #include "chronos_client.h"
 #include "chronos_transactions.h"
+#include "chronos_heap.h"
 
 int benchmark_debug_level = 0;
 int chronos_debug_level = 0;
@@ -33,6 +36,16 @@ typedef struct chronosClientContext_t {
 
   int     minThinkingTime;
   int     maxThinkingTime;
+
+  /* How many requests each thread keeps in flight */
+  int     pipelineWindow;
+
+  /* If positive, numClientsThreads users are simulated
+   * by this many event loop threads */
+  int     numEventLoops;
+
+  /* Transactions sent together in a single request */
+  int     batchSize;
   
   int     (*timeToDieFp)(void);
 
@@ -45,10 +58,30 @@ typedef struct chronosClientThreadInfo_t {
   chronosConnHandle       connectionH;
   int                     socket_fd;
   int                     numUsers;
+  int                     firstUser;
 
   chronosClientContext_t  *contextP;
 } chronosClientThreadInfo_t;
 
+typedef struct chronosClientStats_t {
+  int cnt_txns;
+  int cnt_view_stock;
+  int cnt_view_portfolio;
+  int cnt_view_purchase;
+  int cnt_view_sale;
+  int cnt_success;
+  int cnt_fail;
+} chronosClientStats_t;
+
+/* A user simulated by an event loop thread. It either 
+ * waits for its think time to expire (it is in the timer heap)
+ * or for the response of its outstanding request */
+typedef struct chronosVirtualUser_t {
+  int                 user_num;
+  int                 loadIterations;
+  chronosConnHandle   connectionH;
+} chronosVirtualUser_t;
+
 static int
 waitClientThreads(int num_threads, chronosClientThreadInfo_t *infoP, chronosClientContext_t *contextP);
 
@@ -58,6 +91,9 @@ spawnClientThreads(int num_threads, chronosClientThreadInfo_t **info_ret, chrono
 static void *
 userTransactionThread(void *argP);
 
+static void *
+eventLoopThread(void *argP);
+
 static int
 pickTransactionType(chronosUserTransaction_t *txn_type_ret, chronosClientThreadInfo_t *infoP);
 
@@ -67,6 +103,9 @@ chronosUsage();
 static void 
 sigintHandler(int sig);
 
+#define CHRONOS_CLIENT_LOAD_ITERATIONS  10
+#define CHRONOS_CLIENT_SAMPLING_INTERVAL  10
+
 int time_to_die = 0;
 
 int isTimeToDie()
@@ -74,6 +113,15 @@ int isTimeToDie()
   return time_to_die;
 }
 
+/*
+ * Returns a thinking time uniformly selected between the bounds
+ */
+static int
+thinkTimeGet(int minThinkTimeMS, int maxThinkTimeMS) 
+{
+  return minThinkTimeMS + (rand() % (1 + maxThinkTimeMS - minThinkTimeMS));
+}
+
 /*
  * Wait the thinking time
  */
@@ -83,7 +131,7 @@ waitThinkTime(int minThinkTimeMS, int maxThinkTimeMS)
   struct timespec waitPeriod;
   int randomWaitTimeMS;
 
-  randomWaitTimeMS = minThinkTimeMS + (rand() % (1 + maxThinkTimeMS - minThinkTimeMS));
+  randomWaitTimeMS = thinkTimeGet(minThinkTimeMS, maxThinkTimeMS);
    
   waitPeriod.tv_sec = randomWaitTimeMS / 1000;
   waitPeriod.tv_nsec = ((int)randomWaitTimeMS % 1000) * 1000000;
@@ -94,6 +142,19 @@ waitThinkTime(int minThinkTimeMS, int maxThinkTimeMS)
   return CHRONOS_SUCCESS; 
 }
 
+/*
+ * Monotonic time in milliseconds, used as the timer heap key
+ */
+static unsigned long long
+currentTimeMS()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (unsigned long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
 #define xstr(a) str(a)
 #define str(a) #a
 
@@ -106,16 +167,23 @@ chronosUsage()
     "Starts up a number of chronos clients\n"
     "\n"
     "OPTIONS:\n"
-    "-c [num]              number of threads (default: %d)\n"
-    "-a [address]          server ip address (default: %s)\n"
+    "-c [num]              number of clients (default: %d)\n"
+    "-a [address]          server ip address, unix:/path for a unix domain socket,\n"
+    "                      or shm:/path for shared memory (default: %s)\n"
     "-p [num]              server port (default: %d)\n"
     "-v [num]              percentage of user transactions (default: %d%)\n"
     "-d [num]              debug level\n"
+    "-w [num]              requests in flight per connection (default: 1, max: %d)\n"
+    "-e [num]              simulate the clients with this many event loop threads\n"
+    "                      instead of one thread per client (default: %d)\n"
+    "-b [num]              transactions per request (default: 1, max: %d)\n"
     "-h                    help";
 
   snprintf(usage, sizeof(usage), template,
           CHRONOS_NUM_CLIENT_THREADS, CHRONOS_SERVER_ADDRESS, 
-          CHRONOS_SERVER_PORT, CHRONOS_RATE_VIEW_TRANSACTIONS);
+          CHRONOS_SERVER_PORT, CHRONOS_RATE_VIEW_TRANSACTIONS,
+          CHRONOS_MAX_PIPELINE_DEPTH, CHRONOS_NUM_CLIENT_EVENT_LOOPS,
+          CHRONOS_MAX_BATCH_SIZE);
   printf("%s\n", usage);
 }
 
@@ -128,6 +196,9 @@ initProcessArguments(chronosClientContext_t *contextP)
   contextP->numClientsThreads = CHRONOS_NUM_CLIENT_THREADS;
   contextP->minThinkingTime = CHRONOS_MIN_THINK_TIME_MS;
   contextP->maxThinkingTime = CHRONOS_MAX_THINK_TIME_MS;
+  contextP->pipelineWindow = 1;
+  contextP->numEventLoops = CHRONOS_NUM_CLIENT_EVENT_LOOPS;
+  contextP->batchSize = 1;
   contextP->timeToDieFp = isTimeToDie;
 
 #ifdef CHRONOS_DEBUG
@@ -155,7 +226,7 @@ processArguments(int argc, char *argv[], chronosClientContext_t *contextP)
 
   initProcessArguments(contextP);
 
-  while ((c = getopt(argc, argv, "n:c:a:p:v:d:h")) != -1) {
+  while ((c = getopt(argc, argv, "n:c:a:p:v:d:w:e:b:h")) != -1) {
     switch(c) {
       case 'c':
         contextP->numClientsThreads = atoi(optarg);
@@ -182,6 +253,21 @@ processArguments(int argc, char *argv[], chronosClientContext_t *contextP)
         chronos_debug(2, "*** Debug Level: %d", contextP->debugLevel);
         break;
 
+      case 'w':
+        contextP->pipelineWindow = atoi(optarg);
+        chronos_debug(2, "*** Pipeline window: %d", contextP->pipelineWindow);
+        break;
+
+      case 'e':
+        contextP->numEventLoops = atoi(optarg);
+        chronos_debug(2, "*** Num event loops: %d", contextP->numEventLoops);
+        break;
+
+      case 'b':
+        contextP->batchSize = atoi(optarg);
+        chronos_debug(2, "*** Batch size: %d", contextP->batchSize);
+        break;
+
       case 'h':
         chronosUsage();
         exit(0);
@@ -208,6 +294,31 @@ processArguments(int argc, char *argv[], chronosClientContext_t *contextP)
     goto failXit;
   }
 
+  if (contextP->pipelineWindow < 1 || contextP->pipelineWindow > CHRONOS_MAX_PIPELINE_DEPTH) {
+    chronos_error("pipeline window must be between 1 and %d", CHRONOS_MAX_PIPELINE_DEPTH);
+    goto failXit;
+  }
+
+  if (contextP->numEventLoops < 0 || contextP->numEventLoops > contextP->numClientsThreads) {
+    chronos_error("number of event loops must be between 0 and the number of clients");
+    goto failXit;
+  }
+
+  if (contextP->numEventLoops > 0 && contextP->pipelineWindow != 1) {
+    chronos_error("simulated clients issue one request at a time");
+    goto failXit;
+  }
+
+  if (contextP->batchSize < 1 || contextP->batchSize > CHRONOS_MAX_BATCH_SIZE) {
+    chronos_error("batch size must be between 1 and %d", CHRONOS_MAX_BATCH_SIZE);
+    goto failXit;
+  }
+
+  if (contextP->numEventLoops > 0 && contextP->batchSize != 1) {
+    chronos_error("simulated clients do not send batches");
+    goto failXit;
+  }
+
   if (contextP->serverAddress[0] == '\0') {
     chronos_error("address must be a valid one");
     goto failXit;
@@ -285,9 +396,18 @@ spawnClientThreads(int num_threads, chronosClientThreadInfo_t **info_ret, chrono
     infoP[i].thread_num = i+ 1;
     infoP[i].contextP = contextP;
 
+    if (contextP->numEventLoops > 0) {
+      /* Split the clients evenly among the event loops */
+      infoP[i].numUsers = contextP->numClientsThreads / num_threads;
+      if (i < contextP->numClientsThreads % num_threads) {
+        infoP[i].numUsers ++;
+      }
+      infoP[i].firstUser = (i > 0) ? infoP[i-1].firstUser + infoP[i-1].numUsers : 0;
+    }
+
     rc = pthread_create(&infoP[i].thread_id,
                         &attr,
-                        &userTransactionThread,
+                        contextP->numEventLoops > 0 ? &eventLoopThread : &userTransactionThread,
                         &infoP[i]);
     if (rc != 0) {
       chronos_error("failed to spawn thread");
@@ -313,6 +433,68 @@ void sigintHandler(int sig)
 }
 
 
+/*
+ * Picks the type of the next transaction of a user. The first few
+ * transactions are purchases, to warm up the system.
+ */
+static int
+nextTransactionType(int *loadIterationsP,
+                    chronosUserTransaction_t *txn_type_ret,
+                    chronosClientStats_t *statsP,
+                    chronosClientThreadInfo_t *infoP)
+{
+  chronosUserTransaction_t txnType;
+
+  (*loadIterationsP) ++;
+
+  if (*loadIterationsP < CHRONOS_CLIENT_LOAD_ITERATIONS) {
+    txnType = CHRONOS_USER_TXN_PURCHASE;
+    statsP->cnt_view_purchase ++;  
+  }
+  else {
+    /* Pick a transaction type */
+    if (pickTransactionType(&txnType, infoP) != CHRONOS_SUCCESS) {
+      chronos_error("Failed to pick transaction type");
+      goto failXit;
+    }
+    if (txnType == CHRONOS_USER_TXN_VIEW_STOCK) {
+      statsP->cnt_view_stock ++;
+    }
+    else if (txnType == CHRONOS_USER_TXN_VIEW_PORTFOLIO) {
+      statsP->cnt_view_portfolio ++;
+    }
+    else if (txnType == CHRONOS_USER_TXN_PURCHASE) {
+      statsP->cnt_view_purchase ++;
+    }
+    else if (txnType == CHRONOS_USER_TXN_SALE) {
+      statsP->cnt_view_sale ++;
+    }
+  }
+
+  *txn_type_ret = txnType;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+static void
+printClientStats(int thread_num, int sample_period, const chronosClientStats_t *statsP)
+{
+  int cnt_txns = statsP->cnt_txns;
+
+  fprintf(stderr,"STATS: thr: %d\t sample: %d\t count: %d\t success: %d (%.2f%%)\t fail: %d (%.2f%%)"
+                 "\t view_stock: %d (%.2f%%)\t view_portfolio: %d (%.2f%%)\t view_purchase: %d (%.2f%%)\t view_sale: %d (%.2f%%)\n"
+                 , thread_num, sample_period, cnt_txns
+                 , statsP->cnt_success, cnt_txns > 0 ? 100 * (float)statsP->cnt_success/cnt_txns : 0
+                 , statsP->cnt_fail, cnt_txns > 0 ? 100 * (float)statsP->cnt_fail/cnt_txns : 0
+                 , statsP->cnt_view_stock, cnt_txns > 0 ? 100 * (float)statsP->cnt_view_stock/cnt_txns : 0
+                 , statsP->cnt_view_portfolio, cnt_txns > 0 ? 100 * (float)statsP->cnt_view_portfolio/cnt_txns : 0
+                 , statsP->cnt_view_purchase, cnt_txns > 0 ? 100 * (float)statsP->cnt_view_purchase/cnt_txns : 0
+                 , statsP->cnt_view_sale, cnt_txns > 0 ? 100 * (float)statsP->cnt_view_sale/cnt_txns : 0); 
+}
+
 /* 
  * This is the callback function of a client thread. 
  * It receives the following information:
@@ -336,18 +518,12 @@ userTransactionThread(void *argP)
   chronosCache      cacheH = NULL;
   chronosUserTransaction_t txnType;
   chronosClientCache  clientCacheH = NULL;
-  int inLoadPhase = 1;
-#define CHRONOS_CLIENT_LOAD_ITERATIONS  10
-#define CHRONOS_CLIENT_SAMPLING_INTERVAL  10
+  chronosClientStats_t stats;
   int loadIterations = 0;
-  int cnt_txns = 0;
-  int cnt_view_stock = 0;
-  int cnt_view_portfolio = 0;
-  int cnt_view_purchase = 0;
-  int cnt_view_sale = 0;
-  int cnt_success = 0;
-  int cnt_fail = 0;
-  int txn_rc = 0;
+  int i;
+  int num_txns = 0;
+  int txn_rc_arr[CHRONOS_MAX_BATCH_SIZE];
+  chronosRequest requestsArr[CHRONOS_MAX_BATCH_SIZE];
   time_t current_time;
   time_t next_sample_time;
   int sample_period = 0;
@@ -361,6 +537,8 @@ userTransactionThread(void *argP)
 
   chronos_debug(3,"This is thread: %d", infoP->thread_num);
 
+  memset(&stats, 0, sizeof(stats));
+
   envH = infoP->contextP->chronosEnvH;
   if (envH == NULL) {
     chronos_error("Null environment handle");
@@ -389,90 +567,91 @@ userTransactionThread(void *argP)
     goto cleanup;
   }
 
+  rc = chronosClientWindowSet(infoP->contextP->pipelineWindow, connectionH);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Could not set pipeline window");
+    goto cleanup;
+  }
+
   current_time = time(NULL);
   next_sample_time = current_time + CHRONOS_CLIENT_SAMPLING_INTERVAL;
 
   /* Determine how many View_Stock transactions we need to execute */
   while(1) {
-    chronosRequest requestH = NULL;
-    
-    /* First we run a few purchases to warm up the system */
-    loadIterations ++;
-    if (loadIterations >= CHRONOS_CLIENT_LOAD_ITERATIONS) {
-      inLoadPhase = 0;
-    }
+    int batchSize = infoP->contextP->batchSize;
 
-    if (inLoadPhase) {
-      txnType = CHRONOS_USER_TXN_PURCHASE;
-      cnt_view_purchase ++;  
-    }
-    else {
-      /* Pick a transaction type */
-      if (pickTransactionType(&txnType, infoP) != CHRONOS_SUCCESS) {
-        chronos_error("Failed to pick transaction type");
-        goto cleanup;
+    for (i=0; i<batchSize; i++) {
+      if (nextTransactionType(&loadIterations, &txnType, &stats, infoP) != CHRONOS_SUCCESS) {
+        batchSize = i;
+        rc = CHRONOS_FAIL;
+        break;
       }
-      if (txnType == CHRONOS_USER_TXN_VIEW_STOCK) {
-        cnt_view_stock ++;
+
+      requestsArr[i] = chronosRequestCreate(txnType, clientCacheH, envH);
+      if (requestsArr[i] == NULL) {
+        chronos_error("Failed to populate request");
+        batchSize = i;
+        rc = CHRONOS_FAIL;
+        break;
       }
-      else if (txnType == CHRONOS_USER_TXN_VIEW_PORTFOLIO) {
-        cnt_view_portfolio ++;
+    }
+
+    /* Send the request to the server */
+    if (rc == CHRONOS_SUCCESS) {
+      if (batchSize == 1) {
+        rc = chronosClientSendRequest(requestsArr[0], connectionH);
       }
-      else if (txnType == CHRONOS_USER_TXN_PURCHASE) {
-        cnt_view_purchase ++;
+      else {
+        rc = chronosClientSendBatch(requestsArr, batchSize, connectionH);
       }
-      else if (txnType == CHRONOS_USER_TXN_SALE) {
-        cnt_view_sale ++;
+      if (rc != CHRONOS_SUCCESS) {
+        chronos_error("Failed to send transaction request");
       }
     }
 
-    requestH = chronosRequestCreate(txnType, clientCacheH, envH);
-    if (requestH == NULL) {
-      chronos_error("Failed to populate request");
-      goto cleanup;
+    /* The requests were already encoded into the socket */
+    for (i=0; i<batchSize; i++) {
+      if (chronosRequestFree(requestsArr[i]) != CHRONOS_SUCCESS) {
+        chronos_error("Failed to release request");
+        rc = CHRONOS_FAIL;
+      }
     }
 
-    /* Send the request to the server */
-    rc = chronosClientSendRequest(requestH, connectionH);
     if (rc != CHRONOS_SUCCESS) {
-      chronos_error("Failed to send transaction request");
       goto cleanup;
     }
 
-    cnt_txns ++;
-    chronos_debug(3,"[thr: %d] txn count: %d", infoP->thread_num, cnt_txns);
+    stats.cnt_txns += batchSize;
+    chronos_debug(3,"[thr: %d] txn count: %d", infoP->thread_num, stats.cnt_txns);
+
+    /* Keep the pipeline full before waiting for a response */
+    if (chronosClientWindowAvailable(connectionH) > 0) {
+      if (time_to_die == 1) {
+        chronos_info("Requested termination");
+        break;
+      }
+      continue;
+    }
     
-    rc = chronosClientReceiveResponse(&txn_rc, connectionH, infoP->contextP->timeToDieFp);
+    rc = chronosClientReceiveBatchResponse(txn_rc_arr, &num_txns, NULL, connectionH, infoP->contextP->timeToDieFp);
     if (rc != CHRONOS_SUCCESS) {
       chronos_error("Failed to receive transaction response");
       goto cleanup;
     }
 
-    if (txn_rc == 0) {
-      cnt_success ++;
-    }
-    else {
-      cnt_fail ++;
-    }
-
-    rc = chronosRequestFree(requestH);
-    if (rc != CHRONOS_SUCCESS) {
-      chronos_error("Failed to release request");
-      goto cleanup;
+    for (i=0; i<num_txns; i++) {
+      if (txn_rc_arr[i] == 0) {
+        stats.cnt_success ++;
+      }
+      else {
+        stats.cnt_fail ++;
+      }
     }
 
     current_time = time(NULL);
     if (current_time >= next_sample_time) {
       sample_period ++;
-      fprintf(stderr,"STATS: thr: %d\t sample: %d\t count: %d\t success: %d (%.2f%%)\t fail: %d (%.2f%%)"
-                     "\t view_stock: %d (%.2f%%)\t view_portfolio: %d (%.2f%%)\t view_purchase: %d (%.2f%%)\t view_sale: %d (%.2f%%)\n"
-                     , infoP->thread_num, sample_period, cnt_txns
-                     , cnt_success, cnt_txns > 0 ? 100 * (float)cnt_success/cnt_txns : 0
-                     , cnt_fail, cnt_txns > 0 ? 100 * (float)cnt_fail/cnt_txns : 0
-                     , cnt_view_stock, cnt_txns > 0 ? 100 * (float)cnt_view_stock/cnt_txns : 0
-                     , cnt_view_portfolio, cnt_txns > 0 ? 100 * (float)cnt_view_portfolio/cnt_txns : 0
-                     , cnt_view_purchase, cnt_txns > 0 ? 100 * (float)cnt_view_purchase/cnt_txns : 0
-                     , cnt_view_sale, cnt_txns > 0 ? 100 * (float)cnt_view_sale/cnt_txns : 0); 
+      printClientStats(infoP->thread_num, sample_period, &stats);
       next_sample_time = current_time + CHRONOS_CLIENT_SAMPLING_INTERVAL;
     }
 
@@ -504,6 +683,267 @@ cleanup:
   pthread_exit(NULL);
 }
 
+/*
+ * Issue the next request of a virtual user
+ */
+static int
+virtualUserSend(chronosVirtualUser_t *userP,
+                chronosClientCache clientCacheH,
+                chronosClientStats_t *statsP,
+                chronosClientThreadInfo_t *infoP)
+{
+  int rc;
+  chronosUserTransaction_t txnType;
+  chronosRequest requestH = NULL;
+
+  if (nextTransactionType(&userP->loadIterations, &txnType, statsP, infoP) != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  requestH = chronosRequestCreate(txnType, clientCacheH, infoP->contextP->chronosEnvH);
+  if (requestH == NULL) {
+    chronos_error("Failed to populate request");
+    goto failXit;
+  }
+
+  rc = chronosClientSendRequest(requestH, userP->connectionH);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to send transaction request");
+    goto failXit;
+  }
+
+  statsP->cnt_txns ++;
+  chronos_debug(3,"[thr: %d, user: %d] txn count: %d", infoP->thread_num, userP->user_num, statsP->cnt_txns);
+
+  rc = chronosRequestFree(requestH);
+  requestH = NULL;
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to release request");
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  if (requestH != NULL) {
+    chronosRequestFree(requestH);
+  }
+  return CHRONOS_FAIL;
+}
+
+/*
+ * This is the callback function of an event loop thread. 
+ *
+ * It simulates infoP->numUsers clients. Each of them has its own 
+ * connection to the server and behaves like userTransactionThread(): 
+ * send a request, wait for the response, think, and repeat. Instead
+ * of blocking, a user waiting for its think time sits in a timer
+ * heap keyed by its wake up time, and a user waiting for a response
+ * is woken up by epoll.
+ */
+static void *
+eventLoopThread(void *argP) 
+{
+  chronosClientThreadInfo_t *infoP = (chronosClientThreadInfo_t *)argP;
+  chronosClientContext_t *contextP = NULL;
+  chronosVirtualUser_t *usersArrP = NULL;
+  chronosVirtualUser_t *userP = NULL;
+  chronosClientCache  clientCacheH = NULL;
+  chronosClientStats_t stats;
+  chronosHeap_t       timerHeap;
+  struct epoll_event  event;
+  struct epoll_event  events[CHRONOS_NETWORK_MAX_EVENTS];
+  unsigned long long  now;
+  unsigned long long  wakeup_time;
+  void               *data = NULL;
+  int epoll_fd = -1;
+  int num_events;
+  int timeout_ms;
+  int txn_rc = 0;
+  int i;
+  time_t current_time;
+  time_t next_sample_time;
+  int sample_period = 0;
+  int rc = CHRONOS_SUCCESS;
+
+  memset(&timerHeap, 0, sizeof(timerHeap));
+  memset(&stats, 0, sizeof(stats));
+
+  if (infoP == NULL || infoP->contextP == NULL || infoP->numUsers <= 0) {
+    chronos_error("Invalid argument");
+    goto cleanup;
+  }
+
+  contextP = infoP->contextP;
+
+  chronos_debug(3,"This is event loop: %d, users: %d", infoP->thread_num, infoP->numUsers);
+
+  usersArrP = calloc(infoP->numUsers, sizeof(chronosVirtualUser_t));
+  if (usersArrP == NULL) {
+    chronos_error("Could not allocate users");
+    goto cleanup;
+  }
+
+  rc = chronosHeapInit(&timerHeap, infoP->numUsers);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Could not allocate timer heap");
+    goto cleanup;
+  }
+
+  epoll_fd = epoll_create1(0);
+  if (epoll_fd < 0) {
+    perror("epoll_create1() failed");
+    goto cleanup;
+  }
+
+  /* The users of a loop share one client cache */
+  clientCacheH = chronosClientCacheAlloc(infoP->thread_num,
+                                         contextP->numEventLoops, 
+                                         chronosEnvCacheGet(contextP->chronosEnvH));
+
+  now = currentTimeMS();
+
+  for (i=0; i<infoP->numUsers; i++) {
+    userP = &usersArrP[i];
+    userP->user_num = infoP->firstUser + i + 1;
+
+    userP->connectionH = chronosConnHandleAlloc(contextP->chronosEnvH);
+    if (userP->connectionH == NULL) {
+      chronos_error("Could not allocate connection handle");
+      goto cleanup;
+    }
+
+    rc = chronosClientConnect(contextP->serverAddress,
+                              contextP->serverPort,
+                              NULL,
+                              userP->connectionH);
+    if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Could not connect to chronos server");
+      goto cleanup;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = userP;
+    rc = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, chronosClientSocketGet(userP->connectionH), &event);
+    if (rc < 0) {
+      perror("epoll_ctl() failed");
+      goto cleanup;
+    }
+
+    /* Spread the first requests over one think time */
+    rc = chronosHeapInsert(&timerHeap, 
+                           now + thinkTimeGet(0, contextP->maxThinkingTime),
+                           userP);
+    if (rc != CHRONOS_SUCCESS) {
+      goto cleanup;
+    }
+  }
+
+  current_time = time(NULL);
+  next_sample_time = current_time + CHRONOS_CLIENT_SAMPLING_INTERVAL;
+
+  while (time_to_die == 0) {
+
+    /* Users whose think time expired issue their next request */
+    now = currentTimeMS();
+    while (chronosHeapPeek(&timerHeap, &wakeup_time, NULL) == CHRONOS_SUCCESS
+           && wakeup_time <= now) {
+      chronosHeapRemoveMin(&timerHeap, NULL, &data);
+      if (virtualUserSend(data, clientCacheH, &stats, infoP) != CHRONOS_SUCCESS) {
+        goto cleanup;
+      }
+    }
+
+    /* Sleep until the next think time expires or a response arrives */
+    timeout_ms = 1000;
+    if (chronosHeapPeek(&timerHeap, &wakeup_time, NULL) == CHRONOS_SUCCESS
+        && wakeup_time - now < (unsigned long long) timeout_ms) {
+      timeout_ms = wakeup_time - now;
+    }
+
+    num_events = epoll_wait(epoll_fd, events, CHRONOS_NETWORK_MAX_EVENTS, timeout_ms);
+    if (num_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait() failed");
+      goto cleanup;
+    }
+
+    now = currentTimeMS();
+    for (i=0; i<num_events; i++) {
+      userP = events[i].data.ptr;
+
+      while (1) {
+        rc = chronosClientResponsePoll(&txn_rc, NULL, userP->connectionH);
+        if (rc == CHRONOS_CLIENT_NO_RESPONSE) {
+          break;
+        }
+        else if (rc != CHRONOS_SUCCESS) {
+          chronos_error("Failed to receive transaction response");
+          goto cleanup;
+        }
+
+        if (txn_rc == 0) {
+          stats.cnt_success ++;
+        }
+        else {
+          stats.cnt_fail ++;
+        }
+
+        /* Wait some time before issuing next request */
+        rc = chronosHeapInsert(&timerHeap, 
+                               now + thinkTimeGet(contextP->minThinkingTime, contextP->maxThinkingTime),
+                               userP);
+        if (rc != CHRONOS_SUCCESS) {
+          goto cleanup;
+        }
+      }
+    }
+
+    current_time = time(NULL);
+    if (current_time >= next_sample_time) {
+      sample_period ++;
+      printClientStats(infoP->thread_num, sample_period, &stats);
+      next_sample_time = current_time + CHRONOS_CLIENT_SAMPLING_INTERVAL;
+    }
+  }
+
+  chronos_info("Requested termination");
+
+cleanup:
+  if (usersArrP != NULL) {
+    for (i=0; i<infoP->numUsers; i++) {
+      if (usersArrP[i].connectionH == NULL) {
+        continue;
+      }
+
+      /* disconnect from the chronos server */
+      rc = chronosClientDisconnect(usersArrP[i].connectionH);
+      if (rc != CHRONOS_SUCCESS) {
+        chronos_error("Failed to disconnect from server");
+      }
+
+      rc = chronosConnHandleFree(usersArrP[i].connectionH);
+      if (rc != CHRONOS_SUCCESS) {
+        chronos_error("Failed to free connection handle");
+      }
+    }
+    free(usersArrP);
+  }
+
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+  }
+
+  if (timerHeap.entries != NULL) {
+    chronosHeapDestroy(&timerHeap);
+  }
+
+  pthread_exit(NULL);
+}
+
 /*
  * Selects a transaction type with a given probability
  */
@@ -584,6 +1024,7 @@ int main(int argc, char *argv[])
 {
   chronosClientContext_t client_context;
   chronosClientThreadInfo_t *thread_infoP = NULL;
+  int num_threads;
 
   srand(time(NULL));
 
@@ -609,13 +1050,16 @@ int main(int argc, char *argv[])
     goto failXit;
   }
 
-  /* Next we need to spawn the client threads */
-  if (spawnClientThreads(client_context.numClientsThreads, &thread_infoP, &client_context) != CHRONOS_SUCCESS) {
+  /* Next we need to spawn the client threads. In event loop
+   * mode there is one thread per loop instead of per client */
+  num_threads = client_context.numEventLoops > 0 ? client_context.numEventLoops : client_context.numClientsThreads;
+
+  if (spawnClientThreads(num_threads, &thread_infoP, &client_context) != CHRONOS_SUCCESS) {
     chronos_error("Failed spawning threads");
     goto failXit;
   }
 
-  if (waitClientThreads(client_context.numClientsThreads, thread_infoP, &client_context) != CHRONOS_SUCCESS) {
+  if (waitClientThreads(num_threads, thread_infoP, &client_context) != CHRONOS_SUCCESS) {
     chronos_error("Failed while waiting for threads termination");
     goto failXit;
   }
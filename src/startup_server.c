@@ -20,6 +20,7 @@
 #include "chronos_packets.h"
 #include "chronos_queue.h"
 #include "chronos_server.h"
+#include "chronos_socket.h"
 #include "chronos_transactions.h"
 
 #define CHRONOS_TCP_QUEUE   1024
@@ -894,14 +895,16 @@ failXit:
 static void *
 daHandler(void *argP) 
 {
-  int num_bytes;
+  int rc;
   int cnt_msg = 0;
   int need_admission_control = 0;
-  int written, to_write;
   int txn_rc = 0;
   chronosResponsePacket_t resPacket;
   chronosServerThreadInfo_t *infoP = (chronosServerThreadInfo_t *) argP;
   chronosRequestPacket_t reqPacket;
+  chronosSocketBuffer_t recvBuffer;
+  char frame[CHRONOS_REQUEST_MAX_ENCODED_SIZE];
+  int frameSize;
 
   if (infoP == NULL || infoP->contextP == NULL) {
     chronos_error("Invalid argument");
@@ -911,22 +914,49 @@ daHandler(void *argP)
   CHRONOS_SERVER_THREAD_CHECK(infoP);
   CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
 
+  chronosSocketBufferInit(&recvBuffer, infoP->socket_fd);
+
   /*------------ Read the request -----------------*/
   chronos_debug(3, "waiting new request");
 
   memset(&reqPacket, 0, sizeof(reqPacket));
-  char *buf = (char *) &reqPacket;
-  int   to_read = sizeof(reqPacket);
 
-  while (to_read > 0) {
-    num_bytes = read(infoP->socket_fd, buf, 1);
-    if (num_bytes < 0) {
-      chronos_error("Failed while reading request from client");
-      goto cleanup;
-    }
+  /* First the header, which tells us how much more to read */
+  rc = chronosSocketRecvFrame(&recvBuffer, frame, sizeof(chronosPacketHeader_t), isTimeToDie);
+  if (rc == CHRONOS_SOCKET_CLOSED) {
+    chronos_info("Client closed the connection");
+    goto cleanup;
+  }
+  else if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed while reading request from client");
+    goto cleanup;
+  }
+
+  frameSize = chronosRequestEncodedSizeFromHeader(frame);
+  if (frameSize < 0) {
+    chronos_error("Received an invalid request header");
+    goto cleanup;
+  }
+
+  /* This server takes one request at a time. A batch would not fit in frame */
+  if (chronosRequestIsBatch(frame)) {
+    chronos_error("Batch requests are not supported");
+    goto cleanup;
+  }
 
-    to_read -= num_bytes;
-    buf += num_bytes;
+  rc = chronosSocketRecvFrame(&recvBuffer,
+                              frame + sizeof(chronosPacketHeader_t),
+                              frameSize - sizeof(chronosPacketHeader_t),
+                              isTimeToDie);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed while reading request from client");
+    goto cleanup;
+  }
+
+  rc = chronosRequestDecode(frame, frameSize, &reqPacket);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to decode request");
+    goto cleanup;
   }
 
   assert(CHRONOS_TXN_IS_VALID(reqPacket.txn_type));
@@ -975,20 +1005,13 @@ daHandler(void *argP)
 
   memset(&resPacket, 0, sizeof(resPacket));
   resPacket.txn_type = reqPacket.txn_type;
+  resPacket.request_id = reqPacket.request_id;
   resPacket.rc = txn_rc;
 
-  buf = (char *)&resPacket;
-  to_write = sizeof(resPacket);
-
-  while(to_write >0) {
-    written = write(infoP->socket_fd, buf, to_write);
-    if (written < 0) {
-      chronos_error("Failed to write to socket");
-      goto cleanup;
-    }
-
-    to_write -= written;
-    buf += written;
+  rc = chronosSocketSendAll(infoP->socket_fd, &resPacket, sizeof(resPacket), isTimeToDie);
+  if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to write to socket");
+    goto cleanup;
   }
   chronos_debug(3, "Replied to client");
   /*-----------------------------------------------*/
@@ -1367,7 +1390,7 @@ processRefreshTransaction(chronosRequestPacket_t *requestP,
   chronos_debug(3, "Updating value for pkey: %s...", pkey);
 
   CHRONOS_TIME_GET(txn_begin);
-  if (benchmark_refresh_quotes2(contextP->benchmarkCtxtP, pkey, -1 /*Update randomly*/) != CHRONOS_SUCCESS) {
+  if (benchmark_refresh_quotes2(contextP->benchmarkCtxtP, pkey, -1 /*Update randomly*/, NULL) != CHRONOS_SUCCESS) {
     chronos_error("Failed to refresh quotes");
     goto failXit;
   }
@@ -2,24 +2,30 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <stddef.h>
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/ioctl.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sched.h>
 #include <errno.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 #include "chronos.h"
 #include "chronos_config.h"
 #include "chronos_packets.h"
 #include "chronos_queue.h"
 #include "chronos_server.h"
+#include "chronos_socket.h"
 #include "chronos_transactions.h"
 
 static const char *program_name = "startup_server";
@@ -29,7 +35,9 @@ int chronos_debug_level = CHRONOS_DEBUG_LEVEL_MIN;
 
 const char *chronosServerThreadNames[] ={
   "CHRONOS_SERVER_THREAD_LISTENER",
-  "CHRONOS_SERVER_THREAD_UPDATE"
+  "CHRONOS_SERVER_THREAD_UPDATE",
+  "CHRONOS_SERVER_THREAD_PROCESSING",
+  "CHRONOS_SERVER_THREAD_NETWORK"
 };
 
 static int
@@ -50,11 +58,50 @@ updateThread(void *argP);
 static void *
 processThread(void *argP);
 
+static void *
+networkThread(void *argP);
+
+static int
+startNetworkThreads(chronosServerContext_t *contextP);
+
+static void
+releaseNetworkThreads(chronosServerContext_t *contextP);
+
+static int
+createListenSocket(chronosServerContext_t *contextP, int reusePort);
+
+static void
+accountDataItemAccess(const chronosRequestPacket_t *reqPacketP, chronosServerContext_t *contextP);
+
+static int
+requestBuffersDecode(const char *frame, int frameSize, chronosRequestBuffer_t **requestBufArr, int *numRequestsP, chronosServerContext_t *contextP);
+
+static void
+requestBuffersRelease(chronosRequestBuffer_t **requestBufArr, int numRequests);
+
+static int
+dispatchTableFn (chronosRequestBuffer_t *requestBufP, int *txn_rc, chronosServerThreadInfo_t *infoP);
+
 static int
-dispatchTableFn (chronosRequestPacket_t *reqPacketP, int *txn_rc, chronosServerThreadInfo_t *infoP);
+dispatchBatchFn (chronosRequestBuffer_t **requestBufArr, int numRequests, int *txn_rc_arr, chronosServerThreadInfo_t *infoP);
 
 static int
-waitPeriod(double updatePeriodMS);
+updateTimerArm(int timer_fd, unsigned long long time_ms);
+
+static void
+reportPlacement(chronosPlacementClass_t placementClass,
+                const chronosServerThreadInfo_t *infoArrP,
+                int numThreads,
+                chronosServerContext_t *contextP);
+
+static int
+quoteMirrorLoad(chronosServerContext_t *contextP);
+
+static int
+groupCommitFlush(void *argP);
+
+static int
+groupCommitWait(chronosServerContext_t *contextP);
 
 #if 0
 static int
@@ -84,6 +131,7 @@ chronosServerContext_t *serverContextP = NULL;
 chronosServerThreadInfo_t *listenerThreadInfoP = NULL;
 chronosServerThreadInfo_t *processingThreadInfoArrP = NULL;
 chronosServerThreadInfo_t *updateThreadInfoArrP = NULL;
+chronosServerThreadInfo_t *networkThreadInfoArrP = NULL;
 chronos_queue_t *userTxnQueueP = NULL;
 chronos_queue_t *sysTxnQueueP = NULL;
 
@@ -140,6 +188,13 @@ int main(int argc, char *argv[])
   int    num_pkeys = 0;
   chronos_time_t  system_start;
   unsigned long long initial_update_time_ms;
+  int    groupCommitInitialized = 0;
+  int    groupCommitStarted = 0;
+#ifdef CHRONOS_UPDATE_TRANSACTIONS_ENABLED
+  int    num_items_per_thread;
+  int    first_item;
+  int    num_items;
+#endif
 
   set_chronos_debug_level(CHRONOS_DEBUG_LEVEL_MIN);
   set_benchmark_debug_level(BENCHMARK_DEBUG_LEVEL_MIN);
@@ -193,43 +248,53 @@ int main(int argc, char *argv[])
   serverContextP->magic = CHRONOS_SERVER_CTX_MAGIC;
   CHRONOS_SERVER_CTX_CHECK(serverContextP);
   
-  if (pthread_mutex_init(&userTxnQueueP->mutex, NULL) != 0) {
-    chronos_error("Failed to init mutex");
+  if (chronos_user_queues_init(serverContextP->numUserQueuesRequested, serverContextP) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to init user transactions queues");
     goto failXit;
   }
 
-  if (pthread_mutex_init(&sysTxnQueueP->mutex, NULL) != 0) {
-    chronos_error("Failed to init mutex");
+  if (chronos_queue_init(serverContextP->lockFreeQueues, CHRONOS_QUEUE_FIFO, sysTxnQueueP) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to init system transactions queue");
     goto failXit;
   }
 
-  if (pthread_mutex_init(&serverContextP->startThreadsMutex, NULL) != 0) {
-    chronos_error("Failed to init mutex");
+  if (chronosEventInit(&serverContextP->workAvailable) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to init work event");
     goto failXit;
   }
 
-  if (pthread_cond_init(&sysTxnQueueP->more, NULL) != 0) {
-    chronos_error("Failed to init condition variable");
+  if (chronosAdmissionGateInit(&serverContextP->admissionGate) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to init admission gate");
     goto failXit;
   }
 
-  if (pthread_cond_init(&sysTxnQueueP->less, NULL) != 0) {
-    chronos_error("Failed to init condition variable");
+  if (chronosRequestPoolInit(&serverContextP->requestPool, CHRONOS_REQUEST_POOL_SIZE) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to init request pool");
     goto failXit;
   }
 
-  if (pthread_cond_init(&userTxnQueueP->more, NULL) != 0) {
-    chronos_error("Failed to init condition variable");
+  if (pthread_mutex_init(&serverContextP->startThreadsMutex, NULL) != 0) {
+    chronos_error("Failed to init mutex");
     goto failXit;
   }
 
-  if (pthread_cond_init(&userTxnQueueP->less, NULL) != 0) {
+  if (pthread_cond_init(&serverContextP->startThreadsWait, NULL) != 0) {
     chronos_error("Failed to init condition variable");
     goto failXit;
   }
 
-  if (pthread_cond_init(&serverContextP->startThreadsWait, NULL) != 0) {
-    chronos_error("Failed to init condition variable");
+  /* Quotes and Portfolios keep page versions if any txn reads a snapshot */
+  if (benchmark_snapshot_xacts_set(serverContextP->snapshotXacts) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to set snapshot txns");
+    goto failXit;
+  }
+
+  /* With group commit, the log flusher makes the update txns durable */
+  benchmark_xact_nosync_set(serverContextP->groupCommitWindowUS >= 0);
+
+  /* The BDB cache is allocated on the node of whoever touches it first */
+  if (chronosPlacementCacheNodeBind(serverContextP->placementP) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to bind to the NUMA node");
     goto failXit;
   }
 
@@ -278,6 +343,11 @@ int main(int argc, char *argv[])
     chronos_error("Failed to allocate handle");
     goto failXit;
   }
+
+  if (chronosPlacementCacheNodeUnbind(serverContextP->placementP) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to unbind from the NUMA node");
+    goto failXit;
+  }
  
   rc = pthread_attr_init(&attr);
   if (rc != 0) {
@@ -319,6 +389,38 @@ int main(int argc, char *argv[])
     chronos_debug(3, "%d next update time: %llu", i, initial_update_time_ms);
   }
 
+  if (serverContextP->quoteMirrorEnabled) {
+    if (quoteMirrorLoad(serverContextP) != CHRONOS_SUCCESS) {
+      chronos_error("Failed to load the quote mirror");
+      goto failXit;
+    }
+  }
+
+  /* Spawn the log flusher */
+  if (serverContextP->groupCommitWindowUS >= 0) {
+    if (chronosGroupCommitInit(&serverContextP->groupCommit, 
+                               serverContextP->groupCommitWindowUS,
+                               serverContextP->groupCommitBatchSize,
+                               groupCommitFlush,
+                               serverContextP) != CHRONOS_SUCCESS) {
+      chronos_error("Failed to init group commit");
+      goto failXit;
+    }
+    groupCommitInitialized = 1;
+
+    rc = pthread_create(&serverContextP->groupCommitThread,
+                        &attr,
+                        &chronosGroupCommitFlusher,
+                        &serverContextP->groupCommit);
+    if (rc != 0) {
+      chronos_error("failed to spawn thread: %s", strerror(rc));
+      goto failXit;
+    }
+    groupCommitStarted = 1;
+
+    chronos_debug(2,"Spawed log flusher thread");
+  }
+
   /* Spawn processing thread */
   processingThreadInfoArrP = calloc(serverContextP->numServerThreads, sizeof(chronosServerThreadInfo_t));
   if (processingThreadInfoArrP == NULL) {
@@ -326,6 +428,10 @@ int main(int argc, char *argv[])
     goto failXit;
   }
 
+  if (chronosPlacementAttrSet(serverContextP->placementP, CHRONOS_PLACEMENT_PROCESSING, &attr) != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
   for (i=0; i<serverContextP->numServerThreads; i++) {
     processingThreadInfoArrP[i].thread_type = CHRONOS_SERVER_THREAD_PROCESSING;
     processingThreadInfoArrP[i].contextP = serverContextP;
@@ -344,14 +450,30 @@ int main(int argc, char *argv[])
     chronos_debug(2,"Spawed processing thread");
  } 
 
+  reportPlacement(CHRONOS_PLACEMENT_PROCESSING, processingThreadInfoArrP, serverContextP->numServerThreads, serverContextP);
+
 #ifdef CHRONOS_UPDATE_TRANSACTIONS_ENABLED
-  /* Spawn the update threads */
+  /* Spawn the update threads. The data items are split evenly among them */
+  if (num_pkeys <= 0) {
+    chronos_error("There are no data items to update");
+    goto failXit;
+  }
+  if (serverContextP->numUpdateThreads > num_pkeys) {
+    serverContextP->numUpdateThreads = num_pkeys;
+  }
+  num_items_per_thread = (num_pkeys + serverContextP->numUpdateThreads - 1) / serverContextP->numUpdateThreads;
+  serverContextP->numUpdateThreads = (num_pkeys + num_items_per_thread - 1) / num_items_per_thread;
+
   updateThreadInfoArrP = calloc(serverContextP->numUpdateThreads, sizeof(chronosServerThreadInfo_t));
   if (updateThreadInfoArrP == NULL) {
     chronos_error("Failed to allocate thread structure");
     goto failXit;
   }
 
+  if (chronosPlacementAttrSet(serverContextP->placementP, CHRONOS_PLACEMENT_UPDATE, &attr) != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
   for (i=0; i<serverContextP->numUpdateThreads; i++) {
     /* Set the generic data */
     updateThreadInfoArrP[i].thread_type = CHRONOS_SERVER_THREAD_UPDATE;
@@ -359,14 +481,16 @@ int main(int argc, char *argv[])
     updateThreadInfoArrP[i].thread_num = thread_num ++;
     updateThreadInfoArrP[i].magic = CHRONOS_SERVER_THREAD_MAGIC;
 
-    /* Set the update specific data */
-    updateThreadInfoArrP[i].first_symbol_id = i * serverContextP->numUpdatesPerUpdateThread;
-    updateThreadInfoArrP[i].parameters.updateParameters.dataItemsArray = &(serverContextP->dataItemsArray[i * serverContextP->numUpdatesPerUpdateThread]);
-    updateThreadInfoArrP[i].parameters.updateParameters.num_stocks = serverContextP->numUpdatesPerUpdateThread;
+    /* Set the update specific data: each thread gets a slice of the data items */
+    first_item = i * num_items_per_thread;
+    num_items = num_pkeys - first_item < num_items_per_thread ? num_pkeys - first_item : num_items_per_thread;
+    updateThreadInfoArrP[i].first_symbol_id = first_item;
+    updateThreadInfoArrP[i].parameters.updateParameters.dataItemsArray = &(serverContextP->dataItemsArray[first_item]);
+    updateThreadInfoArrP[i].parameters.updateParameters.num_stocks = num_items;
     chronos_debug(5,"Thread: %d, will handle from %d to %d", 
                   updateThreadInfoArrP[i].thread_num, 
-                  i * serverContextP->numUpdatesPerUpdateThread, 
-                  (i+1) * serverContextP->numUpdatesPerUpdateThread - 1);
+                  first_item, 
+                  first_item + num_items - 1);
 
     rc = pthread_create(&updateThreadInfoArrP[i].thread_id,
 			&attr,
@@ -379,6 +503,8 @@ int main(int argc, char *argv[])
 
     chronos_debug(2,"Spawed update thread: %d", updateThreadInfoArrP[i].thread_num);
   }
+
+  reportPlacement(CHRONOS_PLACEMENT_UPDATE, updateThreadInfoArrP, serverContextP->numUpdateThreads, serverContextP);
 #endif
 
 #ifdef CHRONOS_USER_TRANSACTIONS_ENABLED
@@ -394,6 +520,10 @@ int main(int argc, char *argv[])
   listenerThreadInfoP->contextP = serverContextP;
   listenerThreadInfoP->thread_num = thread_num ++;
   listenerThreadInfoP->magic = CHRONOS_SERVER_THREAD_MAGIC;
+
+  if (chronosPlacementAttrSet(serverContextP->placementP, CHRONOS_PLACEMENT_LISTENER, &attr) != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
     
   rc = pthread_create(&listenerThreadInfoP->thread_id,
                       &attr,
@@ -405,6 +535,16 @@ int main(int argc, char *argv[])
   }
 
   chronos_debug(2,"Spawed listener thread");
+
+  reportPlacement(CHRONOS_PLACEMENT_LISTENER, listenerThreadInfoP, 1, serverContextP);
+  if (serverContextP->numNetworkThreads == 0) {
+    /* Handler threads are created as clients connect */
+    reportPlacement(CHRONOS_PLACEMENT_NETWORK, NULL, 0, serverContextP);
+  }
+#endif
+
+#ifdef CHRONOS_SAMPLING_ENABLED
+  reportPlacement(CHRONOS_PLACEMENT_SAMPLING, NULL, 0, serverContextP);
 #endif
 
   /* ===================================================================
@@ -429,6 +569,8 @@ int main(int argc, char *argv[])
       chronos_error("Failed while joining thread %s", CHRONOS_SERVER_THREAD_NAME(updateThreadInfoArrP[i].thread_type));
     }
   }
+
+  chronos_info("%d refreshes were merged into queued ones", serverContextP->numCoalescedRefreshes);
 #endif
   
   for (i=0; i<serverContextP->numServerThreads; i++) {
@@ -438,6 +580,10 @@ int main(int argc, char *argv[])
     }
   }
 
+#ifdef CHRONOS_USER_TRANSACTIONS_ENABLED
+  releaseNetworkThreads(serverContextP);
+#endif
+
 #ifdef CHRONOS_PRINT_STATS
   printStats(infoP);
 #endif
@@ -451,21 +597,38 @@ failXit:
 cleanup:
 
   if (userTxnQueueP) {
-    pthread_cond_destroy(&userTxnQueueP->more);
-    pthread_cond_destroy(&userTxnQueueP->less);
-    pthread_mutex_destroy(&userTxnQueueP->mutex);
+    chronos_user_queues_destroy(serverContextP);
   }
 
   if (sysTxnQueueP) {
-    pthread_cond_destroy(&sysTxnQueueP->more);
-    pthread_cond_destroy(&sysTxnQueueP->less);
-    pthread_mutex_destroy(&sysTxnQueueP->mutex);
+    chronos_queue_destroy(sysTxnQueueP);
   }
   
   if (serverContextP) {
     pthread_cond_destroy(&serverContextP->startThreadsWait);
     pthread_mutex_destroy(&serverContextP->startThreadsMutex);
 
+    chronosRequestPoolDestroy(&serverContextP->requestPool);
+    chronosAdmissionGateDestroy(&serverContextP->admissionGate);
+
+    if (serverContextP->placementP) {
+      chronosPlacementDestroy(serverContextP->placementP);
+    }
+
+    if (serverContextP->quoteMirrorEnabled) {
+      chronosQuoteMirrorDestroy(&serverContextP->quoteMirror);
+    }
+
+    /* The last commits are flushed before the flusher exits */
+    if (groupCommitStarted) {
+      chronosGroupCommitStop(&serverContextP->groupCommit);
+      pthread_join(serverContextP->groupCommitThread, NULL);
+    }
+
+    if (groupCommitInitialized) {
+      chronosGroupCommitDestroy(&serverContextP->groupCommit);
+    }
+
     if (serverContextP->dataItemsArray) {
       free(serverContextP->dataItemsArray);
     }
@@ -504,11 +667,17 @@ void handler_sampling(void *arg)
   int i;
   int    total_failed_txns = 0;
   int    total_timely_txns = 0;
+  int    total_missed_deadlines = 0;
+  int    total_dropped_txns = 0;
+  int    total_aborted_txns = 0;
+  int    num_txn_to_wait = 0;
   double count = 0;
   double duration_ms = 0;
 
   chronosServerStats_t *statsP = NULL;
   chronosDataItem_t    *dataItem = NULL;
+  benchmark_mvcc_stats_t mvcc_stats;
+  chronosGroupCommitStats_t group_commit_stats;
 
   chronos_info("****** TIMER... *****");
   CHRONOS_SERVER_CTX_CHECK(contextP);
@@ -566,6 +735,9 @@ void handler_sampling(void *arg)
     duration_ms += statsP->cumulative_time_ms;
     total_failed_txns += statsP->num_failed_txns;
     total_timely_txns += statsP->num_timely_txns;
+    total_missed_deadlines += statsP->num_missed_deadlines;
+    total_dropped_txns += statsP->num_dropped_txns;
+    total_aborted_txns += statsP->num_aborted_txns;
   }
   if (count > 0) {
     contextP->average_service_delay_ms = duration_ms / count;
@@ -585,25 +757,58 @@ void handler_sampling(void *arg)
   }
   contextP->smoth_degree_timing_violation = contextP->alpha * contextP->degree_timing_violation
                                             + (1.0 - contextP->alpha) * contextP->smoth_degree_timing_violation;
-  contextP->total_txns_enqueued = contextP->userTxnQueue.occupied + contextP->sysTxnQueue.occupied;
+  contextP->total_txns_enqueued = chronos_user_queue_size(contextP) + chronos_queue_size(&contextP->sysTxnQueue);
   if ((IS_CHRONOS_MODE_FULL(contextP) || IS_CHRONOS_MODE_AC(contextP))
        && contextP->smoth_degree_timing_violation > 0) 
   {
-    contextP->num_txn_to_wait = contextP->total_txns_enqueued * contextP->smoth_degree_timing_violation / 100.0;
+    num_txn_to_wait = contextP->total_txns_enqueued * contextP->smoth_degree_timing_violation / 100.0;
   }
   else {
-    contextP->num_txn_to_wait = 0;
+    num_txn_to_wait = 0;
   }
+  chronosAdmissionGateSet(&contextP->admissionGate, num_txn_to_wait);
   /*==================================================*/
 
 
   chronos_info("SAMPLING [ACC_DURATION_MS: %lf], [NUM_TXN: %d], [AVG_DURATION_MS: %.3lf] [NUM_FAILED_TXNS: %d], "
-               "[NUM_TIMELY_TXNS: %d] [DELTA(k): %.3lf], [DELTA_S(k): %.3lf] [TNX_ENQUEUED: %d] [TXN_TO_WAIT: %d]", 
+               "[NUM_TIMELY_TXNS: %d] [NUM_MISSED_DEADLINES: %d] [NUM_DROPPED_TXNS: %d] "
+               "[NUM_ABORTED_LATE_TXNS: %d] [NUM_COALESCED_REFRESHES: %d] "
+               "[DELTA(k): %.3lf], [DELTA_S(k): %.3lf] [TNX_ENQUEUED: %d] [TXN_TO_WAIT: %d]", 
                duration_ms, (int)count, contextP->average_service_delay_ms, total_failed_txns, total_timely_txns,
+               total_missed_deadlines,
+               total_dropped_txns,
+               total_aborted_txns,
+               contextP->numCoalescedRefreshes,
                contextP->degree_timing_violation,
                contextP->smoth_degree_timing_violation,
                contextP->total_txns_enqueued,
-               contextP->num_txn_to_wait);
+               num_txn_to_wait);
+
+  /* What the snapshots cost in the cache */
+  if (contextP->snapshotXacts != 0) {
+    if (benchmark_mvcc_stats_get(contextP->benchmarkCtxtP, &mvcc_stats) == CHRONOS_SUCCESS) {
+      chronos_info("SAMPLING MVCC [SNAPSHOTS: %u] [MAX_SNAPSHOTS: %u] [FROZEN: %u] [THAWED: %u] "
+                   "[FREED: %u] [REUSED: %u] [CACHE_PAGES: %u] [DIRTY_PAGES: %u] [EVICTIONS: %u]",
+                   mvcc_stats.num_snapshots, mvcc_stats.max_snapshots,
+                   mvcc_stats.num_frozen, mvcc_stats.num_thawed,
+                   mvcc_stats.num_freed, mvcc_stats.num_reused,
+                   mvcc_stats.num_pages, mvcc_stats.num_dirty_pages,
+                   mvcc_stats.num_evictions);
+    }
+  }
+
+  /* How many commits share a flush, and what waiting for it costs them */
+  if (contextP->groupCommitWindowUS >= 0) {
+    if (chronosGroupCommitStatsGet(&contextP->groupCommit, &group_commit_stats) == CHRONOS_SUCCESS) {
+      chronos_info("SAMPLING GROUP_COMMIT [FLUSHES: %d] [COMMITS: %d] [AVG_BATCH: %.2lf] [MAX_BATCH: %d] "
+                   "[AVG_ADDED_LATENCY_MS: %.3lf] [MAX_ADDED_LATENCY_MS: %.3lf]",
+                   group_commit_stats.numFlushes, group_commit_stats.numCommits,
+                   group_commit_stats.numFlushes > 0 ? (double) group_commit_stats.numCommits / group_commit_stats.numFlushes : 0.0,
+                   group_commit_stats.maxBatch,
+                   group_commit_stats.numCommits > 0 ? group_commit_stats.cumulativeWaitMS / group_commit_stats.numCommits : 0.0,
+                   group_commit_stats.maxWaitMS);
+    }
+  }
 
   return;
 }
@@ -720,16 +925,25 @@ static int
 initProcessArguments(chronosServerContext_t *contextP)
 {
   contextP->numServerThreads = CHRONOS_NUM_SERVER_THREADS;
+  contextP->numNetworkThreads = CHRONOS_NUM_NETWORK_THREADS;
   contextP->numClientsThreads = CHRONOS_NUM_CLIENT_THREADS;
-  contextP->numUpdateThreads = CHRONOS_NUM_UPDATE_THREADS;
-  contextP->numUpdatesPerUpdateThread = CHRONOS_NUM_STOCK_UPDATES_PER_UPDATE_THREAD;
+  contextP->numUpdateThreads = CHRONOS_NUM_UPDATE_SCHEDULER_THREADS;
   contextP->serverPort = CHRONOS_SERVER_PORT;
+  snprintf(contextP->serverAddress, sizeof(contextP->serverAddress), "%s", CHRONOS_SERVER_ADDRESS);
   contextP->initialValidityIntervalMS = CHRONOS_INITIAL_VALIDITY_INTERVAL_MS;
   contextP->samplingPeriodSec = CHRONOS_SAMPLING_PERIOD_SEC;
   contextP->duration_sec = CHRONOS_EXPERIMENT_DURATION_SEC;
   contextP->desiredDelayBoundMS = CHRONOS_DESIRED_DELAY_BOUND_MS;
   contextP->alpha = CHRONOS_ALPHA;
   contextP->initialLoad = 1;
+  contextP->lockFreeQueues = CHRONOS_LOCK_FREE_QUEUE_DEFAULT;
+  contextP->queueDiscipline = CHRONOS_QUEUE_DISCIPLINE_DEFAULT;
+  contextP->numUserQueuesRequested = CHRONOS_NUM_USER_QUEUES;
+  contextP->processBatchSize = CHRONOS_PROCESS_BATCH_SIZE;
+  contextP->processBatchMaxWaitUS = CHRONOS_PROCESS_BATCH_MAX_WAIT_US;
+  contextP->snapshotXacts = CHRONOS_SNAPSHOT_XACTS_DEFAULT;
+  contextP->groupCommitWindowUS = CHRONOS_GROUP_COMMIT_WINDOW_US;
+  contextP->groupCommitBatchSize = CHRONOS_GROUP_COMMIT_BATCH_SIZE;
 
   contextP->timeToDieFp = isTimeToDie;
 
@@ -739,6 +953,118 @@ initProcessArguments(chronosServerContext_t *contextP)
 }
 
 
+/*
+ * Print the CPUs the given threads run on
+ */
+static void
+reportPlacement(chronosPlacementClass_t placementClass,
+                const chronosServerThreadInfo_t *infoArrP,
+                int numThreads,
+                chronosServerContext_t *contextP)
+{
+  int        i;
+  pthread_t *threadArr = NULL;
+
+  if (contextP->placementP == NULL) {
+    return;
+  }
+
+  if (numThreads > 0) {
+    threadArr = calloc(numThreads, sizeof(pthread_t));
+    if (threadArr == NULL) {
+      chronos_error("Failed to allocate thread array");
+      return;
+    }
+
+    for (i=0; i<numThreads; i++) {
+      threadArr[i] = infoArrP[i].thread_id;
+    }
+  }
+
+  (void) chronosPlacementReport(contextP->placementP, placementClass, threadArr, numThreads);
+
+  free(threadArr);
+}
+
+/*
+ * Fill the quote mirror from BDB. Entry i of the mirror
+ * is the quote of data item i
+ */
+static int
+quoteMirrorLoad(chronosServerContext_t *contextP)
+{
+  int          rc = CHRONOS_SUCCESS;
+  int          i;
+  int          num_pkeys = contextP->szDataItemsArray;
+  const char **pkey_list = NULL;
+  QUOTE       *quote_list = NULL;
+
+  if (chronosQuoteMirrorInit(&contextP->quoteMirror, num_pkeys) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to init quote mirror");
+    goto failXit;
+  }
+
+  if (num_pkeys == 0) {
+    goto cleanup;
+  }
+
+  pkey_list = calloc(num_pkeys, sizeof(const char *));
+  quote_list = calloc(num_pkeys, sizeof(QUOTE));
+  if (pkey_list == NULL || quote_list == NULL) {
+    chronos_error("Failed to allocate quote list");
+    goto failXit;
+  }
+
+  for (i=0; i<num_pkeys; i++) {
+    pkey_list[i] = contextP->dataItemsArray[i].dataItem;
+  }
+
+  if (benchmark_quote_list_get(contextP->benchmarkCtxtP, num_pkeys, pkey_list, quote_list) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to read the quotes");
+    goto failXit;
+  }
+
+  for (i=0; i<num_pkeys; i++) {
+    if (chronosQuoteMirrorPublish(&contextP->quoteMirror, i, &quote_list[i]) != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+  }
+
+  chronos_info("Loaded %d quotes into the quote mirror", num_pkeys);
+  goto cleanup;
+
+failXit:
+  rc = CHRONOS_FAIL;
+
+cleanup:
+  free(pkey_list);
+  free(quote_list);
+
+  return rc;
+}
+
+static int
+groupCommitFlush(void *argP)
+{
+  chronosServerContext_t *contextP = (chronosServerContext_t *) argP;
+
+  return benchmark_log_flush(contextP->benchmarkCtxtP);
+}
+
+/*
+ * Wait until the update txns this thread committed are durable.
+ * Without group commit, each commit already flushed the log.
+ */
+static int
+groupCommitWait(chronosServerContext_t *contextP)
+{
+  if (contextP->groupCommitWindowUS < 0) {
+    return CHRONOS_SUCCESS;
+  }
+
+  return chronosGroupCommitWait(&contextP->groupCommit);
+}
+
 /*
  * Process the command line arguments
  */
@@ -755,7 +1081,7 @@ processArguments(int argc, char *argv[], chronosServerContext_t *contextP)
   memset(contextP, 0, sizeof(*contextP));
   (void) initProcessArguments(contextP);
 
-  while ((c = getopt(argc, argv, "m:c:v:s:u:r:p:d:nh")) != -1) {
+  while ((c = getopt(argc, argv, "m:c:v:s:u:r:p:a:d:e:q:S:k:B:W:P:I:G:g:FRMnh")) != -1) {
     switch(c) {
       case 'm':
         contextP->runningMode = atoi(optarg);
@@ -792,11 +1118,88 @@ processArguments(int argc, char *argv[], chronosServerContext_t *contextP)
         chronos_debug(2, "*** Server port: %d", contextP->serverPort);
         break;
 
+      case 'a':
+        snprintf(contextP->serverAddress, sizeof(contextP->serverAddress), "%s", optarg);
+        chronos_debug(2, "*** Server address: %s", contextP->serverAddress);
+        break;
+
       case 'd':
         contextP->debugLevel = atoi(optarg);
         chronos_debug(2, "*** Debug Level: %d", contextP->debugLevel);
         break;
 
+      case 'e':
+        contextP->numNetworkThreads = atoi(optarg);
+        chronos_debug(2, "*** Num network threads: %d", contextP->numNetworkThreads);
+        break;
+
+      case 'q':
+        contextP->lockFreeQueues = atoi(optarg);
+        chronos_debug(2, "*** Lock-free queues: %d", contextP->lockFreeQueues);
+        break;
+
+      case 'S':
+        contextP->queueDiscipline = atoi(optarg);
+        chronos_debug(2, "*** Queue discipline: %d", contextP->queueDiscipline);
+        break;
+
+      case 'k':
+        contextP->numUserQueuesRequested = atoi(optarg);
+        chronos_debug(2, "*** Num user queues: %d", contextP->numUserQueuesRequested);
+        break;
+
+      case 'B':
+        contextP->processBatchSize = atoi(optarg);
+        chronos_debug(2, "*** Processing batch size: %d", contextP->processBatchSize);
+        break;
+
+      case 'W':
+        contextP->processBatchMaxWaitUS = atoi(optarg);
+        chronos_debug(2, "*** Processing batch max wait: %d [usecs]", contextP->processBatchMaxWaitUS);
+        break;
+
+      case 'P':
+        if (contextP->placementP != NULL) {
+          chronosPlacementDestroy(contextP->placementP);
+          contextP->placementP = NULL;
+        }
+        if (chronosPlacementCreate(optarg, &contextP->placementP) != CHRONOS_SUCCESS) {
+          chronos_error("Invalid thread placement: %s", optarg);
+          goto failXit;
+        }
+        chronos_debug(2, "*** Thread placement: %s", optarg);
+        break;
+
+      case 'I':
+        contextP->snapshotXacts = atoi(optarg);
+        chronos_debug(2, "*** Snapshot txns: %d", contextP->snapshotXacts);
+        break;
+
+      case 'G':
+        contextP->groupCommitWindowUS = atoi(optarg);
+        chronos_debug(2, "*** Group commit window: %d us", contextP->groupCommitWindowUS);
+        break;
+
+      case 'g':
+        contextP->groupCommitBatchSize = atoi(optarg);
+        chronos_debug(2, "*** Group commit batch size: %d", contextP->groupCommitBatchSize);
+        break;
+
+      case 'F':
+        contextP->firmDeadlines = 1;
+        chronos_debug(2, "*** Firm deadlines");
+        break;
+
+      case 'R':
+        contextP->reusePort = 1;
+        chronos_debug(2, "*** Use SO_REUSEPORT");
+        break;
+
+      case 'M':
+        contextP->quoteMirrorEnabled = 1;
+        chronos_debug(2, "*** Serve VIEW_STOCK from the quote mirror");
+        break;
+
       case 'n':
         contextP->initialLoad = 0;
         chronos_debug(2, "*** Do not perform initial load");
@@ -833,87 +1236,307 @@ processArguments(int argc, char *argv[], chronosServerContext_t *contextP)
     goto failXit;
   }
 
-  contextP->minUpdatePeriodMS = 0.5 * contextP->initialValidityIntervalMS;
-  contextP->maxUpdatePeriodMS = 0.5 * CHRONOS_UPDATE_PERIOD_RELAXATION_BOUND * contextP->initialValidityIntervalMS;
-  contextP->updatePeriodMS  =  0.5 * contextP->initialValidityIntervalMS;
+  if (contextP->numNetworkThreads < 0) {
+    chronos_error("number of network threads must be >= 0");
+    goto failXit;
+  }
 
+  if (contextP->reusePort && contextP->numNetworkThreads == 0) {
+    chronos_error("SO_REUSEPORT requires network threads");
+    goto failXit;
+  }
 
-  return CHRONOS_SUCCESS;
+  if (contextP->reusePort && chronosSocketAddressIsUnix(contextP->serverAddress)) {
+    chronos_error("SO_REUSEPORT is not available for unix domain sockets");
+    goto failXit;
+  }
 
-failXit:
-  chronos_usage();
-  return CHRONOS_FAIL;
-}
+  if (contextP->lockFreeQueues != 0 && contextP->lockFreeQueues != 1) {
+    chronos_error("lock-free queues must be either 0 or 1");
+    goto failXit;
+  }
 
-static int
-dispatchTableFn (chronosRequestPacket_t *reqPacketP, int *txn_rc_ret, chronosServerThreadInfo_t *infoP)
-{
-  int i;
-  volatile int txn_done = 0;
-  volatile int txn_rc = 0;
-  volatile int current_slot;
-  unsigned long long ticket = 0;
-  chronos_time_t   txn_enqueue;
+  if (contextP->queueDiscipline != CHRONOS_QUEUE_FIFO
+      && contextP->queueDiscipline != CHRONOS_QUEUE_EDF
+      && contextP->queueDiscipline != CHRONOS_QUEUE_LSF) {
+    chronos_error("queue discipline must be 0, 1 or 2");
+    goto failXit;
+  }
 
-  if (infoP == NULL || infoP->contextP == NULL) {
-    chronos_error("Invalid argument");
+  if (contextP->numUserQueuesRequested < 0) {
+    chronos_error("number of user queues must be >= 0");
     goto failXit;
   }
 
-  CHRONOS_SERVER_THREAD_CHECK(infoP);
-  CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
+  if (contextP->processBatchSize < 1 || contextP->processBatchSize > CHRONOS_PROCESS_BATCH_MAX) {
+    chronos_error("processing batch size must be between 1 and %d", CHRONOS_PROCESS_BATCH_MAX);
+    goto failXit;
+  }
 
-  /*===========================================
-   * Put a new transaction in the txn queue
-   *==========================================*/
-  chronos_debug(2, "Processing transaction: %s", CHRONOS_TXN_NAME(reqPacketP->txn_type));
-  
-  CHRONOS_TIME_GET(txn_enqueue);
-  chronos_enqueue_user_transaction(reqPacketP,
-                                   &txn_enqueue, 
-                                   &ticket, 
-                                   &txn_done, 
-                                   &txn_rc,
-                                   infoP->contextP);
+  if (contextP->processBatchMaxWaitUS < 0) {
+    chronos_error("processing batch max wait must be >= 0");
+    goto failXit;
+  }
 
-  if (reqPacketP->txn_type == CHRONOS_USER_TXN_VIEW_STOCK) {
-    current_slot = infoP->contextP->currentSlot;
-    for (i=0; i<reqPacketP->numItems; i++) {
-      infoP->contextP->dataItemsArray[reqPacketP->request_data.symbolInfo[i].symbolId].updateFrequency[current_slot] ++;
-    }
+  if ((contextP->snapshotXacts & ~BENCHMARK_SNAPSHOT_ALL) != 0) {
+    chronos_error("snapshot txns must be between 0 and %d", BENCHMARK_SNAPSHOT_ALL);
+    goto failXit;
   }
 
-  while (!txn_done) {
-    (void) sched_yield();
+  if (contextP->groupCommitBatchSize < 1) {
+    chronos_error("group commit batch size must be >= 1");
+    goto failXit;
   }
 
-  *txn_rc_ret = txn_rc;
+  if (contextP->lockFreeQueues && contextP->queueDiscipline != CHRONOS_QUEUE_FIFO) {
+    chronos_error("lock-free queues are always FIFO");
+    goto failXit;
+  }
+
+  if (contextP->serverAddress[0] == '\0') {
+    chronos_error("address must be a valid one");
+    goto failXit;
+  }
+
+  contextP->minUpdatePeriodMS = 0.5 * contextP->initialValidityIntervalMS;
+  contextP->maxUpdatePeriodMS = 0.5 * CHRONOS_UPDATE_PERIOD_RELAXATION_BOUND * contextP->initialValidityIntervalMS;
+  contextP->updatePeriodMS  =  0.5 * contextP->initialValidityIntervalMS;
 
-  chronos_debug(2, "Done processing transaction: %s, rc: %d", CHRONOS_TXN_NAME(reqPacketP->txn_type), txn_rc);
 
   return CHRONOS_SUCCESS;
 
 failXit:
+  chronos_usage();
   return CHRONOS_FAIL;
 }
 
 /*
- * Starting point for a handlerThread.
- * handle a transaction request
+ * Decode a request frame, or all the requests of a batch frame, into
+ * buffers from the request pool. Each buffer comes with one reference.
  */
-static void *
-daHandler(void *argP) 
+static int
+requestBuffersDecode(const char *frame, 
+                     int frameSize, 
+                     chronosRequestBuffer_t **requestBufArr, 
+                     int *numRequestsP, 
+                     chronosServerContext_t *contextP)
 {
-  int num_bytes;
-  int cnt_msg = 0;
-  int need_admission_control = 0;
-  int written, to_write;
-  int txn_rc = 0;
-  chronosResponsePacket_t resPacket;
-  chronosServerThreadInfo_t *infoP = (chronosServerThreadInfo_t *) argP;
-  chronosRequestPacket_t reqPacket;
+  int rc;
+  int numRequests = 1;
+  int numBuffers = 0;
+  chronosPacketHeader_t header;
+  chronosRequestPacket_t *reqPacketsArr[CHRONOS_MAX_BATCH_SIZE];
 
-  if (infoP == NULL || infoP->contextP == NULL) {
+  memcpy(&header, frame, sizeof(header));
+
+  if (chronosRequestIsBatch(&header)) {
+    numRequests = header.numItems;
+    if (numRequests < 1 || numRequests > CHRONOS_MAX_BATCH_SIZE) {
+      chronos_error("Invalid number of requests in batch: %d", numRequests);
+      goto failXit;
+    }
+  }
+
+  for (numBuffers=0; numBuffers<numRequests; numBuffers++) {
+    requestBufArr[numBuffers] = chronosRequestBufferAlloc(&contextP->requestPool);
+    if (requestBufArr[numBuffers] == NULL) {
+      goto failXit;
+    }
+    reqPacketsArr[numBuffers] = &(requestBufArr[numBuffers]->request);
+  }
+
+  if (chronosRequestIsBatch(&header)) {
+    rc = chronosRequestBatchDecode(frame, frameSize, reqPacketsArr, numRequests, &numRequests);
+    if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Failed to decode batch");
+      goto failXit;
+    }
+  }
+  else {
+    rc = chronosRequestDecode(frame, frameSize, reqPacketsArr[0]);
+    if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Failed to decode request");
+      goto failXit;
+    }
+  }
+
+  *numRequestsP = numRequests;
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  requestBuffersRelease(requestBufArr, numBuffers);
+  return CHRONOS_FAIL;
+}
+
+static void
+requestBuffersRelease(chronosRequestBuffer_t **requestBufArr, 
+                      int numRequests)
+{
+  int i;
+
+  for (i=0; i<numRequests; i++) {
+    chronosRequestBufferRelease(requestBufArr[i]);
+  }
+}
+
+/*
+ * Queue a txn and wait for it. The request buffer gets a second
+ * reference for the queue, the caller keeps its own.
+ */
+static int
+dispatchTableFn (chronosRequestBuffer_t *requestBufP, int *txn_rc_ret, chronosServerThreadInfo_t *infoP)
+{
+  int rc;
+  int txn_rc = 0;
+  unsigned long long ticket = 0;
+  chronos_time_t   txn_enqueue;
+  chronosCompletion_t completion;
+  const chronosRequestPacket_t *reqPacketP = NULL;
+
+  if (infoP == NULL || infoP->contextP == NULL || requestBufP == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  CHRONOS_SERVER_THREAD_CHECK(infoP);
+  CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
+
+  /*===========================================
+   * Put a new transaction in the txn queue
+   *==========================================*/
+  reqPacketP = &(requestBufP->request);
+  chronos_debug(2, "Processing transaction: %s", CHRONOS_TXN_NAME(reqPacketP->txn_type));
+  
+  chronosCompletionInit(&completion, -1, NULL);
+
+  chronosRequestBufferRetain(requestBufP);
+
+  CHRONOS_TIME_GET(txn_enqueue);
+  rc = chronos_enqueue_user_transaction(requestBufP,
+                                        &txn_enqueue, 
+                                        &ticket, 
+                                        &completion,
+                                        infoP->contextP);
+  if (rc != CHRONOS_SUCCESS) {
+    chronosRequestBufferRelease(requestBufP);
+    chronos_error("Failed to enqueue request");
+    goto failXit;
+  }
+
+  accountDataItemAccess(reqPacketP, infoP->contextP);
+
+  /* The processing thread signals the completion on our stack */
+  rc = chronosCompletionWait(&completion, &txn_rc);
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  *txn_rc_ret = txn_rc;
+
+  chronos_debug(2, "Done processing transaction: %s, rc: %d", CHRONOS_TXN_NAME(reqPacketP->txn_type), txn_rc);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Put all the transactions of a batch in the txn queue at once
+ * and wait for all of them.
+ */
+static int
+dispatchBatchFn (chronosRequestBuffer_t **requestBufArr, int numRequests, int *txn_rc_arr, chronosServerThreadInfo_t *infoP)
+{
+  int i;
+  int rc;
+  chronosCompletion_t completionArr[CHRONOS_MAX_BATCH_SIZE];
+  chronosCompletion_t *completionPtrArr[CHRONOS_MAX_BATCH_SIZE];
+  unsigned long long ticket = 0;
+  chronos_time_t   txn_enqueue;
+
+  if (infoP == NULL || infoP->contextP == NULL || requestBufArr == NULL || txn_rc_arr == NULL) {
+    chronos_error("Invalid argument");
+    goto failXit;
+  }
+
+  if (numRequests < 1 || numRequests > CHRONOS_MAX_BATCH_SIZE) {
+    chronos_error("Invalid number of requests: %d", numRequests);
+    goto failXit;
+  }
+
+  CHRONOS_SERVER_THREAD_CHECK(infoP);
+  CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
+
+  chronos_debug(2, "Processing batch of %d transactions", numRequests);
+
+  for (i=0; i<numRequests; i++) {
+    chronosCompletionInit(&completionArr[i], -1, NULL);
+    completionPtrArr[i] = &completionArr[i];
+    chronosRequestBufferRetain(requestBufArr[i]);
+  }
+
+  CHRONOS_TIME_GET(txn_enqueue);
+  rc = chronos_enqueue_user_transaction_batch(requestBufArr,
+                                              numRequests,
+                                              &txn_enqueue, 
+                                              &ticket, 
+                                              completionPtrArr,
+                                              infoP->contextP);
+  if (rc != CHRONOS_SUCCESS) {
+    requestBuffersRelease(requestBufArr, numRequests);
+    chronos_error("Failed to enqueue batch");
+    goto failXit;
+  }
+
+  for (i=0; i<numRequests; i++) {
+    accountDataItemAccess(&(requestBufArr[i]->request), infoP->contextP);
+  }
+
+  /* The processing threads signal the completions on our stack,
+   * so all of them are waited for */
+  for (i=0; i<numRequests; i++) {
+    if (chronosCompletionWait(&completionArr[i], &txn_rc_arr[i]) != CHRONOS_SUCCESS) {
+      rc = CHRONOS_FAIL;
+    }
+  }
+
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  chronos_debug(2, "Done processing batch of %d transactions", numRequests);
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Starting point for a handlerThread.
+ * handle a transaction request
+ */
+static void *
+daHandler(void *argP) 
+{
+  int rc;
+  int txn_rc = 0;
+  chronosResponsePacket_t resPacket;
+  chronosServerThreadInfo_t *infoP = (chronosServerThreadInfo_t *) argP;
+  chronosSocketBuffer_t recvBuffer;
+  chronosShmConnection_t shmConnection;
+  chronosShmConnection_t *shmP = NULL;
+  int frameSize;
+  int isBatch = 0;
+  chronosRequestBuffer_t *requestBufArr[CHRONOS_MAX_BATCH_SIZE];
+  chronosRequestPacket_t *reqPacketP = NULL;
+  int numRequests = 0;
+  int batchRcArr[CHRONOS_MAX_BATCH_SIZE];
+  char batchReply[sizeof(chronosResponsePacket_t) + sizeof(batchRcArr)];
+
+  if (infoP == NULL || infoP->contextP == NULL) {
     chronos_error("Invalid argument");
     goto cleanup;
   }
@@ -921,6 +1544,18 @@ daHandler(void *argP)
   CHRONOS_SERVER_THREAD_CHECK(infoP);
   CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
 
+  chronosSocketBufferInit(&recvBuffer, infoP->socket_fd);
+
+  if (chronosSocketAddressIsShm(infoP->contextP->serverAddress)) {
+    rc = chronosShmAccept(infoP->socket_fd, &shmConnection, isTimeToDie);
+    if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Failed to set up shared memory connection");
+      goto cleanup;
+    }
+    shmP = &shmConnection;
+    chronosSocketBufferShmSet(&recvBuffer, shmP);
+  }
+
   /*=======================================================
    * Wait here till all threads are initialized 
    *======================================================*/
@@ -946,48 +1581,61 @@ daHandler(void *argP)
     /*------------ Read the request -----------------*/
     chronos_debug(3, "waiting new request");
 
-    memset(&reqPacket, 0, sizeof(reqPacket));
-    char *buf = (char *) &reqPacket;
-    int   to_read = sizeof(reqPacket);
+    /* First the header, which tells us how much more to read */
+    rc = chronosSocketBufferWait(&recvBuffer, sizeof(chronosPacketHeader_t), isTimeToDie);
+    if (rc == CHRONOS_SOCKET_CLOSED) {
+      chronos_info("Client closed the connection");
+      goto cleanup;
+    }
+    else if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Failed while reading request from client");
+      goto cleanup;
+    }
 
-    while (to_read > 0) {
-      num_bytes = read(infoP->socket_fd, buf, 1);
-      if (num_bytes < 0) {
-        chronos_error("Failed while reading request from client");
-        goto cleanup;
-      }
+    frameSize = chronosRequestEncodedSizeFromHeader(chronosSocketBufferHead(&recvBuffer));
+    if (frameSize < 0) {
+      chronos_error("Received an invalid request header");
+      goto cleanup;
+    }
+
+    rc = chronosSocketBufferWait(&recvBuffer, frameSize, isTimeToDie);
+    if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Failed while reading request from client");
+      goto cleanup;
+    }
 
-      to_read -= num_bytes;
-      buf += num_bytes;
+    /* The requests are decoded straight from the receive buffer */
+    isBatch = chronosRequestIsBatch(chronosSocketBufferHead(&recvBuffer));
+    rc = requestBuffersDecode(chronosSocketBufferHead(&recvBuffer), frameSize, 
+                              requestBufArr, &numRequests, infoP->contextP);
+    if (rc != CHRONOS_SUCCESS) {
+      goto cleanup;
     }
+    chronosSocketBufferSkip(&recvBuffer, frameSize);
 
-    assert(CHRONOS_TXN_IS_VALID(reqPacket.txn_type));
-    chronos_debug(3, "Received transaction request: %s", CHRONOS_TXN_NAME(reqPacket.txn_type));
+    reqPacketP = &(requestBufArr[0]->request);
+    if (isBatch) {
+      chronos_debug(3, "Received batch of %d requests", numRequests);
+    }
+    else {
+      chronos_debug(3, "Received transaction request: %s", CHRONOS_TXN_NAME(reqPacketP->txn_type));
+    }
     /*-----------------------------------------------*/
 
 
     /*----------- do admission control ---------------*/
-    need_admission_control = infoP->contextP->num_txn_to_wait > 0 ? 1 : 0;
-    cnt_msg = 0;
-#define MSG_FREQ 10
-    while (infoP->contextP->num_txn_to_wait > 0)
-    {
-      if (cnt_msg >= MSG_FREQ) {
-        chronos_warning("### [AC] Doing admission control (%d/%d) ###",
-                     infoP->contextP->num_txn_to_wait,
-                     infoP->contextP->total_txns_enqueued);
-      }
-      cnt_msg = (cnt_msg + 1) % MSG_FREQ;
-      if (time_to_die == 1) {
+    if (!chronosAdmissionGateTryEnter(&infoP->contextP->admissionGate)) {
+      chronos_warning("### [AC] Doing admission control (%d/%d) ###",
+                   infoP->contextP->admissionGate.debt,
+                   infoP->contextP->total_txns_enqueued);
+
+      if (chronosAdmissionGateEnter(&infoP->contextP->admissionGate, infoP->contextP->timeToDieFp) != CHRONOS_SUCCESS) {
         chronos_info("Requested to die");
         goto cleanup;
       }
 
-      (void) sched_yield();
-    }
-    if (need_admission_control) {
       chronos_warning("### [AC] Done with admission control (%d/%d) ###",
-                   infoP->contextP->num_txn_to_wait,
+                   infoP->contextP->admissionGate.debt,
                    infoP->contextP->total_txns_enqueued);
     }
     /*-----------------------------------------------*/
@@ -995,7 +1643,13 @@ daHandler(void *argP)
 
 
     /*----------- Process the request ----------------*/
-    if (dispatchTableFn(&reqPacket, &txn_rc, infoP) != CHRONOS_SUCCESS) {
+    if (isBatch) {
+      if (dispatchBatchFn(requestBufArr, numRequests, batchRcArr, infoP) != CHRONOS_SUCCESS) {
+        chronos_error("Failed to handle batch");
+        goto cleanup;
+      }
+    }
+    else if (dispatchTableFn(requestBufArr[0], &txn_rc, infoP) != CHRONOS_SUCCESS) {
       chronos_error("Failed to handle request");
       goto cleanup;
     }
@@ -1006,21 +1660,34 @@ daHandler(void *argP)
     chronos_debug(3, "Replying to client");
 
     memset(&resPacket, 0, sizeof(resPacket));
-    resPacket.txn_type = reqPacket.txn_type;
-    resPacket.rc = txn_rc;
+    if (isBatch) {
+      /* One response for the whole batch */
+      resPacket.txn_type = CHRONOS_PACKET_TYPE_BATCH;
+      resPacket.request_id = reqPacketP->request_id;
+      resPacket.rc = numRequests;
+
+      memcpy(batchReply, &resPacket, sizeof(resPacket));
+      memcpy(batchReply + sizeof(resPacket), batchRcArr, numRequests * sizeof(int));
+
+      rc = chronosSocketBufferSendAll(&recvBuffer, batchReply, 
+                                      sizeof(resPacket) + numRequests * sizeof(int), 
+                                      isTimeToDie);
+    }
+    else {
+      resPacket.txn_type = reqPacketP->txn_type;
+      resPacket.request_id = reqPacketP->request_id;
+      resPacket.rc = txn_rc;
 
-    buf = (char *)&resPacket;
-    to_write = sizeof(resPacket);
+      rc = chronosSocketBufferSendAll(&recvBuffer, &resPacket, sizeof(resPacket), isTimeToDie);
+    }
 
-    while(to_write >0) {
-      written = write(infoP->socket_fd, buf, to_write);
-      if (written < 0) {
-        chronos_error("Failed to write to socket");
-        goto cleanup;
-      }
+    requestBuffersRelease(requestBufArr, numRequests);
+    numRequests = 0;
+    reqPacketP = NULL;
 
-      to_write -= written;
-      buf += written;
+    if (rc != CHRONOS_SUCCESS) {
+      chronos_error("Failed to write to socket");
+      goto cleanup;
     }
     chronos_debug(3, "Replied to client");
     /*-----------------------------------------------*/
@@ -1034,6 +1701,13 @@ daHandler(void *argP)
 
 cleanup:
 
+  /* Txns the processing threads still have hold their own reference */
+  requestBuffersRelease(requestBufArr, numRequests);
+
+  if (shmP != NULL) {
+    chronosShmClose(shmP);
+  }
+
   close(infoP->socket_fd);
 
   pthread_mutex_lock(&infoP->contextP->startThreadsMutex);
@@ -1050,112 +1724,1363 @@ cleanup:
 }
 
 /*
- * listen for client requests
+ * Create, bind and start listening on the server socket.
+ * Returns the socket descriptor or -1 on failure.
  */
-static void *
-daListener(void *argP) 
+static int
+createListenSocket(chronosServerContext_t *contextP, int reusePort)
 {
   int rc;
-  int done_creating = 0;
-  struct sockaddr_in server_address;
-  struct sockaddr_in client_address;
-  struct pollfd fds[1];
-  int socket_fd;
-  int accepted_socket_fd;
   int on = 1;
-  time_t current_time;
-  time_t next_sample_time;
-
-  socklen_t client_address_len;
-  pthread_attr_t attr;
-  const int stack_size = 0x100000; // 1 MB
-  chronosServerThreadInfo_t *handlerInfoP = NULL;
-
-  chronosServerThreadInfo_t *infoP = (chronosServerThreadInfo_t *) argP;
-
-  if (infoP == NULL || infoP->contextP == NULL) {
-    chronos_error("Invalid argument");
-    goto cleanup;
-  }
-
-  chronos_debug(1, "Starting listener thread...");
-
-  rc = pthread_attr_init(&attr);
-  if (rc != 0) {
-    perror("failed to init thread attributes");
-    goto cleanup;
-  }
-  
-  rc = pthread_attr_setstacksize(&attr, stack_size);
-  if (rc != 0) {
-    perror("failed to set stack size");
-    goto cleanup;
-  }
-
-  rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-  if (rc != 0) {
-    perror("failed to set detachable attribute");
-    goto cleanup;
+  int socket_fd = -1;
+  struct sockaddr_storage server_address;
+  socklen_t server_address_len;
+
+  rc = chronosSocketAddressGet(contextP->serverAddress,
+                               contextP->serverPort,
+                               &server_address,
+                               &server_address_len);
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
   }
 
-  /* Create socket to receive incoming connections */
-  socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+  socket_fd = socket(server_address.ss_family, SOCK_STREAM, 0);
   if (socket_fd == -1) {
     perror("Failed to create socket");
-    goto cleanup;
+    goto failXit;
   }
 
   /* Make socket reusable */
   rc = setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, (char *)&on, sizeof(on));
   if (rc == -1) {
     perror("setsockopt() failed");
-    goto cleanup;
+    goto failXit;
+  }
+
+  if (reusePort) {
+#ifdef SO_REUSEPORT
+    /* Let the kernel spread new connections among all
+     * the sockets bound to this port */
+    rc = setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, (char *)&on, sizeof(on));
+    if (rc == -1) {
+      perror("setsockopt() failed");
+      goto failXit;
+    }
+#else
+    chronos_error("SO_REUSEPORT is not supported");
+    goto failXit;
+#endif
   }
 
   /* Make non-blocking socket */
   rc = ioctl(socket_fd, FIONBIO, (char *)&on);
   if (rc < 0) {
     perror("ioctl() failed");
-    goto cleanup;
+    goto failXit;
   }
 
-  server_address.sin_family = AF_INET;
-  // Perhaps I need to change the ip address in the following line
-  server_address.sin_addr.s_addr = inet_addr(CHRONOS_SERVER_ADDRESS);
-  server_address.sin_port = htons(infoP->contextP->serverPort);
+  /* A socket file left behind by a previous run makes bind() fail */
+  if (server_address.ss_family == AF_UNIX) {
+    unlink(((struct sockaddr_un *) &server_address)->sun_path);
+  }
 
-  rc = bind(socket_fd, (struct sockaddr *)&server_address, sizeof(server_address));
+  rc = bind(socket_fd, (struct sockaddr *)&server_address, server_address_len);
   if (rc < 0) {
     perror("bind() failed");
-    goto cleanup;
+    goto failXit;
   }
 
-  rc = listen(socket_fd, infoP->contextP->numClientsThreads);
+  rc = listen(socket_fd, contextP->numClientsThreads);
   if (rc < 0) {
     perror("listen() failed");
-    goto cleanup;
+    goto failXit;
   }
 
-  fds[0].events = POLLIN;
-  fds[0].fd = socket_fd;
+  return socket_fd;
 
-  chronos_debug(4, "Waiting for incoming connections...");
+failXit:
+  if (socket_fd >= 0) {
+    close(socket_fd);
+  }
+  return -1;
+}
 
-  /* Keep listening for incoming connections till we
-   * complete all threads for the experiment
-   */
-  while(!done_creating && !time_to_die) {
+/*
+ * Keep track of how often each data item is accessed.
+ * This is used to adapt the update period of the data items.
+ */
+static void
+accountDataItemAccess(const chronosRequestPacket_t *reqPacketP, chronosServerContext_t *contextP)
+{
+  int i;
+  volatile int current_slot;
 
-    chronos_debug(4, "Polling for new connection");
-    
-    /* wait for a new connection */
-    rc = poll(fds, 1, 1000 /* one second */);
-    if (rc < 0) {
-      perror("poll() failed");
-      goto cleanup;
+  if (reqPacketP->txn_type == CHRONOS_USER_TXN_VIEW_STOCK) {
+    current_slot = contextP->currentSlot;
+    for (i=0; i<reqPacketP->numItems; i++) {
+      contextP->dataItemsArray[reqPacketP->request_data.symbolInfo[i].symbolId].updateFrequency[current_slot] ++;
     }
-    else if (rc == 0) {
-      chronos_debug(4, "poll() timed out");
+  }
+}
+
+/*===================================================================
+ * Network threads.
+ *
+ * Instead of one handler thread per client, a few network threads
+ * multiplex all client connections with epoll. A request is decoded
+ * and put in the user queue, and the processing thread tells us
+ * when it is done by writing the txn slot pointer to our pipe.
+ *
+ * A connection can have up to CHRONOS_MAX_PIPELINE_DEPTH requests
+ * in flight, and their responses go back in completion order.
+ *==================================================================*/
+struct chronosServerConnection_t;
+
+/* Replies that a client did not take yet wait in the connection. No
+ * new request is taken while they do, so the replies of the txns in
+ * flight are all that has to fit. A batch of n txns takes fewer bytes
+ * than n single replies. */
+#define CHRONOS_SERVER_SEND_BUFFER_SIZE \
+  (CHRONOS_MAX_PIPELINE_DEPTH * (sizeof(chronosResponsePacket_t) + sizeof(int)))
+
+/* Collects the results of the txns of a batch request,
+ * which are answered together once all of them are done */
+typedef struct chronosServerBatch_t {
+  unsigned int             request_id;
+  int                      num_txns;
+  int                      num_done;
+  int                      txn_rc[CHRONOS_MAX_BATCH_SIZE];
+} chronosServerBatch_t;
+
+typedef struct chronosServerTxnSlot_t {
+  struct chronosServerConnection_t *connP;
+  chronosServerBatch_t    *batchP;
+  int                      batch_index;
+  int                      in_use;
+  unsigned int             request_id;
+  chronosUserTransaction_t txn_type;
+  chronosCompletion_t      completion;
+} chronosServerTxnSlot_t;
+
+typedef struct chronosServerConnection_t {
+  int                     socket_fd;
+
+  /* Position in the connection array of the network thread */
+  int                     slot;
+
+  /* The epoll events we are polling the socket for. We stop polling
+   * for input while the receive buffer is full, and for output
+   * unless there are replies waiting to be sent */
+  unsigned int            watching;
+
+  /* The client went away while txns were in the queue */
+  int                     closing;
+
+  /* A shm: client that did not send its region yet. Until
+   * then, we poll the socket it is going to come through */
+  int                     handshaking;
+
+  /* Requests from this connection that are in the user queue */
+  int                     num_pending;
+  chronosServerTxnSlot_t  txnSlots[CHRONOS_MAX_PIPELINE_DEPTH];
+
+  /* We poll recvBuffer.socket_fd, which is the 
+   * event fd of shmConnection for shm: clients */
+  chronosSocketBuffer_t   recvBuffer;
+  chronosShmConnection_t  shmConnection;
+
+  /* Replies the client did not take yet */
+  int                     sendLen;
+  char                    sendData[CHRONOS_SERVER_SEND_BUFFER_SIZE];
+
+  /* Closed connections are freed only after the current batch
+   * of epoll events, which may still refer to them */
+  struct chronosServerConnection_t *nextFree;
+
+  /* Set while the connection is in the FIFO of connections with
+   * requests held back (see networkDeferQueue_t) */
+  int                     deferred;
+  struct chronosServerConnection_t *nextDeferred;
+} chronosServerConnection_t;
+
+/* Connections with requests held back by admission control, or
+ * because not all the clients are connected yet. They are retried
+ * in the order they were held back, so every one gets its turn. */
+typedef struct networkDeferQueue_t {
+  chronosServerConnection_t *headP;
+  chronosServerConnection_t *tailP;
+} networkDeferQueue_t;
+
+/* These tell apart the non-client descriptors in the epoll set */
+static char networkListenTag;
+static char networkNotifyTag;
+
+static void
+networkDeferQueuePush(networkDeferQueue_t *queueP, chronosServerConnection_t *connP)
+{
+  if (connP->deferred) {
+    return;
+  }
+
+  connP->deferred = 1;
+  connP->nextDeferred = NULL;
+  if (queueP->tailP != NULL) {
+    queueP->tailP->nextDeferred = connP;
+  }
+  else {
+    queueP->headP = connP;
+  }
+  queueP->tailP = connP;
+}
+
+static void
+networkDeferQueueRemove(networkDeferQueue_t *queueP, chronosServerConnection_t *connP)
+{
+  chronosServerConnection_t *prevP = NULL;
+  chronosServerConnection_t *curP = NULL;
+
+  if (!connP->deferred) {
+    return;
+  }
+
+  for (curP = queueP->headP; curP != connP; curP = curP->nextDeferred) {
+    prevP = curP;
+  }
+
+  if (prevP != NULL) {
+    prevP->nextDeferred = connP->nextDeferred;
+  }
+  else {
+    queueP->headP = connP->nextDeferred;
+  }
+
+  if (queueP->tailP == connP) {
+    queueP->tailP = prevP;
+  }
+
+  connP->deferred = 0;
+  connP->nextDeferred = NULL;
+}
+
+static void
+networkConnectionFree(chronosServerConnection_t *connP)
+{
+  if (connP->recvBuffer.shmP != NULL) {
+    chronosShmClose(connP->recvBuffer.shmP);
+    connP->recvBuffer.shmP = NULL;
+  }
+  if (connP->socket_fd >= 0) {
+    close(connP->socket_fd);
+    connP->socket_fd = -1;
+  }
+  free(connP);
+}
+
+/*
+ * The client closed the connection (or misbehaved). If txns of this
+ * connection are still queued, the connection waits in the closing
+ * list and is released when the last of them completes.
+ */
+static void
+networkConnectionClose(chronosServerConnection_t *connP,
+                       int epoll_fd,
+                       chronosServerConnection_t **connArr,
+                       int *numConnsP,
+                       chronosServerConnection_t **freeListP,
+                       chronosServerConnection_t **closingListP,
+                       networkDeferQueue_t *deferQueueP,
+                       chronosServerContext_t *contextP)
+{
+  int last;
+
+  (void) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connP->recvBuffer.socket_fd, NULL);
+  networkDeferQueueRemove(deferQueueP, connP);
+
+  last = *numConnsP - 1;
+  connArr[connP->slot] = connArr[last];
+  connArr[connP->slot]->slot = connP->slot;
+  *numConnsP = last;
+
+  if (connP->recvBuffer.shmP != NULL) {
+    chronosShmClose(connP->recvBuffer.shmP);
+    connP->recvBuffer.shmP = NULL;
+  }
+  close(connP->socket_fd);
+  connP->socket_fd = -1;
+
+  pthread_mutex_lock(&contextP->startThreadsMutex);
+  contextP->currentNumClients -= 1;
+  if (contextP->currentNumClients == 0) {
+    time_to_die = 1;
+  }
+  pthread_mutex_unlock(&contextP->startThreadsMutex);
+
+  if (connP->num_pending > 0) {
+    connP->closing = 1;
+    connP->nextFree = *closingListP;
+    *closingListP = connP;
+  }
+  else {
+    connP->nextFree = *freeListP;
+    *freeListP = connP;
+  }
+}
+
+/*
+ * Poll the socket for input only while there is room to store it, and
+ * for output while replies are waiting. The event fd of a shm: client
+ * is always writable: the network thread retries those on its own.
+ */
+static int
+networkConnectionWatch(chronosServerConnection_t *connP, int epoll_fd)
+{
+  unsigned int want = 0;
+  struct epoll_event ev;
+
+  if (chronosSocketBufferAvailable(&connP->recvBuffer) < CHRONOS_SOCKET_BUFFER_SIZE) {
+    want |= EPOLLIN;
+  }
+  if (connP->sendLen > 0 && connP->recvBuffer.shmP == NULL) {
+    want |= EPOLLOUT;
+  }
+
+  if (want == connP->watching) {
+    return CHRONOS_SUCCESS;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = want;
+  ev.data.ptr = connP;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connP->recvBuffer.socket_fd, &ev) < 0) {
+    perror("epoll_ctl() failed");
+    goto failXit;
+  }
+
+  connP->watching = want;
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Write the replies that are waiting, as far as the client takes them
+ */
+static int
+networkConnectionFlush(chronosServerConnection_t *connP)
+{
+  int num_bytes = 0;
+
+  if (connP->sendLen == 0) {
+    return CHRONOS_SUCCESS;
+  }
+
+  if (chronosSocketBufferSend(&connP->recvBuffer, connP->sendData, connP->sendLen, &num_bytes) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to write to socket");
+    return CHRONOS_FAIL;
+  }
+
+  connP->sendLen -= num_bytes;
+  if (connP->sendLen > 0 && num_bytes > 0) {
+    memmove(connP->sendData, connP->sendData + num_bytes, connP->sendLen);
+  }
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Send a reply without blocking the network thread. Whatever the
+ * client does not take now is sent when it drains its socket.
+ */
+static int
+networkConnectionSend(chronosServerConnection_t *connP,
+                      const void *bufP,
+                      int len)
+{
+  int num_bytes = 0;
+
+  /* Replies go out in order */
+  if (connP->sendLen == 0) {
+    if (chronosSocketBufferSend(&connP->recvBuffer, bufP, len, &num_bytes) != CHRONOS_SUCCESS) {
+      chronos_error("Failed to write to socket");
+      return CHRONOS_FAIL;
+    }
+  }
+
+  if (num_bytes == len) {
+    return CHRONOS_SUCCESS;
+  }
+
+  if (connP->sendLen + (len - num_bytes) > (int) sizeof(connP->sendData)) {
+    chronos_error("Client is not reading its replies");
+    return CHRONOS_FAIL;
+  }
+
+  memcpy(connP->sendData + connP->sendLen, (const char *) bufP + num_bytes, len - num_bytes);
+  connP->sendLen += len - num_bytes;
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * Queue all the txns of a batch in one go. Each of them takes
+ * a txn slot, which the caller made sure are available. The
+ * caller keeps its references to the request buffers.
+ */
+static int
+networkConnectionDispatchBatch(chronosServerConnection_t *connP,
+                               chronosRequestBuffer_t **requestBufArr,
+                               int numRequests,
+                               chronosServerThreadInfo_t *infoP)
+{
+  int i;
+  int j;
+  int rc;
+  unsigned long long ticket = 0;
+  chronos_time_t txn_enqueue;
+  chronosServerBatch_t *batchP = NULL;
+  chronosServerTxnSlot_t *txnSlotArr[CHRONOS_MAX_BATCH_SIZE];
+  chronosCompletion_t *completionArr[CHRONOS_MAX_BATCH_SIZE];
+
+  chronos_debug(3, "Received batch of %d requests", numRequests);
+
+  batchP = calloc(1, sizeof(chronosServerBatch_t));
+  if (batchP == NULL) {
+    chronos_error("Could not allocate batch");
+    goto failXit;
+  }
+
+  batchP->request_id = requestBufArr[0]->request.request_id;
+  batchP->num_txns = numRequests;
+
+  for (i=0, j=0; i<numRequests; i++) {
+    while (connP->txnSlots[j].in_use) {
+      j++;
+    }
+    assert(j < CHRONOS_MAX_PIPELINE_DEPTH);
+
+    txnSlotArr[i] = &(connP->txnSlots[j]);
+    txnSlotArr[i]->connP = connP;
+    txnSlotArr[i]->batchP = batchP;
+    txnSlotArr[i]->batch_index = i;
+    txnSlotArr[i]->in_use = 1;
+    txnSlotArr[i]->request_id = requestBufArr[i]->request.request_id;
+    txnSlotArr[i]->txn_type = requestBufArr[i]->request.txn_type;
+    chronosCompletionInit(&txnSlotArr[i]->completion,
+                          infoP->parameters.networkParameters.notify_fd,
+                          txnSlotArr[i]);
+
+    completionArr[i] = &txnSlotArr[i]->completion;
+    chronosRequestBufferRetain(requestBufArr[i]);
+  }
+  connP->num_pending += numRequests;
+
+  CHRONOS_TIME_GET(txn_enqueue);
+  rc = chronos_enqueue_user_transaction_batch(requestBufArr,
+                                              numRequests,
+                                              &txn_enqueue,
+                                              &ticket,
+                                              completionArr,
+                                              infoP->contextP);
+  if (rc != CHRONOS_SUCCESS) {
+    for (i=0; i<numRequests; i++) {
+      txnSlotArr[i]->in_use = 0;
+      txnSlotArr[i]->batchP = NULL;
+    }
+    requestBuffersRelease(requestBufArr, numRequests);
+    connP->num_pending -= numRequests;
+    free(batchP);
+    chronos_error("Failed to enqueue batch");
+    goto failXit;
+  }
+
+  for (i=0; i<numRequests; i++) {
+    accountDataItemAccess(&(requestBufArr[i]->request), infoP->contextP);
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Hand every complete request buffered in the connection to the
+ * processing threads, as long as there are free txn slots.
+ * The connection joins the deferred FIFO when a request has to wait 
+ * (admission control or not all clients are connected yet).
+ */
+static int
+networkConnectionDispatch(chronosServerConnection_t *connP,
+                          int started,
+                          networkDeferQueue_t *deferQueueP,
+                          chronosServerThreadInfo_t *infoP)
+{
+  int i;
+  int rc;
+  int frameSize;
+  int numRequests = 0;
+  unsigned long long ticket = 0;
+  chronos_time_t txn_enqueue;
+  chronosPacketHeader_t header;
+  chronosServerTxnSlot_t *txnSlotP = NULL;
+  chronosRequestBuffer_t *requestBufArr[CHRONOS_MAX_BATCH_SIZE];
+  chronosRequestPacket_t *reqPacketP = NULL;
+
+  /* Requests wait while the client is not taking its replies */
+  while (connP->num_pending < CHRONOS_MAX_PIPELINE_DEPTH && connP->sendLen == 0) {
+
+    if (chronosSocketBufferPeek(&connP->recvBuffer, &header, sizeof(header)) != CHRONOS_SUCCESS) {
+      break;
+    }
+
+    if (!started || !chronosAdmissionGateTryEnter(&infoP->contextP->admissionGate)) {
+      networkDeferQueuePush(deferQueueP, connP);
+      break;
+    }
+
+    frameSize = chronosRequestEncodedSizeFromHeader(&header);
+    if (frameSize < 0) {
+      chronos_error("Received an invalid request header");
+      goto failXit;
+    }
+
+    if (chronosSocketBufferAvailable(&connP->recvBuffer) < frameSize) {
+      break;
+    }
+
+    if (chronosRequestIsBatch(&header)) {
+      if (header.numItems < 1 || header.numItems > CHRONOS_MAX_BATCH_SIZE) {
+        chronos_error("Invalid number of requests in batch: %d", header.numItems);
+        goto failXit;
+      }
+
+      /* The whole batch goes in at once */
+      if (CHRONOS_MAX_PIPELINE_DEPTH - connP->num_pending < header.numItems) {
+        break;
+      }
+    }
+
+    /* The requests are decoded straight from the receive buffer */
+    rc = requestBuffersDecode(chronosSocketBufferHead(&connP->recvBuffer), frameSize,
+                              requestBufArr, &numRequests, infoP->contextP);
+    if (rc != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+    chronosSocketBufferSkip(&connP->recvBuffer, frameSize);
+
+    if (chronosRequestIsBatch(&header)) {
+      rc = networkConnectionDispatchBatch(connP, requestBufArr, numRequests, infoP);
+      requestBuffersRelease(requestBufArr, numRequests);
+      if (rc != CHRONOS_SUCCESS) {
+        goto failXit;
+      }
+
+      continue;
+    }
+
+    reqPacketP = &(requestBufArr[0]->request);
+    chronos_debug(3, "Received transaction request: %s", CHRONOS_TXN_NAME(reqPacketP->txn_type));
+
+    for (i=0; i<CHRONOS_MAX_PIPELINE_DEPTH; i++) {
+      if (!connP->txnSlots[i].in_use) {
+        txnSlotP = &(connP->txnSlots[i]);
+        break;
+      }
+    }
+    assert(txnSlotP != NULL);
+
+    txnSlotP->connP = connP;
+    txnSlotP->batchP = NULL;
+    txnSlotP->in_use = 1;
+    txnSlotP->request_id = reqPacketP->request_id;
+    txnSlotP->txn_type = reqPacketP->txn_type;
+    chronosCompletionInit(&txnSlotP->completion,
+                          infoP->parameters.networkParameters.notify_fd,
+                          txnSlotP);
+    connP->num_pending ++;
+
+    chronosRequestBufferRetain(requestBufArr[0]);
+
+    CHRONOS_TIME_GET(txn_enqueue);
+    rc = chronos_enqueue_user_transaction(requestBufArr[0],
+                                          &txn_enqueue,
+                                          &ticket,
+                                          &txnSlotP->completion,
+                                          infoP->contextP);
+    if (rc != CHRONOS_SUCCESS) {
+      txnSlotP->in_use = 0;
+      connP->num_pending --;
+      /* Both the queue's reference and ours */
+      chronosRequestBufferRelease(requestBufArr[0]);
+      chronosRequestBufferRelease(requestBufArr[0]);
+      chronos_error("Failed to enqueue request");
+      goto failXit;
+    }
+
+    accountDataItemAccess(reqPacketP, infoP->contextP);
+    chronosRequestBufferRelease(requestBufArr[0]);
+    txnSlotP = NULL;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Send the result of a finished txn back to the client
+ */
+static int
+networkConnectionReply(chronosServerTxnSlot_t *txnSlotP)
+{
+  int rc;
+  chronosServerConnection_t *connP = txnSlotP->connP;
+  chronosServerBatch_t *batchP = txnSlotP->batchP;
+  chronosResponsePacket_t resPacket;
+  char batchReply[sizeof(chronosResponsePacket_t) + CHRONOS_MAX_BATCH_SIZE * sizeof(int)];
+
+  if (batchP != NULL) {
+    /* Batches are answered when their last txn is done */
+    batchP->txn_rc[txnSlotP->batch_index] = chronosCompletionResultGet(&txnSlotP->completion);
+    batchP->num_done ++;
+
+    txnSlotP->batchP = NULL;
+    txnSlotP->in_use = 0;
+    connP->num_pending --;
+
+    if (batchP->num_done < batchP->num_txns) {
+      return CHRONOS_SUCCESS;
+    }
+
+    memset(&resPacket, 0, sizeof(resPacket));
+    resPacket.txn_type = CHRONOS_PACKET_TYPE_BATCH;
+    resPacket.request_id = batchP->request_id;
+    resPacket.rc = batchP->num_txns;
+
+    memcpy(batchReply, &resPacket, sizeof(resPacket));
+    memcpy(batchReply + sizeof(resPacket), batchP->txn_rc, batchP->num_txns * sizeof(int));
+
+    rc = CHRONOS_SUCCESS;
+    if (!connP->closing) {
+      rc = networkConnectionSend(connP, batchReply, sizeof(resPacket) + batchP->num_txns * sizeof(int));
+    }
+
+    free(batchP);
+
+    if (rc != CHRONOS_SUCCESS) {
+      goto failXit;
+    }
+
+    return CHRONOS_SUCCESS;
+  }
+
+  memset(&resPacket, 0, sizeof(resPacket));
+  resPacket.txn_type = txnSlotP->txn_type;
+  resPacket.request_id = txnSlotP->request_id;
+  resPacket.rc = chronosCompletionResultGet(&txnSlotP->completion);
+
+  txnSlotP->in_use = 0;
+  connP->num_pending --;
+
+  if (connP->closing) {
+    return CHRONOS_SUCCESS;
+  }
+
+  rc = networkConnectionSend(connP, &resPacket, sizeof(resPacket));
+  if (rc != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Set up the shared memory of a shm: client, if it sent its region
+ * already. From then on, we poll the event fd of the connection
+ * instead of the socket.
+ */
+static int
+networkConnectionHandshake(chronosServerConnection_t *connP, int epoll_fd)
+{
+  int rc;
+  struct epoll_event ev;
+
+  rc = chronosShmAcceptTry(connP->socket_fd, &connP->shmConnection);
+  if (rc == CHRONOS_SHM_AGAIN) {
+    return CHRONOS_SUCCESS;
+  }
+  else if (rc != CHRONOS_SUCCESS) {
+    chronos_error("Failed to set up shared memory connection");
+    goto failXit;
+  }
+
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connP->socket_fd, NULL) < 0) {
+    perror("epoll_ctl() failed");
+    chronosShmClose(&connP->shmConnection);
+    goto failXit;
+  }
+
+  chronosSocketBufferShmSet(&connP->recvBuffer, &connP->shmConnection);
+  connP->handshaking = 0;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = connP;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connP->recvBuffer.socket_fd, &ev) < 0) {
+    perror("epoll_ctl() failed");
+    goto failXit;
+  }
+  connP->watching = EPOLLIN;
+
+  chronos_debug(2, "Set up shared memory connection");
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Accept all the connections queued up on the listening socket
+ */
+static int
+networkAccept(int listen_fd,
+              int epoll_fd,
+              chronosServerConnection_t ***connArrP,
+              int *numConnsP,
+              int *maxConnsP,
+              chronosServerContext_t *contextP)
+{
+  int on = 1;
+  int accepted_socket_fd;
+  struct epoll_event ev;
+  chronosServerConnection_t *connP = NULL;
+  chronosServerConnection_t **newConnArr = NULL;
+
+  while (1) {
+    accepted_socket_fd = accept(listen_fd, NULL, NULL);
+    if (accepted_socket_fd == -1) {
+      if (errno != EWOULDBLOCK && errno != EAGAIN) {
+        perror("accept() failed");
+        goto failXit;
+      }
+      break;
+    }
+
+    if (ioctl(accepted_socket_fd, FIONBIO, (char *)&on) < 0) {
+      perror("ioctl() failed");
+      close(accepted_socket_fd);
+      goto failXit;
+    }
+
+    if (*numConnsP == *maxConnsP) {
+      int newMax = (*maxConnsP == 0) ? 64 : 2 * (*maxConnsP);
+      newConnArr = realloc(*connArrP, newMax * sizeof(chronosServerConnection_t *));
+      if (newConnArr == NULL) {
+        chronos_error("Could not grow connection array");
+        close(accepted_socket_fd);
+        goto failXit;
+      }
+      *connArrP = newConnArr;
+      *maxConnsP = newMax;
+    }
+
+    connP = calloc(1, sizeof(chronosServerConnection_t));
+    if (connP == NULL) {
+      chronos_error("Could not allocate connection");
+      close(accepted_socket_fd);
+      goto failXit;
+    }
+
+    connP->socket_fd = accepted_socket_fd;
+    connP->watching = EPOLLIN;
+    chronosSocketBufferInit(&connP->recvBuffer, accepted_socket_fd);
+
+    /* The client sends its region right after connecting. 
+     * It is picked up when the socket becomes readable */
+    connP->handshaking = chronosSocketAddressIsShm(contextP->serverAddress);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = connP;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connP->recvBuffer.socket_fd, &ev) < 0) {
+      perror("epoll_ctl() failed");
+      networkConnectionFree(connP);
+      goto failXit;
+    }
+
+    connP->slot = *numConnsP;
+    (*connArrP)[*numConnsP] = connP;
+    *numConnsP += 1;
+
+    pthread_mutex_lock(&contextP->startThreadsMutex);
+    contextP->currentNumClients += 1;
+    pthread_cond_broadcast(&contextP->startThreadsWait);
+    pthread_mutex_unlock(&contextP->startThreadsMutex);
+
+    chronos_debug(2, "Accepted new connection");
+  }
+
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * This is the driver function of a network thread
+ */
+static void *
+networkThread(void *argP)
+{
+  int i;
+  int n;
+  int rc;
+  int started = 0;
+  int backlogged = 0;
+  int timeout_ms;
+  int epoll_fd = -1;
+  int notify_pipe[2] = {-1, -1};
+  int numConns = 0;
+  int maxConns = 0;
+  chronosServerConnection_t **connArr = NULL;
+  chronosServerConnection_t *connP = NULL;
+  chronosServerConnection_t *freeList = NULL;
+  chronosServerConnection_t *closingList = NULL;
+  chronosServerConnection_t **linkP = NULL;
+  chronosServerConnection_t *pendingP = NULL;
+  chronosServerConnection_t *pendingTailP = NULL;
+  networkDeferQueue_t deferQueue = {NULL, NULL};
+  chronosAdmissionWatcher_t *watcherP = NULL;
+  chronosServerContext_t *contextP = NULL;
+  struct epoll_event ev;
+  struct epoll_event events[CHRONOS_NETWORK_MAX_EVENTS];
+  chronosServerThreadInfo_t *infoP = (chronosServerThreadInfo_t *) argP;
+
+  if (infoP == NULL || infoP->contextP == NULL) {
+    chronos_error("Invalid argument");
+    goto cleanup;
+  }
+
+  CHRONOS_SERVER_THREAD_CHECK(infoP);
+  CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
+
+  contextP = infoP->contextP;
+
+  epoll_fd = epoll_create1(0);
+  if (epoll_fd < 0) {
+    perror("epoll_create1() failed");
+    goto cleanup;
+  }
+
+  if (pipe(notify_pipe) < 0) {
+    perror("pipe() failed");
+    goto cleanup;
+  }
+  infoP->parameters.networkParameters.notify_fd = notify_pipe[1];
+  infoP->parameters.networkParameters.notify_read_fd = notify_pipe[0];
+
+  /* The gate tells us through the notify pipe when it opens */
+  watcherP = &infoP->parameters.networkParameters.gateWatcher;
+  if (chronosAdmissionWatcherInit(watcherP, notify_pipe[1], NULL) != CHRONOS_SUCCESS) {
+    goto cleanup;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = &networkNotifyTag;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, notify_pipe[0], &ev) < 0) {
+    perror("epoll_ctl() failed");
+    goto cleanup;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+  /* With a shared listening socket, only wake up one of us */
+  if (!contextP->reusePort) {
+    ev.events |= EPOLLEXCLUSIVE;
+  }
+#endif
+  ev.data.ptr = &networkListenTag;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, infoP->parameters.networkParameters.listen_fd, &ev) < 0) {
+    perror("epoll_ctl() failed");
+    goto cleanup;
+  }
+
+  chronos_debug(1, "Starting network thread %d...", infoP->thread_num);
+
+  while (!time_to_die) {
+
+    CHRONOS_SERVER_THREAD_CHECK(infoP);
+    CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
+
+    /* Requests are held back till all the clients have connected,
+     * so that we can have a fair experiment */
+    if (!started && contextP->currentNumClients >= contextP->numClientsThreads) {
+      started = 1;
+    }
+
+    /* Requests held back by the admission gate are retried when it tells
+     * us it opened. Those held back till all the clients are connected,
+     * and shm: replies that are waiting, are retried soon */
+    timeout_ms = 1000;
+    if (backlogged || (!started && deferQueue.headP != NULL)) {
+      timeout_ms = 1;
+    }
+    else if (deferQueue.headP != NULL
+             && !chronosAdmissionGateWatch(&contextP->admissionGate, watcherP)) {
+      timeout_ms = 0;
+    }
+
+    n = epoll_wait(epoll_fd, events, CHRONOS_NETWORK_MAX_EVENTS, timeout_ms);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait() failed");
+      goto cleanup;
+    }
+
+    /* Nothing tells us when a shm: client makes room in its ring */
+    if (backlogged) {
+      backlogged = 0;
+      for (i=0; i<numConns; i++) {
+        connP = connArr[i];
+        if (connP->sendLen == 0 || connP->recvBuffer.shmP == NULL) {
+          continue;
+        }
+
+        if (networkConnectionFlush(connP) != CHRONOS_SUCCESS
+            || networkConnectionDispatch(connP, started, &deferQueue, infoP) != CHRONOS_SUCCESS
+            || networkConnectionWatch(connP, epoll_fd) != CHRONOS_SUCCESS) {
+          networkConnectionClose(connP, epoll_fd, connArr, &numConns, &freeList, &closingList, &deferQueue, contextP);
+          i--;
+          continue;
+        }
+
+        backlogged |= (connP->sendLen > 0);
+      }
+    }
+
+    /* Retry the held back requests first come, first served. The first
+     * connection held back again keeps its place at the head, and the
+     * ones behind it stay where they were */
+    pendingP = deferQueue.headP;
+    pendingTailP = deferQueue.tailP;
+    deferQueue.headP = NULL;
+    deferQueue.tailP = NULL;
+
+    while (pendingP != NULL) {
+      connP = pendingP;
+      pendingP = connP->nextDeferred;
+      connP->deferred = 0;
+      connP->nextDeferred = NULL;
+
+      if (networkConnectionDispatch(connP, started, &deferQueue, infoP) != CHRONOS_SUCCESS
+          || networkConnectionWatch(connP, epoll_fd) != CHRONOS_SUCCESS) {
+        networkConnectionClose(connP, epoll_fd, connArr, &numConns, &freeList, &closingList, &deferQueue, contextP);
+        continue;
+      }
+
+      if (connP->deferred) {
+        if (pendingP != NULL) {
+          connP->nextDeferred = pendingP;
+          deferQueue.tailP = pendingTailP;
+        }
+        break;
+      }
+    }
+
+    for (i=0; i<n; i++) {
+
+      if (events[i].data.ptr == &networkListenTag) {
+        /*------------ Accept new clients ---------------*/
+        rc = networkAccept(infoP->parameters.networkParameters.listen_fd,
+                           epoll_fd, &connArr, &numConns, &maxConns, contextP);
+        if (rc != CHRONOS_SUCCESS) {
+          chronos_error("Failed to accept new connections");
+        }
+      }
+      else if (events[i].data.ptr == &networkNotifyTag) {
+        /*------------ Reply to finished txns -----------*/
+        chronosServerTxnSlot_t *doneArr[CHRONOS_NETWORK_MAX_EVENTS];
+        int num_bytes;
+        int j;
+
+        num_bytes = read(notify_pipe[0], doneArr, sizeof(doneArr));
+        if (num_bytes < 0) {
+          perror("read() failed");
+          goto cleanup;
+        }
+
+        for (j=0; j<num_bytes / (int)sizeof(doneArr[0]); j++) {
+          /* The admission gate opened. The held back requests
+           * are retried below */
+          if (doneArr[j] == NULL) {
+            continue;
+          }
+
+          connP = doneArr[j]->connP;
+
+          rc = networkConnectionReply(doneArr[j]);
+
+          if (connP->closing) {
+            if (connP->num_pending == 0) {
+              for (linkP = &closingList; *linkP != connP; linkP = &(*linkP)->nextFree) {
+              }
+              *linkP = connP->nextFree;
+
+              connP->nextFree = freeList;
+              freeList = connP;
+            }
+            continue;
+          }
+
+          /* A slot was freed, more requests may go in */
+          if (rc != CHRONOS_SUCCESS
+              || networkConnectionDispatch(connP, started, &deferQueue, infoP) != CHRONOS_SUCCESS
+              || networkConnectionWatch(connP, epoll_fd) != CHRONOS_SUCCESS) {
+            networkConnectionClose(connP, epoll_fd, connArr, &numConns, &freeList, &closingList, &deferQueue, contextP);
+            continue;
+          }
+
+          if (connP->sendLen > 0 && connP->recvBuffer.shmP != NULL) {
+            backlogged = 1;
+          }
+        }
+      }
+      else {
+        /*------------ Read new requests ----------------*/
+        connP = (chronosServerConnection_t *) events[i].data.ptr;
+        if (connP->socket_fd < 0) {
+          /* Closed earlier in this batch */
+          continue;
+        }
+
+        if (connP->handshaking) {
+          if (networkConnectionHandshake(connP, epoll_fd) != CHRONOS_SUCCESS) {
+            networkConnectionClose(connP, epoll_fd, connArr, &numConns, &freeList, &closingList, &deferQueue, contextP);
+          }
+          continue;
+        }
+
+        /*------------ Send waiting replies -----------*/
+        if ((events[i].events & EPOLLOUT)
+            && networkConnectionFlush(connP) != CHRONOS_SUCCESS) {
+          networkConnectionClose(connP, epoll_fd, connArr, &numConns, &freeList, &closingList, &deferQueue, contextP);
+          continue;
+        }
+
+        rc = CHRONOS_SUCCESS;
+        if (events[i].events & ~EPOLLOUT) {
+          rc = chronosSocketBufferFill(&connP->recvBuffer);
+        }
+
+        if (rc == CHRONOS_SOCKET_CLOSED) {
+          chronos_info("Client closed the connection");
+          networkConnectionClose(connP, epoll_fd, connArr, &numConns, &freeList, &closingList, &deferQueue, contextP);
+          continue;
+        }
+        else if (rc != CHRONOS_SUCCESS
+                 || networkConnectionDispatch(connP, started, &deferQueue, infoP) != CHRONOS_SUCCESS
+                 || networkConnectionWatch(connP, epoll_fd) != CHRONOS_SUCCESS) {
+          chronos_error("Failed while reading request from client");
+          networkConnectionClose(connP, epoll_fd, connArr, &numConns, &freeList, &closingList, &deferQueue, contextP);
+          continue;
+        }
+      }
+    }
+
+    while (freeList != NULL) {
+      connP = freeList;
+      freeList = connP->nextFree;
+      networkConnectionFree(connP);
+    }
+  }
+
+cleanup:
+  while (freeList != NULL) {
+    connP = freeList;
+    freeList = connP->nextFree;
+    networkConnectionFree(connP);
+  }
+
+  /* Connections with a queued txn are handed over to main, which frees
+   * them once the processing threads are gone. The same goes for the
+   * notify pipe: the processing threads may still write to it */
+  for (i=0; i<numConns; i++) {
+    if (connArr[i]->num_pending == 0) {
+      networkConnectionFree(connArr[i]);
+    }
+    else {
+      connArr[i]->nextFree = closingList;
+      closingList = connArr[i];
+    }
+  }
+  free(connArr);
+
+  if (infoP != NULL) {
+    infoP->parameters.networkParameters.orphanListP = closingList;
+  }
+
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+  }
+
+  chronos_info("networkThread exiting");
+  pthread_exit(NULL);
+}
+
+/*
+ * Create the listening socket(s) and spawn the network threads
+ */
+static int
+startNetworkThreads(chronosServerContext_t *contextP)
+{
+  int i;
+  int rc;
+  int shared_fd = -1;
+  pthread_attr_t attr;
+  const int stack_size = 0x100000; // 1 MB
+
+  rc = pthread_attr_init(&attr);
+  if (rc != 0) {
+    chronos_error("failed to init thread attributes");
+    goto failXit;
+  }
+  
+  rc = pthread_attr_setstacksize(&attr, stack_size);
+  if (rc != 0) {
+    chronos_error("failed to set stack size");
+    goto failXit;
+  }
+
+  if (!contextP->reusePort) {
+    shared_fd = createListenSocket(contextP, 0);
+    if (shared_fd < 0) {
+      goto failXit;
+    }
+  }
+
+  networkThreadInfoArrP = calloc(contextP->numNetworkThreads, sizeof(chronosServerThreadInfo_t));
+  if (networkThreadInfoArrP == NULL) {
+    chronos_error("Failed to allocate thread structure");
+    if (shared_fd >= 0) {
+      close(shared_fd);
+    }
+    goto failXit;
+  }
+
+  for (i=0; i<contextP->numNetworkThreads; i++) {
+    networkThreadInfoArrP[i].parameters.networkParameters.listen_fd = -1;
+    networkThreadInfoArrP[i].parameters.networkParameters.notify_fd = -1;
+    networkThreadInfoArrP[i].parameters.networkParameters.notify_read_fd = -1;
+  }
+
+  if (chronosPlacementAttrSet(contextP->placementP, CHRONOS_PLACEMENT_NETWORK, &attr) != CHRONOS_SUCCESS) {
+    goto failXit;
+  }
+
+  for (i=0; i<contextP->numNetworkThreads; i++) {
+    networkThreadInfoArrP[i].thread_type = CHRONOS_SERVER_THREAD_NETWORK;
+    networkThreadInfoArrP[i].contextP = contextP;
+    networkThreadInfoArrP[i].thread_num = i;
+
+    if (contextP->reusePort) {
+      networkThreadInfoArrP[i].parameters.networkParameters.listen_fd = createListenSocket(contextP, 1);
+      if (networkThreadInfoArrP[i].parameters.networkParameters.listen_fd < 0) {
+        goto failXit;
+      }
+    }
+    else {
+      networkThreadInfoArrP[i].parameters.networkParameters.listen_fd = shared_fd;
+    }
+
+    networkThreadInfoArrP[i].magic = CHRONOS_SERVER_THREAD_MAGIC;
+
+    rc = pthread_create(&networkThreadInfoArrP[i].thread_id,
+                        &attr,
+                        &networkThread,
+                        &(networkThreadInfoArrP[i]));
+    if (rc != 0) {
+      networkThreadInfoArrP[i].magic = 0;
+      chronos_error("failed to spawn thread: %s", strerror(rc));
+      goto failXit;
+    }
+
+    chronos_debug(2,"Spawed network thread: %d", i);
+  }
+
+  reportPlacement(CHRONOS_PLACEMENT_NETWORK, networkThreadInfoArrP, contextP->numNetworkThreads, contextP);
+
+  pthread_attr_destroy(&attr);
+  return CHRONOS_SUCCESS;
+
+failXit:
+  return CHRONOS_FAIL;
+}
+
+/*
+ * Free what the network threads left behind. Called once the processing
+ * threads are joined, so nobody writes to the connections or to the
+ * notify pipes anymore. Queued request buffers go with the request pool.
+ */
+static void
+releaseNetworkThreads(chronosServerContext_t *contextP)
+{
+  int i;
+  int shared_fd = -1;
+  chronosNetworkThreadInfo_t *paramsP = NULL;
+  chronosServerConnection_t *connP = NULL;
+
+  if (networkThreadInfoArrP == NULL) {
+    return;
+  }
+
+  for (i=0; i<contextP->numNetworkThreads; i++) {
+    paramsP = &networkThreadInfoArrP[i].parameters.networkParameters;
+
+    (void) chronosAdmissionGateUnwatch(&contextP->admissionGate, &paramsP->gateWatcher);
+
+    while (paramsP->orphanListP != NULL) {
+      connP = paramsP->orphanListP;
+      paramsP->orphanListP = connP->nextFree;
+      networkConnectionFree(connP);
+    }
+
+    if (paramsP->notify_fd >= 0) {
+      close(paramsP->notify_fd);
+    }
+    if (paramsP->notify_read_fd >= 0) {
+      close(paramsP->notify_read_fd);
+    }
+
+    /* Without SO_REUSEPORT all the threads share one listening socket */
+    if (contextP->reusePort) {
+      if (paramsP->listen_fd >= 0) {
+        close(paramsP->listen_fd);
+      }
+    }
+    else {
+      shared_fd = paramsP->listen_fd;
+    }
+  }
+
+  if (shared_fd >= 0) {
+    close(shared_fd);
+  }
+
+  free(networkThreadInfoArrP);
+  networkThreadInfoArrP = NULL;
+}
+
+/*
+ * listen for client requests
+ */
+static void *
+daListener(void *argP) 
+{
+  int rc;
+  int done_creating = 0;
+  int i;
+  struct sockaddr_storage client_address;
+  struct pollfd fds[1];
+  int socket_fd = -1;
+  int accepted_socket_fd;
+  time_t current_time;
+  time_t next_sample_time;
+
+  socklen_t client_address_len;
+  pthread_attr_t attr;
+  const int stack_size = 0x100000; // 1 MB
+  chronosServerThreadInfo_t *handlerInfoP = NULL;
+
+  chronosServerThreadInfo_t *infoP = (chronosServerThreadInfo_t *) argP;
+
+  if (infoP == NULL || infoP->contextP == NULL) {
+    chronos_error("Invalid argument");
+    goto cleanup;
+  }
+
+  chronos_debug(1, "Starting listener thread...");
+
+  rc = pthread_attr_init(&attr);
+  if (rc != 0) {
+    perror("failed to init thread attributes");
+    goto cleanup;
+  }
+  
+  rc = pthread_attr_setstacksize(&attr, stack_size);
+  if (rc != 0) {
+    perror("failed to set stack size");
+    goto cleanup;
+  }
+
+  rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (rc != 0) {
+    perror("failed to set detachable attribute");
+    goto cleanup;
+  }
+
+  /* Handler threads are placed with the network threads */
+  if (chronosPlacementAttrSet(infoP->contextP->placementP, CHRONOS_PLACEMENT_NETWORK, &attr) != CHRONOS_SUCCESS) {
+    goto cleanup;
+  }
+
+  if (infoP->contextP->numNetworkThreads > 0) {
+    /* Connections are accepted and served by the network threads.
+     * We just wait for all of them to show up */
+    if (startNetworkThreads(infoP->contextP) != CHRONOS_SUCCESS) {
+      chronos_error("Failed to start network threads");
+      goto cleanup;
+    }
+
+    pthread_mutex_lock(&infoP->contextP->startThreadsMutex);
+    while (infoP->contextP->currentNumClients < infoP->contextP->numClientsThreads && time_to_die == 0) {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += 1;
+      pthread_cond_timedwait(&infoP->contextP->startThreadsWait, &infoP->contextP->startThreadsMutex, &ts);
+    }
+    pthread_mutex_unlock(&infoP->contextP->startThreadsMutex);
+
+    chronos_info("daListener: all clients connected");
+    done_creating = 1;
+  }
+  else {
+    /* Create socket to receive incoming connections */
+    socket_fd = createListenSocket(infoP->contextP, 0);
+    if (socket_fd < 0) {
+      goto cleanup;
+    }
+
+    fds[0].events = POLLIN;
+    fds[0].fd = socket_fd;
+  }
+
+  chronos_debug(4, "Waiting for incoming connections...");
+
+  /* Keep listening for incoming connections till we
+   * complete all threads for the experiment
+   */
+  while(!done_creating && !time_to_die) {
+
+    chronos_debug(4, "Polling for new connection");
+    
+    /* wait for a new connection */
+    rc = poll(fds, 1, 1000 /* one second */);
+    if (rc < 0) {
+      perror("poll() failed");
+      goto cleanup;
+    }
+    else if (rc == 0) {
+      chronos_debug(4, "poll() timed out");
       continue;
     }
     else {
@@ -1181,106 +3106,375 @@ daListener(void *argP)
         break;
       }
 
-      handlerInfoP  = NULL;
-      handlerInfoP = calloc(1, sizeof(chronosServerThreadInfo_t));
-      if (handlerInfoP == NULL) {
-        chronos_error("Failed to allocate space for thread info");
-        goto cleanup;
-      }
+      handlerInfoP  = NULL;
+      handlerInfoP = calloc(1, sizeof(chronosServerThreadInfo_t));
+      if (handlerInfoP == NULL) {
+        chronos_error("Failed to allocate space for thread info");
+        goto cleanup;
+      }
+
+      // TODO: What would be needed to use a thread pool instead?
+      handlerInfoP->socket_fd = accepted_socket_fd;
+      handlerInfoP->contextP = infoP->contextP;
+      handlerInfoP->state = CHRONOS_SERVER_THREAD_STATE_RUN;
+      handlerInfoP->magic = CHRONOS_SERVER_THREAD_MAGIC;
+
+      rc = pthread_create(&handlerInfoP->thread_id,
+                          &attr,
+                          &daHandler,
+                          handlerInfoP);
+      if (rc != 0) {
+        chronos_error("failed to spawn thread");
+        goto cleanup;
+      }
+
+      chronos_debug(2,"Spawed handler thread");
+
+      /*===========================================================
+       * Signal the threads for the fact that all of them have
+       * been created and that they can start creating transactions
+       *==========================================================*/
+      pthread_mutex_lock(&infoP->contextP->startThreadsMutex);
+      infoP->contextP->currentNumClients += 1;
+      if (infoP->contextP->currentNumClients == infoP->contextP->numClientsThreads) {
+        done_creating = 1;
+        chronos_info("daListener created all requested threads");
+      }
+      pthread_cond_broadcast(&infoP->contextP->startThreadsWait);
+      pthread_mutex_unlock(&infoP->contextP->startThreadsMutex);
+    } while (accepted_socket_fd != -1);
+  }
+
+  if (time_to_die == 1) {
+    chronos_info("Requested to die");
+    goto cleanup;
+  }
+
+#ifdef CHRONOS_SAMPLING_ENABLED
+  if (startSamplingTimer(infoP->contextP) != CHRONOS_SUCCESS) {
+    goto cleanup;
+  }
+#endif
+
+#if 0
+  if (startExperimentTimer(infoP->contextP) != CHRONOS_SUCCESS) {
+    goto cleanup;
+  }
+#endif
+
+  current_time = time(NULL);
+  next_sample_time = current_time + infoP->contextP->duration_sec;
+
+  while (!time_to_die) {
+    current_time = time(NULL);
+    if (current_time >= next_sample_time) {
+      time_to_die = 1;
+      chronos_info("**** CHRONOS EXPERIMENT FINISHING ****");
+    }
+    else {
+      sleep(0);
+    }
+  }
+
+cleanup:
+  if (networkThreadInfoArrP != NULL) {
+    for (i=0; i<infoP->contextP->numNetworkThreads; i++) {
+      if (networkThreadInfoArrP[i].magic == CHRONOS_SERVER_THREAD_MAGIC) {
+        pthread_join(networkThreadInfoArrP[i].thread_id, NULL);
+      }
+    }
+  }
+
+  if (socket_fd >= 0) {
+    close(socket_fd);
+  }
+
+  if (chronosSocketAddressIsUnix(infoP->contextP->serverAddress)) {
+    unlink(chronosSocketAddressPathGet(infoP->contextP->serverAddress));
+  }
+
+  chronos_info("daListener exiting");
+  pthread_exit(NULL);
+}
+
+/*
+ * Make a timerfd expire at the given time (ms, CLOCK_REALTIME)
+ */
+static int
+updateTimerArm(int timer_fd, unsigned long long time_ms)
+{
+  struct itimerspec timer_spec;
+
+  memset(&timer_spec, 0, sizeof(timer_spec));
+  CHRONOS_MS_TO_TIME(time_ms, timer_spec.it_value);
+
+  if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer_spec, NULL) != 0) {
+    perror("timerfd_settime() failed");
+    return CHRONOS_FAIL;
+  }
+
+  return CHRONOS_SUCCESS; 
+}
+
+#ifdef CHRONOS_USER_TRANSACTIONS_ENABLED
+/* Purchase and sell items are laid out like benchmark_xact_data_t,
+ * so they are handed to the benchmark without copying them. Every
+ * field has to sit at the same offset and have the same size */
+#define CHRONOS_XACT_FIELD_CHECK(type, field)                                     \
+  typedef char type##_##field##_check[                                           \
+    (offsetof(type, field) == offsetof(benchmark_xact_data_t, field)              \
+     && sizeof(((type *) 0)->field) == sizeof(((benchmark_xact_data_t *) 0)->field)) ? 1 : -1]
+
+typedef char chronosPurchaseInfoSizeCheck[sizeof(chronosPurchaseInfo_t) == sizeof(benchmark_xact_data_t) ? 1 : -1];
+CHRONOS_XACT_FIELD_CHECK(chronosPurchaseInfo_t, accountId);
+CHRONOS_XACT_FIELD_CHECK(chronosPurchaseInfo_t, symbolId);
+CHRONOS_XACT_FIELD_CHECK(chronosPurchaseInfo_t, symbol);
+CHRONOS_XACT_FIELD_CHECK(chronosPurchaseInfo_t, price);
+CHRONOS_XACT_FIELD_CHECK(chronosPurchaseInfo_t, amount);
+
+typedef char chronosSellInfoSizeCheck[sizeof(chronosSellInfo_t) == sizeof(benchmark_xact_data_t) ? 1 : -1];
+CHRONOS_XACT_FIELD_CHECK(chronosSellInfo_t, accountId);
+CHRONOS_XACT_FIELD_CHECK(chronosSellInfo_t, symbolId);
+CHRONOS_XACT_FIELD_CHECK(chronosSellInfo_t, symbol);
+CHRONOS_XACT_FIELD_CHECK(chronosSellInfo_t, price);
+CHRONOS_XACT_FIELD_CHECK(chronosSellInfo_t, amount);
+
+static int
+userTransactionRun(const chronosRequestPacket_t *requestP, chronosServerContext_t *contextP)
+{
+  int               i;
+  int               txn_rc = CHRONOS_SUCCESS;
+  int               num_data_items = requestP->numItems;
+  const char        *pkey_list[CHRONOS_MAX_DATA_ITEMS_PER_XACT];
+
+  /* dispatch a transaction */
+  switch(requestP->txn_type) {
+
+  case CHRONOS_USER_TXN_VIEW_STOCK:
+    for (i=0; i<num_data_items; i++) {
+      pkey_list[i] = requestP->request_data.symbolInfo[i].symbol;
+    }
+    txn_rc = benchmark_view_stock2(num_data_items, pkey_list, contextP->benchmarkCtxtP);
+    break;
+
+  case CHRONOS_USER_TXN_VIEW_PORTFOLIO:
+    for (i=0; i<num_data_items; i++) {
+      pkey_list[i] = requestP->request_data.portfolioInfo[i].accountId;
+    }
+    txn_rc = benchmark_view_portfolio2(num_data_items, pkey_list, contextP->benchmarkCtxtP);
+    break;
+
+  case CHRONOS_USER_TXN_PURCHASE:
+    txn_rc = benchmark_purchase2(num_data_items, 
+                                 (benchmark_xact_data_t *) requestP->request_data.purchaseInfo,
+                                 contextP->benchmarkCtxtP);
+    break;
+
+  case CHRONOS_USER_TXN_SALE:
+    txn_rc = benchmark_sell2(num_data_items, 
+                             (benchmark_xact_data_t *) requestP->request_data.sellInfo, 
+                             contextP->benchmarkCtxtP);
+    break;
+
+  default:
+    assert(0);
+  }
+
+  return txn_rc;
+}
+
+/*
+ * Microseconds left until the deadline. Negative once it has passed
+ */
+static long long
+deadlineRemainingUS(const chronos_time_t *deadlineP)
+{
+  chronos_time_t now;
+
+  CHRONOS_TIME_GET(now);
+
+  return (long long) (deadlineP->tv_sec - now.tv_sec) * 1000000LL 
+         + (deadlineP->tv_nsec - now.tv_nsec) / 1000;
+}
+
+/*
+ * With firm deadlines, the BDB transactions started from now on by this
+ * thread are aborted if they are still running when the deadline passes.
+ * A txn whose deadline already passed should not be started at all.
+ */
+static int
+firmDeadlineArm(const chronos_time_t *deadlineP, chronosServerContext_t *contextP)
+{
+  long long remaining_us;
+
+  if (!contextP->firmDeadlines) {
+    return CHRONOS_SUCCESS;
+  }
+
+  remaining_us = deadlineRemainingUS(deadlineP);
+  if (remaining_us <= 0) {
+    return CHRONOS_TXN_RC_DROPPED;
+  }
+
+  benchmark_xact_timeout_set(remaining_us > UINT_MAX ? UINT_MAX : (unsigned int) remaining_us);
+
+  return CHRONOS_SUCCESS;
+}
 
-      // TODO: What would be needed to use a thread pool instead?
-      handlerInfoP->socket_fd = accepted_socket_fd;
-      handlerInfoP->contextP = infoP->contextP;
-      handlerInfoP->state = CHRONOS_SERVER_THREAD_STATE_RUN;
-      handlerInfoP->magic = CHRONOS_SERVER_THREAD_MAGIC;
+/*
+ * Undo firmDeadlineArm(). A txn that failed past its deadline 
+ * was most likely aborted by the timeout.
+ */
+static int
+firmDeadlineDisarm(int txn_rc, const chronos_time_t *deadlineP, chronosServerContext_t *contextP)
+{
+  if (!contextP->firmDeadlines) {
+    return txn_rc;
+  }
 
-      rc = pthread_create(&handlerInfoP->thread_id,
-                          &attr,
-                          &daHandler,
-                          handlerInfoP);
-      if (rc != 0) {
-        chronos_error("failed to spawn thread");
-        goto cleanup;
-      }
+  benchmark_xact_timeout_set(0);
 
-      chronos_debug(2,"Spawed handler thread");
+  if (txn_rc != CHRONOS_SUCCESS && deadlineRemainingUS(deadlineP) <= 0) {
+    return CHRONOS_TXN_RC_ABORTED;
+  }
 
-      /*===========================================================
-       * Signal the threads for the fact that all of them have
-       * been created and that they can start creating transactions
-       *==========================================================*/
-      pthread_mutex_lock(&infoP->contextP->startThreadsMutex);
-      infoP->contextP->currentNumClients += 1;
-      if (infoP->contextP->currentNumClients == infoP->contextP->numClientsThreads) {
-        done_creating = 1;
-        chronos_info("daListener created all requested threads");
-      }
-      pthread_cond_broadcast(&infoP->contextP->startThreadsWait);
-      pthread_mutex_unlock(&infoP->contextP->startThreadsMutex);
-    } while (accepted_socket_fd != -1);
+  return txn_rc;
+}
+
+/*
+ * Serve a VIEW_STOCK from the quote mirror, without a BDB transaction.
+ * Fails if any of its quotes is not in the mirror.
+ */
+static int
+userTransactionViewStockMirror(const chronosRequestPacket_t *requestP, chronosServerContext_t *contextP)
+{
+  int   i;
+  QUOTE quote;
+
+  for (i=0; i<requestP->numItems; i++) {
+    if (chronosQuoteMirrorRead(&contextP->quoteMirror, 
+                               requestP->request_data.symbolInfo[i].symbolId, 
+                               &quote) != CHRONOS_SUCCESS) {
+      return CHRONOS_FAIL;
+    }
+
+    chronos_debug(3, "Value of %s is %f", quote.symbol, quote.current_price);
   }
 
-  if (time_to_die == 1) {
-    chronos_info("Requested to die");
-    goto cleanup;
+  return CHRONOS_SUCCESS;
+}
+
+static int
+userTransactionExecute(const chronosRequestPacket_t *requestP, const chronos_time_t *deadlineP, chronosServerContext_t *contextP)
+{
+  int txn_rc;
+
+  /* Quotes missing from the mirror are read from BDB */
+  if (requestP->txn_type == CHRONOS_USER_TXN_VIEW_STOCK && contextP->quoteMirrorEnabled) {
+    if (userTransactionViewStockMirror(requestP, contextP) == CHRONOS_SUCCESS) {
+      return CHRONOS_SUCCESS;
+    }
   }
 
-#ifdef CHRONOS_SAMPLING_ENABLED
-  if (startSamplingTimer(infoP->contextP) != CHRONOS_SUCCESS) {
-    goto cleanup;
+  txn_rc = firmDeadlineArm(deadlineP, contextP);
+  if (txn_rc != CHRONOS_SUCCESS) {
+    return txn_rc;
   }
-#endif
 
-#if 0
-  if (startExperimentTimer(infoP->contextP) != CHRONOS_SUCCESS) {
-    goto cleanup;
+  txn_rc = userTransactionRun(requestP, contextP);
+
+  return firmDeadlineDisarm(txn_rc, deadlineP, contextP);
+}
+
+/*
+ * Several VIEW_STOCK requests are only reads, so they can share one BDB
+ * transaction, bound by the earliest deadline among them. If it fails,
+ * each of them is retried on its own.
+ */
+static void
+userTransactionsViewStock(chronosRequestBuffer_t **requestBufArr, 
+                          const chronos_time_t *deadline_arr, 
+                          int numTxns, 
+                          int *txn_rc_arr, 
+                          chronosServerContext_t *contextP)
+{
+  int               i;
+  int               j;
+  int               num_pkeys = 0;
+  int               earliest = 0;
+  int               txn_rc;
+  const chronosRequestPacket_t *requestP = NULL;
+  const char        *pkey_list[CHRONOS_PROCESS_BATCH_MAX * CHRONOS_MAX_DATA_ITEMS_PER_XACT];
+
+  for (i=0; i<numTxns; i++) {
+    requestP = &(requestBufArr[i]->request);
+    for (j=0; j<requestP->numItems; j++) {
+      pkey_list[num_pkeys++] = requestP->request_data.symbolInfo[j].symbol;
+    }
+
+    if (CHRONOS_TIME_AFTER(deadline_arr[earliest], deadline_arr[i])) {
+      earliest = i;
+    }
   }
-#endif
 
-  current_time = time(NULL);
-  next_sample_time = current_time + infoP->contextP->duration_sec;
+  txn_rc = firmDeadlineArm(&deadline_arr[earliest], contextP);
+  if (txn_rc == CHRONOS_SUCCESS) {
+    txn_rc = benchmark_view_stock2(num_pkeys, pkey_list, contextP->benchmarkCtxtP);
+    txn_rc = firmDeadlineDisarm(txn_rc, &deadline_arr[earliest], contextP);
+  }
 
-  while (!time_to_die) {
-    current_time = time(NULL);
-    if (current_time >= next_sample_time) {
-      time_to_die = 1;
-      chronos_info("**** CHRONOS EXPERIMENT FINISHING ****");
+  for (i=0; i<numTxns; i++) {
+    if (txn_rc == CHRONOS_SUCCESS) {
+      txn_rc_arr[i] = CHRONOS_SUCCESS;
     }
     else {
-      sleep(0);
+      txn_rc_arr[i] = userTransactionExecute(&(requestBufArr[i]->request), &deadline_arr[i], contextP);
     }
   }
-
-cleanup:
-  chronos_info("daListener exiting");
-  pthread_exit(NULL);
 }
 
 /*
- * Wait till the next release time
+ * With firm deadlines, a txn that is expected to finish after 
+ * its deadline is not run at all. An estimate larger than the whole
+ * budget of the txn says more about the estimate than about the txn:
+ * such a txn is only dropped once its deadline has passed.
  */
 static int
-waitPeriod(double updatePeriodMS)
+userTransactionIsHopeless(int txn_type, 
+                          const chronos_time_t *enqueueP, 
+                          const chronos_time_t *deadlineP, 
+                          chronosServerContext_t *contextP)
 {
-  struct timespec updatePeriod;
+  long long expected_us = 0;
+  long long budget_us;
 
-  updatePeriod.tv_sec = updatePeriodMS / 1000;
-  updatePeriod.tv_nsec = ((int)updatePeriodMS % 1000) * 1000000;
+  if (!contextP->firmDeadlines) {
+    return 0;
+  }
 
-  /* TODO: do I need to check the second argument? */
-  nanosleep(&updatePeriod, NULL);
-  
-  return CHRONOS_SUCCESS; 
+  if (CHRONOS_TXN_IS_VALID(txn_type)) {
+    expected_us = (long long) (contextP->txnExecTimeMSArr[txn_type] * 1000);
+  }
+
+  budget_us = (long long) (deadlineP->tv_sec - enqueueP->tv_sec) * 1000000LL 
+              + (deadlineP->tv_nsec - enqueueP->tv_nsec) / 1000;
+  if (expected_us > budget_us) {
+    expected_us = 0;
+  }
+
+  return deadlineRemainingUS(deadlineP) < expected_us;
 }
 
-#ifdef CHRONOS_USER_TRANSACTIONS_ENABLED
 static int
 processUserTransaction(chronosServerThreadInfo_t *infoP)
 {
   int               rc = CHRONOS_SUCCESS;
   int               i;
-  int               num_data_items = 0;
-  int               txn_rc = CHRONOS_SUCCESS;
+  int               num_txns = 0;
+  int               num_run = 0;
+  int               txn_rc_arr[CHRONOS_PROCESS_BATCH_MAX];
+  int               run_rc_arr[CHRONOS_PROCESS_BATCH_MAX];
+  int               run_idx_arr[CHRONOS_PROCESS_BATCH_MAX];
 #ifdef CHRONOS_SAMPLING_ENABLED
   int               thread_num;
   int               current_slot = 0;
@@ -1288,15 +3482,18 @@ processUserTransaction(chronosServerThreadInfo_t *infoP)
   chronos_time_t    txn_duration;
   chronosServerStats_t  *statsP = NULL;
 #endif
-  unsigned long long ticket = 0;
-  chronos_time_t    txn_enqueue;
+  unsigned long long ticket_arr[CHRONOS_PROCESS_BATCH_MAX];
+  chronos_time_t    txn_enqueue_arr[CHRONOS_PROCESS_BATCH_MAX];
+  chronos_time_t    txn_deadline_arr[CHRONOS_PROCESS_BATCH_MAX];
   chronos_time_t    txn_begin;
   chronos_time_t    txn_end;
-  const char        *pkey_list[CHRONOS_MAX_DATA_ITEMS_PER_XACT];
-  benchmark_xact_data_t data[CHRONOS_MAX_DATA_ITEMS_PER_XACT];
-  volatile int      *txn_done = NULL;
-  volatile int      *txn_rcP = NULL;
-  chronosRequestPacket_t request;
+  chronos_time_t    txn_exec_end;
+  chronos_time_t    txn_execution;
+  double            txn_execution_ms;
+  chronosCompletion_t *completion_arr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosRequestBuffer_t *requestBufArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosRequestBuffer_t *run_buf_arr[CHRONOS_PROCESS_BATCH_MAX];
+  chronos_time_t    run_deadline_arr[CHRONOS_PROCESS_BATCH_MAX];
   chronosUserTransaction_t txn_type;
 
   if (infoP == NULL || infoP->contextP == NULL) {
@@ -1304,106 +3501,156 @@ processUserTransaction(chronosServerThreadInfo_t *infoP)
     goto failXit;
   }
 
-  userTxnQueueP = &(infoP->contextP->userTxnQueue);
-
-  if (userTxnQueueP->occupied > 0) {
+  if (chronos_user_queue_size(infoP->contextP) > 0) {
     chronos_info("Processing user txn...");
 
-    rc = chronos_dequeue_user_transaction(&request, &txn_enqueue, &ticket, &txn_done, &txn_rcP, infoP->contextP);
-    if (rc != CHRONOS_SUCCESS) {
+    rc = chronos_dequeue_user_transactions(requestBufArr, txn_enqueue_arr, txn_deadline_arr, ticket_arr, completion_arr, 
+                                           infoP->contextP->processBatchSize, &num_txns,
+                                           infoP->contextP->processBatchMaxWaitUS,
+                                           infoP->thread_num, infoP->contextP);
+    if (rc == CHRONOS_QUEUE_EMPTY) {
+      /* Another thread got there first */
+      rc = CHRONOS_SUCCESS;
+      goto cleanup;
+    }
+    else if (rc != CHRONOS_SUCCESS) {
       chronos_error("Failed to dequeue a user transaction");
       goto failXit;
     }
 
-    txn_type = request.txn_type;
-    num_data_items = request.numItems;
+    /* The requests are read where they were decoded. 
+     * All of them are of the same type */
+    txn_type = requestBufArr[0]->request.txn_type;
+
+    /* Leave out the txns that cannot make it anymore */
+    for (i=0; i<num_txns; i++) {
+      if (userTransactionIsHopeless(txn_type, &txn_enqueue_arr[i], &txn_deadline_arr[i], infoP->contextP)) {
+        txn_rc_arr[i] = CHRONOS_TXN_RC_DROPPED;
+        continue;
+      }
+
+      run_idx_arr[num_run] = i;
+      run_buf_arr[num_run] = requestBufArr[i];
+      run_deadline_arr[num_run] = txn_deadline_arr[i];
+      num_run ++;
+    }
     
     CHRONOS_TIME_GET(txn_begin);
 
-    /* dispatch a transaction */
-    switch(txn_type) {
-
-    case CHRONOS_USER_TXN_VIEW_STOCK:
-      for (i=0; i<num_data_items; i++) {
-        pkey_list[i] = request.request_data.symbolInfo[i].symbol;
+    /* With the quote mirror, VIEW_STOCK does not need a shared BDB txn */
+    if (num_run > 1 && txn_type == CHRONOS_USER_TXN_VIEW_STOCK && !infoP->contextP->quoteMirrorEnabled) {
+      userTransactionsViewStock(run_buf_arr, run_deadline_arr, num_run, run_rc_arr, infoP->contextP);
+    }
+    else {
+      for (i=0; i<num_run; i++) {
+        run_rc_arr[i] = userTransactionExecute(&(run_buf_arr[i]->request), &run_deadline_arr[i], infoP->contextP);
       }
-      txn_rc = benchmark_view_stock2(num_data_items, pkey_list, infoP->contextP->benchmarkCtxtP);
-      break;
+    }
 
-    case CHRONOS_USER_TXN_VIEW_PORTFOLIO:
-      for (i=0; i<num_data_items; i++) {
-        pkey_list[i] = request.request_data.portfolioInfo[i].accountId;
+    CHRONOS_TIME_GET(txn_exec_end);
+
+    /* Keep track of how long each type of txn takes to run, for least slack 
+     * scheduling and for dropping hopeless txns. The txns of a batch share 
+     * its execution time. The wait for durability and the replies are left 
+     * out: they do not grow with the txn. */
+    if (CHRONOS_TXN_IS_VALID(txn_type)) {
+      if (num_run > 0) {
+        CHRONOS_TIME_NANO_OFFSET_GET(txn_begin, txn_exec_end, txn_execution);
+        txn_execution_ms = (txn_execution.tv_sec * 1000.0 + txn_execution.tv_nsec / 1000000.0) / num_run;
+        infoP->contextP->txnExecTimeMSArr[txn_type] = CHRONOS_EXEC_TIME_WEIGHT * txn_execution_ms
+                                                      + (1.0 - CHRONOS_EXEC_TIME_WEIGHT) * infoP->contextP->txnExecTimeMSArr[txn_type];
       }
-      txn_rc = benchmark_view_portfolio2(num_data_items, pkey_list, infoP->contextP->benchmarkCtxtP);
-      break;
+      else {
+        /* Nothing ran to refresh the estimate. Let it decay, or a type
+         * that was overestimated once would be dropped forever */
+        infoP->contextP->txnExecTimeMSArr[txn_type] *= (1.0 - CHRONOS_EXEC_TIME_WEIGHT);
+      }
+    }
 
-    case CHRONOS_USER_TXN_PURCHASE:
-      for (i=0; i<num_data_items; i++) {
-        memcpy(&(data[i]), &(request.request_data.purchaseInfo[i]), sizeof(data[i]));
+    /* Purchases and sales are only done once they are durable */
+    if (txn_type == CHRONOS_USER_TXN_PURCHASE || txn_type == CHRONOS_USER_TXN_SALE) {
+      for (i=0; i<num_run; i++) {
+        if (run_rc_arr[i] == CHRONOS_SUCCESS) {
+          break;
+        }
       }
-    
-      txn_rc = benchmark_purchase2(num_data_items, 
-                                   data,
-                                   infoP->contextP->benchmarkCtxtP);
-      break;
 
-    case CHRONOS_USER_TXN_SALE:
-      for (i=0; i<num_data_items; i++) {
-        memcpy(&(data[i]), &(request.request_data.sellInfo[i]), sizeof(data[i]));
+      if (i < num_run && groupCommitWait(infoP->contextP) != CHRONOS_SUCCESS) {
+        chronos_error("Failed to make the txns durable");
+        for (; i<num_run; i++) {
+          if (run_rc_arr[i] == CHRONOS_SUCCESS) {
+            run_rc_arr[i] = CHRONOS_FAIL;
+          }
+        }
       }
-    
-      txn_rc = benchmark_sell2(num_data_items, 
-                               data, 
-                               infoP->contextP->benchmarkCtxtP);
-      break;
+    }
 
-    default:
-      assert(0);
+    for (i=0; i<num_run; i++) {
+      txn_rc_arr[run_idx_arr[i]] = run_rc_arr[i];
     }
 
-    /* Notify waiter thread that this txn is done */
-    *txn_done = 1;
-    *txn_rcP = txn_rc;
-    chronos_info("Txn rc: %d", txn_rc);
+    requestBuffersRelease(requestBufArr, num_txns);
 
-    if (infoP->contextP->num_txn_to_wait > 0) {
-      chronos_warning("### [AC] Need to wait for: %d/%d transactions to finish ###", 
-                    infoP->contextP->num_txn_to_wait, 
-                    infoP->contextP->total_txns_enqueued);
-      infoP->contextP->num_txn_to_wait --;
+    /* Notify waiter threads that their txns are done */
+    for (i=0; i<num_txns; i++) {
+      if (chronosCompletionSignal(completion_arr[i], txn_rc_arr[i]) != CHRONOS_SUCCESS) {
+        chronos_error("Failed to signal txn completion");
+      }
+      chronos_info("Txn rc: %d", txn_rc_arr[i]);
+
+      if (infoP->contextP->admissionGate.debt > 0) {
+        chronos_warning("### [AC] Need to wait for: %d/%d transactions to finish ###", 
+                      infoP->contextP->admissionGate.debt, 
+                      infoP->contextP->total_txns_enqueued);
+      }
+      chronosAdmissionGateTxnDone(&infoP->contextP->admissionGate);
     }
 
     /*--------------------------------------------*/
 
 
     CHRONOS_TIME_GET(txn_end);
-   
-    ThreadTraceTxnElapsedTimePrint(&txn_enqueue, &txn_begin, &txn_end, txn_type, infoP);
+
+    for (i=0; i<num_txns; i++) {
+      ThreadTraceTxnElapsedTimePrint(&txn_enqueue_arr[i], &txn_begin, &txn_end, txn_type, infoP);
 
 #ifdef CHRONOS_SAMPLING_ENABLED
-    thread_num = infoP->thread_num;
-    current_slot = infoP->contextP->currentSlot;
-    statsP = &(infoP->contextP->stats_matrix[current_slot][thread_num]);
+      thread_num = infoP->thread_num;
+      current_slot = infoP->contextP->currentSlot;
+      statsP = &(infoP->contextP->stats_matrix[current_slot][thread_num]);
 
-    if (txn_rc == CHRONOS_SUCCESS) {
-      /* One more transasction finished */
-      statsP->num_txns ++;
+      if (txn_rc_arr[i] == CHRONOS_TXN_RC_DROPPED) {
+        statsP->num_dropped_txns ++;
+        chronos_info("User transaction dropped before running");
+      }
+      else if (txn_rc_arr[i] == CHRONOS_TXN_RC_ABORTED) {
+        statsP->num_aborted_txns ++;
+        chronos_info("User transaction aborted past its deadline");
+      }
+      else if (txn_rc_arr[i] == CHRONOS_SUCCESS) {
+        /* One more transasction finished */
+        statsP->num_txns ++;
+
+        CHRONOS_TIME_NANO_OFFSET_GET(txn_begin, txn_end, txn_duration);
+        txn_duration_ms = CHRONOS_TIME_TO_MS(txn_duration);
+        statsP->cumulative_time_ms += txn_duration_ms;
 
-      CHRONOS_TIME_NANO_OFFSET_GET(txn_begin, txn_end, txn_duration);
-      txn_duration_ms = CHRONOS_TIME_TO_MS(txn_duration);
-      statsP->cumulative_time_ms += txn_duration_ms;
+        if (txn_duration_ms <= infoP->contextP->desiredDelayBoundMS) {
+          statsP->num_timely_txns ++;
+        }
 
-      if (txn_duration_ms <= infoP->contextP->desiredDelayBoundMS) {
-        statsP->num_timely_txns ++;
+        if (CHRONOS_TIME_AFTER(txn_end, txn_deadline_arr[i])) {
+          statsP->num_missed_deadlines ++;
+        }
+        chronos_info("User transaction succeeded");
+      }
+      else {
+        statsP->num_failed_txns ++;
+        chronos_error("User transaction failed");
       }
-      chronos_info("User transaction succeeded");
-    }
-    else {
-      statsP->num_failed_txns ++;
-      chronos_error("User transaction failed");
-    }
 #endif
-    chronos_info("Done processing user txn...");
+    }
+    chronos_info("Done processing %d user txns...", num_txns);
   }
   goto cleanup;
 
@@ -1415,16 +3662,57 @@ cleanup:
 }
 #endif
 
+/* A quote to refresh, its position in the data items array,
+ * and the position of its txn in the dequeued batch */
+typedef struct refreshItem_t {
+  const char *pkey;
+  int         data_item;
+  int         txn_index;
+} refreshItem_t;
+
+static int
+refreshSymbolCompare(const void *aP, const void *bP)
+{
+  return strcmp(((const refreshItem_t *) aP)->pkey, ((const refreshItem_t *) bP)->pkey);
+}
+
+/*
+ * Make the refreshed quotes visible to VIEW_STOCK once they are committed
+ */
+static void
+refreshPublish(const refreshItem_t *refreshArr, const QUOTE *quoteArr, int num_quotes, chronosServerContext_t *contextP)
+{
+  int i;
+
+  if (!contextP->quoteMirrorEnabled) {
+    return;
+  }
+
+  for (i=0; i<num_quotes; i++) {
+    if (chronosQuoteMirrorPublish(&contextP->quoteMirror, refreshArr[i].data_item, &quoteArr[i]) != CHRONOS_SUCCESS) {
+      chronos_error("Failed to publish quote: %s", refreshArr[i].pkey);
+    }
+  }
+}
+
 static int
 processRefreshTransaction(chronosServerThreadInfo_t *infoP)
 {
   int               rc = CHRONOS_SUCCESS;
-  const char       *pkey = NULL;
+  int               i;
+  int               num_txns = 0;
+  int               num_failed = 0;
+  const char       *pkey_list[CHRONOS_PROCESS_BATCH_MAX];
+  refreshItem_t     refresh_arr[CHRONOS_PROCESS_BATCH_MAX];
+  int               refreshed_arr[CHRONOS_PROCESS_BATCH_MAX];
+  QUOTE             quote_arr[CHRONOS_PROCESS_BATCH_MAX];
+  QUOTE            *quote_list = NULL;
   chronosServerContext_t *contextP = NULL;
-  chronos_time_t    txn_enqueue;
+  chronos_time_t    txn_enqueue_arr[CHRONOS_PROCESS_BATCH_MAX];
   chronos_time_t    txn_begin;
   chronos_time_t    txn_end;
-  chronosRequestPacket_t request;
+  int               data_item;
+  chronosRequestBuffer_t *requestBufArr[CHRONOS_PROCESS_BATCH_MAX];
 
   if (infoP == NULL || infoP->contextP == NULL) {
     chronos_error("Invalid argument");
@@ -1438,82 +3726,104 @@ processRefreshTransaction(chronosServerThreadInfo_t *infoP)
 
   chronos_info("(thr: %d) Processing update...", infoP->thread_num);
 
-  rc = chronos_dequeue_system_transaction(&request, &txn_enqueue, contextP);
+  rc = chronos_dequeue_system_transactions(requestBufArr, txn_enqueue_arr, 
+                                           contextP->processBatchSize, &num_txns,
+                                           contextP->processBatchMaxWaitUS, contextP);
   if (rc != CHRONOS_SUCCESS) {
     chronos_error("Failed to dequeue a system transaction");
     goto failXit;
   }
 
-  pkey = request.request_data.symbolInfo[0].symbol;
-  assert(pkey != NULL);
-  chronos_debug(3, "Updating value for pkey: %s...", pkey);
+  /* The new quotes are only needed to publish them */
+  if (contextP->quoteMirrorEnabled) {
+    quote_list = quote_arr;
+  }
 
-  CHRONOS_TIME_GET(txn_begin);
-  if (benchmark_refresh_quotes2(contextP->benchmarkCtxtP, pkey, -1 /*Update randomly*/) != CHRONOS_SUCCESS) {
-    chronos_error("Failed to refresh quotes");
-    goto failXit;
+  for (i=0; i<num_txns; i++) {
+    refresh_arr[i].pkey = requestBufArr[i]->request.request_data.symbolInfo[0].symbol;
+    refresh_arr[i].txn_index = i;
+    assert(refresh_arr[i].pkey != NULL);
+    chronos_debug(3, "Updating value for pkey: %s...", refresh_arr[i].pkey);
+
+    /* From now on, a new refresh of this item has to be queued */
+    data_item = requestBufArr[i]->request.request_data.symbolInfo[0].symbolId;
+    refresh_arr[i].data_item = data_item;
+    if (0 <= data_item && data_item < contextP->szDataItemsArray) {
+      __sync_lock_release(&(contextP->dataItemsArray[data_item].refreshPending));
+    }
   }
-  CHRONOS_TIME_GET(txn_end);
 
-  chronos_info("(thr: %d) Done processing update...", infoP->thread_num);
-  if (infoP->contextP->num_txn_to_wait > 0) {
-    chronos_warning("### [AC] Need to wait for: %d/%d transactions to finish ###", 
-                 contextP->num_txn_to_wait, 
-                 contextP->total_txns_enqueued);
-    infoP->contextP->num_txn_to_wait --;
+  CHRONOS_TIME_GET(txn_begin);
+  if (num_txns == 1) {
+    rc = benchmark_refresh_quotes2(contextP->benchmarkCtxtP, refresh_arr[0].pkey, -1 /*Update randomly*/, quote_list);
+    refreshed_arr[0] = (rc == CHRONOS_SUCCESS);
   }
+  else {
+    /* Lock the quotes always in the same order, so that 
+     * concurrent batches do not deadlock each other */
+    qsort(refresh_arr, num_txns, sizeof(refresh_arr[0]), refreshSymbolCompare);
+    for (i=0; i<num_txns; i++) {
+      pkey_list[i] = refresh_arr[i].pkey;
+    }
 
-  ThreadTraceTxnElapsedTimePrint(&txn_enqueue, &txn_begin, &txn_end, -1, infoP);
+    rc = benchmark_refresh_quotes_list(contextP->benchmarkCtxtP, num_txns, pkey_list, -1 /*Update randomly*/, quote_list);
+    for (i=0; i<num_txns; i++) {
+      refreshed_arr[i] = (rc == CHRONOS_SUCCESS);
+    }
 
-#if 0
-  int               i;
-  int               data_item = 0;
-  int               current_slot = 0;
-  chronos_queue_t  *sysTxnQueueP = NULL;
-  chronosUserTransaction_t txn_type;
-  txn_info_t       *txnInfoP     = NULL;
-  sysTxnQueueP = &(infoP->contextP->sysTxnQueue);
+    if (rc != CHRONOS_SUCCESS) {
+      /* Nothing was refreshed. Try them one by one */
+      for (i=0; i<num_txns; i++) {
+        rc = benchmark_refresh_quotes2(contextP->benchmarkCtxtP, pkey_list[i], -1 /*Update randomly*/, 
+                                       quote_list != NULL ? &quote_list[i] : NULL);
+        refreshed_arr[i] = (rc == CHRONOS_SUCCESS);
+      }
+    }
+  }
 
-  if (sysTxnQueueP->occupied > 0) {
-    chronos_info("Processing update...");
-    
-    current_slot = infoP->contextP->currentSlot;
-    txnInfoP = dequeueTransaction(sysTxnQueueP);
-    txn_type = txnInfoP->txn_type;
-    assert(txn_type == CHRONOS_USER_TXN_VIEW_STOCK);
-
-    if (IS_CHRONOS_MODE_BASE(infoP->contextP) || IS_CHRONOS_MODE_AC(infoP->contextP)) {
-      for (i=0; i<BENCHMARK_NUM_SYMBOLS; i++){
-        data_item = i;
-        if (benchmark_refresh_quotes(infoP->contextP->benchmarkCtxtP, &data_item, 0) != CHRONOS_SUCCESS) {
-          chronos_error("Failed to refresh quotes");
-          goto failXit;
-        }
+  for (i=0; i<num_txns; i++) {
+    num_failed += !refreshed_arr[i];
+  }
 
-        if (data_item >= 0) {
-          infoP->contextP->UpdateFrequency[current_slot][data_item] ++;
-        }
+  /* The new quotes are published once they are durable */
+  if (num_failed < num_txns && groupCommitWait(contextP) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to make the refreshes durable");
+    for (i=0; i<num_txns; i++) {
+      refreshed_arr[i] = 0;
+    }
+    num_failed = num_txns;
+  }
+  else {
+    for (i=0; i<num_txns; i++) {
+      if (refreshed_arr[i]) {
+        refreshPublish(&refresh_arr[i], &quote_arr[i], 1, contextP);
       }
     }
-    else {
-      for (i=0; i<BENCHMARK_NUM_SYMBOLS; i++){
-        if (infoP->contextP->AccessUpdateRatio[current_slot][i] >= 1) {
-          data_item = i;
-          if (benchmark_refresh_quotes(infoP->contextP->benchmarkCtxtP, &data_item, 0) != CHRONOS_SUCCESS) {
-            chronos_error("Failed to refresh quotes");
-            goto failXit;
-          }
+  }
+  requestBuffersRelease(requestBufArr, num_txns);
+  CHRONOS_TIME_GET(txn_end);
 
-          if (data_item >= 0) {
-            infoP->contextP->UpdateFrequency[current_slot][data_item] ++;
-          }
-        }
-      }
+  /* Failed refreshes are done too, as far as the admission gate is 
+   * concerned. Only the ones that made it are traced */
+  chronos_info("(thr: %d) Done processing %d updates...", infoP->thread_num, num_txns);
+  for (i=0; i<num_txns; i++) {
+    if (contextP->admissionGate.debt > 0) {
+      chronos_warning("### [AC] Need to wait for: %d/%d transactions to finish ###", 
+                   contextP->admissionGate.debt, 
+                   contextP->total_txns_enqueued);
     }
-    
-    infoP->contextP->txn_update[current_slot] += 1;
+    chronosAdmissionGateTxnDone(&contextP->admissionGate);
+
+    if (refreshed_arr[i]) {
+      ThreadTraceTxnElapsedTimePrint(&txn_enqueue_arr[refresh_arr[i].txn_index], &txn_begin, &txn_end, -1, infoP);
+    }
+  }
+
+  if (num_failed > 0) {
+    chronos_error("Failed to refresh %d quotes", num_failed);
+    goto failXit;
+  }
 
-#endif
   goto cleanup;
 
 failXit:
@@ -1544,12 +3854,14 @@ processThread(void *argP)
   /* Give update transactions more priority */
   /* TODO: Add scheduling technique */
   while (!time_to_die) {
+    int idle = 1;
 
     CHRONOS_SERVER_THREAD_CHECK(infoP);
     CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
 
 #ifdef CHRONOS_UPDATE_TRANSACTIONS_ENABLED
-    if (infoP->contextP->sysTxnQueue.occupied > 0) {
+    if (chronos_queue_size(&infoP->contextP->sysTxnQueue) > 0) {
+      idle = 0;
       /*-------- Process refresh transaction ----------*/
       if (processRefreshTransaction(infoP) != CHRONOS_SUCCESS) {
         chronos_info("Failed to execute refresh transactions");
@@ -1562,7 +3874,8 @@ processThread(void *argP)
     CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
     
 #ifdef CHRONOS_USER_TRANSACTIONS_ENABLED
-    if (infoP->contextP->userTxnQueue.occupied > 0) {
+    if (chronos_user_queue_size(infoP->contextP) > 0) {
+      idle = 0;
       /*-------- Process user transaction ----------*/
       if (processUserTransaction(infoP) != CHRONOS_SUCCESS) {
         chronos_info("Failed to execute refresh transactions");
@@ -1571,6 +3884,11 @@ processThread(void *argP)
     }
 #endif
 
+    /* Sleep instead of polling the queues */
+    if (idle) {
+      (void) chronos_queue_wait_for_work(infoP->contextP);
+    }
+
   }
   
 cleanup:
@@ -1582,22 +3900,77 @@ cleanup:
 }
 
 /*
- * This is the driver function of an update thread
+ * Queue a refresh of a data item, unless one is queued already
+ */
+static int
+updateDataItemRefresh(chronosDataItem_t *dataItemP, chronosServerThreadInfo_t *infoP)
+{
+  int   index = dataItemP->index;
+  char *pkey = dataItemP->dataItem;
+  chronos_time_t   txn_enqueue;
+  chronosRequestBuffer_t *requestBufP = NULL;
+  chronosRequestPacket_t *requestP = NULL;
+  chronosServerContext_t *contextP = infoP->contextP;
+
+  /* A refresh of this item is still in the queue. Only the
+   * latest value matters, so that one will do for both */
+  if (!__sync_bool_compare_and_swap(&dataItemP->refreshPending, 0, 1)) {
+    chronos_debug(3, "(thr: %d) Update for key: %d, %s is already queued", 
+                  infoP->thread_num, index, pkey);
+    __sync_fetch_and_add(&contextP->numCoalescedRefreshes, 1);
+    return CHRONOS_SUCCESS;
+  }
+
+  requestBufP = chronosRequestBufferAlloc(&contextP->requestPool);
+  if (requestBufP == NULL) {
+    chronos_error("(thr: %d) Could not allocate a refresh of key: %d, %s", infoP->thread_num, index, pkey);
+    dataItemP->refreshPending = 0;
+    return CHRONOS_FAIL;
+  }
+  requestP = &(requestBufP->request);
+  requestP->txn_type = CHRONOS_USER_TXN_MAX; /* represents sys xact */
+  requestP->numItems = 1;
+  requestP->request_data.symbolInfo[0].symbolId = index;
+  strncpy(requestP->request_data.symbolInfo[0].symbol, pkey, sizeof(requestP->request_data.symbolInfo[0].symbol));
+  chronos_debug(3, "(thr: %d) (%llu) Enqueuing update for key: %d, %s", 
+                infoP->thread_num, 
+                dataItemP->nextUpdateTimeMS,
+                index,
+                pkey);
+  CHRONOS_TIME_GET(txn_enqueue);
+  if (chronos_enqueue_system_transaction(requestBufP, &txn_enqueue, contextP) != CHRONOS_SUCCESS) {
+    chronos_error("(thr: %d) Could not enqueue the refresh of key: %d, %s", infoP->thread_num, index, pkey);
+    chronosRequestBufferRelease(requestBufP);
+    dataItemP->refreshPending = 0;
+    return CHRONOS_FAIL;
+  }
+
+  return CHRONOS_SUCCESS;
+}
+
+/*
+ * This is the driver function of an update thread. Its data items
+ * are kept in a timer heap keyed on their next update time, and
+ * the thread sleeps on a timerfd until the earliest one is due.
  */
 static void *
 updateThread(void *argP) 
 {
   int    i;
+  int    timer_fd = -1;
   int    num_updates = 0;
   chronosDataItem_t *dataItemArray =  NULL;
+  chronosDataItem_t *dataItemP = NULL;
+  chronosHeap_t      timerHeap;
   volatile int current_slot;
-  chronos_time_t   txn_enqueue;
   chronos_time_t   current_time;
   unsigned long long current_time_ms;
-  chronos_time_t   next_update_time;
-  unsigned long long next_update_time_ms;
+  unsigned long long due_time_ms;
+  unsigned long long wakeup_time_ms;
+  unsigned long long expirations;
   chronosServerThreadInfo_t *infoP = (chronosServerThreadInfo_t *) argP;
-  chronosServerContext_t *contextP = NULL;
+
+  memset(&timerHeap, 0, sizeof(timerHeap));
 
   if (infoP == NULL || infoP->contextP == NULL) {
     chronos_error("Invalid argument");
@@ -1607,63 +3980,93 @@ updateThread(void *argP)
   CHRONOS_SERVER_THREAD_CHECK(infoP);
   CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
 
-  contextP = infoP->contextP;
-
   num_updates = infoP->parameters.updateParameters.num_stocks;
   assert(num_updates > 0);
 
   dataItemArray = infoP->parameters.updateParameters.dataItemsArray;
   assert(dataItemArray != NULL);
 
+  if (chronosHeapInit(&timerHeap, num_updates) != CHRONOS_SUCCESS) {
+    chronos_error("Failed to init timer heap");
+    goto cleanup;
+  }
+
+  for (i=0; i<num_updates; i++) {
+    if (chronosHeapInsert(&timerHeap, dataItemArray[i].nextUpdateTimeMS, &dataItemArray[i]) != CHRONOS_SUCCESS) {
+      goto cleanup;
+    }
+  }
+
+  timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+  if (timer_fd < 0) {
+    perror("timerfd_create() failed");
+    goto cleanup;
+  }
+
   while (1) {
     CHRONOS_SERVER_THREAD_CHECK(infoP);
     CHRONOS_SERVER_CTX_CHECK(infoP->contextP);
 
-
     CHRONOS_TIME_GET(current_time);
     current_time_ms = CHRONOS_TIME_TO_MS(current_time);
 
-    for (i=0; i<num_updates; i++) {
-
-      if (dataItemArray[i].nextUpdateTimeMS <= current_time_ms) {
-        int   index = dataItemArray[i].index;
-        char *pkey = dataItemArray[i].dataItem;
-        chronosRequestPacket_t request;
-        request.txn_type = CHRONOS_USER_TXN_MAX; /* represents sys xact */
-        request.numItems = 1;
-        strncpy(request.request_data.symbolInfo[0].symbol, pkey, sizeof(request.request_data.symbolInfo[0].symbol));
-        chronos_debug(3, "(thr: %d) (%llu <= %llu) [%d] Enqueuing update for key: %d, %s", 
-                      infoP->thread_num, 
-                      dataItemArray[i].nextUpdateTimeMS,
-                      current_time_ms,
-                      i,
-                      index,
-                      pkey);
-        CHRONOS_TIME_GET(txn_enqueue);
-        chronos_enqueue_system_transaction(&request, &txn_enqueue, contextP);
-
-        current_slot = infoP->contextP->currentSlot;
-        dataItemArray[i].updateFrequency[current_slot]++;
-
-        CHRONOS_TIME_GET(next_update_time);
-        next_update_time_ms = CHRONOS_TIME_TO_MS(next_update_time);
-        dataItemArray[i].nextUpdateTimeMS = next_update_time_ms + dataItemArray[i].updatePeriodMS[current_slot];
-        chronos_debug(3, "(thr: %d) %d next update time: %llu", 
-                          infoP->thread_num, i, dataItemArray[i].nextUpdateTimeMS);
+    while (chronosHeapPeek(&timerHeap, &due_time_ms, NULL) == CHRONOS_SUCCESS
+           && due_time_ms <= current_time_ms) {
+
+      (void) chronosHeapRemoveMin(&timerHeap, NULL, (void **) &dataItemP);
+
+      if (updateDataItemRefresh(dataItemP, infoP) != CHRONOS_SUCCESS) {
+        goto cleanup;
       }
-    }
 
-    if (waitPeriod(100) != CHRONOS_SUCCESS) {
-      goto cleanup;
+      current_slot = infoP->contextP->currentSlot;
+      dataItemP->updateFrequency[current_slot]++;
+
+      /* Keep to the period rather than to when we woke up,
+       * unless a whole period was missed */
+      dataItemP->nextUpdateTimeMS = due_time_ms + dataItemP->updatePeriodMS[current_slot];
+      if (dataItemP->nextUpdateTimeMS <= current_time_ms) {
+        dataItemP->nextUpdateTimeMS = current_time_ms + dataItemP->updatePeriodMS[current_slot];
+      }
+      chronos_debug(3, "(thr: %d) %d next update time: %llu", 
+                        infoP->thread_num, dataItemP->index, dataItemP->nextUpdateTimeMS);
+
+      if (chronosHeapInsert(&timerHeap, dataItemP->nextUpdateTimeMS, dataItemP) != CHRONOS_SUCCESS) {
+        goto cleanup;
+      }
     }
 
     if (time_to_die == 1) {
       chronos_info("Requested to die");
       goto cleanup;
     }
+
+    /* Wake up at least once per second to check whether it is time to die */
+    wakeup_time_ms = current_time_ms + SEC_TO_MSEC;
+    if (chronosHeapPeek(&timerHeap, &due_time_ms, NULL) == CHRONOS_SUCCESS
+        && due_time_ms < wakeup_time_ms) {
+      wakeup_time_ms = due_time_ms;
+    }
+
+    if (updateTimerArm(timer_fd, wakeup_time_ms) != CHRONOS_SUCCESS) {
+      goto cleanup;
+    }
+
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EINTR) {
+      perror("read() from timerfd failed");
+      goto cleanup;
+    }
   }
 
 cleanup:
+  if (timer_fd >= 0) {
+    close(timer_fd);
+  }
+
+  if (timerHeap.entries != NULL) {
+    chronosHeapDestroy(&timerHeap);
+  }
+
   chronos_info("updateThread exiting");
   pthread_exit(NULL);
 }
@@ -1699,7 +4102,7 @@ createSamplingTimer(chronosServerContext_t *serverContextP)
   serverContextP->sampling_timer_ev.sigev_notify = SIGEV_THREAD;
   serverContextP->sampling_timer_ev.sigev_value.sival_ptr = serverContextP;
   serverContextP->sampling_timer_ev.sigev_notify_function = (void *)handler_sampling;
-  serverContextP->sampling_timer_ev.sigev_notify_attributes = NULL;
+  serverContextP->sampling_timer_ev.sigev_notify_attributes = chronosPlacementAttrGet(serverContextP->placementP, CHRONOS_PLACEMENT_SAMPLING);
 
   serverContextP->sampling_timer_et.it_interval.tv_sec = serverContextP->samplingPeriodSec;
   serverContextP->sampling_timer_et.it_interval.tv_nsec = 0;  
@@ -1787,7 +4190,7 @@ cleanup:
 static void
 chronos_usage() 
 {
-  char usage[1024];
+  char usage[4096];
   char template[] =
     "Usage: startup_server OPTIONS\n"
     "Starts up a chronos server \n"
@@ -1797,16 +4200,46 @@ chronos_usage()
     "-c [num]              number of clients it can accept (default: %d)\n"
     "-v [num]              validity interval [in milliseconds] (default: %d ms)\n"
     "-s [num]              sampling period [in seconds] (default: %d seconds)\n"
-    "-u [num]              number of update threads (default: %d)\n"
+    "-u [num]              number of update threads. Each one schedules the refreshes of\n"
+    "                      an equal slice of the stocks (default: %d)\n"
     "-r [num]              duration of the experiment [in seconds] (default: %d seconds)\n"
     "-p [num]              port to accept new connections (default: %d)\n"
+    "-a [address]          address to listen on: an ip address, unix:/path for a unix\n"
+    "                      domain socket or shm:/path for shared memory (default: %s)\n"
     "-d [num]              debug level\n"
+    "-e [num]              number of epoll network threads serving the clients (default: %d, one thread per client)\n"
+    "-q [0|1]              1: lock-free ready queues, 0: queues protected by a mutex (default: %d)\n"
+    "-S [num]              user txn scheduling: 0: FIFO, 1: earliest deadline first,\n"
+    "                      2: least slack first (default: %d)\n"
+    "-k [num]              number of user txn queues, 0 for one per core. Idle processing\n"
+    "                      threads steal txns from the other queues (default: %d)\n"
+    "-B [num]              number of queued txns of the same type a processing thread takes\n"
+    "                      at once. Refreshes and VIEW_STOCK reads share a transaction (default: %d)\n"
+    "-W [num]              microseconds to wait for a batch to fill (default: %d)\n"
+    "-F                    firm deadlines: drop user txns that cannot meet their deadline,\n"
+    "                      and abort the ones still running when it passes\n"
+    "-R                    each network thread gets its own listening socket (SO_REUSEPORT)\n"
+    "-M                    serve VIEW_STOCK from an in-memory copy of the quotes, which\n"
+    "                      refreshes update after they commit (default: read from BDB)\n"
+    "-I [num]              read-only txns that run on a snapshot (MVCC) instead of taking\n"
+    "                      read locks: 1: VIEW_STOCK, 2: VIEW_PORTFOLIO, 3: both (default: %d)\n"
+    "-G [num]              group commit: refreshes, purchases and sales commit without flushing\n"
+    "                      the log, and a flusher thread waits up to this many microseconds\n"
+    "                      to flush for several of them at once. -1 to disable (default: %d)\n"
+    "-g [num]              pending commits that make the flusher flush at once (default: %d)\n"
+    "-P [spec|@file]       CPUs of each class of thread, e.g. listener=0;network=1-3;\n"
+    "                      processing=4-31;update=32;sampling=32;numa. With numa, processing\n"
+    "                      threads stay on the NUMA node of the BDB cache\n"
     "-n                    do not perform initial load\n"
     "-h                    help";
 
   snprintf(usage, sizeof(usage), template, 
           CHRONOS_NUM_CLIENT_THREADS, CHRONOS_INITIAL_VALIDITY_INTERVAL_MS, CHRONOS_SAMPLING_PERIOD_SEC,
-          CHRONOS_NUM_UPDATE_THREADS, (int)CHRONOS_EXPERIMENT_DURATION_SEC, CHRONOS_SERVER_PORT);
+          CHRONOS_NUM_UPDATE_SCHEDULER_THREADS, (int)CHRONOS_EXPERIMENT_DURATION_SEC, CHRONOS_SERVER_PORT,
+          CHRONOS_SERVER_ADDRESS, CHRONOS_NUM_NETWORK_THREADS, CHRONOS_LOCK_FREE_QUEUE_DEFAULT,
+          CHRONOS_QUEUE_DISCIPLINE_DEFAULT, CHRONOS_NUM_USER_QUEUES, CHRONOS_PROCESS_BATCH_SIZE,
+          CHRONOS_PROCESS_BATCH_MAX_WAIT_US, CHRONOS_SNAPSHOT_XACTS_DEFAULT,
+          CHRONOS_GROUP_COMMIT_WINDOW_US, CHRONOS_GROUP_COMMIT_BATCH_SIZE);
 
   printf("%s\n", usage);
 }
@@ -65,6 +65,12 @@ benchmark_handle_alloc(void **benchmark_handle,
       goto failXit;
     }
 
+    if (migrate_portfolio_database(benchmarkP) != BENCHMARK_SUCCESS) {
+      benchmark_error("Could not migrate Portfolios table.");
+      databases_close(benchmarkP);
+      goto failXit;
+    }
+
     if (benchmark_portfolios_stats_get(benchmarkP) != BENCHMARK_SUCCESS) {
       benchmark_error("Could not obtain list of portfolios.");
       databases_close(benchmarkP);
@@ -113,7 +119,6 @@ benchmark_handle_free(void *benchmark_handle)
   free(benchmarkP->quotes_db_name);
   free(benchmarkP->quotes_hist_db_name);
   free(benchmarkP->portfolios_db_name);
-  free(benchmarkP->portfolios_sdb_name);
   free(benchmarkP->accounts_db_name);
   free(benchmarkP->currencies_db_name);
   free(benchmarkP->personal_db_name);
@@ -161,7 +166,7 @@ benchmark_view_stock(void *benchmark_handle, int *symbolP)
 #if 0
   ret = show_stocks_records(random_symbol, benchmarkP);
 #endif
-  ret = show_quote(random_symbol, NULL, benchmarkP);
+  ret = show_quote(random_symbol, NULL, NULL, benchmarkP);
 
   if (symbolP != NULL) {
     *symbolP = symbol;
@@ -179,12 +184,11 @@ benchmark_view_stock(void *benchmark_handle, int *symbolP)
   return BENCHMARK_FAIL;
 }
 
-int
-benchmark_view_stock2(int num_symbols, const char **symbol_list_P, void *benchmark_handle)
+static int
+view_stock_list(int num_symbols, const char **symbol_list_P, QUOTE *quote_list_ret, void *benchmark_handle)
 {
   BENCHMARK_DBS *benchmarkP = NULL;
   benchmark_xact_h xactH = NULL;
-  int i;
   int ret;
 
   benchmarkP = benchmark_handle;
@@ -194,19 +198,16 @@ benchmark_view_stock2(int num_symbols, const char **symbol_list_P, void *benchma
   
   BENCHMARK_CHECK_MAGIC(benchmarkP);
 
-  ret = start_xact(&xactH, "VIEW_STOCK_TXN", benchmarkP);
+  ret = start_read_xact(&xactH, "VIEW_STOCK_TXN", BENCHMARK_SNAPSHOT_VIEW_STOCK, benchmarkP);
   if (ret != BENCHMARK_SUCCESS) {
     goto failXit;
   }
 
   benchmark_debug(2, "Showing quotes for: %d symbols", num_symbols);
 
-  for (i=0; i<num_symbols; i++) {
-    benchmark_debug(2, "Showing quote for symbol: %s", symbol_list_P[i]);
-    ret = show_quote((char *)symbol_list_P[i], xactH, benchmarkP);
-    if (ret != BENCHMARK_SUCCESS) {
-      goto failXit;
-    }
+  ret = get_quotes(num_symbols, symbol_list_P, quote_list_ret, xactH, benchmarkP);
+  if (ret != BENCHMARK_SUCCESS) {
+    goto failXit;
   }
 
   ret = commit_xact(xactH, benchmarkP);
@@ -225,3 +226,23 @@ benchmark_view_stock2(int num_symbols, const char **symbol_list_P, void *benchma
 
   return BENCHMARK_FAIL;
 }
+
+int
+benchmark_view_stock2(int num_symbols, const char **symbol_list_P, void *benchmark_handle)
+{
+  return view_stock_list(num_symbols, symbol_list_P, NULL, benchmark_handle);
+}
+
+/*
+ * Read several quotes under a single transaction
+ */
+int
+benchmark_quote_list_get(void *benchmark_handle, int num_symbols, const char **symbol_list_P, QUOTE *quote_list_ret)
+{
+  if (quote_list_ret == NULL) {
+    benchmark_error("Invalid arguments");
+    return BENCHMARK_FAIL;
+  }
+
+  return view_stock_list(num_symbols, symbol_list_P, quote_list_ret, benchmark_handle);
+}
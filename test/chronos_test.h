@@ -0,0 +1,32 @@
+#ifndef _CHRONOS_TEST_H_
+#define _CHRONOS_TEST_H_
+
+#include <stdio.h>
+
+/*
+ * Checks for the unit tests in this directory. A failed check is
+ * reported and counted, and the test goes on. Each test program
+ * defines chronos_test_failures and exits with CHRONOS_TEST_RESULT().
+ */
+extern int chronos_test_failures;
+
+#define CHRONOS_TEST_CHECK(_cond) \
+  do {                                                                  \
+    if (!(_cond)) {                                                     \
+      fprintf(stderr, "FAIL: %s at %s:%d\n", #_cond, __FILE__, __LINE__); \
+      chronos_test_failures ++;                                         \
+    }                                                                   \
+  } while(0)
+
+#define CHRONOS_TEST_RUN(_test) \
+  do {                                                                  \
+    int _failures_ = chronos_test_failures;                             \
+    _test();                                                            \
+    fprintf(stderr, "%s: %s\n", #_test,                                 \
+            chronos_test_failures == _failures_ ? "ok" : "FAILED");     \
+  } while(0)
+
+#define CHRONOS_TEST_RESULT() \
+  (chronos_test_failures == 0 ? 0 : 1)
+
+#endif
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "chronos.h"
+#include "chronos_completion.h"
+#include "chronos_test.h"
+
+int chronos_debug_level = CHRONOS_DEBUG_LEVEL_MIN;
+int chronos_test_failures = 0;
+
+#define TEST_GATE_NUM_WAITERS  (3)
+#define TEST_GATE_STACK_SIZE   (256 * 1024)
+#define TEST_GATE_NUM_THREADS  (4)
+#define TEST_GATE_DEBT         (1000)
+
+static void
+testSleepMS(int ms)
+{
+  usleep(ms * 1000);
+}
+
+static void *
+completionSignaler(void *argP)
+{
+  testSleepMS(50);
+  chronosCompletionSignal((chronosCompletion_t *) argP, 42);
+  return NULL;
+}
+
+static void
+testCompletion()
+{
+  int                 rc = 0;
+  int                 notify_pipe[2];
+  void               *notify_arg = NULL;
+  pthread_t           thread;
+  chronosCompletion_t completion;
+
+  /* Signaled before anyone waits */
+  CHRONOS_TEST_CHECK(chronosCompletionInit(&completion, -1, NULL) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosCompletionSignal(&completion, 7) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosCompletionWait(&completion, &rc) == CHRONOS_SUCCESS && rc == 7);
+
+  /* Signaled while the submitter sleeps */
+  CHRONOS_TEST_CHECK(chronosCompletionInit(&completion, -1, NULL) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(pthread_create(&thread, NULL, completionSignaler, &completion) == 0);
+  CHRONOS_TEST_CHECK(chronosCompletionWait(&completion, &rc) == CHRONOS_SUCCESS && rc == 42);
+  pthread_join(thread, NULL);
+
+  /* Reported through a descriptor, as network threads get it */
+  CHRONOS_TEST_CHECK(pipe(notify_pipe) == 0);
+  CHRONOS_TEST_CHECK(chronosCompletionInit(&completion, notify_pipe[1], &completion) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosCompletionSignal(&completion, 3) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(read(notify_pipe[0], &notify_arg, sizeof(notify_arg)) == sizeof(notify_arg));
+  CHRONOS_TEST_CHECK(notify_arg == &completion);
+  CHRONOS_TEST_CHECK(chronosCompletionResultGet(&completion) == 3);
+  close(notify_pipe[0]);
+  close(notify_pipe[1]);
+}
+
+/*
+ * Each waiter thread runs on a stack of ours, so that we can tell
+ * which thread a queued waiter entry belongs to
+ */
+typedef struct gateWaiterThread_t {
+  chronosAdmissionGate_t *gateP;
+  int                     id;
+  volatile int            rc;
+  volatile int            done;
+  char                   *stackP;
+  pthread_t               thread;
+} gateWaiterThread_t;
+
+static volatile int gateLeaveArr[TEST_GATE_NUM_WAITERS];
+static __thread int gateWaiterId = -1;
+
+static int
+gateWaiterIsTimeToDie()
+{
+  return gateWaiterId >= 0 && gateLeaveArr[gateWaiterId];
+}
+
+static void *
+gateWaiter(void *argP)
+{
+  gateWaiterThread_t *waiterP = (gateWaiterThread_t *) argP;
+
+  gateWaiterId = waiterP->id;
+  waiterP->rc = chronosAdmissionGateEnter(waiterP->gateP, gateWaiterIsTimeToDie);
+  waiterP->done = 1;
+
+  return NULL;
+}
+
+/*
+ * Which waiter thread owns the queued entry, -1 if none
+ */
+static int
+gateWaiterOwner(const chronosAdmissionWaiter_t *entryP, gateWaiterThread_t *threadArr)
+{
+  int i;
+
+  for (i=0; i<TEST_GATE_NUM_WAITERS; i++) {
+    if ((const char *) entryP >= threadArr[i].stackP
+        && (const char *) entryP < threadArr[i].stackP + TEST_GATE_STACK_SIZE) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static void
+gateWaitForWaiters(chronosAdmissionGate_t *gateP, int numWaiters)
+{
+  int i;
+
+  for (i=0; i<1000 && gateP->numWaiters != numWaiters; i++) {
+    testSleepMS(1);
+  }
+}
+
+/*
+ * Blocked submitters queue up in arrival order, and one that gives up
+ * leaves the others in place. Nobody gets in before the debt is paid.
+ */
+static void
+testGateFifo()
+{
+  int                       i;
+  chronosAdmissionGate_t    gate;
+  chronosAdmissionWaiter_t *entryP = NULL;
+  gateWaiterThread_t        threadArr[TEST_GATE_NUM_WAITERS];
+  pthread_attr_t            attr;
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateInit(&gate) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateSet(&gate, 3) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(!chronosAdmissionGateTryEnter(&gate));
+
+  for (i=0; i<TEST_GATE_NUM_WAITERS; i++) {
+    threadArr[i].gateP = &gate;
+    threadArr[i].id = i;
+    threadArr[i].rc = -1;
+    threadArr[i].done = 0;
+    threadArr[i].stackP = malloc(TEST_GATE_STACK_SIZE);
+    gateLeaveArr[i] = 0;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, threadArr[i].stackP, TEST_GATE_STACK_SIZE);
+    CHRONOS_TEST_CHECK(pthread_create(&threadArr[i].thread, &attr, gateWaiter, &threadArr[i]) == 0);
+    pthread_attr_destroy(&attr);
+
+    /* The next one arrives after this one is queued */
+    gateWaitForWaiters(&gate, i + 1);
+  }
+
+  pthread_mutex_lock(&gate.mutex);
+  for (i=0, entryP=gate.headP; entryP != NULL; i++, entryP=entryP->nextP) {
+    CHRONOS_TEST_CHECK(gateWaiterOwner(entryP, threadArr) == i);
+  }
+  CHRONOS_TEST_CHECK(i == TEST_GATE_NUM_WAITERS);
+  pthread_mutex_unlock(&gate.mutex);
+
+  /* The one in the middle gives up */
+  gateLeaveArr[1] = 1;
+  pthread_join(threadArr[1].thread, NULL);
+  CHRONOS_TEST_CHECK(threadArr[1].rc == CHRONOS_FAIL);
+  CHRONOS_TEST_CHECK(gate.numWaiters == TEST_GATE_NUM_WAITERS - 1);
+
+  pthread_mutex_lock(&gate.mutex);
+  CHRONOS_TEST_CHECK(gateWaiterOwner(gate.headP, threadArr) == 0);
+  CHRONOS_TEST_CHECK(gate.headP != NULL && gateWaiterOwner(gate.headP->nextP, threadArr) == 2);
+  CHRONOS_TEST_CHECK(gate.tailP != NULL && gateWaiterOwner(gate.tailP, threadArr) == 2);
+  pthread_mutex_unlock(&gate.mutex);
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTxnDone(&gate) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTxnDone(&gate) == CHRONOS_SUCCESS);
+  testSleepMS(20);
+  CHRONOS_TEST_CHECK(!threadArr[0].done && !threadArr[2].done);
+
+  /* The last txn of the debt lets everybody in */
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTxnDone(&gate) == CHRONOS_SUCCESS);
+  pthread_join(threadArr[0].thread, NULL);
+  pthread_join(threadArr[2].thread, NULL);
+  CHRONOS_TEST_CHECK(threadArr[0].rc == CHRONOS_SUCCESS && threadArr[2].rc == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(gate.numWaiters == 0 && gate.headP == NULL && gate.tailP == NULL);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTryEnter(&gate));
+
+  for (i=0; i<TEST_GATE_NUM_WAITERS; i++) {
+    free(threadArr[i].stackP);
+  }
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateDestroy(&gate) == CHRONOS_SUCCESS);
+}
+
+static void *
+gateTxnDoneWorker(void *argP)
+{
+  int i;
+
+  for (i=0; i<TEST_GATE_DEBT / TEST_GATE_NUM_THREADS; i++) {
+    chronosAdmissionGateTxnDone((chronosAdmissionGate_t *) argP);
+  }
+
+  return NULL;
+}
+
+/*
+ * Every finished txn pays off exactly one unit of debt, and the
+ * debt never goes below zero
+ */
+static void
+testGateDebt()
+{
+  int                    i;
+  pthread_t              threadArr[TEST_GATE_NUM_THREADS];
+  chronosAdmissionGate_t gate;
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateInit(&gate) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTryEnter(&gate));
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateSet(&gate, TEST_GATE_DEBT + 1) == CHRONOS_SUCCESS);
+
+  for (i=0; i<TEST_GATE_NUM_THREADS; i++) {
+    CHRONOS_TEST_CHECK(pthread_create(&threadArr[i], NULL, gateTxnDoneWorker, &gate) == 0);
+  }
+  for (i=0; i<TEST_GATE_NUM_THREADS; i++) {
+    pthread_join(threadArr[i], NULL);
+  }
+
+  CHRONOS_TEST_CHECK(gate.debt == 1);
+  CHRONOS_TEST_CHECK(!chronosAdmissionGateTryEnter(&gate));
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTxnDone(&gate) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(gate.debt == 0);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTxnDone(&gate) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(gate.debt == 0);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTryEnter(&gate));
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateSet(&gate, -5) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(gate.debt == 0);
+
+  /* Nobody waits at an open gate */
+  CHRONOS_TEST_CHECK(chronosAdmissionGateEnter(&gate, NULL) == CHRONOS_SUCCESS);
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateDestroy(&gate) == CHRONOS_SUCCESS);
+}
+
+/*
+ * A watcher hears once about the gate opening, and only if it
+ * asked while the gate was closed
+ */
+static void
+testGateWatcher()
+{
+  int                       notify_pipe[2];
+  void                     *notify_arg = &notify_arg;
+  chronosAdmissionGate_t    gate;
+  chronosAdmissionWatcher_t watcher;
+
+  CHRONOS_TEST_CHECK(pipe(notify_pipe) == 0);
+  CHRONOS_TEST_CHECK(fcntl(notify_pipe[0], F_SETFL, O_NONBLOCK) == 0);
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateInit(&gate) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosAdmissionWatcherInit(&watcher, notify_pipe[1], NULL) == CHRONOS_SUCCESS);
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateWatch(&gate, &watcher) == 0);
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateSet(&gate, 2) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateWatch(&gate, &watcher) == 1);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateWatch(&gate, &watcher) == 1);
+  CHRONOS_TEST_CHECK(gate.numWatchers == 1);
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTxnDone(&gate) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(read(notify_pipe[0], &notify_arg, sizeof(notify_arg)) < 0);
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateTxnDone(&gate) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(read(notify_pipe[0], &notify_arg, sizeof(notify_arg)) == sizeof(notify_arg));
+  CHRONOS_TEST_CHECK(notify_arg == NULL);
+  CHRONOS_TEST_CHECK(read(notify_pipe[0], &notify_arg, sizeof(notify_arg)) < 0);
+  CHRONOS_TEST_CHECK(gate.numWatchers == 0 && !watcher.queued);
+
+  /* Once taken off, it hears nothing */
+  CHRONOS_TEST_CHECK(chronosAdmissionGateSet(&gate, 1) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateWatch(&gate, &watcher) == 1);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateUnwatch(&gate, &watcher) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosAdmissionGateSet(&gate, 0) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(read(notify_pipe[0], &notify_arg, sizeof(notify_arg)) < 0);
+
+  CHRONOS_TEST_CHECK(chronosAdmissionGateDestroy(&gate) == CHRONOS_SUCCESS);
+  close(notify_pipe[0]);
+  close(notify_pipe[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  CHRONOS_TEST_RUN(testCompletion);
+  CHRONOS_TEST_RUN(testGateFifo);
+  CHRONOS_TEST_RUN(testGateDebt);
+  CHRONOS_TEST_RUN(testGateWatcher);
+
+  return CHRONOS_TEST_RESULT();
+}
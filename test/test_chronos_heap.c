@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "chronos.h"
+#include "chronos_heap.h"
+#include "chronos_test.h"
+
+int chronos_debug_level = CHRONOS_DEBUG_LEVEL_MIN;
+int chronos_test_failures = 0;
+
+#define TEST_HEAP_NUM_KEYS  (1000)
+
+/*
+ * Keys come out smallest first, whatever order they went in,
+ * and each one with its own data
+ */
+static void
+testHeapOrder()
+{
+  int                 i;
+  int                 sorted = 1;
+  unsigned long long  key;
+  unsigned long long  prev_key = 0;
+  unsigned long long  keyArr[TEST_HEAP_NUM_KEYS];
+  void               *data = NULL;
+  chronosHeap_t       heap;
+
+  CHRONOS_TEST_CHECK(chronosHeapInit(&heap, 4) == CHRONOS_SUCCESS);
+
+  srand(1);
+  for (i=0; i<TEST_HEAP_NUM_KEYS; i++) {
+    /* Plenty of repeated keys */
+    keyArr[i] = rand() % (TEST_HEAP_NUM_KEYS / 4);
+    CHRONOS_TEST_CHECK(chronosHeapInsert(&heap, keyArr[i], &keyArr[i]) == CHRONOS_SUCCESS);
+  }
+
+  /* It grew past the initial capacity */
+  CHRONOS_TEST_CHECK(chronosHeapSize(&heap) == TEST_HEAP_NUM_KEYS);
+
+  for (i=0; i<TEST_HEAP_NUM_KEYS; i++) {
+    CHRONOS_TEST_CHECK(chronosHeapPeek(&heap, &key, NULL) == CHRONOS_SUCCESS);
+    CHRONOS_TEST_CHECK(chronosHeapRemoveMin(&heap, &key, &data) == CHRONOS_SUCCESS);
+    CHRONOS_TEST_CHECK(data != NULL && *(unsigned long long *) data == key);
+
+    if (i > 0 && key < prev_key) {
+      sorted = 0;
+    }
+    prev_key = key;
+  }
+
+  CHRONOS_TEST_CHECK(sorted);
+  CHRONOS_TEST_CHECK(chronosHeapSize(&heap) == 0);
+
+  CHRONOS_TEST_CHECK(chronosHeapDestroy(&heap) == CHRONOS_SUCCESS);
+}
+
+/*
+ * Inserts and removals mixed, as the timer heap and the queues do
+ */
+static void
+testHeapInterleaved()
+{
+  int                i;
+  unsigned long long key;
+  chronosHeap_t      heap;
+
+  CHRONOS_TEST_CHECK(chronosHeapInit(&heap, 8) == CHRONOS_SUCCESS);
+
+  CHRONOS_TEST_CHECK(chronosHeapInsert(&heap, 50, NULL) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosHeapInsert(&heap, 10, NULL) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosHeapInsert(&heap, 30, NULL) == CHRONOS_SUCCESS);
+
+  CHRONOS_TEST_CHECK(chronosHeapRemoveMin(&heap, &key, NULL) == CHRONOS_SUCCESS && key == 10);
+
+  CHRONOS_TEST_CHECK(chronosHeapInsert(&heap, 20, NULL) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosHeapInsert(&heap, 60, NULL) == CHRONOS_SUCCESS);
+
+  CHRONOS_TEST_CHECK(chronosHeapRemoveMin(&heap, &key, NULL) == CHRONOS_SUCCESS && key == 20);
+  CHRONOS_TEST_CHECK(chronosHeapRemoveMin(&heap, &key, NULL) == CHRONOS_SUCCESS && key == 30);
+
+  CHRONOS_TEST_CHECK(chronosHeapInsert(&heap, 0, NULL) == CHRONOS_SUCCESS);
+
+  CHRONOS_TEST_CHECK(chronosHeapRemoveMin(&heap, &key, NULL) == CHRONOS_SUCCESS && key == 0);
+  CHRONOS_TEST_CHECK(chronosHeapRemoveMin(&heap, &key, NULL) == CHRONOS_SUCCESS && key == 50);
+  CHRONOS_TEST_CHECK(chronosHeapRemoveMin(&heap, &key, NULL) == CHRONOS_SUCCESS && key == 60);
+
+  /* An empty heap has nothing to give */
+  CHRONOS_TEST_CHECK(chronosHeapPeek(&heap, &key, NULL) == CHRONOS_FAIL);
+  CHRONOS_TEST_CHECK(chronosHeapRemoveMin(&heap, &key, NULL) == CHRONOS_FAIL);
+
+  for (i=0; i<3; i++) {
+    CHRONOS_TEST_CHECK(chronosHeapInsert(&heap, 7, NULL) == CHRONOS_SUCCESS);
+  }
+  CHRONOS_TEST_CHECK(chronosHeapSize(&heap) == 3);
+
+  CHRONOS_TEST_CHECK(chronosHeapDestroy(&heap) == CHRONOS_SUCCESS);
+}
+
+int
+main(int argc, char *argv[])
+{
+  CHRONOS_TEST_RUN(testHeapOrder);
+  CHRONOS_TEST_RUN(testHeapInterleaved);
+
+  return CHRONOS_TEST_RESULT();
+}
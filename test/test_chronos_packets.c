@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chronos.h"
+#include "chronos_packets.h"
+#include "chronos_test.h"
+
+int chronos_debug_level = CHRONOS_DEBUG_LEVEL_MIN;
+int chronos_test_failures = 0;
+
+#define TEST_PACKET_NUM_ITEMS   (5)
+#define TEST_PACKET_BATCH_SIZE  (4)
+
+static char encodedBuf[CHRONOS_BATCH_MAX_ENCODED_SIZE];
+
+/*
+ * A request of the given type, with numItems distinct items
+ */
+static chronosRequestPacket_t *
+testRequestCreate(chronosUserTransaction_t txn_type, int numItems, unsigned int request_id)
+{
+  int                     i;
+  chronosRequestPacket_t *requestP = NULL;
+
+  requestP = calloc(1, sizeof(chronosRequestPacket_t));
+  if (requestP == NULL) {
+    return NULL;
+  }
+
+  requestP->txn_type = txn_type;
+  requestP->request_id = request_id;
+  requestP->numItems = numItems;
+
+  for (i=0; i<numItems; i++) {
+    switch (txn_type) {
+      case CHRONOS_USER_TXN_VIEW_STOCK:
+        requestP->request_data.symbolInfo[i].symbolId = i;
+        snprintf(requestP->request_data.symbolInfo[i].symbol, ID_SZ, "S%d", i % 1000);
+        break;
+
+      case CHRONOS_USER_TXN_VIEW_PORTFOLIO:
+        snprintf(requestP->request_data.portfolioInfo[i].accountId, ID_SZ, "A%d", i % 1000);
+        break;
+
+      case CHRONOS_USER_TXN_PURCHASE:
+        snprintf(requestP->request_data.purchaseInfo[i].accountId, ID_SZ, "A%d", i % 1000);
+        requestP->request_data.purchaseInfo[i].symbolId = i;
+        snprintf(requestP->request_data.purchaseInfo[i].symbol, ID_SZ, "S%d", i % 1000);
+        requestP->request_data.purchaseInfo[i].price = i + 0.5;
+        requestP->request_data.purchaseInfo[i].amount = 10 * i;
+        break;
+
+      case CHRONOS_USER_TXN_SALE:
+        snprintf(requestP->request_data.sellInfo[i].accountId, ID_SZ, "A%d", i % 1000);
+        requestP->request_data.sellInfo[i].symbolId = i;
+        snprintf(requestP->request_data.sellInfo[i].symbol, ID_SZ, "S%d", i % 1000);
+        requestP->request_data.sellInfo[i].price = i + 0.25;
+        requestP->request_data.sellInfo[i].amount = 20 * i;
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  return requestP;
+}
+
+/*
+ * Only the populated items count: the rest of the union is
+ * not sent, and not written on decode
+ */
+static int
+testRequestEqual(const chronosRequestPacket_t *aP, const chronosRequestPacket_t *bP)
+{
+  size_t size = chronosRequestSizeGet((chronosRequest) aP) - sizeof(chronosPacketHeader_t);
+
+  return aP->txn_type == bP->txn_type
+         && aP->request_id == bP->request_id
+         && aP->numItems == bP->numItems
+         && memcmp(&aP->request_data, &bP->request_data, size) == 0;
+}
+
+static void
+testPacketRoundTrip()
+{
+  int                     txn_type;
+  size_t                  encodedSize;
+  chronosRequestPacket_t *requestP = NULL;
+  chronosRequestPacket_t  decoded;
+
+  for (txn_type=CHRONOS_USER_TXN_MIN; txn_type<CHRONOS_USER_TXN_MAX; txn_type++) {
+    requestP = testRequestCreate(txn_type, TEST_PACKET_NUM_ITEMS, 1000 + txn_type);
+    CHRONOS_TEST_CHECK(requestP != NULL);
+    if (requestP == NULL) {
+      return;
+    }
+
+    CHRONOS_TEST_CHECK(chronosRequestEncode(requestP, encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_SUCCESS);
+    CHRONOS_TEST_CHECK(encodedSize == chronosRequestSizeGet(requestP));
+    CHRONOS_TEST_CHECK(chronosRequestEncodedSizeFromHeader(encodedBuf) == (int) encodedSize);
+    CHRONOS_TEST_CHECK(!chronosRequestIsBatch(encodedBuf));
+
+    memset(&decoded, 0, sizeof(decoded));
+    CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, encodedSize, &decoded) == CHRONOS_SUCCESS);
+    CHRONOS_TEST_CHECK(testRequestEqual(requestP, &decoded));
+
+    /* The buffer has to hold all of it */
+    CHRONOS_TEST_CHECK(chronosRequestEncode(requestP, encodedBuf, encodedSize - 1, &encodedSize) == CHRONOS_FAIL);
+
+    chronosRequestFree(requestP);
+  }
+
+  /* No items at all is fine */
+  requestP = testRequestCreate(CHRONOS_USER_TXN_VIEW_STOCK, 0, 7);
+  CHRONOS_TEST_CHECK(chronosRequestEncode(requestP, encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(encodedSize == sizeof(chronosPacketHeader_t));
+  CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, encodedSize, &decoded) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(decoded.numItems == 0 && decoded.request_id == 7);
+  chronosRequestFree(requestP);
+}
+
+/*
+ * Whatever comes off the wire is checked before it is used
+ */
+static void
+testPacketBadInput()
+{
+  size_t                  encodedSize;
+  chronosPacketHeader_t  *headerP = (chronosPacketHeader_t *) encodedBuf;
+  chronosRequestPacket_t *requestP = NULL;
+  chronosRequestPacket_t  decoded;
+
+  requestP = testRequestCreate(CHRONOS_USER_TXN_PURCHASE, TEST_PACKET_NUM_ITEMS, 1);
+  CHRONOS_TEST_CHECK(requestP != NULL);
+  if (requestP == NULL) {
+    return;
+  }
+
+  /* Nothing out of range is encoded */
+  requestP->numItems = CHRONOS_MAX_DATA_ITEMS_PER_XACT + 1;
+  CHRONOS_TEST_CHECK(chronosRequestEncode(requestP, encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_FAIL);
+  requestP->numItems = TEST_PACKET_NUM_ITEMS;
+  requestP->txn_type = CHRONOS_USER_TXN_INVAL;
+  CHRONOS_TEST_CHECK(chronosRequestEncode(requestP, encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_FAIL);
+  requestP->txn_type = CHRONOS_USER_TXN_PURCHASE;
+
+#define TEST_PACKET_ENCODE() \
+  CHRONOS_TEST_CHECK(chronosRequestEncode(requestP, encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_SUCCESS)
+
+  TEST_PACKET_ENCODE();
+  CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, encodedSize - 1, &decoded) == CHRONOS_FAIL);
+  CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, sizeof(chronosPacketHeader_t) - 1, &decoded) == CHRONOS_FAIL);
+
+  TEST_PACKET_ENCODE();
+  headerP->version = CHRONOS_PACKET_VERSION + 1;
+  CHRONOS_TEST_CHECK(chronosRequestEncodedSizeFromHeader(encodedBuf) == -1);
+  CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, encodedSize, &decoded) == CHRONOS_FAIL);
+
+  TEST_PACKET_ENCODE();
+  headerP->length = sizeof(chronosPacketHeader_t) - 1;
+  CHRONOS_TEST_CHECK(chronosRequestEncodedSizeFromHeader(encodedBuf) == -1);
+  headerP->length = CHRONOS_REQUEST_MAX_ENCODED_SIZE + 1;
+  CHRONOS_TEST_CHECK(chronosRequestEncodedSizeFromHeader(encodedBuf) == -1);
+
+  /* The length has to match the items */
+  TEST_PACKET_ENCODE();
+  headerP->numItems --;
+  CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, encodedSize, &decoded) == CHRONOS_FAIL);
+
+  TEST_PACKET_ENCODE();
+  headerP->numItems = CHRONOS_MAX_DATA_ITEMS_PER_XACT + 1;
+  CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, encodedSize, &decoded) == CHRONOS_FAIL);
+
+  TEST_PACKET_ENCODE();
+  headerP->numItems = -1;
+  CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, encodedSize, &decoded) == CHRONOS_FAIL);
+
+  TEST_PACKET_ENCODE();
+  headerP->txn_type = CHRONOS_USER_TXN_INVAL;
+  CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, encodedSize, &decoded) == CHRONOS_FAIL);
+
+  /* A view portfolio item is smaller than a purchase item */
+  TEST_PACKET_ENCODE();
+  headerP->txn_type = CHRONOS_USER_TXN_VIEW_PORTFOLIO;
+  CHRONOS_TEST_CHECK(chronosRequestDecode(encodedBuf, encodedSize, &decoded) == CHRONOS_FAIL);
+
+#undef TEST_PACKET_ENCODE
+
+  chronosRequestFree(requestP);
+}
+
+static void
+testPacketBatch()
+{
+  int                     i;
+  int                     numRequests;
+  size_t                  encodedSize;
+  chronosPacketHeader_t  *headerP = (chronosPacketHeader_t *) encodedBuf;
+  chronosRequest          requestsArr[CHRONOS_MAX_BATCH_SIZE + 1];
+  chronosRequestPacket_t  decodedArr[TEST_PACKET_BATCH_SIZE];
+  chronosRequestPacket_t *decodedPArr[TEST_PACKET_BATCH_SIZE];
+
+  for (i=0; i<CHRONOS_MAX_BATCH_SIZE + 1; i++) {
+    requestsArr[i] = testRequestCreate(CHRONOS_USER_TXN_MIN + i % CHRONOS_USER_TXN_MAX, 1 + i % 3, i);
+    CHRONOS_TEST_CHECK(requestsArr[i] != NULL);
+    if (requestsArr[i] == NULL) {
+      return;
+    }
+  }
+
+  for (i=0; i<TEST_PACKET_BATCH_SIZE; i++) {
+    decodedPArr[i] = &decodedArr[i];
+  }
+
+  CHRONOS_TEST_CHECK(chronosRequestBatchEncode(requestsArr, TEST_PACKET_BATCH_SIZE, 77,
+                                               encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosRequestIsBatch(encodedBuf));
+  CHRONOS_TEST_CHECK(chronosRequestEncodedSizeFromHeader(encodedBuf) == (int) encodedSize);
+
+  CHRONOS_TEST_CHECK(chronosRequestBatchDecode(encodedBuf, encodedSize, decodedPArr,
+                                               TEST_PACKET_BATCH_SIZE, &numRequests) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(numRequests == TEST_PACKET_BATCH_SIZE);
+
+  /* Every member carries the id of the batch */
+  for (i=0; i<numRequests; i++) {
+    CHRONOS_TEST_CHECK(chronosRequestIdGet(requestsArr[i]) == 77);
+    CHRONOS_TEST_CHECK(testRequestEqual(requestsArr[i], decodedPArr[i]));
+  }
+
+  /* No room for all the members */
+  CHRONOS_TEST_CHECK(chronosRequestBatchDecode(encodedBuf, encodedSize, decodedPArr,
+                                               TEST_PACKET_BATCH_SIZE - 1, &numRequests) == CHRONOS_FAIL);
+
+  CHRONOS_TEST_CHECK(chronosRequestBatchDecode(encodedBuf, encodedSize - 1, decodedPArr,
+                                               TEST_PACKET_BATCH_SIZE, &numRequests) == CHRONOS_FAIL);
+
+  /* A frame that claims more than its members add up to */
+  headerP->length += 4;
+  CHRONOS_TEST_CHECK(chronosRequestBatchDecode(encodedBuf, encodedSize + 4, decodedPArr,
+                                               TEST_PACKET_BATCH_SIZE, &numRequests) == CHRONOS_FAIL);
+  headerP->length -= 4;
+
+  /* ...or fewer */
+  headerP->numItems --;
+  CHRONOS_TEST_CHECK(chronosRequestBatchDecode(encodedBuf, encodedSize, decodedPArr,
+                                               TEST_PACKET_BATCH_SIZE, &numRequests) == CHRONOS_FAIL);
+
+  /* A single request is not a batch */
+  CHRONOS_TEST_CHECK(chronosRequestEncode(requestsArr[0], encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosRequestBatchDecode(encodedBuf, encodedSize, decodedPArr,
+                                               TEST_PACKET_BATCH_SIZE, &numRequests) == CHRONOS_FAIL);
+
+  CHRONOS_TEST_CHECK(chronosRequestBatchEncode(requestsArr, 0, 1, encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_FAIL);
+  CHRONOS_TEST_CHECK(chronosRequestBatchEncode(requestsArr, CHRONOS_MAX_BATCH_SIZE + 1, 1,
+                                               encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_FAIL);
+  CHRONOS_TEST_CHECK(chronosRequestBatchEncode(requestsArr, CHRONOS_MAX_BATCH_SIZE, 1,
+                                               encodedBuf, sizeof(encodedBuf), &encodedSize) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosRequestBatchEncode(requestsArr, TEST_PACKET_BATCH_SIZE, 1,
+                                               encodedBuf, sizeof(chronosPacketHeader_t) + 1, &encodedSize) == CHRONOS_FAIL);
+
+  for (i=0; i<CHRONOS_MAX_BATCH_SIZE + 1; i++) {
+    chronosRequestFree(requestsArr[i]);
+  }
+}
+
+static void
+testPacketResponseFrame()
+{
+  chronosResponsePacket_t response;
+
+  memset(&response, 0, sizeof(response));
+  response.txn_type = CHRONOS_USER_TXN_SALE;
+  response.rc = CHRONOS_FAIL;
+  CHRONOS_TEST_CHECK(chronosResponseFrameSize(&response) == sizeof(response));
+
+  /* A batch answer carries one rc per request */
+  response.txn_type = CHRONOS_PACKET_TYPE_BATCH;
+  response.rc = 3;
+  CHRONOS_TEST_CHECK(chronosResponseFrameSize(&response) == sizeof(response) + 3 * sizeof(int));
+
+  response.rc = 0;
+  CHRONOS_TEST_CHECK(chronosResponseFrameSize(&response) == -1);
+  response.rc = CHRONOS_MAX_BATCH_SIZE + 1;
+  CHRONOS_TEST_CHECK(chronosResponseFrameSize(&response) == -1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  CHRONOS_TEST_RUN(testPacketRoundTrip);
+  CHRONOS_TEST_RUN(testPacketBadInput);
+  CHRONOS_TEST_RUN(testPacketBatch);
+  CHRONOS_TEST_RUN(testPacketResponseFrame);
+
+  return CHRONOS_TEST_RESULT();
+}
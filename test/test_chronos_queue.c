@@ -0,0 +1,535 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "chronos.h"
+#include "chronos_queue.h"
+#include "chronos_test.h"
+
+int chronos_debug_level = CHRONOS_DEBUG_LEVEL_MIN;
+int chronos_test_failures = 0;
+
+#define TEST_QUEUE_BATCH            (100)
+#define TEST_QUEUE_NUM_ROUNDS       (CHRONOS_READY_QUEUE_SIZE * 3 / TEST_QUEUE_BATCH + 1)
+#define TEST_QUEUE_NUM_PRODUCERS    (4)
+#define TEST_QUEUE_NUM_CONSUMERS    (4)
+#define TEST_QUEUE_NUM_ITEMS        (20000)
+#define TEST_QUEUE_NUM_SHARDS       (4)
+
+static chronosRequestBuffer_t requestBufArr[TEST_QUEUE_BATCH];
+static chronos_queue_t        spareQueue;
+
+static chronosServerContext_t *
+testContextCreate(int lockFree, int discipline, int numQueues)
+{
+  chronosServerContext_t *contextP = NULL;
+
+  contextP = calloc(1, sizeof(chronosServerContext_t));
+  if (contextP == NULL) {
+    return NULL;
+  }
+
+  contextP->lockFreeQueues = lockFree;
+  contextP->queueDiscipline = discipline;
+  contextP->desiredDelayBoundMS = 1000;
+
+  if (chronosEventInit(&contextP->workAvailable) != CHRONOS_SUCCESS
+      || chronos_queue_init(lockFree, CHRONOS_QUEUE_FIFO, &contextP->sysTxnQueue) != CHRONOS_SUCCESS
+      || chronos_user_queues_init(numQueues, contextP) != CHRONOS_SUCCESS) {
+    free(contextP);
+    return NULL;
+  }
+
+  return contextP;
+}
+
+static void
+testContextDestroy(chronosServerContext_t *contextP)
+{
+  chronos_user_queues_destroy(contextP);
+  chronos_queue_destroy(&contextP->sysTxnQueue);
+  free(contextP);
+}
+
+static chronosRequestBuffer_t *
+testRequestBuf(int i, chronosUserTransaction_t txn_type)
+{
+  requestBufArr[i].request.txn_type = txn_type;
+  requestBufArr[i].request.request_id = i;
+  return &requestBufArr[i];
+}
+
+/*
+ * Go around the ring several times. Txns come out in the order
+ * they went in, with consecutive tickets.
+ */
+static void
+testQueueRing(int lockFree)
+{
+  int                     i;
+  int                     round;
+  int                     num;
+  int                     numOut;
+  int                     rc;
+  int                     inOrder = 1;
+  unsigned long long      ticket;
+  unsigned long long      lastTicket = 0;
+  chronos_time_t          now;
+  chronos_time_t          tsArr[CHRONOS_PROCESS_BATCH_MAX];
+  unsigned long long      ticketArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosCompletion_t    *completionArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosRequestBuffer_t *bufArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosServerContext_t *contextP = NULL;
+
+  contextP = testContextCreate(lockFree, CHRONOS_QUEUE_FIFO, 1);
+  CHRONOS_TEST_CHECK(contextP != NULL);
+  if (contextP == NULL) {
+    return;
+  }
+
+  CHRONOS_TIME_GET(now);
+
+  for (round=0; round<TEST_QUEUE_NUM_ROUNDS; round++) {
+    for (i=0; i<TEST_QUEUE_BATCH; i++) {
+      CHRONOS_TEST_CHECK(chronos_enqueue_user_transaction(testRequestBuf(i, CHRONOS_USER_TXN_VIEW_STOCK),
+                                                          &now, &ticket, NULL, contextP) == CHRONOS_SUCCESS);
+    }
+    CHRONOS_TEST_CHECK(chronos_user_queue_size(contextP) == TEST_QUEUE_BATCH);
+
+    numOut = 0;
+    while (1) {
+      rc = chronos_dequeue_user_transactions(bufArr, tsArr, NULL, ticketArr, completionArr,
+                                             CHRONOS_PROCESS_BATCH_MAX, &num, 0, 0, contextP);
+      if (rc == CHRONOS_QUEUE_EMPTY) {
+        break;
+      }
+      CHRONOS_TEST_CHECK(rc == CHRONOS_SUCCESS);
+
+      for (i=0; i<num; i++) {
+        if (bufArr[i] != &requestBufArr[numOut] || ticketArr[i] != lastTicket + 1) {
+          inOrder = 0;
+        }
+        lastTicket = ticketArr[i];
+        numOut ++;
+      }
+    }
+
+    CHRONOS_TEST_CHECK(numOut == TEST_QUEUE_BATCH);
+  }
+
+  CHRONOS_TEST_CHECK(inOrder);
+  CHRONOS_TEST_CHECK(lastTicket == (unsigned long long) TEST_QUEUE_NUM_ROUNDS * TEST_QUEUE_BATCH);
+
+  testContextDestroy(contextP);
+}
+
+static void
+testQueueRingLockFree()
+{
+  testQueueRing(1);
+}
+
+static void
+testQueueRingLocked()
+{
+  testQueueRing(0);
+}
+
+/*
+ * Producers and consumers going at it at once. The completion passed
+ * with each txn tells who enqueued it, and its place in their sequence.
+ */
+typedef struct testQueueThread_t {
+  int                     id;
+  int                     failed;
+  chronosServerContext_t *contextP;
+} testQueueThread_t;
+
+static chronosCompletion_t  completionArr[TEST_QUEUE_NUM_PRODUCERS][TEST_QUEUE_NUM_ITEMS];
+static volatile int         seenArr[TEST_QUEUE_NUM_PRODUCERS][TEST_QUEUE_NUM_ITEMS];
+static volatile int         numDequeued;
+
+static void *
+testQueueProducer(void *argP)
+{
+  int                     i;
+  unsigned long long      ticket;
+  chronos_time_t          now;
+  testQueueThread_t      *threadP = (testQueueThread_t *) argP;
+
+  for (i=0; i<TEST_QUEUE_NUM_ITEMS; i++) {
+    CHRONOS_TIME_GET(now);
+    if (chronos_enqueue_user_transaction(&requestBufArr[threadP->id], &now, &ticket,
+                                         &completionArr[threadP->id][i],
+                                         threadP->contextP) != CHRONOS_SUCCESS) {
+      threadP->failed = 1;
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+static void *
+testQueueConsumer(void *argP)
+{
+  int                     i;
+  int                     num;
+  int                     rc;
+  int                     index;
+  int                     producer;
+  int                     lastArr[TEST_QUEUE_NUM_PRODUCERS];
+  chronos_time_t          tsArr[CHRONOS_PROCESS_BATCH_MAX];
+  unsigned long long      ticketArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosCompletion_t    *completionPArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosRequestBuffer_t *bufArr[CHRONOS_PROCESS_BATCH_MAX];
+  testQueueThread_t      *threadP = (testQueueThread_t *) argP;
+
+  for (i=0; i<TEST_QUEUE_NUM_PRODUCERS; i++) {
+    lastArr[i] = -1;
+  }
+
+  while (numDequeued < TEST_QUEUE_NUM_PRODUCERS * TEST_QUEUE_NUM_ITEMS) {
+    rc = chronos_dequeue_user_transactions(bufArr, tsArr, NULL, ticketArr, completionPArr,
+                                           8, &num, 0, threadP->id, threadP->contextP);
+    if (rc == CHRONOS_QUEUE_EMPTY) {
+      sched_yield();
+      continue;
+    }
+    if (rc != CHRONOS_SUCCESS) {
+      threadP->failed = 1;
+      break;
+    }
+
+    for (i=0; i<num; i++) {
+      index = completionPArr[i] - &completionArr[0][0];
+      producer = index / TEST_QUEUE_NUM_ITEMS;
+      index = index % TEST_QUEUE_NUM_ITEMS;
+
+      /* Each producer's txns come out in the order it enqueued them */
+      if (bufArr[i] != &requestBufArr[producer] || index <= lastArr[producer]) {
+        threadP->failed = 1;
+      }
+      lastArr[producer] = index;
+
+      __sync_fetch_and_add(&seenArr[producer][index], 1);
+    }
+
+    __sync_fetch_and_add(&numDequeued, num);
+  }
+
+  return NULL;
+}
+
+static void
+testQueueConcurrent(int lockFree)
+{
+  int                     i;
+  int                     j;
+  int                     seenOnce = 1;
+  pthread_t               producerArr[TEST_QUEUE_NUM_PRODUCERS];
+  pthread_t               consumerArr[TEST_QUEUE_NUM_CONSUMERS];
+  testQueueThread_t       producerInfoArr[TEST_QUEUE_NUM_PRODUCERS];
+  testQueueThread_t       consumerInfoArr[TEST_QUEUE_NUM_CONSUMERS];
+  chronosServerContext_t *contextP = NULL;
+
+  contextP = testContextCreate(lockFree, CHRONOS_QUEUE_FIFO, 1);
+  CHRONOS_TEST_CHECK(contextP != NULL);
+  if (contextP == NULL) {
+    return;
+  }
+
+  memset((void *) seenArr, 0, sizeof(seenArr));
+  numDequeued = 0;
+
+  /* All of one producer's txns are of its own type */
+  for (i=0; i<TEST_QUEUE_NUM_PRODUCERS; i++) {
+    testRequestBuf(i, CHRONOS_USER_TXN_MIN + i % CHRONOS_USER_TXN_MAX);
+  }
+
+  for (i=0; i<TEST_QUEUE_NUM_CONSUMERS; i++) {
+    consumerInfoArr[i].id = 0;
+    consumerInfoArr[i].failed = 0;
+    consumerInfoArr[i].contextP = contextP;
+    CHRONOS_TEST_CHECK(pthread_create(&consumerArr[i], NULL, testQueueConsumer, &consumerInfoArr[i]) == 0);
+  }
+
+  for (i=0; i<TEST_QUEUE_NUM_PRODUCERS; i++) {
+    producerInfoArr[i].id = i;
+    producerInfoArr[i].failed = 0;
+    producerInfoArr[i].contextP = contextP;
+    CHRONOS_TEST_CHECK(pthread_create(&producerArr[i], NULL, testQueueProducer, &producerInfoArr[i]) == 0);
+  }
+
+  for (i=0; i<TEST_QUEUE_NUM_PRODUCERS; i++) {
+    pthread_join(producerArr[i], NULL);
+    CHRONOS_TEST_CHECK(!producerInfoArr[i].failed);
+  }
+
+  for (i=0; i<TEST_QUEUE_NUM_CONSUMERS; i++) {
+    pthread_join(consumerArr[i], NULL);
+    CHRONOS_TEST_CHECK(!consumerInfoArr[i].failed);
+  }
+
+  for (i=0; i<TEST_QUEUE_NUM_PRODUCERS; i++) {
+    for (j=0; j<TEST_QUEUE_NUM_ITEMS; j++) {
+      if (seenArr[i][j] != 1) {
+        seenOnce = 0;
+      }
+    }
+  }
+  CHRONOS_TEST_CHECK(seenOnce);
+  CHRONOS_TEST_CHECK(chronos_user_queue_size(contextP) == 0);
+
+  testContextDestroy(contextP);
+}
+
+static void
+testQueueConcurrentLockFree()
+{
+  testQueueConcurrent(1);
+}
+
+static void
+testQueueConcurrentLocked()
+{
+  testQueueConcurrent(0);
+}
+
+/*
+ * A batch is the txns of the same type at the head of the queue
+ */
+static void
+testQueueBatchSameType(int lockFree)
+{
+  int                     i;
+  int                     num;
+  unsigned long long      ticket;
+  chronos_time_t          now;
+  chronos_time_t          tsArr[CHRONOS_PROCESS_BATCH_MAX];
+  unsigned long long      ticketArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosCompletion_t    *completionPArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosRequestBuffer_t *bufArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosServerContext_t *contextP = NULL;
+  chronosUserTransaction_t typeArr[] = {CHRONOS_USER_TXN_VIEW_STOCK,
+                                        CHRONOS_USER_TXN_VIEW_STOCK,
+                                        CHRONOS_USER_TXN_PURCHASE,
+                                        CHRONOS_USER_TXN_VIEW_STOCK};
+
+  contextP = testContextCreate(lockFree, CHRONOS_QUEUE_FIFO, 1);
+  CHRONOS_TEST_CHECK(contextP != NULL);
+  if (contextP == NULL) {
+    return;
+  }
+
+  CHRONOS_TIME_GET(now);
+  for (i=0; i<4; i++) {
+    CHRONOS_TEST_CHECK(chronos_enqueue_user_transaction(testRequestBuf(i, typeArr[i]),
+                                                        &now, &ticket, NULL, contextP) == CHRONOS_SUCCESS);
+  }
+
+  CHRONOS_TEST_CHECK(chronos_dequeue_user_transactions(bufArr, tsArr, NULL, ticketArr, completionPArr,
+                                                       CHRONOS_PROCESS_BATCH_MAX, &num, 0, 0, contextP) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(num == 2 && bufArr[0] == &requestBufArr[0] && bufArr[1] == &requestBufArr[1]);
+
+  CHRONOS_TEST_CHECK(chronos_dequeue_user_transactions(bufArr, tsArr, NULL, ticketArr, completionPArr,
+                                                       CHRONOS_PROCESS_BATCH_MAX, &num, 0, 0, contextP) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(num == 1 && bufArr[0] == &requestBufArr[2]);
+
+  /* Waiting for the batch to fill gives up when nothing else comes */
+  CHRONOS_TEST_CHECK(chronos_dequeue_user_transactions(bufArr, tsArr, NULL, ticketArr, completionPArr,
+                                                       CHRONOS_PROCESS_BATCH_MAX, &num, 1000, 0, contextP) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(num == 1 && bufArr[0] == &requestBufArr[3]);
+
+  CHRONOS_TEST_CHECK(chronos_dequeue_user_transactions(bufArr, tsArr, NULL, ticketArr, completionPArr,
+                                                       CHRONOS_PROCESS_BATCH_MAX, &num, 0, 0, contextP) == CHRONOS_QUEUE_EMPTY);
+
+  /* Enqueued together, they come out together */
+  for (i=0; i<CHRONOS_PROCESS_BATCH_MAX; i++) {
+    bufArr[i] = testRequestBuf(i, CHRONOS_USER_TXN_SALE);
+    completionPArr[i] = NULL;
+  }
+  CHRONOS_TEST_CHECK(chronos_enqueue_user_transaction_batch(bufArr, CHRONOS_PROCESS_BATCH_MAX, &now,
+                                                            &ticket, completionPArr, contextP) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronos_dequeue_user_transactions(bufArr, tsArr, NULL, ticketArr, completionPArr,
+                                                       CHRONOS_PROCESS_BATCH_MAX, &num, 0, 0, contextP) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(num == CHRONOS_PROCESS_BATCH_MAX);
+  CHRONOS_TEST_CHECK(ticketArr[0] == ticket && ticketArr[num - 1] == ticket + num - 1);
+
+  testContextDestroy(contextP);
+}
+
+static void
+testQueueBatchLockFree()
+{
+  testQueueBatchSameType(1);
+}
+
+static void
+testQueueBatchLocked()
+{
+  testQueueBatchSameType(0);
+}
+
+/*
+ * Earliest deadline first: the deadline follows the enqueue time
+ */
+static void
+testQueueEdf()
+{
+  int                     i;
+  unsigned long long      ticket;
+  chronos_time_t          ts;
+  chronos_time_t          deadline;
+  chronosCompletion_t    *completionP = NULL;
+  chronosRequestBuffer_t *bufP = NULL;
+  chronosServerContext_t *contextP = NULL;
+  int                     secArr[] = {50, 10, 30, 20, 40};
+  int                     orderArr[] = {1, 3, 2, 4, 0};
+
+  contextP = testContextCreate(0, CHRONOS_QUEUE_EDF, 1);
+  CHRONOS_TEST_CHECK(contextP != NULL);
+  if (contextP == NULL) {
+    return;
+  }
+
+  /* Only FIFO queues can be lock-free */
+  CHRONOS_TEST_CHECK(chronos_queue_init(1, CHRONOS_QUEUE_EDF, &spareQueue) == CHRONOS_FAIL);
+
+  for (i=0; i<5; i++) {
+    ts.tv_sec = secArr[i];
+    ts.tv_nsec = 0;
+    CHRONOS_TEST_CHECK(chronos_enqueue_user_transaction(testRequestBuf(i, CHRONOS_USER_TXN_VIEW_STOCK),
+                                                        &ts, &ticket, NULL, contextP) == CHRONOS_SUCCESS);
+  }
+
+  for (i=0; i<5; i++) {
+    CHRONOS_TEST_CHECK(chronos_dequeue_user_transaction(&bufP, &ts, &deadline, &ticket, &completionP,
+                                                        0, contextP) == CHRONOS_SUCCESS);
+    CHRONOS_TEST_CHECK(bufP == &requestBufArr[orderArr[i]]);
+    CHRONOS_TEST_CHECK(deadline.tv_sec == ts.tv_sec + 1 && deadline.tv_nsec == ts.tv_nsec);
+  }
+
+  testContextDestroy(contextP);
+}
+
+/*
+ * Least slack first: with the same deadline, the txn type that
+ * takes longest to run goes first
+ */
+static void
+testQueueLsf()
+{
+  int                     i;
+  unsigned long long      ticket;
+  chronos_time_t          ts;
+  chronos_time_t          deadline;
+  chronosCompletion_t    *completionP = NULL;
+  chronosRequestBuffer_t *bufP = NULL;
+  chronosServerContext_t *contextP = NULL;
+  int                     orderArr[] = {1, 3, 2, 0};
+
+  contextP = testContextCreate(0, CHRONOS_QUEUE_LSF, 1);
+  CHRONOS_TEST_CHECK(contextP != NULL);
+  if (contextP == NULL) {
+    return;
+  }
+
+  contextP->txnExecTimeMSArr[CHRONOS_USER_TXN_VIEW_STOCK] = 10;
+  contextP->txnExecTimeMSArr[CHRONOS_USER_TXN_VIEW_PORTFOLIO] = 500;
+  contextP->txnExecTimeMSArr[CHRONOS_USER_TXN_PURCHASE] = 100;
+  contextP->txnExecTimeMSArr[CHRONOS_USER_TXN_SALE] = 300;
+
+  CHRONOS_TIME_GET(ts);
+  for (i=CHRONOS_USER_TXN_MIN; i<CHRONOS_USER_TXN_MAX; i++) {
+    CHRONOS_TEST_CHECK(chronos_enqueue_user_transaction(testRequestBuf(i, i),
+                                                        &ts, &ticket, NULL, contextP) == CHRONOS_SUCCESS);
+  }
+
+  for (i=CHRONOS_USER_TXN_MIN; i<CHRONOS_USER_TXN_MAX; i++) {
+    CHRONOS_TEST_CHECK(chronos_dequeue_user_transaction(&bufP, &ts, &deadline, &ticket, &completionP,
+                                                        0, contextP) == CHRONOS_SUCCESS);
+    CHRONOS_TEST_CHECK(bufP == &requestBufArr[orderArr[i]]);
+  }
+
+  testContextDestroy(contextP);
+}
+
+/*
+ * A txn goes to the queue of the cpu it was submitted from, and
+ * a processing thread whose own queue is empty steals it
+ */
+static void
+testQueueSteal()
+{
+  int                     i;
+  int                     cpu;
+  int                     num;
+  int                     local;
+  unsigned long long      ticket;
+  cpu_set_t               savedSet;
+  cpu_set_t               cpuSet;
+  chronos_time_t          now;
+  chronos_time_t          tsArr[CHRONOS_PROCESS_BATCH_MAX];
+  unsigned long long      ticketArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosCompletion_t    *completionPArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosRequestBuffer_t *bufArr[CHRONOS_PROCESS_BATCH_MAX];
+  chronosServerContext_t *contextP = NULL;
+
+  contextP = testContextCreate(0, CHRONOS_QUEUE_FIFO, TEST_QUEUE_NUM_SHARDS);
+  CHRONOS_TEST_CHECK(contextP != NULL);
+  if (contextP == NULL) {
+    return;
+  }
+  CHRONOS_TEST_CHECK(contextP->numUserTxnQueues == TEST_QUEUE_NUM_SHARDS);
+
+  /* Stay on one cpu, so that we know which queue is ours */
+  CHRONOS_TEST_CHECK(sched_getaffinity(0, sizeof(savedSet), &savedSet) == 0);
+  for (cpu=0; cpu<CPU_SETSIZE && !CPU_ISSET(cpu, &savedSet); cpu++);
+  CPU_ZERO(&cpuSet);
+  CPU_SET(cpu, &cpuSet);
+  CHRONOS_TEST_CHECK(sched_setaffinity(0, sizeof(cpuSet), &cpuSet) == 0);
+  local = cpu % TEST_QUEUE_NUM_SHARDS;
+
+  CHRONOS_TIME_GET(now);
+  for (i=0; i<3; i++) {
+    CHRONOS_TEST_CHECK(chronos_enqueue_user_transaction(testRequestBuf(i, CHRONOS_USER_TXN_VIEW_STOCK),
+                                                        &now, &ticket, NULL, contextP) == CHRONOS_SUCCESS);
+  }
+  CHRONOS_TEST_CHECK(chronos_queue_size(&contextP->userTxnQueuesArr[local]) == 3);
+  CHRONOS_TEST_CHECK(chronos_user_queue_size(contextP) == 3);
+
+  /* Taken from the home queue of another processing thread */
+  CHRONOS_TEST_CHECK(chronos_dequeue_user_transactions(bufArr, tsArr, NULL, ticketArr, completionPArr,
+                                                       CHRONOS_PROCESS_BATCH_MAX, &num, 0,
+                                                       (local + 1) % TEST_QUEUE_NUM_SHARDS,
+                                                       contextP) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(num == 3 && bufArr[0] == &requestBufArr[0] && bufArr[2] == &requestBufArr[2]);
+  CHRONOS_TEST_CHECK(chronos_user_queue_size(contextP) == 0);
+
+  CHRONOS_TEST_CHECK(chronos_dequeue_user_transactions(bufArr, tsArr, NULL, ticketArr, completionPArr,
+                                                       CHRONOS_PROCESS_BATCH_MAX, &num, 0, local,
+                                                       contextP) == CHRONOS_QUEUE_EMPTY);
+
+  sched_setaffinity(0, sizeof(savedSet), &savedSet);
+
+  testContextDestroy(contextP);
+}
+
+int
+main(int argc, char *argv[])
+{
+  CHRONOS_TEST_RUN(testQueueRingLockFree);
+  CHRONOS_TEST_RUN(testQueueRingLocked);
+  CHRONOS_TEST_RUN(testQueueConcurrentLockFree);
+  CHRONOS_TEST_RUN(testQueueConcurrentLocked);
+  CHRONOS_TEST_RUN(testQueueBatchLockFree);
+  CHRONOS_TEST_RUN(testQueueBatchLocked);
+  CHRONOS_TEST_RUN(testQueueEdf);
+  CHRONOS_TEST_RUN(testQueueLsf);
+  CHRONOS_TEST_RUN(testQueueSteal);
+
+  return CHRONOS_TEST_RESULT();
+}
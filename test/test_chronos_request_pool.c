@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "chronos.h"
+#include "chronos_request_pool.h"
+#include "chronos_test.h"
+
+int chronos_debug_level = CHRONOS_DEBUG_LEVEL_MIN;
+int chronos_test_failures = 0;
+
+#define TEST_POOL_SIZE         (16)
+#define TEST_POOL_NUM_THREADS  (8)
+#define TEST_POOL_NUM_ROUNDS   (100000)
+
+/*
+ * Number of buffers in the free list of the pool, or -1 if
+ * a buffer shows up twice in it
+ */
+static int
+poolFreeCount(chronosRequestPool_t *poolP)
+{
+  int count = 0;
+  int index;
+  char seenArr[TEST_POOL_SIZE];
+
+  memset(seenArr, 0, sizeof(seenArr));
+
+  index = (int) (poolP->freeHead & 0xFFFFFFFFULL) - 1;
+  while (index >= 0) {
+    if (index >= poolP->numBuffers || seenArr[index]) {
+      return -1;
+    }
+    seenArr[index] = 1;
+    count ++;
+    index = poolP->bufferArr[index].next;
+  }
+
+  return count;
+}
+
+static void
+testPoolAllocRelease()
+{
+  int                     i;
+  chronosRequestPool_t    pool;
+  chronosRequestBuffer_t *bufferArr[TEST_POOL_SIZE];
+  chronosRequestBuffer_t *overflowP = NULL;
+  chronosRequestBuffer_t *bufferP = NULL;
+
+  CHRONOS_TEST_CHECK(chronosRequestPoolInit(&pool, TEST_POOL_SIZE) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(poolFreeCount(&pool) == TEST_POOL_SIZE);
+
+  for (i=0; i<TEST_POOL_SIZE; i++) {
+    bufferArr[i] = chronosRequestBufferAlloc(&pool);
+    CHRONOS_TEST_CHECK(bufferArr[i] != NULL);
+    CHRONOS_TEST_CHECK(bufferArr[i]->index >= 0 && bufferArr[i]->refCount == 1);
+  }
+  CHRONOS_TEST_CHECK(poolFreeCount(&pool) == 0);
+
+  /* Past the pool, buffers come from the heap */
+  overflowP = chronosRequestBufferAlloc(&pool);
+  CHRONOS_TEST_CHECK(overflowP != NULL && overflowP->index == -1);
+  CHRONOS_TEST_CHECK(pool.numOverflows == 1);
+  CHRONOS_TEST_CHECK(chronosRequestBufferRelease(overflowP) == CHRONOS_SUCCESS);
+
+  /* A buffer goes back only with its last reference */
+  CHRONOS_TEST_CHECK(chronosRequestBufferRetain(bufferArr[0]) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(chronosRequestBufferRelease(bufferArr[0]) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(poolFreeCount(&pool) == 0);
+  CHRONOS_TEST_CHECK(chronosRequestBufferRelease(bufferArr[0]) == CHRONOS_SUCCESS);
+  CHRONOS_TEST_CHECK(poolFreeCount(&pool) == 1);
+
+  /* The free list is LIFO */
+  bufferP = chronosRequestBufferAlloc(&pool);
+  CHRONOS_TEST_CHECK(bufferP == bufferArr[0]);
+
+  for (i=0; i<TEST_POOL_SIZE; i++) {
+    CHRONOS_TEST_CHECK(chronosRequestBufferRelease(bufferArr[i]) == CHRONOS_SUCCESS);
+  }
+  CHRONOS_TEST_CHECK(poolFreeCount(&pool) == TEST_POOL_SIZE);
+
+  /* One release too many is caught */
+  CHRONOS_TEST_CHECK(chronosRequestBufferRelease(bufferArr[0]) == CHRONOS_FAIL);
+
+  CHRONOS_TEST_CHECK(chronosRequestPoolDestroy(&pool) == CHRONOS_SUCCESS);
+}
+
+static void *
+poolWorker(void *argP)
+{
+  int                     i;
+  int                     failed = 0;
+  chronosRequestPool_t   *poolP = (chronosRequestPool_t *) argP;
+  chronosRequestBuffer_t *bufferArr[2];
+
+  for (i=0; i<TEST_POOL_NUM_ROUNDS; i++) {
+    bufferArr[0] = chronosRequestBufferAlloc(poolP);
+    bufferArr[1] = chronosRequestBufferAlloc(poolP);
+    if (bufferArr[0] == NULL || bufferArr[1] == NULL || bufferArr[0] == bufferArr[1]) {
+      failed = 1;
+      break;
+    }
+
+    /* Nobody else may hold these */
+    bufferArr[0]->request.request_id = (unsigned int) i;
+    chronosRequestBufferRetain(bufferArr[0]);
+    if (bufferArr[0]->refCount != 2 || bufferArr[1]->refCount != 1) {
+      failed = 1;
+    }
+
+    chronosRequestBufferRelease(bufferArr[0]);
+    chronosRequestBufferRelease(bufferArr[1]);
+    chronosRequestBufferRelease(bufferArr[0]);
+  }
+
+  return failed ? argP : NULL;
+}
+
+/*
+ * Many threads taking and returning buffers. In the end every
+ * buffer is back in the free list exactly once.
+ */
+static void
+testPoolConcurrent()
+{
+  int                  i;
+  void                *thread_rc = NULL;
+  pthread_t            threadArr[TEST_POOL_NUM_THREADS];
+  chronosRequestPool_t pool;
+
+  CHRONOS_TEST_CHECK(chronosRequestPoolInit(&pool, TEST_POOL_SIZE) == CHRONOS_SUCCESS);
+
+  for (i=0; i<TEST_POOL_NUM_THREADS; i++) {
+    CHRONOS_TEST_CHECK(pthread_create(&threadArr[i], NULL, poolWorker, &pool) == 0);
+  }
+
+  for (i=0; i<TEST_POOL_NUM_THREADS; i++) {
+    pthread_join(threadArr[i], &thread_rc);
+    CHRONOS_TEST_CHECK(thread_rc == NULL);
+  }
+
+  CHRONOS_TEST_CHECK(poolFreeCount(&pool) == TEST_POOL_SIZE);
+
+  CHRONOS_TEST_CHECK(chronosRequestPoolDestroy(&pool) == CHRONOS_SUCCESS);
+}
+
+int
+main(int argc, char *argv[])
+{
+  CHRONOS_TEST_RUN(testPoolAllocRelease);
+  CHRONOS_TEST_RUN(testPoolConcurrent);
+
+  return CHRONOS_TEST_RESULT();
+}